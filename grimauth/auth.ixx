@@ -1,9 +1,9 @@
-module;
-
-export module grim.auth;
-export import grim.arch.auth;
-export import grim.auth.client;
-
-export namespace grim::auth
-{
-}
+module;
+
+export module grim.auth;
+export import grim.arch.auth;
+export import grim.auth.client;
+
+export namespace grim::auth
+{
+}
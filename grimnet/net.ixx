@@ -1,11 +1,36 @@
-module;
-
-export module grim.net;
-export import grim.arch.net;
-export import grim.net.client;
-export import grim.net.proxy_server;
-export import grim.net.session_server;
-
-export namespace grim::net
-{
-}
+module;
+
+export module grim.net;
+export import grim.arch.net;
+export import grim.net.auth_batch;
+export import grim.net.auth_cache;
+export import grim.net.bind;
+export import grim.net.client;
+export import grim.net.datagram;
+export import grim.net.group;
+export import grim.net.lanes;
+export import grim.net.loopback;
+export import grim.net.message;
+export import grim.net.proxy_api;
+export import grim.net.proxy_select;
+export import grim.net.proxy_server;
+export import grim.net.queue;
+export import grim.net.relay;
+export import grim.net.replay;
+export import grim.net.route;
+export import grim.net.schema;
+export import grim.net.send_queue;
+export import grim.net.session_api;
+export import grim.net.session_link;
+export import grim.net.session_log;
+export import grim.net.session_server;
+export import grim.net.session_table;
+export import grim.net.shm;
+export import grim.net.stats;
+export import grim.net.stream;
+export import grim.net.tls;
+export import grim.net.transport;
+
+export namespace grim::net
+{
+}
@@ -0,0 +1,316 @@
+module;
+
+#include <chrono>
+#include <cinttypes>
+#include <exception>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+export module grim.net.auth_batch;
+
+import cpp.asio;
+import cpp.log;
+import cpp.memory;
+import grim.arch.auth;
+import grim.arch.net;
+
+export namespace grim::net
+{
+    //! Collects user token verifications over a short window and sends them to the auth service
+    //! as one authBatch.  A batch is sent when the window closes or `maxBatch` tokens are waiting,
+    //! whichever comes first, so a burst of logins (e.g. a proxy failover) costs a few round trips
+    //! rather than one per login.
+    class AuthBatcher
+    {
+    public:
+        using                               DoneFn = std::function<void( Result result, uint64_t userId, const std::string & email )>;
+
+        struct Stats
+        {
+            uint64_t                        batches = 0;
+            uint64_t                        tokens = 0;
+        };
+
+        void                                open(
+                                                cpp::AsyncContext & io,
+                                                auth::IClient & client,
+                                                auth::AuthToken serviceToken,
+                                                int windowMillis = 2,
+                                                size_t maxBatch = 256 );
+        //! fails anything still waiting with Result::Retry
+        void                                close( );
+        bool                                isOpen( ) const;
+
+        void                                auth( std::string userIp, uint64_t userToken, DoneFn fn );
+        //! sends whatever is waiting now
+        void                                flush( );
+
+        size_t                              pending( ) const;
+        const Stats &                       stats( ) const;
+
+        static Result                       toResult( auth::Result result );
+    private:
+        cpp::AsyncContext                   m_io;
+        auth::IClient *                     m_client = nullptr;
+        auth::AuthToken                     m_serviceToken{ 0 };
+        int                                 m_windowMillis = 2;
+        size_t                              m_maxBatch = 256;
+
+        std::vector<auth::AuthRequest>      m_requests;
+        std::vector<DoneFn>                 m_done;
+        cpp::AsyncTimer                     m_timer;
+        bool                                m_isTimerSet = false;
+        Stats                               m_stats;
+    };
+
+    namespace test
+    {
+        //! sends `tokenCount` verifications to an in-process stand-in auth server, one call per
+        //! token and then through an AuthBatcher, and logs the throughput of each.  The stand-in
+        //! spends `requestMicros` per call and `tokenMicros` per token.
+        void                                benchAuthBatch( size_t tokenCount = 100000, int requestMicros = 50, int tokenMicros = 2 );
+    };
+}
+
+namespace grim::net
+{
+    void AuthBatcher::open(
+        cpp::AsyncContext & io,
+        auth::IClient & client,
+        auth::AuthToken serviceToken,
+        int windowMillis,
+        size_t maxBatch )
+    {
+        m_io = io;
+        m_client = &client;
+        m_serviceToken = serviceToken;
+        m_windowMillis = windowMillis;
+        m_maxBatch = maxBatch ? maxBatch : 1;
+    }
+
+    void AuthBatcher::close( )
+    {
+        m_timer.cancel( );
+        m_isTimerSet = false;
+        auto done = std::move( m_done );
+        m_requests.clear( );
+        m_done.clear( );
+        m_client = nullptr;
+        for ( auto & fn : done )
+            { fn( Result::Retry, 0, { } ); }
+    }
+
+    bool AuthBatcher::isOpen( ) const
+    {
+        return m_client != nullptr;
+    }
+
+    void AuthBatcher::auth( std::string userIp, uint64_t userToken, DoneFn fn )
+    {
+        if ( !isOpen( ) )
+            { fn( Result::Retry, 0, { } ); return; }
+
+        m_requests.push_back( auth::AuthRequest{ { std::move( userIp ) }, { userToken } } );
+        m_done.push_back( std::move( fn ) );
+        if ( m_requests.size( ) >= m_maxBatch )
+            { flush( ); }
+        else if ( !m_isTimerSet )
+        {
+            m_isTimerSet = true;
+            m_timer = m_io.waitFor( cpp::Duration::ofMillis( m_windowMillis ), [this]( )
+                {
+                    m_isTimerSet = false;
+                    flush( );
+                } );
+        }
+    }
+
+    void AuthBatcher::flush( )
+    {
+        if ( m_isTimerSet )
+        {
+            m_timer.cancel( );
+            m_isTimerSet = false;
+        }
+        if ( m_requests.empty( ) || !isOpen( ) )
+            { return; }
+
+        m_stats.batches++;
+        m_stats.tokens += m_requests.size( );
+        auto requests = std::move( m_requests );
+        m_requests.clear( );
+        m_client->authBatch( m_serviceToken, requests,
+            [done = std::move( m_done )]( auth::Result result, std::span<const auth::AuthReply> replies )
+            {
+                for ( size_t i = 0; i < done.size( ); i++ )
+                {
+                    if ( result != auth::Result::Ok || i >= replies.size( ) )
+                        { done[i]( toResult( result == auth::Result::Ok ? auth::Result::Retry : result ), 0, { } ); }
+                    else
+                        { done[i]( toResult( replies[i].result ), replies[i].userId.value, replies[i].email.value ); }
+                }
+            } );
+        m_done.clear( );
+    }
+
+    size_t AuthBatcher::pending( ) const
+    {
+        return m_requests.size( );
+    }
+
+    const AuthBatcher::Stats & AuthBatcher::stats( ) const
+    {
+        return m_stats;
+    }
+
+    Result AuthBatcher::toResult( auth::Result result )
+    {
+        switch ( result )
+        {
+        case auth::Result::Ok:
+            return Result::Ok;
+        case auth::Result::Denied:
+            return Result::Access;
+        case auth::Result::Timeout:
+            return Result::Timeout;
+        default:
+            return Result::Retry;
+        }
+    }
+
+    namespace test
+    {
+        void spinFor( int micros )
+        {
+            auto until = std::chrono::steady_clock::now( ) + std::chrono::microseconds( micros );
+            while ( std::chrono::steady_clock::now( ) < until )
+                { }
+        }
+
+        //! Stand-in for the auth service.  Calls are served one at a time on `io`, which stands in
+        //! for the service's request loop.  Tokens divisible by 10 are denied.
+        class StandInAuthServer : public auth::IServer::AuthApi
+        {
+        public:
+            StandInAuthServer( cpp::AsyncContext & io, int requestMicros, int tokenMicros ) :
+                m_io( io ), m_requestMicros( requestMicros ), m_tokenMicros( tokenMicros ) { }
+
+            void timecode( auth::DeviceIP, cpp::Memory, cpp::Memory, timecodeCallback callback ) override
+                { m_io.post( [=]( ) { callback( auth::Result::Retry, { } ); } ); }
+            void id( auth::DeviceIP, cpp::Memory, cpp::Memory, auth::Timestamp, auth::Passcode, auth::HostId, cpp::Memory, cpp::Memory, idCallback callback ) override
+                { m_io.post( [=]( ) { callback( auth::Result::Retry, { }, { }, { } ); } ); }
+            void check( auth::DeviceIP, auth::AuthToken, checkCallback callback ) override
+                { m_io.post( [=]( ) { callback( auth::Result::Retry ); } ); }
+            void confirm( auth::DeviceIP, auth::AuthToken, cpp::Memory, confirmCallback callback ) override
+                { m_io.post( [=]( ) { callback( auth::Result::Retry ); } ); }
+            void authInit( auth::DeviceIP, auth::AuthToken, authInitCallback callback ) override
+                { m_io.post( [=]( ) { callback( auth::Result::Ok ); } ); }
+
+            void auth( auth::DeviceIP, auth::AuthToken, auth::DeviceIP userIp, auth::AuthToken userToken, authCallback callback ) override
+            {
+                m_io.post( [=, this]( )
+                    {
+                        spinFor( m_requestMicros + m_tokenMicros );
+                        auth::AuthReply reply = verify( userToken );
+                        callback( reply.result, reply.userId, reply.email );
+                    } );
+            }
+
+            void authBatch( auth::DeviceIP, auth::AuthToken, std::span<const auth::AuthRequest> requests, authBatchCallback callback ) override
+            {
+                m_io.post( [=, this, requests = std::vector<auth::AuthRequest>( requests.begin( ), requests.end( ) )]( )
+                    {
+                        spinFor( m_requestMicros + m_tokenMicros * (int)requests.size( ) );
+                        std::vector<auth::AuthReply> replies;
+                        replies.reserve( requests.size( ) );
+                        for ( auto & request : requests )
+                            { replies.push_back( verify( request.userToken ) ); }
+                        callback( auth::Result::Ok, replies );
+                    } );
+            }
+        private:
+            static auth::AuthReply verify( auth::AuthToken userToken )
+            {
+                if ( userToken.value % 10 == 0 )
+                    { return { auth::Result::Denied, { 0 }, { } }; }
+                return { auth::Result::Ok, { userToken.value }, { "user@grimethos.com" } };
+            }
+
+            cpp::AsyncContext               m_io;
+            int                             m_requestMicros;
+            int                             m_tokenMicros;
+        };
+
+        //! the session server's view of the stand-in
+        class StandInAuthClient : public auth::IClient
+        {
+        public:
+            StandInAuthClient( StandInAuthServer & server ) :
+                m_server( server ) { }
+
+            auth::Result login( auth::UserEmail, auth::ServiceId, int, int, auth::AuthToken * ) override
+                { return auth::Result::Retry; }
+            cpp::AsyncCall login( auth::UserEmail, auth::ServiceId, int, int, LoginFn ) override
+                { return { }; }
+            cpp::AsyncCall login( auth::AuthToken, int, LoginFn ) override
+                { return { }; }
+            void authInit( auth::AuthToken serviceToken, authInitFn callback ) override
+                { m_server.authInit( { "127.0.0.1" }, serviceToken, callback ); }
+            void auth( auth::AuthToken serviceToken, auth::DeviceIP userIp, auth::AuthToken userToken, authFn callback ) override
+                { m_server.auth( { "127.0.0.1" }, serviceToken, userIp, userToken, callback ); }
+            void authBatch( auth::AuthToken serviceToken, std::span<const auth::AuthRequest> requests, authBatchFn callback ) override
+                { m_server.authBatch( { "127.0.0.1" }, serviceToken, requests, callback ); }
+        private:
+            StandInAuthServer &             m_server;
+        };
+
+        void benchAuthBatch( size_t tokenCount, int requestMicros, int tokenMicros )
+        {
+            // every login of a failover arrives at once
+            auto run = [&]( const char * name, auto send )
+                {
+                    cpp::AsyncContext io;
+                    StandInAuthServer server{ io, requestMicros, tokenMicros };
+                    StandInAuthClient client{ server };
+                    size_t done = 0;
+                    size_t denied = 0;
+                    auto count = [&]( Result result )
+                        {
+                            done++;
+                            denied += result != Result::Ok;
+                        };
+
+                    auto start = std::chrono::steady_clock::now( );
+                    send( io, client, count );
+                    io.run( );
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now( ) - start;
+                    if ( done != tokenCount )
+                        { throw std::exception{ name }; }
+                    cpp::Log::info( "{} : {} tokens ({} denied), {:.0f} tokens/sec", name, tokenCount, denied, tokenCount / elapsed.count( ) );
+                };
+
+            run( "auth (per token)", [&]( cpp::AsyncContext & io, auth::IClient & client, auto & count )
+                {
+                    for ( size_t i = 0; i < tokenCount; i++ )
+                    {
+                        client.auth( { 0 }, { "20.0.0.1" }, { i + 1 }, [&]( auth::Result result, auth::UserId, auth::UserEmail )
+                            { count( AuthBatcher::toResult( result ) ); } );
+                    }
+                } );
+
+            AuthBatcher batcher;
+            run( "authBatch", [&]( cpp::AsyncContext & io, auth::IClient & client, auto & count )
+                {
+                    batcher.open( io, client, { 0 } );
+                    for ( size_t i = 0; i < tokenCount; i++ )
+                    {
+                        batcher.auth( "20.0.0.1", i + 1, [&]( Result result, uint64_t, const std::string & )
+                            { count( result ); } );
+                    }
+                    batcher.flush( );
+                } );
+        }
+    }
+}
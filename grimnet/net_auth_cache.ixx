@@ -0,0 +1,328 @@
+module;
+
+#include <chrono>
+#include <cinttypes>
+#include <exception>
+#include <functional>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+export module grim.net.auth_cache;
+
+import grim.arch.net;
+
+export namespace grim::net
+{
+    //! Bounded cache of auth verifications keyed by (authToken, address, service).  The address is
+    //! an "ip:port" with the port dropped, so a client reconnecting from a new port still hits.
+    //! Accepted tokens are kept for `ttl`; denied tokens are kept for `negativeTtl` so a client
+    //! retrying a bad token does not reach the auth service each time.  Once full, the least
+    //! recently used entry is evicted.
+    class AuthCache
+    {
+    public:
+        using                               Clock = std::chrono::steady_clock;
+
+        struct Stats
+        {
+            uint64_t                        hits = 0;
+            uint64_t                        negativeHits = 0;
+            uint64_t                        misses = 0;
+            uint64_t                        expirations = 0;
+            uint64_t                        evictions = 0;
+            uint64_t                        invalidations = 0;
+            //! calls made to the auth service on a miss, and their latency
+            uint64_t                        backendCalls = 0;
+            uint64_t                        backendMicros = 0;
+            uint64_t                        maxBackendMicros = 0;
+
+            double                          hitRate( ) const;
+            double                          meanBackendMicros( ) const;
+        };
+
+        void                                setLimits( size_t capacity, Clock::duration ttl, Clock::duration negativeTtl );
+
+        //! true on a hit, with the cached result (Ok or Access) and, if Ok, the user
+        bool                                find(
+                                                uint64_t authToken,
+                                                std::string_view addr,
+                                                std::string_view service,
+                                                Clock::time_point now,
+                                                Result * result,
+                                                uint64_t * userId,
+                                                std::string * email );
+        //! like find( ), but neither counted nor marked as used
+        bool                                contains(
+                                                uint64_t authToken,
+                                                std::string_view addr,
+                                                std::string_view service,
+                                                Clock::time_point now ) const;
+        //! caches an Ok or Access result, anything else (e.g. Retry) is not a verdict and is ignored
+        void                                insert(
+                                                uint64_t authToken,
+                                                std::string_view addr,
+                                                std::string_view service,
+                                                Clock::time_point now,
+                                                Result result,
+                                                uint64_t userId,
+                                                std::string_view email );
+        //! drops every entry for `authToken`, e.g. once the token is revoked
+        void                                invalidate( uint64_t authToken );
+        void                                clear( );
+        void                                recordBackend( Clock::duration latency );
+
+        size_t                              size( ) const;
+        const Stats &                       stats( ) const;
+    private:
+        struct Key
+        {
+            uint64_t                        authToken;
+            std::string                     addr;
+            std::string                     service;
+
+            bool                            operator==( const Key & ) const = default;
+        };
+        struct KeyHash
+        {
+            size_t                          operator()( const Key & key ) const;
+        };
+        struct Entry
+        {
+            Key                             key;
+            Result                          result;
+            uint64_t                        userId;
+            std::string                     email;
+            Clock::time_point               expiry;
+        };
+        using                               EntryList = std::list<Entry>;
+
+        static Key                          makeKey( uint64_t authToken, std::string_view addr, std::string_view service );
+        void                                erase( EntryList::iterator itr );
+
+        size_t                              m_capacity = 100000;
+        Clock::duration                     m_ttl = std::chrono::minutes( 5 );
+        Clock::duration                     m_negativeTtl = std::chrono::seconds( 30 );
+        //! most recently used first
+        EntryList                           m_entries;
+        std::unordered_map<Key, EntryList::iterator, KeyHash> m_index;
+        Stats                               m_stats;
+    };
+
+    namespace test
+    {
+        void                                testAuthCache( );
+    };
+}
+
+namespace grim::net
+{
+    double AuthCache::Stats::hitRate( ) const
+    {
+        uint64_t lookups = hits + negativeHits + misses;
+        return lookups ? (double)( hits + negativeHits ) / lookups : 0;
+    }
+
+    double AuthCache::Stats::meanBackendMicros( ) const
+    {
+        return backendCalls ? (double)backendMicros / backendCalls : 0;
+    }
+
+    size_t AuthCache::KeyHash::operator()( const Key & key ) const
+    {
+        size_t hash = std::hash<uint64_t>{ }( key.authToken );
+        hash ^= std::hash<std::string>{ }( key.addr ) + 0x9e3779b97f4a7c15ull + ( hash << 6 ) + ( hash >> 2 );
+        hash ^= std::hash<std::string>{ }( key.service ) + 0x9e3779b97f4a7c15ull + ( hash << 6 ) + ( hash >> 2 );
+        return hash;
+    }
+
+    AuthCache::Key AuthCache::makeKey( uint64_t authToken, std::string_view addr, std::string_view service )
+    {
+        // an address without a port (or a bracketed ipv6 one) is used as is
+        size_t colon = addr.find_last_of( ':' );
+        if ( colon != std::string_view::npos && addr.find( ']', colon ) == std::string_view::npos )
+            { addr = addr.substr( 0, colon ); }
+        return Key{ authToken, std::string{ addr }, std::string{ service } };
+    }
+
+    void AuthCache::setLimits( size_t capacity, Clock::duration ttl, Clock::duration negativeTtl )
+    {
+        m_capacity = capacity ? capacity : 1;
+        m_ttl = ttl;
+        m_negativeTtl = negativeTtl;
+        while ( m_entries.size( ) > m_capacity )
+        {
+            erase( std::prev( m_entries.end( ) ) );
+            m_stats.evictions++;
+        }
+    }
+
+    bool AuthCache::find(
+        uint64_t authToken,
+        std::string_view addr,
+        std::string_view service,
+        Clock::time_point now,
+        Result * result,
+        uint64_t * userId,
+        std::string * email )
+    {
+        auto itr = m_index.find( makeKey( authToken, addr, service ) );
+        if ( itr == m_index.end( ) )
+        {
+            m_stats.misses++;
+            return false;
+        }
+        auto entry = itr->second;
+        if ( entry->expiry <= now )
+        {
+            erase( entry );
+            m_stats.expirations++;
+            m_stats.misses++;
+            return false;
+        }
+
+        m_entries.splice( m_entries.begin( ), m_entries, entry );
+        *result = entry->result;
+        if ( entry->result == Result::Ok )
+        {
+            *userId = entry->userId;
+            *email = entry->email;
+            m_stats.hits++;
+        }
+        else
+        {
+            m_stats.negativeHits++;
+        }
+        return true;
+    }
+
+    bool AuthCache::contains(
+        uint64_t authToken,
+        std::string_view addr,
+        std::string_view service,
+        Clock::time_point now ) const
+    {
+        auto itr = m_index.find( makeKey( authToken, addr, service ) );
+        return itr != m_index.end( ) && itr->second->expiry > now;
+    }
+
+    void AuthCache::insert(
+        uint64_t authToken,
+        std::string_view addr,
+        std::string_view service,
+        Clock::time_point now,
+        Result result,
+        uint64_t userId,
+        std::string_view email )
+    {
+        if ( result != Result::Ok && result != Result::Access )
+            { return; }
+
+        Key key = makeKey( authToken, addr, service );
+        if ( auto itr = m_index.find( key ); itr != m_index.end( ) )
+            { erase( itr->second ); }
+        if ( m_entries.size( ) >= m_capacity )
+        {
+            erase( std::prev( m_entries.end( ) ) );
+            m_stats.evictions++;
+        }
+
+        auto expiry = now + ( result == Result::Ok ? m_ttl : m_negativeTtl );
+        m_entries.push_front( Entry{ std::move( key ), result, userId, std::string{ email }, expiry } );
+        m_index.emplace( m_entries.front( ).key, m_entries.begin( ) );
+    }
+
+    void AuthCache::invalidate( uint64_t authToken )
+    {
+        for ( auto itr = m_entries.begin( ); itr != m_entries.end( ); )
+        {
+            auto next = std::next( itr );
+            if ( itr->key.authToken == authToken )
+            {
+                erase( itr );
+                m_stats.invalidations++;
+            }
+            itr = next;
+        }
+    }
+
+    void AuthCache::clear( )
+    {
+        m_stats.invalidations += m_entries.size( );
+        m_index.clear( );
+        m_entries.clear( );
+    }
+
+    void AuthCache::recordBackend( Clock::duration latency )
+    {
+        uint64_t micros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>( latency ).count( );
+        m_stats.backendCalls++;
+        m_stats.backendMicros += micros;
+        if ( micros > m_stats.maxBackendMicros )
+            { m_stats.maxBackendMicros = micros; }
+    }
+
+    void AuthCache::erase( EntryList::iterator itr )
+    {
+        m_index.erase( itr->key );
+        m_entries.erase( itr );
+    }
+
+    size_t AuthCache::size( ) const
+    {
+        return m_entries.size( );
+    }
+
+    const AuthCache::Stats & AuthCache::stats( ) const
+    {
+        return m_stats;
+    }
+
+    namespace test
+    {
+        void testAuthCache( )
+        {
+            using namespace std::chrono_literals;
+            AuthCache cache;
+            cache.setLimits( 2, 60s, 5s );
+            auto now = AuthCache::Clock::now( );
+            Result result;
+            uint64_t userId = 0;
+            std::string email;
+
+            if ( cache.find( 1, "10.0.0.1:1", "grimethos.com", now, &result, &userId, &email ) )
+                { throw std::exception{ "cache.find( empty )" }; }
+            cache.insert( 1, "10.0.0.1:1", "grimethos.com", now, Result::Ok, 7, "user@grimethos.com" );
+            cache.insert( 2, "10.0.0.2:1", "grimethos.com", now, Result::Access, 0, "" );
+            cache.insert( 3, "10.0.0.3:1", "grimethos.com", now, Result::Retry, 0, "" );
+            if ( cache.size( ) != 2 )
+                { throw std::exception{ "cache.insert( retry )" }; }
+
+            // the port is not part of the key, the service is
+            if ( !cache.find( 1, "10.0.0.1:2", "grimethos.com", now, &result, &userId, &email ) || result != Result::Ok || userId != 7 )
+                { throw std::exception{ "cache.find( hit )" }; }
+            if ( cache.find( 1, "10.0.0.1:2", "proxy.grimethos.com", now, &result, &userId, &email ) )
+                { throw std::exception{ "cache.find( other service )" }; }
+            if ( !cache.find( 2, "10.0.0.2:1", "grimethos.com", now, &result, &userId, &email ) || result != Result::Access )
+                { throw std::exception{ "cache.find( negative )" }; }
+
+            // denied tokens expire first
+            if ( cache.find( 2, "10.0.0.2:1", "grimethos.com", now + 10s, &result, &userId, &email ) )
+                { throw std::exception{ "cache.find( negative expired )" }; }
+            if ( !cache.find( 1, "10.0.0.1:1", "grimethos.com", now + 10s, &result, &userId, &email ) )
+                { throw std::exception{ "cache.find( positive )" }; }
+
+            // token 1 is the most recently used, so token 5 evicts token 4
+            cache.insert( 4, "10.0.0.4:1", "grimethos.com", now, Result::Ok, 4, "" );
+            cache.find( 1, "10.0.0.1:1", "grimethos.com", now, &result, &userId, &email );
+            cache.insert( 5, "10.0.0.5:1", "grimethos.com", now, Result::Ok, 5, "" );
+            if ( cache.find( 4, "10.0.0.4:1", "grimethos.com", now, &result, &userId, &email ) || cache.stats( ).evictions != 1 )
+                { throw std::exception{ "cache.insert( evict )" }; }
+
+            cache.invalidate( 1 );
+            if ( cache.find( 1, "10.0.0.1:1", "grimethos.com", now, &result, &userId, &email ) )
+                { throw std::exception{ "cache.invalidate( )" }; }
+        }
+    }
+}
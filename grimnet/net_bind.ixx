@@ -0,0 +1,252 @@
+module;
+
+#include <algorithm>
+#include <cinttypes>
+#include <exception>
+#include <functional>
+#include <utility>
+#include <vector>
+
+export module grim.net.bind;
+
+import grim.arch.net;
+
+export namespace grim::net
+{
+    //! Set in the moniker of a reply from one session to another, so the receiver can tell it from
+    //! a request which happens to carry the same bind and moniker (see Client::receive); the
+    //! generations BindTable hands out as monikers stay below it.
+    constexpr uint16_t                      ReplyMoniker = 0x8000;
+
+    //! Outstanding requests indexed directly by bind id.  Slots are allocated from a free list and
+    //! carry a generation which is sent as the request moniker, so a late reply to a recycled bind
+    //! is rejected.  Every request has a deadline; a hashed timer wheel finds expired requests
+    //! without scanning the table.  add, find, remove and expire are O(1) per request.
+    class BindTable
+    {
+    public:
+        static constexpr uint64_t           TickMillis = 250;
+        static constexpr size_t             WheelSize = 64;
+        static constexpr size_t             MaxBinds = 0xffff;
+
+        using                               ExpireFn = std::function<void( uint16_t bind, uint16_t moniker, BindFn bindFunction )>;
+
+        //! returns the new bind (0 if the table is full) and sets `moniker` to its generation
+        uint16_t                            add( BindFn bindFunction, uint64_t deadlineMillis, uint16_t * moniker );
+        //! returns the handler for a live bind whose moniker matches, otherwise nullptr
+        BindFn *                            find( uint16_t bind, uint16_t moniker );
+        //! moves the deadline of a live bind (e.g. while a multi-part reply is arriving)
+        void                                touch( uint16_t bind, uint16_t moniker, uint64_t deadlineMillis );
+        //! releases a live bind and returns its handler
+        BindFn                              remove( uint16_t bind, uint16_t moniker );
+        //! releases every bind whose deadline is at or before `nowMillis`
+        void                                expire( uint64_t nowMillis, const ExpireFn & fn );
+        //! releases every live bind, e.g. once their replies can no longer arrive
+        void                                clear( const ExpireFn & fn );
+
+        size_t                              size( ) const;
+        bool                                isEmpty( ) const;
+    private:
+        struct Slot
+        {
+            BindFn                          bindFunction;
+            uint64_t                        deadline = 0;
+            uint16_t                        generation = 0;
+            uint16_t                        nextFree = 0;
+            bool                            isUsed = false;
+        };
+        struct Timer
+        {
+            uint16_t                        bind;
+            uint16_t                        generation;
+        };
+        void                                schedule( uint16_t bind );
+        Slot &                              slotOf( uint16_t bind );
+
+        // slot 0 is never used, bind 0 means "no reply expected"
+        std::vector<Slot>                   m_slots = std::vector<Slot>( 1 );
+        std::vector<Timer>                  m_wheel[WheelSize];
+        uint64_t                            m_wheelTick = 0;
+        uint16_t                            m_freeHead = 0;
+        uint16_t                            m_nextGeneration = 1;
+        size_t                              m_size = 0;
+    };
+
+    namespace test
+    {
+        void                                testBindTable( );
+    };
+}
+
+namespace grim::net
+{
+    BindTable::Slot & BindTable::slotOf( uint16_t bind )
+    {
+        return m_slots[bind];
+    }
+
+    uint16_t BindTable::add( BindFn bindFunction, uint64_t deadlineMillis, uint16_t * moniker )
+    {
+        uint16_t bind = m_freeHead;
+        if ( bind )
+            { m_freeHead = slotOf( bind ).nextFree; }
+        else if ( m_slots.size( ) <= MaxBinds )
+            { bind = (uint16_t)m_slots.size( ); m_slots.emplace_back( ); }
+        else
+            { return 0; }
+
+        auto & slot = slotOf( bind );
+        slot.bindFunction = std::move( bindFunction );
+        slot.deadline = deadlineMillis;
+        slot.generation = m_nextGeneration++;
+        slot.isUsed = true;
+        if ( m_nextGeneration == ReplyMoniker )
+            { m_nextGeneration = 1; }
+        m_size++;
+        schedule( bind );
+
+        *moniker = slot.generation;
+        return bind;
+    }
+
+    BindFn * BindTable::find( uint16_t bind, uint16_t moniker )
+    {
+        if ( !bind || bind >= m_slots.size( ) )
+            { return nullptr; }
+        auto & slot = slotOf( bind );
+        if ( !slot.isUsed || slot.generation != moniker )
+            { return nullptr; }
+        return &slot.bindFunction;
+    }
+
+    void BindTable::touch( uint16_t bind, uint16_t moniker, uint64_t deadlineMillis )
+    {
+        if ( !find( bind, moniker ) )
+            { return; }
+        // the wheel entry is left in place; expire() reschedules it when it comes due
+        slotOf( bind ).deadline = deadlineMillis;
+    }
+
+    BindFn BindTable::remove( uint16_t bind, uint16_t moniker )
+    {
+        if ( !find( bind, moniker ) )
+            { return nullptr; }
+        auto & slot = slotOf( bind );
+        BindFn bindFunction = std::move( slot.bindFunction );
+        slot.bindFunction = nullptr;
+        slot.isUsed = false;
+        slot.nextFree = m_freeHead;
+        m_freeHead = bind;
+        m_size--;
+        return bindFunction;
+    }
+
+    void BindTable::schedule( uint16_t bind )
+    {
+        auto & slot = slotOf( bind );
+        // never schedule behind the wheel's current tick, or the entry would wait a full turn
+        uint64_t tick = std::max( slot.deadline / TickMillis, m_wheelTick );
+        m_wheel[tick % WheelSize].push_back( Timer{ bind, slot.generation } );
+    }
+
+    void BindTable::expire( uint64_t nowMillis, const ExpireFn & fn )
+    {
+        uint64_t nowTick = nowMillis / TickMillis;
+        if ( nowTick < m_wheelTick )
+            { return; }
+        // after a long stall every bucket is due once, not once per missed tick
+        if ( nowTick - m_wheelTick >= WheelSize )
+            { m_wheelTick = nowTick - WheelSize + 1; }
+
+        for ( ; m_wheelTick <= nowTick; m_wheelTick++ )
+        {
+            auto timers = std::move( m_wheel[m_wheelTick % WheelSize] );
+            m_wheel[m_wheelTick % WheelSize].clear( );
+            for ( auto & timer : timers )
+            {
+                auto & slot = slotOf( timer.bind );
+                // removed, or recycled by a newer request with its own timer
+                if ( !slot.isUsed || slot.generation != timer.generation )
+                    { continue; }
+                if ( slot.deadline > nowMillis )
+                    { schedule( timer.bind ); continue; }
+                fn( timer.bind, timer.generation, remove( timer.bind, timer.generation ) );
+            }
+        }
+        m_wheelTick = nowTick;
+    }
+
+    void BindTable::clear( const ExpireFn & fn )
+    {
+        // collected first, a handler may add binds of its own; their wheel entries go stale
+        std::vector<Timer> live;
+        for ( size_t bind = 1; bind < m_slots.size( ); bind++ )
+        {
+            if ( m_slots[bind].isUsed )
+                { live.push_back( Timer{ (uint16_t)bind, m_slots[bind].generation } ); }
+        }
+        for ( auto & timer : live )
+            { fn( timer.bind, timer.generation, remove( timer.bind, timer.generation ) ); }
+    }
+
+    size_t BindTable::size( ) const
+    {
+        return m_size;
+    }
+
+    bool BindTable::isEmpty( ) const
+    {
+        return m_size == 0;
+    }
+
+    namespace test
+    {
+        void testBindTable( )
+        {
+            BindTable binds;
+            int replies = 0;
+            int timeouts = 0;
+            BindFn onReply = [&]( const Message & msg, StrArg data ) { replies++; };
+            auto onExpire = [&]( uint16_t bind, uint16_t moniker, BindFn bindFunction ) { timeouts++; };
+
+            uint16_t moniker[3];
+            uint16_t bind0 = binds.add( onReply, 1000, &moniker[0] );
+            uint16_t bind1 = binds.add( onReply, 2000, &moniker[1] );
+            if ( !bind0 || !bind1 || bind0 == bind1 || binds.size( ) != 2 )
+                { throw std::exception{ "binds.add( )" }; }
+
+            if ( binds.find( bind0, moniker[0] + 1 ) )
+                { throw std::exception{ "binds.find( bind0, stale moniker )" }; }
+            if ( !binds.remove( bind0, moniker[0] ) )
+                { throw std::exception{ "binds.remove( bind0 )" }; }
+
+            // recycled bind gets a new generation, so the old moniker no longer matches
+            uint16_t bind2 = binds.add( onReply, 1000, &moniker[2] );
+            if ( bind2 != bind0 || moniker[2] == moniker[0] || binds.find( bind2, moniker[0] ) )
+                { throw std::exception{ "binds.add( recycled )" }; }
+
+            binds.touch( bind2, moniker[2], 3000 );
+            binds.expire( 2000, onExpire );
+            if ( timeouts != 1 || binds.find( bind1, moniker[1] ) || !binds.find( bind2, moniker[2] ) )
+                { throw std::exception{ "binds.expire( 2000 )" }; }
+            binds.expire( 3000, onExpire );
+            if ( timeouts != 2 || !binds.isEmpty( ) )
+                { throw std::exception{ "binds.expire( 3000 )" }; }
+
+            binds.add( onReply, 5000, &moniker[0] );
+            binds.add( onReply, 6000, &moniker[1] );
+            binds.clear( onExpire );
+            if ( timeouts != 4 || !binds.isEmpty( ) )
+                { throw std::exception{ "binds.clear( )" }; }
+
+            // generations wrap before ReplyMoniker
+            for ( int i = 0; i < ReplyMoniker; i++ )
+            {
+                uint16_t bind = binds.add( onReply, 1000, &moniker[0] );
+                if ( !moniker[0] || ( moniker[0] & ReplyMoniker ) )
+                    { throw std::exception{ "binds.add( wrap )" }; }
+                binds.remove( bind, moniker[0] );
+            }
+        }
+    }
+}
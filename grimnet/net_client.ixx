@@ -1,739 +1,1788 @@
-module;
-
-#include <cassert>
-#include <chrono>
-#include <functional>
-#include <map>
-#include <string>
-#include <system_error>
-#include <vector>
-
-export module grim.net.client;
-
-import cpp.asio.tcp;
-import cpp.buffer;
-import cpp.log;
-import cpp.thread;
-import grim.arch.net;
-import grim.auth;
-
-export namespace grim::net
-{
-    class Client : public IClient
-    {
-    public:
-        void                                open(
-                                                cpp::AsyncContext & io,
-                                                StrArg email,
-                                                StrArg addrs );
-        void                                open(
-                                                cpp::AsyncContext & io,
-                                                StrArg email,
-                                                auth::AuthToken authToken,
-                                                StrArg addrs );
-        void                                close( );
-
-        void                                onIdentifying( IdentifyingFn ) override;
-        void                                onIdentify( IdentifyFn ) override;
-        void                                onConnecting( ConnectingFn ) override;
-        void                                onConnect( ConnectFn ) override;
-        void                                onAuthing( AuthingFn ) override;
-        void                                onAuth( AuthFn ) override;
-        void                                onReady( ReadyFn ) override;
-        void                                onDisconnect( DisconnectFn ) override;
-
-        void                                identify( int timeoutSeconds, IdentifyFn );
-        bool                                identify(
-                                                int timeoutSeconds,
-                                                Result * result,
-                                                StrOut email,
-                                                StrOut pendingUrl );
-        void                                connect( int timeoutSeconds, ConnectFn ) override;
-        bool                                connect(
-                                                int timeoutSeconds,
-                                                Result * result,
-                                                StrOut address,
-                                                StrOut reason ) override;
-        void                                auth( int timeoutSeconds, AuthFn ) override;
-        bool                                auth(
-                                                int timeoutSeconds,
-                                                Result * result,
-                                                StrOut email,
-                                                uint64_t * sessionId ) override;
-        void                                ready( int timeoutSeconds, ReadyFn ) override;
-        bool                                ready(
-                                                int timeoutSeconds,
-                                                Result * result ) override;
-
-        void                                send(                               // request
-                                                uint64_t toSessionId,
-                                                uint8_t type,
-                                                cpp::Memory data,
-                                                BindFn bindFunction ) override;
-        void                                send(                               // reply
-                                                uint64_t toSessionId,
-                                                uint16_t moniker,
-                                                uint16_t bind,
-                                                uint8_t type,
-                                                uint8_t result,
-                                                cpp::Memory data ) override;
-
-        cpp::AsyncContext &                 getAsyncContext( );
-    private:
-        void                                notifyIdentifying( const std::string & email );
-        void                                notifyIdentify( net::Result result, const std::string & email, const std::string & pendingUrl );
-        void                                notifyConnecting( const std::string & addr );
-        void                                notifyConnect( net::Result result, const std::string & addr, const std::string & reason );
-        void                                notifyAuthing( const std::string & email );
-        void                                notifyAuth( Result result, StrArg email, uint64_t sessionId );
-        void                                notifyReady( );
-
-        void                                doIdentify( );
-        void                                didIdentify( grim::auth::Result result, grim::auth::AuthToken authToken );
-        void                                doConnect( );
-        void                                doHello( );
-        void                                didHello( Result result, StrArg email, uint64_t sessionId );
-        void                                doRello( );
-        void                                didRello( Result result );
-        void                                authReady( grim::auth::Result result );
-
-        void                                handlerStart( int timeoutSeconds, std::function<void( )> fn );
-        Result                              handlerWait( );
-    private:
-        cpp::AsyncContext                   io;
-        std::vector<std::string>            addrs;
-        std::string                         email;
-        std::string                         access;
-        cpp::TcpClient                      tcp;
-        std::string                         caFilename;
-        grim::auth::Client                  grimauth;
-        grim::auth::AuthToken               authToken;
-
-        IdentifyingFn                       onIdentifyingHandler;
-        IdentifyFn                          onIdentifyHandler;
-        ConnectingFn                        onConnectingHandler;
-        ConnectFn                           onConnectHandler;
-        AuthingFn                           onAuthingHandler;
-        AuthFn                              onAuthHandler;
-        ReadyFn                             onReadyHandler;
-        DisconnectFn                        onDisconnectHandler;
-
-        IdentifyFn                          identifyHandler;
-        ConnectFn                           connectHandler;
-        AuthFn                              authHandler;
-        ReadyFn                             readyHandler;
-        cpp::AsyncTimer                     handlerTimer;
-        cpp::AsyncCondition<Result>         handlerCond;
-
-        uint64_t                            isIdentified : 1;
-        uint64_t                            isConnected : 1;
-        uint64_t                            isAuthed : 1;
-        uint64_t                            isReady : 1;
-
-        std::string                         addr;
-        uint64_t                            sessionId;
-        uint16_t                            bindIndex;
-        std::map<uint16_t, BindFn>          bindMap;
-    };
-}
-
-namespace grim::net
-{
-    struct ProxyApi : public INetServerApi, IProxyApi 
-    {
-        enum class                          MessageType { Hello, Rello, AuthServer, FindServer };
-
-                                            ProxyApi( Client & client );
-
-        void                                hello( auth::AuthToken authToken, OnHello ) override;
-        void                                rello( uint64_t sessionId, OnRello ) override;
-        void                                authServer( StrArg svcName, int nodeId, AuthServerReply reply ) override;
-        void                                findServer( StrArg svcName, int nodeId, FindServerReply reply ) override;
-    private:
-        Client & m_client;
-    };
-
-    void Client::open(
-        cpp::AsyncContext & io,
-        StrArg email,
-        StrArg addrs )
-    {
-        open( io, email, auth::AuthToken{ 0 }, addrs );
-    }
-
-    void Client::open(
-        cpp::AsyncContext & io,
-        StrArg email,
-        auth::AuthToken authToken,
-        StrArg addrs )
-    {
-        this->io = io;
-        this->grimauth.setAsyncContext( io );
-        for ( auto & addr : addrs.split( "," ) )
-            { this->addrs.push_back( addr ); }
-        this->email = email;
-        this->authToken = authToken;
-        this->access = access;
-        this->sessionId = 0;
-
-        if ( this->authToken.value == 0 )
-            { doIdentify( ); }
-        else
-            { doConnect( ); }
-    }
-
-    Result toResult( uint64_t code ) {
-        if ( code == (uint64_t)Result::Ok )
-            { return Result::Ok; }
-        if ( code >= (uint64_t)Result::Arg && code < (uint64_t)Result::Unknown )
-            { return (Result)code; }
-        return Result::Unknown;
-    }
-
-    Result toResult( std::error_code ec ) {
-        if ( !ec )
-            { return Result::Ok; }
-        else if ( ec.value( ) == (int)std::errc::connection_refused )
-            { return Result::Route; }
-        else
-            { return Result::Route; }
-    }
-
-    void Client::notifyIdentifying( const std::string & email )
-    {
-        if ( onIdentifyingHandler )
-            { onIdentifyingHandler( email ); }
-    }
-
-    void Client::notifyIdentify( net::Result result, const std::string & email, const std::string & pendingUrl )
-    {
-        if ( onIdentifyHandler )
-            { onIdentifyHandler( result, addr, pendingUrl ); }
-        if ( identifyHandler )
-            { identifyHandler( result, addr, pendingUrl ); }
-    }
-
-    void Client::notifyConnecting( const std::string & addr )
-    {
-        if ( onConnectingHandler )
-            { onConnectingHandler( addr ); }
-    }
-
-    void Client::notifyConnect( net::Result result, const std::string & addr, const std::string & reason )
-    {
-        if ( onConnectHandler )
-            { onConnectHandler( result, addr, reason ); }
-        if ( connectHandler )
-            { connectHandler( result, addr, reason ); }
-    }
-
-    void Client::notifyAuthing( const std::string & email )
-    {
-        if ( onAuthingHandler )
-            { onAuthingHandler( email ); }
-    }
-
-    void Client::notifyAuth( net::Result result, StrArg email, uint64_t sessionId )
-    {
-        if ( onAuthHandler )
-            { onAuthHandler( result, email, sessionId ); }
-        if ( authHandler )
-            { authHandler( result, email, sessionId ); }
-    }
-
-    void Client::notifyReady( )
-    {
-        if ( onReadyHandler )
-            { onReadyHandler( Result::Ok ); }
-        if ( readyHandler )
-            { readyHandler( Result::Ok ); }
-    }
-
-    void Client::doIdentify( )
-    {
-        using namespace std::placeholders;
-        int options = grim::auth::LoginOption::Interactive;
-        int timeout = 5;
-        if ( authToken.value )
-        {
-            grimauth.login(
-                this->authToken,
-                timeout,
-                std::bind( &Client::didIdentify, this, _1, _2 ) );
-        }
-        else
-        {
-            grimauth.login(
-                grim::auth::UserEmail{ email },
-                grim::auth::ServiceId{ "backwater.grimethos.com" },
-                options,
-                5,
-                std::bind( &Client::didIdentify, this, _1, _2 ) );
-        }
-        notifyIdentifying( email );
-    }
-
-    void Client::didIdentify( grim::auth::Result result, grim::auth::AuthToken authToken )
-    {
-        std::string pendingUrl;
-        switch ( result )
-        {
-        case grim::auth::Result::Ok:
-            this->authToken = authToken;
-            notifyIdentify( Result::Ok, email, "" );
-            doConnect( );
-            break;
-        case grim::auth::Result::Pending:
-            notifyIdentify( Result::Ok, email, pendingUrl );
-            doConnect( );
-            break;
-        case grim::auth::Result::Denied:
-            notifyIdentify( Result::Access, email, pendingUrl );
-            break;
-        case grim::auth::Result::Timeout:
-            notifyIdentify( Result::Timeout, email, pendingUrl );
-            io.waitFor( cpp::Duration::ofSeconds( 10 ), [this]( ) { doIdentify( ); } );
-        case grim::auth::Result::Retry:
-            notifyIdentify( Result::Retry, email, pendingUrl );
-            io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( ) { doIdentify( ); } );
-            break;
-        }
-    }
-
-    void Client::doConnect( )
-    {
-        if ( !addrs.size( ) ) { return; }
-        int index = (int)( ( cpp::Time::now( ).sinceEpoch( ).millis( ) / 10 ) % addrs.size( ) );
-        this->addr = addrs[index];
-
-        notifyConnecting( this->addr );
-        tcp.connect( *io, addr,
-            [this]( std::error_code connectResult )
-            {
-                notifyConnect( addr, toResult( connectResult ), connectResult.message( ) );
-                if ( connectResult )
-                    { doConnect( ); }
-                else if ( sessionId == 0 )
-                    { doHello( ); }
-                else
-                    { doRello( ); }
-            },
-            [this]( std::string & recvBuffer )
-            {
-            },
-            [this]( std::error_code reason )
-            {
-                isConnected = isAuthed = isReady = false;
-                if ( onDisconnectHandler )
-                    { onDisconnectHandler( this->addr, toResult( reason ), reason.message( ) ); }
-                doConnect( );
-                // disconnected
-            }, caFilename );
-    }
-
-    void Client::doHello( )
-    {
-        using namespace std::placeholders;
-
-        ProxyApi proxy{ *this };
-        proxy.hello( authToken, std::bind( &Client::didHello, this, _1, _2, _3 ) );
-    }
-
-    void Client::didHello( Result result, StrArg email, uint64_t sessionId )
-    {
-        if ( result != Result::Ok )
-        {
-            cpp::Log::error( "onHello() : result={}", std::to_underlying( result ) );
-            io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( ) { doAuthLogin( ); } );
-            return;
-        }
-        this->sessionId = sessionId;
-        this->isAuthed = true;
-        notifyAuth( this->email, this->sessionId, result );
-        notifyReady( );
-    }
-
-    void Client::doRello( )
-    {
-        using namespace std::placeholders;
-
-        ProxyApi proxy{ *this };
-        proxy.rello( sessionId, std::bind( &Client::didRello, this, _1 ) );
-    }
-
-    void Client::didRello( Result result )
-    {
-        if ( result != Result::Ok )
-        {
-            doAuthLogin( );
-            return;
-        }
-        this->isAuthed = true;
-        notifyAuth( this->email, this->sessionId, result );
-        notifyReady( );
-    }
-
-    void Client::onConnect( StrArg address, Result result, std::string reason )
-    {
-        if ( onConnectHandler )
-            { onConnectHandler( address, result, reason ); }
-        if ( connectHandler )
-            { connectHandler( address, result, reason ); }
-    }
-
-    void Client::onAuth( StrArg email, uint64_t sessionId, Result result )
-    {
-        if ( onAuthHandler )
-            { onAuthHandler( email, sessionId, result ); }
-        if ( authHandler )
-            { authHandler( email, sessionId, result ); }
-    }
-
-    void Client::onReady( Result result )
-    {
-        if ( onReadyHandler )
-            { onReadyHandler( result ); }
-        if ( readyHandler )
-            { readyHandler( result ); }
-    }
-
-    void Client::close( )
-    {
-        addrs.clear( );
-        tcp.disconnect( );
-    }
-
-    void Client::onConnecting( ConnectingFn fn )
-    {
-        onConnectingHandler = std::move( fn );
-    }
-
-    void Client::onConnect( ConnectFn fn )
-    {
-        onConnectHandler = std::move( fn );
-    }
-
-    void Client::onAuthing( AuthingFn fn )
-    {
-        onAuthingHandler = std::move( fn );
-    }
-
-    void Client::onAuth( AuthFn fn )
-    {
-        onAuthHandler = std::move( fn );
-    }
-
-    void Client::onReady( ReadyFn fn )
-    {
-        onReadyHandler = std::move( fn );
-    }
-
-    void Client::onDisconnect( DisconnectFn fn )
-    {
-        onDisconnectHandler = std::move( fn );
-    }
-
-    void Client::handlerStart( int timeoutSeconds, std::function<void()> fn )
-    {
-        handlerCond.reset( );
-        handlerTimer = io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this, fn]( )
-            { fn( ); handlerCond.notify( Result::Timeout ); } );
-    }
-
-    Result Client::handlerWait( )
-    {
-        return handlerCond.wait( );
-    }
-
-    void Client::connect(
-        int timeoutSeconds,
-        ConnectFn fn )
-    {
-        if ( connectHandler )
-            { io.post( [=, this]( ) { fn( addr, Result::Retry, "Retry" ); } ); return; }
-        if ( addr.empty() )
-            { io.post( [=, this]( ) { fn( addr, Result::Route, "Route" ); } ); return; }
-        if ( isConnected )
-            { io.post( [=, this]( ) { fn( addr, Result::Ok, "Ok" ); } ); return; }
-
-        handlerStart( timeoutSeconds, [this, fn]()
-            { 
-                fn( addr, Result::Timeout, "Timeout" ); 
-                connectHandler = nullptr; 
-            } );
-        connectHandler = [=,this]( StrArg address, Result result, std::string reason )
-            { 
-                if ( result == Result::Ok )
-                {
-                    handlerTimer.cancel( );
-                    fn( address, result, reason );
-                }
-                if ( addr.empty( ) )
-                {
-                    handlerTimer.cancel( );
-                    fn( addr, Result::Route, "Route" );
-                }
-                connectHandler = nullptr;
-            };
-    }
-
-    bool Client::connect(
-        int timeoutSeconds,
-        StrOut address,
-        Result * result, StrOut reason )
-    {
-        bool isDone = false;
-        Result outResult = Result::Timeout;
-        connect( timeoutSeconds, [&]( StrArg inAddr, Result inResult, std::string inReason )
-            {
-                if ( address ) { *address = inAddr; }
-                if ( result ) { *result = inResult; }
-                if ( reason ) { *reason = inReason; }
-                outResult = inResult;
-                isDone = true;
-            } );
-        while ( !isDone ) { io.runOne( ); }
-        return outResult == Result::Ok;
-    }
-
-    void Client::auth( int timeoutSeconds, AuthFn fn )
-    {
-        // if isReady, post result immediately
-        if ( isAuthed )
-            { io.post( [this, fn]( ) { fn( email, 0, Result::Ok ); } ); return; }
-
-        // start a timer that will return timeout if it elapses before the readyHandler is called
-        authHandler = std::move( fn );
-        handlerTimer = io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
-            { authHandler( email, 0, Result::Timeout ); } );
-    }
-
-    bool Client::auth(
-        int timeoutSeconds,
-        StrOut emailOut,
-        uint64_t * sessionIdOut,
-        Result * result )
-    {
-        *result = Result::Ok;
-        if ( !isAuthed )
-        {
-            auto isAuthedCond = io.createCondition<Result>( );
-            authHandler = [&]( StrArg email, uint64_t sessionId, Result authResult )
-                { isAuthedCond.notify( authResult ); };
-            *result = isAuthedCond.wait( );
-        }
-        *emailOut = email;
-        *sessionIdOut = 0;
-
-        return *result == Result::Ok;
-    }
-
-    void Client::ready(
-        int timeoutSeconds,
-        ReadyFn fn )
-    {
-        // if isReady, post result immediately
-        if ( isReady )
-            { io.post( [this, fn]( ) { fn( Result::Ok ); } ); return; }
-
-        // start a timer that will return timeout if it elapses before the readyHandler is called
-        readyHandler = std::move( fn );
-        handlerTimer = io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
-            { readyHandler( Result::Timeout ); } );
-    }
-
-    bool Client::ready(
-        int timeoutSeconds,
-        Result * result )
-    {
-        *result = Result::Ok;
-        if ( !isReady )
-        {
-            auto isReadyCond = io.createCondition<Result>( );
-            readyHandler = [&]( Result readyResult )
-                { isReadyCond.notify( readyResult ); };
-            *result = isReadyCond.wait( );
-        }
-        return *result == Result::Ok;
-    }
-
-    void Client::send(
-        uint64_t toSessionId,
-        uint8_t type,
-        cpp::Memory data,
-        BindFn bindFunction )
-    {
-        uint16_t bind = 0;
-        if ( bindFunction )
-        {
-            while ( !bind || bindMap.count( bind ) ) { bind = bindIndex++; }
-            bindMap[bind] = std::move( bindFunction );
-        }
-
-        uint64_t t = cpp::Time::now( ).sinceEpoch( ).micros( );
-        uint16_t moniker = ( t & 0xffff ) ^ ( ( t >> 16 ) & 0xffff ) ^ ( ( t >> 32 ) & 0xffff ) ^ ( ( t >> 48 ) & 0xffff ) ^ bind;
-
-        assert( data.length( ) < 0xffff * 8 );
-        uint16_t len = (uint16_t)( ( data.length( ) + 7 ) / 8 );
-        size_t padding = ( 8 - ( data.length( ) % 8 ) ) % 8;
-
-        uint8_t result = 0;
-
-        auto request = cpp::StringBuffer::writeTo( 24 );
-        request.putBinary( len, ByteOrder );
-        request.putBinary( moniker, ByteOrder );
-        request.putBinary( bind, ByteOrder );
-        request.putBinary( type, ByteOrder );
-        request.putBinary( result, ByteOrder );
-        request.putBinary( toSessionId, ByteOrder );
-        request.putBinary( sessionId, ByteOrder );
-
-        tcp.send( request.getAll( ) );
-        tcp.send( data );
-        if ( padding )
-            { tcp.send( std::string( padding, '\0' ) ); }
-    }
-
-    void Client::send(
-        uint64_t toSessionId,
-        uint16_t moniker,
-        uint16_t bind,
-        uint8_t type,
-        uint8_t result,
-        cpp::Memory data )
-    {
-        assert( data.length( ) < 0xffff * 8 );
-        uint16_t len = (uint16_t)( ( data.length( ) + 7 ) / 8 );
-        size_t padding = ( 8 - ( data.length( ) % 8 ) ) % 8;
-
-        auto request = cpp::StringBuffer::writeTo( 24 );
-        request.putBinary( len, ByteOrder );
-        request.putBinary( moniker, ByteOrder );
-        request.putBinary( bind, ByteOrder );
-        request.putBinary( type, ByteOrder );
-        request.putBinary( result, ByteOrder );
-        request.putBinary( toSessionId, ByteOrder );
-        request.putBinary( sessionId, ByteOrder );
-
-        tcp.send( request.getAll( ) );
-        tcp.send( data );
-        if ( padding )
-            { tcp.send( std::string( padding, '\0' ) ); }
-    }
-
-    void Client::openUdp( uint16_t port )
-    {
-    }
-
-    void Client::closeUdp( )
-    {
-    }
-
-    void Client::sendUdp(
-        uint64_t toSessionId,
-        cpp::Memory data )
-    {
-    }
-
-
-    cpp::AsyncContext & Client::getAsyncContext( )
-    {
-        return io;
-    }
-
-
-    ProxyApi::ProxyApi( Client & client )
-        : m_client(client)
-    {
-    }
-
-    void ProxyApi::hello( auth::AuthToken authToken, HelloReply handler )
-    {
-        auto request = cpp::StringBuffer::writeTo(256);
-        request.putBinary( authToken.value, ByteOrder );
-
-        // fake response
-        m_client.getAsyncContext( ).post( [handler]( ) 
-            { 
-                handler( Result::Ok, "placeholder@x.com", 1 );
-            } );
-
-        /*
-        m_client.send( 0, (int)MessageType::Hello, request.getAll( ), [handler]( const Message & msg, StrArg data )
-            {
-                Result result = toResult( msg.result );
-                std::string email;
-                uint64_t sessionId;
-
-                try
-                {
-                    cpp::DataBuffer reply{ data };
-                    reply.getBinary( email, ByteOrder );
-                    reply.getBinary( sessionId, ByteOrder );
-                }
-                catch ( std::exception & ) { result = Result::Unknown; }
-
-                handler( result, email, sessionId );
-            } );
-        */
-    }
-
-    void ProxyApi::rello( uint64_t sessionId, RelloReply handler )
-    {
-        auto request = cpp::StringBuffer::writeTo( 256 );
-        request.putBinary( sessionId, ByteOrder );
-
-        m_client.send( 0, (int)MessageType::Rello, request.getAll( ), [handler]( const Message & msg, StrArg data )
-            {
-                Result result = toResult( msg.result );
-                handler( result );
-            } );
-    }
-
-    void ProxyApi::authServer( StrArg svcName, int nodeId, AuthServerReply handler )
-    {
-        auto request = cpp::StringBuffer::writeTo( 256 );
-        request.putBinary( svcName, ByteOrder );
-        request.putBinary( nodeId, ByteOrder );
-
-        m_client.send( 0, (int)MessageType::AuthServer, request.getAll( ), [handler]( const Message & msg, StrArg data )
-            {
-                Result result = toResult( msg.result );
-                std::string email;
-                uint64_t sessionId;
-
-                try
-                {
-                    cpp::DataBuffer reply{ data };
-                    reply.getBinary( email, ByteOrder );
-                    reply.getBinary( sessionId, ByteOrder );
-                }
-                catch ( std::exception & ) { result = Result::Unknown; }
-
-                handler( result, email, sessionId );
-            } );
-    }
-
-    void ProxyApi::findServer( StrArg svcName, int nodeId, FindServerReply handler )
-    {
-        auto request = cpp::StringBuffer::writeTo( 256 );
-        request.putBinary( svcName, ByteOrder );
-        request.putBinary( nodeId, ByteOrder );
-
-        m_client.send( 0, (int)MessageType::AuthServer, request.getAll( ), [handler]( const Message & msg, StrArg data )
-            {
-                Result result = toResult( msg.result );
-                uint64_t sessionId;
-
-                try
-                {
-                    cpp::DataBuffer reply{ data };
-                    reply.getBinary( sessionId, ByteOrder );
-                }
-                catch ( std::exception & ) { result = Result::Unknown; }
-
-                handler( result, sessionId );
-            } );
-    }
-
+module;
+
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+export module grim.net.client;
+
+import cpp.asio.tcp;
+import cpp.asio.udp;
+import cpp.buffer;
+import cpp.log;
+import cpp.thread;
+import grim.arch.net;
+import grim.auth;
+import grim.net.bind;
+import grim.net.datagram;
+import grim.net.lanes;
+import grim.net.loopback;
+import grim.net.message;
+import grim.net.proxy_api;
+import grim.net.proxy_select;
+import grim.net.replay;
+import grim.net.schema;
+import grim.net.send_queue;
+import grim.net.stats;
+import grim.net.stream;
+import grim.net.tls;
+import grim.net.transport;
+
+export namespace grim::net
+{
+    class Client : public IClient
+    {
+    public:
+        void                                open(
+                                                cpp::AsyncContext & io,
+                                                StrArg email,
+                                                StrArg addrs );
+        void                                open(
+                                                cpp::AsyncContext & io,
+                                                StrArg email,
+                                                auth::AuthToken authToken,
+                                                StrArg addrs );
+        void                                close( );
+        //! drops the connection to the proxy as a network failure would; the client reconnects and
+        //! rellos with its session
+        void                                reconnect( );
+
+        void                                onIdentifying( IdentifyingFn ) override;
+        void                                onIdentify( IdentifyFn ) override;
+        void                                onConnecting( ConnectingFn ) override;
+        void                                onConnect( ConnectFn ) override;
+        void                                onAuthing( AuthingFn ) override;
+        void                                onAuth( AuthFn ) override;
+        void                                onReady( ReadyFn ) override;
+        void                                onDisconnect( DisconnectFn ) override;
+        void                                onBackpressure( BackpressureFn ) override;
+        void                                setSendLimits( const SendLimits & limits ) override;
+
+        void                                identify( int timeoutSeconds, IdentifyFn );
+        bool                                identify(
+                                                int timeoutSeconds,
+                                                Result * result,
+                                                StrOut email,
+                                                StrOut pendingUrl );
+        void                                connect( int timeoutSeconds, ConnectFn ) override;
+        bool                                connect(
+                                                int timeoutSeconds,
+                                                Result * result,
+                                                StrOut address,
+                                                StrOut reason ) override;
+        void                                auth( int timeoutSeconds, AuthFn ) override;
+        bool                                auth(
+                                                int timeoutSeconds,
+                                                Result * result,
+                                                StrOut email,
+                                                uint64_t * sessionId ) override;
+        void                                ready( int timeoutSeconds, ReadyFn ) override;
+        bool                                ready(
+                                                int timeoutSeconds,
+                                                Result * result ) override;
+
+        void                                send(                               // request
+                                                uint64_t toSessionId,
+                                                uint8_t type,
+                                                cpp::Memory data,
+                                                BindFn bindFunction ) override;
+        void                                send(                               // reply
+                                                uint64_t toSessionId,
+                                                uint16_t moniker,
+                                                uint16_t bind,
+                                                uint8_t type,
+                                                uint8_t result,
+                                                cpp::Memory data ) override;
+        void                                sendStream(
+                                                uint64_t toSessionId,
+                                                uint8_t type,
+                                                std::string data,
+                                                BindFn bindFunction ) override;
+        //! a request declared with a schema (see grim.net.schema), encoded into a buffer which is
+        //! reused from one request to the next
+        template<Schema T>
+        void                                send( uint64_t toSessionId, const T & request, BindFn bindFunction )
+                                                { encode( request, &encodeBuffer ); send( toSessionId, (uint8_t)T::Type, encodeBuffer, std::move( bindFunction ) ); }
+
+        //! datagrams relayed by the proxy; the endpoint is reopened with each proxy the client
+        //! (re)connects to, and datagrams sent before that are dropped
+        void                                openUdp( uint16_t port );
+        void                                closeUdp( );
+        void                                sendUdp(
+                                                uint64_t toSessionId,
+                                                cpp::Memory data );
+        void                                onRecvUdp( UdpFn );
+        //! messages from other sessions which are not replies: those without a bind, and requests,
+        //! answered with the reply send( ); a stream arrives whole, as one request
+        void                                onRecv( BindFn );
+        //! messages of `type` to other sessions go in `lane` (see grim.net.lanes): bulk frames are
+        //! sent a quantum per io turn, behind control frames queued meanwhile
+        void                                setLane( uint8_t type, Lane lane );
+        //! connections to proxies are TLS (see grim.net.tls), the certificate checked against the
+        //! proxy's name as given to open( ).  `tls` keeps each proxy's session, so a reconnect
+        //! (after a proxy restarts, say) resumes it rather than repeating the full handshake; one
+        //! context may be shared by many clients.
+        void                                setTls( std::shared_ptr<TlsClientContext> tls );
+
+        //! groups of sessions kept by the proxy for this session (see grim.net.group): a message
+        //! sent without a bind to a group id (makeGroupId) is copied by the proxy to each member
+        //! connected to it.  Groups are registered again after each reconnect.  Only a server
+        //! node's session (IProxyApi::authServer) owns groups; a join the proxy refuses is logged
+        //! and forgotten, except one past its limits, which is tried again after a reconnect.
+        void                                joinGroup( uint64_t groupId, uint64_t sessionId );
+        void                                leaveGroup( uint64_t groupId, uint64_t sessionId );
+        void                                closeGroup( uint64_t groupId );
+
+        //! this client's counters and latencies (see grim.net.stats); read from any thread
+        const NetStats &                    stats( ) const;
+        //! asks the server at the other end (a proxy or a session server) for its stats
+        using                               StatsFn = std::function<void( Result result, std::string text )>;
+        void                                requestStats( StatsFn fn );
+
+        cpp::AsyncContext &                 getAsyncContext( );
+    private:
+        void                                notifyIdentifying( const std::string & email );
+        void                                notifyIdentify( net::Result result, const std::string & email, const std::string & pendingUrl );
+        void                                notifyConnecting( const std::string & addr );
+        void                                notifyConnect( net::Result result, const std::string & addr, const std::string & reason );
+        void                                notifyAuthing( const std::string & email );
+        void                                notifyAuth( Result result, StrArg email, uint64_t sessionId );
+        void                                notifyReady( );
+
+        void                                doIdentify( );
+        void                                didIdentify( grim::auth::Result result, grim::auth::AuthToken authToken );
+        void                                doConnect( );
+        void                                doProbe( );
+        void                                didResolve( uint32_t round, std::vector<std::vector<std::string>> candidates );
+        void                                doProbeNext( size_t raceIndex );
+        void                                didProbe( size_t raceIndex, size_t probeIndex, uint32_t load, uint16_t shardIndex );
+        void                                finishRace( size_t raceIndex );
+        void                                didProbeAll( );
+        static bool                         isNumericAddr( const std::string & addr );
+        static std::vector<std::string>     resolveAll( const std::string & addr );
+        void                                doHello( );
+        void                                didHello( Result result, StrArg email, uint64_t sessionId );
+        void                                doRello( );
+        void                                didRello( Result result, bool isResumed, uint64_t proxyReceived );
+        bool                                doResend( uint64_t proxyReceived );
+        //! releases the bind of a request which was not sent, and posts `result` to its handler
+        void                                failBind( const Message & message, Result result );
+        void                                failBinds( Result result );
+        void                                authReady( grim::auth::Result result );
+
+        void                                handlerStart( int timeoutSeconds, std::function<void( )> fn );
+        Result                              handlerWait( );
+
+        struct                              Stream;
+        //! 0 without a bindFunction, or if the table is full, when bindFunction is failed with Retry
+        uint16_t                            makeBind( BindFn bindFunction, uint16_t * moniker );
+        uint16_t                            makeMoniker( );
+        void                                doExpireBinds( );
+        void                                didStream( std::shared_ptr<Stream> stream, const Message & message, const cpp::Memory & data );
+        void                                doStreamPart( std::shared_ptr<Stream> stream );
+
+        void                                queue( const Message & message, cpp::Memory data );
+        void                                putAck( );
+        void                                flush( );
+        void                                notifyBackpressure( );
+        void                                receive( const Message & message, const cpp::Memory & data );
+        //! a bound request from another session, or a part of its stream
+        void                                receiveRequest( const Message & message, const cpp::Memory & data );
+
+        void                                doOpenUdp( );
+        void                                doJoinGroups( );
+        void                                doJoinGroup( uint64_t groupId, uint64_t sessionId );
+        void                                didOpenUdp( Result result, uint64_t key, uint16_t proxyPort );
+        void                                queueUdp( uint64_t toSessionId, const cpp::Memory & data );
+        void                                flushUdp( );
+        void                                receiveUdp( const cpp::Memory & datagram );
+    private:
+        using                               Clock = std::chrono::steady_clock;
+        static constexpr int                ProbeTimeoutMillis = 2000;
+        static constexpr int                ProbeIntervalSeconds = 60;
+        //! happy eyeballs' connection attempt delay (RFC 8305)
+        static constexpr int                RaceDelayMillis = 250;
+        struct                              Probe;
+        struct                              ProxyRace;
+
+        cpp::AsyncContext                   io;
+        std::vector<std::string>            addrs;
+        std::string                         email;
+        std::string                         access;
+        TransportClient                     tcp;
+        std::string                         caFilename;
+        std::shared_ptr<TlsClientContext>   tls;
+        grim::auth::Client                  grimauth;
+        grim::auth::AuthToken               authToken;
+
+        IdentifyingFn                       onIdentifyingHandler;
+        IdentifyFn                          onIdentifyHandler;
+        ConnectingFn                        onConnectingHandler;
+        ConnectFn                           onConnectHandler;
+        AuthingFn                           onAuthingHandler;
+        AuthFn                              onAuthHandler;
+        ReadyFn                             onReadyHandler;
+        DisconnectFn                        onDisconnectHandler;
+        BackpressureFn                      onBackpressureHandler;
+        BindFn                              onRecvHandler;
+
+        IdentifyFn                          identifyHandler;
+        ConnectFn                           connectHandler;
+        AuthFn                              authHandler;
+        ReadyFn                             readyHandler;
+        cpp::AsyncTimer                     handlerTimer;
+        cpp::AsyncCondition<Result>         handlerCond;
+
+        uint64_t                            isIdentified : 1;
+        uint64_t                            isConnected : 1;
+        uint64_t                            isAuthed : 1;
+        uint64_t                            isReady : 1;
+        uint64_t                            isFlushPending : 1;
+        uint64_t                            isBindTimerPending : 1;
+        uint64_t                            isUdpOpen : 1;
+        uint64_t                            isUdpFlushPending : 1;
+        uint64_t                            isProbing : 1;
+
+        std::string                         addr;
+        uint64_t                            sessionId;
+        int                                 requestTimeoutSeconds = 30;
+        BindTable                           binds;
+        cpp::AsyncTimer                     bindTimer;
+        LaneWriter                          writer;
+        MessageReader                       reader;
+        std::string                         encodeBuffer;
+        //! frames sent to the proxy which it has not acked, and the frames received from it; a
+        //! rello resumes both streams so only the gap is sent again
+        ReplayBuffer                        replay;
+        uint64_t                            receivedCount = 0;
+        uint64_t                            ackedCount = 0;
+        size_t                              unackedBytes = 0;
+        //! bounds the writer and what was sent but not acked, for a slow proxy
+        SendQueue                           sendQueue;
+        //! streams other sessions are sending this one, see grim.net.stream
+        StreamReader                        streams;
+
+        cpp::UdpClient                      udp;
+        //! 0 until the proxy has opened the endpoint
+        uint64_t                            udpKey = 0;
+        std::string                         proxyUdpAddr;
+        uint32_t                            udpSeq = 0;
+        ReplayWindow                        udpReplay;
+        //! datagrams queued during this io turn, back to back
+        std::string                         udpBatch;
+        std::vector<uint32_t>               udpSizes;
+        UdpFn                               onRecvUdpHandler;
+
+        std::map<uint64_t, std::set<uint64_t>> groups;
+
+        //! every proxy is probed (over ipv6 and ipv4, raced) before the first connect, and again
+        //! before a reconnect once the last probe is ProbeIntervalSeconds old
+        ProxySelector                       proxies;
+        size_t                              proxyIndex = 0;
+        Clock::time_point                   connectStart;
+        Clock::time_point                   lastProbe;
+        std::vector<std::unique_ptr<ProxyRace>> races;
+        size_t                              racesPending = 0;
+        //! handlers of an earlier round ignore anything which arrives late
+        uint32_t                            probeRound = 0;
+        //! replaced by close( ), which orphans the lookups still running for the last probe
+        std::shared_ptr<bool>               resolveToken = std::make_shared<bool>( true );
+        cpp::AsyncTimer                     probeTimer;
+        cpp::AsyncTimer                     connectTimer;
+
+        NetStats                            netStats;
+        //! when each bind's request was sent, indexed by bind
+        std::vector<Clock::time_point>      bindSent;
+        Clock::time_point                   identifyStart;
+        Clock::time_point                   helloStart;
+        Clock::time_point                   relloStart;
+    };
+}
+
+namespace grim::net
+{
+    struct ProxyApi : public INetServerApi, IProxyApi 
+    {
+                                            ProxyApi( Client & client );
+
+        void                                hello( auth::AuthToken authToken, OnHello ) override;
+        void                                rello( uint64_t sessionId, OnRello ) override;
+        void                                resume( uint64_t sessionId, uint64_t receivedCount, OnResume ) override;
+        void                                authServer( StrArg svcName, int nodeId, AuthServerReply reply ) override;
+        void                                findServer( StrArg svcName, int nodeId, FindServerReply reply ) override;
+        void                                openUdp( uint16_t port ) override;
+        void                                closeUdp( ) override;
+        void                                sendUdp( uint64_t toSessionId, cpp::Memory data ) override;
+    private:
+        Client & m_client;
+    };
+
+    void Client::open(
+        cpp::AsyncContext & io,
+        StrArg email,
+        StrArg addrs )
+    {
+        open( io, email, auth::AuthToken{ 0 }, addrs );
+    }
+
+    void Client::open(
+        cpp::AsyncContext & io,
+        StrArg email,
+        auth::AuthToken authToken,
+        StrArg addrs )
+    {
+        this->io = io;
+        this->grimauth.setAsyncContext( io );
+        for ( auto & addr : addrs.split( "," ) )
+            { this->addrs.push_back( addr ); }
+        this->proxies.setAddrs( this->addrs );
+        this->email = email;
+        this->authToken = authToken;
+        this->access = access;
+        this->sessionId = 0;
+        this->isFlushPending = false;
+        this->isBindTimerPending = false;
+        this->isUdpOpen = false;
+        this->isUdpFlushPending = false;
+        this->isProbing = false;
+        setSendLimits( sendQueue.limits( ) );
+
+        if ( this->authToken.value == 0 )
+            { doIdentify( ); }
+        else
+            { doConnect( ); }
+    }
+
+    Result toResult( uint64_t code ) {
+        if ( code == (uint64_t)Result::Ok )
+            { return Result::Ok; }
+        if ( code >= (uint64_t)Result::Arg && code < (uint64_t)Result::Unknown )
+            { return (Result)code; }
+        return Result::Unknown;
+    }
+
+    Result toResult( std::error_code ec ) {
+        if ( !ec )
+            { return Result::Ok; }
+        else if ( ec.value( ) == (int)std::errc::connection_refused )
+            { return Result::Route; }
+        else
+            { return Result::Route; }
+    }
+
+    void Client::notifyIdentifying( const std::string & email )
+    {
+        if ( onIdentifyingHandler )
+            { onIdentifyingHandler( email ); }
+    }
+
+    void Client::notifyIdentify( net::Result result, const std::string & email, const std::string & pendingUrl )
+    {
+        if ( onIdentifyHandler )
+            { onIdentifyHandler( result, addr, pendingUrl ); }
+        if ( identifyHandler )
+            { identifyHandler( result, addr, pendingUrl ); }
+    }
+
+    void Client::notifyConnecting( const std::string & addr )
+    {
+        if ( onConnectingHandler )
+            { onConnectingHandler( addr ); }
+    }
+
+    void Client::notifyConnect( net::Result result, const std::string & addr, const std::string & reason )
+    {
+        if ( onConnectHandler )
+            { onConnectHandler( result, addr, reason ); }
+        if ( connectHandler )
+            { connectHandler( result, addr, reason ); }
+    }
+
+    void Client::notifyAuthing( const std::string & email )
+    {
+        if ( onAuthingHandler )
+            { onAuthingHandler( email ); }
+    }
+
+    void Client::notifyAuth( net::Result result, StrArg email, uint64_t sessionId )
+    {
+        if ( onAuthHandler )
+            { onAuthHandler( result, email, sessionId ); }
+        if ( authHandler )
+            { authHandler( result, email, sessionId ); }
+    }
+
+    void Client::notifyReady( )
+    {
+        if ( onReadyHandler )
+            { onReadyHandler( Result::Ok ); }
+        if ( readyHandler )
+            { readyHandler( Result::Ok ); }
+    }
+
+    void Client::doIdentify( )
+    {
+        using namespace std::placeholders;
+        int options = grim::auth::LoginOption::Interactive;
+        int timeout = 5;
+        identifyStart = Clock::now( );
+        if ( authToken.value )
+        {
+            grimauth.login(
+                this->authToken,
+                timeout,
+                std::bind( &Client::didIdentify, this, _1, _2 ) );
+        }
+        else
+        {
+            grimauth.login(
+                grim::auth::UserEmail{ email },
+                grim::auth::ServiceId{ "backwater.grimethos.com" },
+                options,
+                5,
+                std::bind( &Client::didIdentify, this, _1, _2 ) );
+        }
+        notifyIdentifying( email );
+    }
+
+    void Client::didIdentify( grim::auth::Result result, grim::auth::AuthToken authToken )
+    {
+        netStats.auth.record( Clock::now( ) - identifyStart );
+        std::string pendingUrl;
+        switch ( result )
+        {
+        case grim::auth::Result::Ok:
+            this->authToken = authToken;
+            notifyIdentify( Result::Ok, email, "" );
+            doConnect( );
+            break;
+        case grim::auth::Result::Pending:
+            notifyIdentify( Result::Ok, email, pendingUrl );
+            doConnect( );
+            break;
+        case grim::auth::Result::Denied:
+            notifyIdentify( Result::Access, email, pendingUrl );
+            break;
+        case grim::auth::Result::Timeout:
+            notifyIdentify( Result::Timeout, email, pendingUrl );
+            io.waitFor( cpp::Duration::ofSeconds( 10 ), [this]( ) { doIdentify( ); } );
+        case grim::auth::Result::Retry:
+            notifyIdentify( Result::Retry, email, pendingUrl );
+            io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( ) { doIdentify( ); } );
+            break;
+        }
+    }
+
+    void Client::doConnect( )
+    {
+        if ( !addrs.size( ) || isProbing ) { return; }
+        auto now = Clock::now( );
+        if ( lastProbe == Clock::time_point{ } || now - lastProbe > std::chrono::seconds( ProbeIntervalSeconds ) )
+            { doProbe( ); return; }
+        if ( !proxies.select( now, &proxyIndex ) )
+        {
+            auto delay = std::chrono::duration_cast<std::chrono::milliseconds>( proxies.retryDelay( now ) ).count( );
+            connectTimer = io.waitFor( cpp::Duration::ofMillis( delay + 1 ), [this]( ) { doConnect( ); } );
+            return;
+        }
+        this->addr = proxies.proxy( proxyIndex ).connectAddr;
+        connectStart = now;
+
+        notifyConnecting( this->addr );
+        tcp.setTls( tls.get( ), proxies.proxy( proxyIndex ).addr );
+        tcp.connect( io, addr,
+            [this]( std::error_code connectResult )
+            {
+                reader.reset( );
+                // anything left unsent is in the replay buffer, and is resent once (re)attached
+                writer.clear( );
+                sendQueue.restart( );
+                notifyConnect( addr, toResult( connectResult ), connectResult.message( ) );
+                if ( connectResult )
+                {
+                    proxies.recordFailure( proxyIndex, Clock::now( ) );
+                    doConnect( );
+                    return;
+                }
+                // the handshake is a round trip too
+                proxies.recordRtt( proxyIndex, Clock::now( ) - connectStart );
+                proxies.recordSuccess( proxyIndex );
+                isConnected = true;
+                netStats.connects.add( );
+                if ( sessionId )
+                    { netStats.reconnects.add( ); }
+                if ( sessionId == 0 )
+                    { doHello( ); }
+                else
+                    { doRello( ); }
+            },
+            [this]( std::string & recvBuffer )
+            {
+                reader.read( recvBuffer, [this]( const Message & message, const cpp::Memory & data )
+                    { receive( message, data ); } );
+                if ( isAuthed && ( receivedCount - ackedCount >= ReplayAckFrames || unackedBytes >= ReplayAckBytes ) )
+                    { putAck( ); }
+            },
+            [this]( std::error_code reason )
+            {
+                // what was not sent yet joins the replay buffer, to be resent once reattached
+                writer.drain( [this]( const char * frame, size_t frameSize )
+                    {
+                        if ( isSequenced( decodeHeader( frame ) ) )
+                            { replay.push( frame, frameSize ); }
+                    } );
+                isConnected = isAuthed = isReady = false;
+                // what was in flight is held in the replay buffer now, and counted there
+                sendQueue.restart( );
+                netStats.disconnects.add( );
+                // the key belongs to the proxy's relay, a new one is opened after the reconnect
+                udpKey = 0;
+                if ( onDisconnectHandler )
+                    { onDisconnectHandler( this->addr, toResult( reason ), reason.message( ) ); }
+                // the proxy backs off before it is tried again, so clients dropped by the same
+                // proxy neither all return to it nor all arrive at the next one at once
+                proxies.recordFailure( proxyIndex, Clock::now( ) );
+                doConnect( );
+                // disconnected
+            }, caFilename );
+    }
+
+    struct Client::Probe
+    {
+        std::string                         addr;
+        TransportClient                     tcp;
+        MessageReader                       reader;
+        Clock::time_point                   sent;
+    };
+
+    //! a proxy's resolved addresses, raced (ipv6 first); the first to answer a probe wins
+    struct Client::ProxyRace
+    {
+        std::vector<std::string>            candidates;
+        std::vector<std::unique_ptr<Probe>> probes;
+        size_t                              failed = 0;
+        bool                                isDone = false;
+        cpp::AsyncTimer                     timer;
+    };
+
+    void Client::doProbe( )
+    {
+        isProbing = true;
+        probeRound++;
+        races.clear( );
+        racesPending = proxies.size( );
+        // a numeric address is raced at once, names are resolved off the io context (a lookup
+        // blocks) and raced once they are
+        std::vector<std::string> names;
+        for ( size_t i = 0; i < proxies.size( ); i++ )
+        {
+            races.push_back( std::make_unique<ProxyRace>( ) );
+            const std::string & addr = proxies.proxy( i ).addr;
+            if ( isNumericAddr( addr ) )
+                { races.back( )->candidates = { addr }; }
+            else
+                { names.push_back( addr ); }
+        }
+        if ( !names.empty( ) )
+        {
+            // the lookup may outlive the client, it only touches it (back on the io context) if
+            // the client has not been closed or destroyed meanwhile
+            std::weak_ptr<bool> alive = resolveToken;
+            std::thread( [io = this->io, alive, self = this, round = probeRound, names = std::move( names )]( ) mutable
+                {
+                    std::vector<std::vector<std::string>> candidates;
+                    for ( auto & name : names )
+                        { candidates.push_back( resolveAll( name ) ); }
+                    io.post( [alive, self, round, candidates = std::move( candidates )]( ) mutable
+                        {
+                            if ( alive.lock( ) )
+                                { self->didResolve( round, std::move( candidates ) ); }
+                        } );
+                } ).detach( );
+        }
+        for ( size_t i = 0; i < races.size( ); i++ )
+            { doProbeNext( i ); }
+
+        // a proxy which has not answered (or been resolved) by now counts as failed, so a slow
+        // lookup holds up the connect no longer than a slow proxy would
+        probeTimer = io.waitFor( cpp::Duration::ofMillis( ProbeTimeoutMillis ), [this, round = probeRound]( )
+            {
+                if ( round != probeRound )
+                    { return; }
+                for ( size_t i = 0; i < races.size( ); i++ )
+                {
+                    if ( !races[i]->isDone )
+                    {
+                        proxies.recordFailure( i, Clock::now( ) );
+                        finishRace( i );
+                    }
+                }
+            } );
+    }
+
+    void Client::didResolve( uint32_t round, std::vector<std::vector<std::string>> candidates )
+    {
+        // late, for a round which already timed out or a closed client
+        if ( round != probeRound )
+            { return; }
+        size_t next = 0;
+        for ( size_t i = 0; i < races.size( ) && next < candidates.size( ); i++ )
+        {
+            if ( !races[i]->candidates.empty( ) )
+                { continue; }
+            races[i]->candidates = std::move( candidates[next++] );
+            doProbeNext( i );
+        }
+    }
+
+    void Client::doProbeNext( size_t raceIndex )
+    {
+        auto & race = *races[raceIndex];
+        if ( race.isDone || race.probes.size( ) >= race.candidates.size( ) )
+            { return; }
+        size_t probeIndex = race.probes.size( );
+        race.probes.push_back( std::make_unique<Probe>( ) );
+        auto & probe = *race.probes.back( );
+        probe.addr = race.candidates[probeIndex];
+        uint32_t round = probeRound;
+        // a probe is over before shared memory would pay for itself
+        probe.tcp.setShm( false );
+        probe.tcp.setTls( tls.get( ), proxies.proxy( raceIndex ).addr );
+
+        probe.tcp.connect( io, probe.addr,
+            [this, round, raceIndex, probeIndex]( std::error_code connectResult )
+            {
+                if ( round != probeRound || races[raceIndex]->isDone )
+                    { return; }
+                auto & race = *races[raceIndex];
+                if ( connectResult )
+                {
+                    // the next address is tried at once rather than after the race delay
+                    if ( ++race.failed == race.candidates.size( ) )
+                    {
+                        proxies.recordFailure( raceIndex, Clock::now( ) );
+                        finishRace( raceIndex );
+                    }
+                    else
+                        { doProbeNext( raceIndex ); }
+                    return;
+                }
+                auto & probe = *race.probes[probeIndex];
+                Message message{ };
+                message.bind = 1;
+                MessageWriter frame;
+                putMessage( frame, message, ProbeRequest{ } );
+                probe.sent = Clock::now( );
+                probe.tcp.send( frame.getAll( ) );
+            },
+            [this, round, raceIndex, probeIndex]( std::string & recvBuffer )
+            {
+                if ( round != probeRound || races[raceIndex]->isDone )
+                    { recvBuffer.clear( ); return; }
+                auto & probe = *races[raceIndex]->probes[probeIndex];
+                probe.reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                    {
+                        if ( message.type != (uint8_t)IProxyApi::MessageType::Probe || races[raceIndex]->isDone )
+                            { return; }
+                        ProbeReply reply{ };
+                        decode( data, &reply );
+                        didProbe( raceIndex, probeIndex, reply.load, reply.shardIndex );
+                    } );
+            },
+            []( std::error_code ) { }, caFilename );
+
+        if ( race.probes.size( ) < race.candidates.size( ) )
+        {
+            race.timer = io.waitFor( cpp::Duration::ofMillis( RaceDelayMillis ), [this, round, raceIndex]( )
+                {
+                    if ( round == probeRound )
+                        { doProbeNext( raceIndex ); }
+                } );
+        }
+    }
+
+    void Client::didProbe( size_t raceIndex, size_t probeIndex, uint32_t load, uint16_t shardIndex )
+    {
+        auto & probe = *races[raceIndex]->probes[probeIndex];
+        proxies.recordRtt( raceIndex, Clock::now( ) - probe.sent );
+        proxies.recordLoad( raceIndex, load );
+        proxies.recordSuccess( raceIndex );
+        // the proxy's shard for this client listens on a port of its own
+        proxies.setConnectAddr( raceIndex, shardAddress( probe.addr, shardIndex ) );
+        finishRace( raceIndex );
+    }
+
+    void Client::finishRace( size_t raceIndex )
+    {
+        auto & race = *races[raceIndex];
+        if ( race.isDone )
+            { return; }
+        race.isDone = true;
+        race.timer.cancel( );
+        // closed outside of their own handlers
+        io.post( [this, round = probeRound, raceIndex]( )
+            {
+                if ( round != probeRound )
+                    { return; }
+                for ( auto & probe : races[raceIndex]->probes )
+                    { probe->tcp.disconnect( ); }
+            } );
+        if ( --racesPending == 0 )
+            { didProbeAll( ); }
+    }
+
+    void Client::didProbeAll( )
+    {
+        isProbing = false;
+        probeTimer.cancel( );
+        lastProbe = Clock::now( );
+        doConnect( );
+    }
+
+    bool Client::isNumericAddr( const std::string & addr )
+    {
+        // or in process, or without a port to resolve for
+        size_t colon = addr.find_last_of( ':' );
+        if ( colon == std::string::npos || addr.starts_with( '[' ) || isLoopAddress( addr ) )
+            { return true; }
+        return addr.substr( 0, colon ).find_first_not_of( "0123456789." ) == std::string::npos;
+    }
+
+    std::vector<std::string> Client::resolveAll( const std::string & addr )
+    {
+        // a name is resolved (blocking, so never on the io context) for each family
+        if ( isNumericAddr( addr ) )
+            { return { addr }; }
+        size_t colon = addr.find_last_of( ':' );
+        std::string host = addr.substr( 0, colon );
+        std::string port = addr.substr( colon + 1 );
+
+        std::vector<std::string> candidates;
+        for ( auto version : { cpp::TcpVersion::v6, cpp::TcpVersion::v4 } )
+        {
+            try
+            {
+                std::string ip = cpp::TcpServer::resolve( version, host );
+                if ( !ip.empty( ) )
+                    { candidates.push_back( version == cpp::TcpVersion::v6 ? "[" + ip + "]:" + port : ip + ":" + port ); }
+            }
+            catch ( std::exception & ) { }
+        }
+        if ( candidates.empty( ) )
+            { candidates.push_back( addr ); }
+        return candidates;
+    }
+
+    void Client::doHello( )
+    {
+        using namespace std::placeholders;
+
+        helloStart = Clock::now( );
+        ProxyApi proxy{ *this };
+        proxy.hello( authToken, std::bind( &Client::didHello, this, _1, _2, _3 ) );
+    }
+
+    void Client::didHello( Result result, StrArg email, uint64_t sessionId )
+    {
+        netStats.hello.record( Clock::now( ) - helloStart );
+        if ( result != Result::Ok )
+        {
+            cpp::Log::error( "onHello() : result={}", std::to_underlying( result ) );
+            notifyAuth( result, this->email, 0 );
+            // refused (or the proxy could not reach the session service), asked again later
+            connectTimer = io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( )
+                {
+                    if ( isConnected && !isAuthed )
+                        { doHello( ); }
+                } );
+            return;
+        }
+        this->sessionId = sessionId;
+        this->isAuthed = true;
+        // a new session, both streams start over; anything queued before it goes out now
+        receivedCount = ackedCount = 0;
+        replay.restart( );
+        streams.clear( );
+        doResend( 0 );
+        notifyAuth( result, this->email, this->sessionId );
+        notifyReady( );
+        if ( isUdpOpen )
+            { doOpenUdp( ); }
+        doJoinGroups( );
+    }
+
+    void Client::doRello( )
+    {
+        using namespace std::placeholders;
+
+        relloStart = Clock::now( );
+        ProxyApi proxy{ *this };
+        proxy.resume( sessionId, receivedCount, std::bind( &Client::didRello, this, _1, _2, _3 ) );
+    }
+
+    void Client::didRello( Result result, bool isResumed, uint64_t proxyReceived )
+    {
+        netStats.rello.record( Clock::now( ) - relloStart );
+        if ( result != Result::Ok )
+        {
+            // the session is gone (expired, or refused by the session service); what was sent on
+            // it will not be answered, and a new session starts over
+            cpp::Log::info( "onRello() : result={}", std::to_underlying( result ) );
+            replay.reset( );
+            receivedCount = ackedCount = 0;
+            failBinds( Result::Retry );
+            sessionId = 0;
+            doHello( );
+            return;
+        }
+        // only the frames the proxy missed are sent again; if it no longer has the stream (or
+        // this one has lost frames it needs), the replies in flight are gone and callers re-sync
+        replay.ack( proxyReceived );
+        if ( !isResumed || !doResend( proxyReceived ) )
+        {
+            replay.reset( );
+            receivedCount = ackedCount = 0;
+            failBinds( Result::Retry );
+        }
+        this->isAuthed = true;
+        notifyAuth( result, this->email, this->sessionId );
+        notifyReady( );
+        if ( isUdpOpen )
+            { doOpenUdp( ); }
+        // a resumed session still has its groups, a join the proxy already has is ignored
+        doJoinGroups( );
+    }
+
+    void Client::onConnect( StrArg address, Result result, std::string reason )
+    {
+        if ( onConnectHandler )
+            { onConnectHandler( address, result, reason ); }
+        if ( connectHandler )
+            { connectHandler( address, result, reason ); }
+    }
+
+    void Client::onAuth( StrArg email, uint64_t sessionId, Result result )
+    {
+        if ( onAuthHandler )
+            { onAuthHandler( email, sessionId, result ); }
+        if ( authHandler )
+            { authHandler( email, sessionId, result ); }
+    }
+
+    void Client::onReady( Result result )
+    {
+        if ( onReadyHandler )
+            { onReadyHandler( result ); }
+        if ( readyHandler )
+            { readyHandler( result ); }
+    }
+
+    void Client::close( )
+    {
+        addrs.clear( );
+        connectTimer.cancel( );
+        probeTimer.cancel( );
+        for ( auto & race : races )
+        {
+            for ( auto & probe : race->probes )
+                { probe->tcp.disconnect( ); }
+        }
+        probeRound++;
+        isProbing = false;
+        resolveToken = std::make_shared<bool>( true );
+        closeUdp( );
+        tcp.disconnect( );
+    }
+
+    void Client::reconnect( )
+    {
+        tcp.disconnect( );
+    }
+
+    void Client::onIdentifying( IdentifyingFn fn )
+    {
+        onIdentifyingHandler = std::move( fn );
+    }
+
+    void Client::onIdentify( IdentifyFn fn )
+    {
+        onIdentifyHandler = std::move( fn );
+    }
+
+    void Client::onConnecting( ConnectingFn fn )
+    {
+        onConnectingHandler = std::move( fn );
+    }
+
+    void Client::onConnect( ConnectFn fn )
+    {
+        onConnectHandler = std::move( fn );
+    }
+
+    void Client::onAuthing( AuthingFn fn )
+    {
+        onAuthingHandler = std::move( fn );
+    }
+
+    void Client::onAuth( AuthFn fn )
+    {
+        onAuthHandler = std::move( fn );
+    }
+
+    void Client::onReady( ReadyFn fn )
+    {
+        onReadyHandler = std::move( fn );
+    }
+
+    void Client::onDisconnect( DisconnectFn fn )
+    {
+        onDisconnectHandler = std::move( fn );
+    }
+
+    void Client::onBackpressure( BackpressureFn fn )
+    {
+        onBackpressureHandler = std::move( fn );
+    }
+
+    void Client::setSendLimits( const SendLimits & limits )
+    {
+        sendQueue.setLimits( limits );
+        // while the session is detached the replay buffer holds what the send queue admits, up to
+        // its hard limit, so none of it is evicted before the reconnect
+        replay.setLimit( 2 * sendQueue.limits( ).highWater );
+    }
+
+    void Client::handlerStart( int timeoutSeconds, std::function<void()> fn )
+    {
+        handlerCond.reset( );
+        handlerTimer = io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this, fn]( )
+            { fn( ); handlerCond.notify( Result::Timeout ); } );
+    }
+
+    Result Client::handlerWait( )
+    {
+        return handlerCond.wait( );
+    }
+
+    void Client::connect(
+        int timeoutSeconds,
+        ConnectFn fn )
+    {
+        if ( connectHandler )
+            { io.post( [=, this]( ) { fn( addr, Result::Retry, "Retry" ); } ); return; }
+        if ( addr.empty() )
+            { io.post( [=, this]( ) { fn( addr, Result::Route, "Route" ); } ); return; }
+        if ( isConnected )
+            { io.post( [=, this]( ) { fn( addr, Result::Ok, "Ok" ); } ); return; }
+
+        handlerStart( timeoutSeconds, [this, fn]()
+            { 
+                fn( addr, Result::Timeout, "Timeout" ); 
+                connectHandler = nullptr; 
+            } );
+        connectHandler = [=,this]( StrArg address, Result result, std::string reason )
+            { 
+                if ( result == Result::Ok )
+                {
+                    handlerTimer.cancel( );
+                    fn( address, result, reason );
+                }
+                if ( addr.empty( ) )
+                {
+                    handlerTimer.cancel( );
+                    fn( addr, Result::Route, "Route" );
+                }
+                connectHandler = nullptr;
+            };
+    }
+
+    bool Client::connect(
+        int timeoutSeconds,
+        StrOut address,
+        Result * result, StrOut reason )
+    {
+        bool isDone = false;
+        Result outResult = Result::Timeout;
+        connect( timeoutSeconds, [&]( StrArg inAddr, Result inResult, std::string inReason )
+            {
+                if ( address ) { *address = inAddr; }
+                if ( result ) { *result = inResult; }
+                if ( reason ) { *reason = inReason; }
+                outResult = inResult;
+                isDone = true;
+            } );
+        while ( !isDone ) { io.runOne( ); }
+        return outResult == Result::Ok;
+    }
+
+    void Client::auth( int timeoutSeconds, AuthFn fn )
+    {
+        // if isReady, post result immediately
+        if ( isAuthed )
+            { io.post( [this, fn]( ) { fn( email, 0, Result::Ok ); } ); return; }
+
+        // start a timer that will return timeout if it elapses before the readyHandler is called
+        authHandler = std::move( fn );
+        handlerTimer = io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
+            { authHandler( email, 0, Result::Timeout ); } );
+    }
+
+    bool Client::auth(
+        int timeoutSeconds,
+        StrOut emailOut,
+        uint64_t * sessionIdOut,
+        Result * result )
+    {
+        *result = Result::Ok;
+        if ( !isAuthed )
+        {
+            auto isAuthedCond = io.createCondition<Result>( );
+            authHandler = [&]( StrArg email, uint64_t sessionId, Result authResult )
+                { isAuthedCond.notify( authResult ); };
+            *result = isAuthedCond.wait( );
+        }
+        *emailOut = email;
+        *sessionIdOut = 0;
+
+        return *result == Result::Ok;
+    }
+
+    void Client::ready(
+        int timeoutSeconds,
+        ReadyFn fn )
+    {
+        // if isReady, post result immediately
+        if ( isReady )
+            { io.post( [this, fn]( ) { fn( Result::Ok ); } ); return; }
+
+        // start a timer that will return timeout if it elapses before the readyHandler is called
+        readyHandler = std::move( fn );
+        handlerTimer = io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
+            { readyHandler( Result::Timeout ); } );
+    }
+
+    bool Client::ready(
+        int timeoutSeconds,
+        Result * result )
+    {
+        *result = Result::Ok;
+        if ( !isReady )
+        {
+            auto isReadyCond = io.createCondition<Result>( );
+            readyHandler = [&]( Result readyResult )
+                { isReadyCond.notify( readyResult ); };
+            *result = isReadyCond.wait( );
+        }
+        return *result == Result::Ok;
+    }
+
+    void Client::send(
+        uint64_t toSessionId,
+        uint8_t type,
+        cpp::Memory data,
+        BindFn bindFunction )
+    {
+        uint16_t moniker = 0;
+        bool isBound = bindFunction != nullptr;
+        uint16_t bind = makeBind( std::move( bindFunction ), &moniker );
+        // refused (and already failed) rather than sent without a way back to the caller
+        if ( isBound && !bind )
+            { return; }
+
+        assert( data.length( ) < MaxMessageDataSize );
+        Message message;
+        message.len = ( data.length( ) + 7 ) / 8;
+        message.moniker = moniker;
+        message.bind = bind;
+        message.type = type;
+        message.result = 0;
+        message.toSessionId = toSessionId;
+        message.fromSessionId = sessionId;
+
+        queue( message, data );
+    }
+
+    void Client::send(
+        uint64_t toSessionId,
+        uint16_t moniker,
+        uint16_t bind,
+        uint8_t type,
+        uint8_t result,
+        cpp::Memory data )
+    {
+        assert( data.length( ) < MaxMessageDataSize );
+        Message message;
+        message.len = ( data.length( ) + 7 ) / 8;
+        // so the requester does not take it for a request of ours
+        message.moniker = moniker | ReplyMoniker;
+        message.bind = bind;
+        message.type = type;
+        message.result = result;
+        message.toSessionId = toSessionId;
+        message.fromSessionId = sessionId;
+
+        queue( message, data );
+    }
+
+    struct Client::Stream
+    {
+        uint64_t                            toSessionId;
+        uint16_t                            moniker;
+        uint16_t                            bind;
+        uint8_t                             type;
+        std::string                         data;
+        size_t                              offset;
+        uint32_t                            credits;
+        bool                                isPartPending;
+        BindFn                              bindFunction;
+    };
+
+    void Client::sendStream(
+        uint64_t toSessionId,
+        uint8_t type,
+        std::string data,
+        BindFn bindFunction )
+    {
+        // nothing to split, the receiver gets it as an ordinary request
+        if ( data.empty( ) )
+            { send( toSessionId, type, data, std::move( bindFunction ) ); return; }
+        auto stream = std::make_shared<Stream>( );
+        stream->toSessionId = toSessionId;
+        stream->type = type;
+        stream->data = std::move( data );
+        stream->offset = 0;
+        stream->credits = StreamWindow;
+        stream->isPartPending = false;
+        stream->bindFunction = std::move( bindFunction );
+        stream->bind = makeBind( [this, stream]( const Message & message, StrArg data )
+            { didStream( stream, message, data ); }, &stream->moniker );
+        if ( !stream->bind )
+            { return; }
+
+        auto open = cpp::StringBuffer::writeTo( 8 );
+        open.putBinary( (uint64_t)stream->data.size( ), ByteOrder );
+
+        Message message;
+        message.len = 1;
+        message.moniker = stream->moniker;
+        message.bind = stream->bind;
+        message.type = type;
+        message.result = (uint8_t)Result::More;
+        message.toSessionId = toSessionId;
+        message.fromSessionId = sessionId;
+        queue( message, open.getAll( ) );
+
+        doStreamPart( stream );
+    }
+
+    void Client::didStream( std::shared_ptr<Stream> stream, const Message & message, const cpp::Memory & data )
+    {
+        if ( message.result == (uint8_t)Result::More )
+        {
+            stream->credits += decodeStreamCredits( data );
+            doStreamPart( stream );
+            return;
+        }
+        // final reply, the bind has already been released
+        stream->offset = stream->data.size( );
+        if ( stream->bindFunction )
+            { stream->bindFunction( message, data ); }
+    }
+
+    void Client::doStreamPart( std::shared_ptr<Stream> stream )
+    {
+        if ( stream->isPartPending || !stream->credits || stream->offset >= stream->data.size( ) )
+            { return; }
+
+        // one part per io turn, so other messages on this connection are interleaved with the stream
+        stream->isPartPending = true;
+        io.post( [this, stream]( )
+            {
+                stream->isPartPending = false;
+                if ( !stream->credits || stream->offset >= stream->data.size( ) )
+                    { return; }
+
+                auto part = cpp::Memory{ stream->data }.substr( stream->offset, StreamPartSize );
+                stream->offset += part.length( );
+                stream->credits--;
+
+                Message message;
+                message.len = ( part.length( ) + 7 ) / 8;
+                message.moniker = stream->moniker;
+                message.bind = stream->bind;
+                message.type = stream->type;
+                message.result = (uint8_t)( stream->offset < stream->data.size( ) ? Result::More : Result::Ok );
+                message.toSessionId = stream->toSessionId;
+                message.fromSessionId = sessionId;
+                queue( message, part );
+
+                doStreamPart( stream );
+            } );
+    }
+
+    uint16_t Client::makeBind( BindFn bindFunction, uint16_t * moniker )
+    {
+        // unbound requests still get a moniker so they can be told apart on the wire
+        *moniker = makeMoniker( );
+        if ( !bindFunction )
+            { return 0; }
+
+        if ( binds.size( ) >= BindTable::MaxBinds )
+        {
+            // the caller hears of it as of any other request which did not get through
+            cpp::Log::error( "makeBind() : too many pending requests" );
+            io.post( [bindFunction = std::move( bindFunction )]( )
+                {
+                    Message message{ };
+                    message.result = (uint8_t)Result::Retry;
+                    bindFunction( message, cpp::Memory{ } );
+                } );
+            return 0;
+        }
+        uint64_t now = cpp::Time::now( ).sinceEpoch( ).millis( );
+        uint16_t bind = binds.add( std::move( bindFunction ), now + requestTimeoutSeconds * 1000, moniker );
+        if ( bind >= bindSent.size( ) )
+            { bindSent.resize( bind + 1 ); }
+        bindSent[bind] = Clock::now( );
+        if ( !isBindTimerPending )
+        {
+            isBindTimerPending = true;
+            bindTimer = io.waitFor( cpp::Duration::ofMillis( BindTable::TickMillis ), [this]( ) { doExpireBinds( ); } );
+        }
+        return bind;
+    }
+
+    uint16_t Client::makeMoniker( )
+    {
+        uint64_t t = cpp::Time::now( ).sinceEpoch( ).micros( );
+        return ( t & 0xffff ) ^ ( ( t >> 16 ) & 0xffff ) ^ ( ( t >> 32 ) & 0xffff ) ^ ( ( t >> 48 ) & 0xffff );
+    }
+
+    void Client::doExpireBinds( )
+    {
+        isBindTimerPending = false;
+        uint64_t now = cpp::Time::now( ).sinceEpoch( ).millis( );
+        binds.expire( now, [this]( uint16_t bind, uint16_t moniker, BindFn bindFunction )
+            {
+                Message message{ };
+                message.moniker = moniker;
+                message.bind = bind;
+                message.result = (uint8_t)Result::Timeout;
+                message.toSessionId = sessionId;
+                bindFunction( message, cpp::Memory{ } );
+            } );
+        if ( !binds.isEmpty( ) )
+        {
+            isBindTimerPending = true;
+            bindTimer = io.waitFor( cpp::Duration::ofMillis( BindTable::TickMillis ), [this]( ) { doExpireBinds( ); } );
+        }
+    }
+
+    bool Client::doResend( uint64_t proxyReceived )
+    {
+        bool isResent = replay.resend( proxyReceived, [this]( const char * frame, size_t frameSize )
+            {
+                // it may have been queued before this session was known
+                std::string resent{ frame, frameSize };
+                setFromSessionId( resent.data( ), sessionId );
+                writer.putResent( resent.data( ), resent.size( ) );
+            } );
+        if ( !writer.isEmpty( ) && !isFlushPending )
+        {
+            isFlushPending = true;
+            io.post( [this]( ) { flush( ); } );
+        }
+        return isResent;
+    }
+
+    void Client::failBind( const Message & message, Result result )
+    {
+        if ( !message.bind )
+            { return; }
+        BindFn bindFunction = binds.remove( (uint16_t)message.bind, (uint16_t)message.moniker );
+        if ( !bindFunction )
+            { return; }
+        // posted, as the caller is still inside send( )
+        io.post( [this, message, result, bindFunction = std::move( bindFunction )]( )
+            {
+                Message reply{ };
+                reply.moniker = message.moniker;
+                reply.bind = message.bind;
+                reply.result = (uint8_t)result;
+                reply.toSessionId = sessionId;
+                bindFunction( reply, cpp::Memory{ } );
+            } );
+    }
+
+    void Client::failBinds( Result result )
+    {
+        binds.clear( [this, result]( uint16_t bind, uint16_t moniker, BindFn bindFunction )
+            {
+                Message message{ };
+                message.moniker = moniker;
+                message.bind = bind;
+                message.result = (uint8_t)result;
+                message.toSessionId = sessionId;
+                bindFunction( message, cpp::Memory{ } );
+            } );
+    }
+
+    void Client::queue( const Message & message, cpp::Memory data )
+    {
+        if ( isSequenced( message ) )
+        {
+            size_t frameSize = MessageHeaderSize + data.length( ) + paddingOf( data.length( ) );
+            // kept until acked; until the session is (re)attached it waits there rather than
+            // reaching a proxy which would refuse it, bounded as the writer is
+            if ( !isAuthed )
+            {
+                auto verdict = sendQueue.admit( replay.bytes( ), frameSize, !message.bind );
+                if ( verdict != SendQueue::Verdict::Queue )
+                {
+                    // there is no connection to drop, so the frame is
+                    notifyBackpressure( );
+                    failBind( message, Result::Retry );
+                    return;
+                }
+                MessageWriter frame;
+                frame.put( message, data );
+                replay.push( frame.getAll( ).data( ), frame.size( ) );
+                notifyBackpressure( );
+                return;
+            }
+            auto verdict = sendQueue.admit( writer.size( ), frameSize, !message.bind );
+            if ( verdict != SendQueue::Verdict::Queue )
+            {
+                notifyBackpressure( );
+                failBind( message, Result::Retry );
+                // the proxy is not keeping up; a reconnect resumes from what it has acked
+                if ( verdict == SendQueue::Verdict::Disconnect )
+                    { io.post( [this]( ) { tcp.disconnect( ); } ); }
+                return;
+            }
+            // pushed to the replay buffer as it is sent, see flush( )
+            size_t offset = writer.size( );
+            writer.put( message, data );
+            netStats.countSent( message.type, writer.size( ) - offset );
+            notifyBackpressure( );
+        }
+        else
+        {
+            size_t offset = writer.size( );
+            writer.put( message, data );
+            netStats.countSent( message.type, writer.size( ) - offset );
+        }
+        // every message queued during this io turn is flushed with one send
+        if ( !isFlushPending )
+        {
+            isFlushPending = true;
+            io.post( [this]( ) { flush( ); } );
+        }
+    }
+
+    void Client::putAck( )
+    {
+        encode( Ack{ receivedCount }, &encodeBuffer );
+        Message message{ };
+        message.len = 1;
+        message.type = (uint8_t)Ack::Type;
+        message.fromSessionId = sessionId;
+        ackedCount = receivedCount;
+        unackedBytes = 0;
+        queue( message, encodeBuffer );
+    }
+
+    void Client::flush( )
+    {
+        // an ack rides along with anything else sent
+        if ( isAuthed && receivedCount > ackedCount && !writer.isEmpty( ) )
+            { putAck( ); }
+        isFlushPending = false;
+        // the writer holds what is queued until the proxy acks enough to reopen the window
+        if ( writer.isEmpty( ) || !sendQueue.canSend( ) )
+            { return; }
+        // frames are numbered for replay in the order they go on the wire, which is the order the
+        // proxy counts them in (control frames overtake bulk ones)
+        auto batch = writer.take( [this]( const char * frame, size_t frameSize )
+            {
+                if ( isSequenced( decodeHeader( frame ) ) )
+                    { replay.push( frame, frameSize ); }
+            } );
+        tcp.send( batch );
+        if ( isAuthed )
+            { sendQueue.sent( batch.length( ), replay.sent( ) ); }
+        // the rest of a bulk transfer goes next turn, behind whatever is queued meanwhile
+        if ( !writer.isEmpty( ) && !isFlushPending )
+        {
+            isFlushPending = true;
+            io.post( [this]( ) { flush( ); } );
+        }
+    }
+
+    void Client::notifyBackpressure( )
+    {
+        // while detached, what is pending is held in the replay buffer
+        size_t pending = isAuthed ? writer.size( ) : replay.bytes( );
+        if ( sendQueue.update( pending ) && onBackpressureHandler )
+            { onBackpressureHandler( addr, sendQueue.isBlocked( ), pending + sendQueue.inFlight( ) ); }
+    }
+
+    void Client::receive( const Message & message, const cpp::Memory & data )
+    {
+        netStats.countRecv( message.type, MessageHeaderSize + data.length( ) );
+        if ( isSequenced( message ) )
+        {
+            receivedCount++;
+            unackedBytes += MessageHeaderSize + data.length( );
+        }
+        else if ( message.type == (uint8_t)IProxyApi::MessageType::Ack )
+        {
+            Ack ack{ };
+            if ( decode( data, &ack ) )
+            {
+                replay.ack( ack.received );
+                sendQueue.ack( ack.received );
+            }
+            // the window may have reopened for whatever is waiting
+            if ( !writer.isEmpty( ) && !isFlushPending )
+            {
+                isFlushPending = true;
+                io.post( [this]( ) { flush( ); } );
+            }
+            notifyBackpressure( );
+            return;
+        }
+        if ( !message.bind )
+        {
+            if ( onRecvHandler )
+                { onRecvHandler( message, data ); }
+            return;
+        }
+        // the proxy only replies, another session's replies carry ReplyMoniker
+        if ( message.fromSessionId && !( message.moniker & ReplyMoniker ) )
+        {
+            receiveRequest( message, data );
+            return;
+        }
+        uint16_t moniker = message.moniker & ~ReplyMoniker;
+        // a multi-part reply keeps its bind (and extends its deadline) until the final part arrives
+        if ( message.result == (uint8_t)Result::More )
+        {
+            BindFn * bindFunction = binds.find( message.bind, moniker );
+            if ( !bindFunction )
+                { return; }
+            uint64_t now = cpp::Time::now( ).sinceEpoch( ).millis( );
+            binds.touch( message.bind, moniker, now + requestTimeoutSeconds * 1000 );
+            // copied, since the handler may add binds and move the slot it lives in
+            BindFn handler = *bindFunction;
+            handler( message, data );
+        }
+        else if ( BindFn bindFunction = binds.remove( message.bind, moniker ) )
+        {
+            netStats.bindRtt.record( Clock::now( ) - bindSent[message.bind] );
+            bindFunction( message, data );
+        }
+    }
+
+    void Client::receiveRequest( const Message & message, const cpp::Memory & data )
+    {
+        auto reply = [this]( const Message & request, Result result, const cpp::Memory & replyData )
+            { send( request.fromSessionId, request.moniker, request.bind, request.type, (uint8_t)result, replyData ); };
+        auto deliver = [this]( const Message & request, const cpp::Memory & requestData )
+            {
+                if ( onRecvHandler )
+                    { onRecvHandler( request, requestData ); }
+            };
+        uint64_t now = cpp::Time::now( ).sinceEpoch( ).millis( );
+        // a stream whose sender has gone quiet is dropped as its reply would time out
+        if ( message.result == (uint8_t)Result::More && streams.size( ) )
+            { streams.expire( now - requestTimeoutSeconds * 1000 ); }
+        if ( !streams.read( message, data, now, reply, deliver ) )
+            { deliver( message, data ); }
+    }
+
+    void Client::openUdp( uint16_t port )
+    {
+        if ( isUdpOpen )
+            { return; }
+        isUdpOpen = true;
+        udp.bind( io, "0.0.0.0:" + std::to_string( port ),
+            [this]( cpp::Memory from, cpp::Memory datagram )
+                { receiveUdp( datagram ); },
+            [this]( std::error_code error )
+                { cpp::Log::error( "openUdp() : msg='{}'", error.message( ) ); } );
+        if ( isAuthed )
+            { doOpenUdp( ); }
+    }
+
+    void Client::closeUdp( )
+    {
+        if ( !isUdpOpen )
+            { return; }
+        if ( udpKey )
+            { send( 0, 0, 0, (uint8_t)CloseUdpRequest::Type, 0, cpp::Memory{ } ); }
+        isUdpOpen = false;
+        udpKey = 0;
+        udpBatch.clear( );
+        udpSizes.clear( );
+        udp.close( );
+    }
+
+    void Client::sendUdp(
+        uint64_t toSessionId,
+        cpp::Memory data )
+    {
+        // best effort, like the datagram itself
+        if ( !udpKey || data.length( ) > MaxDatagramDataSize )
+            { return; }
+        queueUdp( toSessionId, data );
+    }
+
+    void Client::onRecvUdp( UdpFn fn )
+    {
+        onRecvUdpHandler = std::move( fn );
+    }
+
+    void Client::onRecv( BindFn fn )
+    {
+        onRecvHandler = std::move( fn );
+    }
+
+    void Client::setLane( uint8_t type, Lane lane )
+    {
+        writer.setLane( type, lane );
+    }
+
+    void Client::setTls( std::shared_ptr<TlsClientContext> tls )
+    {
+        this->tls = std::move( tls );
+    }
+
+    void Client::joinGroup( uint64_t groupId, uint64_t sessionId )
+    {
+        if ( !groups[groupId].insert( sessionId ).second || !isAuthed )
+            { return; }
+        doJoinGroup( groupId, sessionId );
+    }
+
+    void Client::leaveGroup( uint64_t groupId, uint64_t sessionId )
+    {
+        auto itr = groups.find( groupId );
+        if ( itr == groups.end( ) || !itr->second.erase( sessionId ) )
+            { return; }
+        if ( itr->second.empty( ) )
+            { groups.erase( itr ); }
+        if ( isAuthed )
+            { send( 0, GroupLeaveRequest{ groupId, sessionId }, nullptr ); }
+    }
+
+    void Client::closeGroup( uint64_t groupId )
+    {
+        if ( !groups.erase( groupId ) || !isAuthed )
+            { return; }
+        send( 0, GroupCloseRequest{ groupId }, nullptr );
+    }
+
+    void Client::doJoinGroups( )
+    {
+        for ( auto & [groupId, members] : groups )
+        {
+            for ( uint64_t sessionId : members )
+                { doJoinGroup( groupId, sessionId ); }
+        }
+    }
+
+    void Client::doJoinGroup( uint64_t groupId, uint64_t sessionId )
+    {
+        send( 0, GroupJoinRequest{ groupId, sessionId }, [this, groupId, sessionId]( const Message & msg, StrArg )
+            {
+                Result result = toResult( msg.result );
+                if ( result == Result::Ok || result == Result::Timeout )
+                    { return; }
+                cpp::Log::error( "joinGroup() : groupId={:x} result={}", groupId, std::to_underlying( result ) );
+                if ( result != Result::Access && result != Result::Arg )
+                    { return; }
+                auto itr = groups.find( groupId );
+                if ( itr != groups.end( ) && itr->second.erase( sessionId ) && itr->second.empty( ) )
+                    { groups.erase( itr ); }
+            } );
+    }
+
+    void Client::doOpenUdp( )
+    {
+        udpKey = 0;
+        send( 0, OpenUdpRequest{ udp.localAddress( ) }, [this]( const Message & msg, StrArg data )
+            {
+                Result result = toResult( msg.result );
+                OpenUdpReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                didOpenUdp( result, reply.key, reply.proxyPort );
+            } );
+    }
+
+    void Client::didOpenUdp( Result result, uint64_t key, uint16_t proxyPort )
+    {
+        if ( result != Result::Ok || !isUdpOpen )
+        {
+            cpp::Log::error( "didOpenUdp() : result={}", std::to_underlying( result ) );
+            return;
+        }
+        // the proxy relays datagrams on the port it listens on, at the address we connected to
+        proxyUdpAddr = addr.substr( 0, addr.find_last_of( ':' ) ) + ":" + std::to_string( proxyPort );
+        udpKey = key;
+        udpSeq = 0;
+        udpReplay.reset( );
+        // an empty datagram to no session tells the proxy where our datagrams come from
+        queueUdp( 0, cpp::Memory{ } );
+    }
+
+    void Client::queueUdp( uint64_t toSessionId, const cpp::Memory & data )
+    {
+        size_t offset = udpBatch.size( );
+        encodeDatagram( udpBatch, DatagramHeader{ toSessionId, sessionId, ++udpSeq }, udpKey, data );
+        udpSizes.push_back( (uint32_t)( udpBatch.size( ) - offset ) );
+        // every datagram queued during this io turn is sent together
+        if ( !isUdpFlushPending )
+        {
+            isUdpFlushPending = true;
+            io.post( [this]( ) { flushUdp( ); } );
+        }
+    }
+
+    void Client::flushUdp( )
+    {
+        isUdpFlushPending = false;
+        size_t offset = 0;
+        for ( uint32_t size : udpSizes )
+        {
+            udp.send( proxyUdpAddr, cpp::Memory{ udpBatch }.substr( offset, size ) );
+            offset += size;
+        }
+        udpBatch.clear( );
+        udpSizes.clear( );
+    }
+
+    void Client::receiveUdp( const cpp::Memory & datagram )
+    {
+        // only the proxy holds our key, so a verified datagram came through it
+        DatagramHeader header;
+        cpp::Memory data;
+        if ( !udpKey || !decodeDatagram( datagram, &header, &data ) || header.toSessionId != sessionId )
+            { return; }
+        if ( !verifyDatagram( datagram, udpKey ) || !udpReplay.accept( header.seq ) )
+            { return; }
+        if ( onRecvUdpHandler )
+            { onRecvUdpHandler( header.fromSessionId, data ); }
+    }
+
+
+    const NetStats & Client::stats( ) const
+    {
+        return netStats;
+    }
+
+    void Client::requestStats( StatsFn fn )
+    {
+        send( 0, StatsRequest{ }, [fn]( const Message & msg, StrArg data )
+            {
+                Result result = toResult( msg.result );
+                StatsReply reply{ };
+                if ( !decode( data, &reply ) && result == Result::Ok )
+                    { result = Result::Unknown; }
+                fn( result, reply.text );
+            } );
+    }
+
+    cpp::AsyncContext & Client::getAsyncContext( )
+    {
+        return io;
+    }
+
+
+    ProxyApi::ProxyApi( Client & client )
+        : m_client(client)
+    {
+    }
+
+    void ProxyApi::hello( auth::AuthToken authToken, OnHello handler )
+    {
+        m_client.send( 0, HelloRequest{ authToken.value }, [handler]( const Message & msg, StrArg data )
+            {
+                Result result = toResult( msg.result );
+                HelloReply reply{ };
+                if ( !decode( data, &reply ) && result == Result::Ok )
+                    { result = Result::Unknown; }
+                handler( result, reply.email, reply.sessionId );
+            } );
+    }
+
+    void ProxyApi::rello( uint64_t sessionId, OnRello handler )
+    {
+        m_client.send( 0, RelloRequest{ sessionId }, [handler]( const Message & msg, StrArg data )
+            {
+                Result result = toResult( msg.result );
+                handler( result );
+            } );
+    }
+
+    void ProxyApi::resume( uint64_t sessionId, uint64_t receivedCount, OnResume handler )
+    {
+        m_client.send( 0, ResumeRequest{ sessionId, receivedCount }, [handler]( const Message & msg, StrArg data )
+            {
+                Result result = toResult( msg.result );
+                // a proxy which could not resume the stream replies without a count
+                ResumeReply reply{ };
+                bool isResumed = decode( data, &reply ) && result == Result::Ok;
+                handler( result, isResumed, reply.proxyReceived );
+            } );
+    }
+
+    void ProxyApi::authServer( StrArg svcName, int nodeId, AuthServerReply handler )
+    {
+        m_client.send( 0, AuthServerRequest{ std::string{ svcName }, nodeId }, [handler]( const Message & msg, StrArg data )
+            {
+                Result result = toResult( msg.result );
+                net::AuthServerReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                handler( result, reply.email, reply.sessionId );
+            } );
+    }
+
+    void ProxyApi::findServer( StrArg svcName, int nodeId, FindServerReply handler )
+    {
+        m_client.send( 0, FindServerRequest{ std::string{ svcName }, nodeId }, [handler]( const Message & msg, StrArg data )
+            {
+                Result result = toResult( msg.result );
+                net::FindServerReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                handler( result, reply.sessionId );
+            } );
+    }
+
+    void ProxyApi::openUdp( uint16_t port )
+    {
+        m_client.openUdp( port );
+    }
+
+    void ProxyApi::closeUdp( )
+    {
+        m_client.closeUdp( );
+    }
+
+    void ProxyApi::sendUdp( uint64_t toSessionId, cpp::Memory data )
+    {
+        m_client.sendUdp( toSessionId, data );
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,368 @@
+module;
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <string>
+#include <system_error>
+#include <vector>
+
+export module grim.net.datagram;
+
+import cpp.asio.tcp;
+import cpp.asio.udp;
+import cpp.log;
+import cpp.memory;
+import grim.arch.net;
+import grim.net.message;
+
+export namespace grim::net
+{
+    //! A datagram is a session header, the data and a tag, in the wire byte order:
+    //!     * header: toSessionId (8), fromSessionId (8), seq (4)
+    //!     * tag (8): SipHash-2-4 of the header and the data, keyed by the session key
+    //! A datagram is sent to and from the proxy, which checks the tag with the sender's key and
+    //! signs it again with the receiver's key.
+    struct DatagramHeader
+    {
+        uint64_t                            toSessionId = 0;
+        uint64_t                            fromSessionId = 0;
+        uint32_t                            seq = 0;
+    };
+    constexpr size_t                        DatagramHeaderSize = 20;
+    constexpr size_t                        DatagramTagSize = 8;
+    //! keeps a datagram within the minimum IPv6 MTU, so it is never fragmented
+    constexpr size_t                        MaxDatagramSize = 1232;
+    constexpr size_t                        MaxDatagramDataSize = MaxDatagramSize - DatagramHeaderSize - DatagramTagSize;
+
+    //! appends the signed datagram to `out`
+    void                                    encodeDatagram( std::string & out, const DatagramHeader & header, uint64_t key, const cpp::Memory & data );
+    //! reads the header (without checking the tag), false if `datagram` is too short
+    bool                                    decodeDatagram( const cpp::Memory & datagram, DatagramHeader * header, cpp::Memory * data );
+    bool                                    verifyDatagram( const cpp::Memory & datagram, uint64_t key );
+    //! rewrites the fromSessionId and seq of a datagram in place and signs it with `key`
+    void                                    signDatagram( char * datagram, size_t size, uint64_t fromSessionId, uint32_t seq, uint64_t key );
+    uint64_t                                sipHash( uint64_t k0, uint64_t k1, const char * data, size_t size );
+
+    //! Rejects replayed (or very late) datagrams: a seq is accepted once, and only if it is within
+    //! the last 64 seqs seen.
+    class ReplayWindow
+    {
+    public:
+        bool                                accept( uint32_t seq );
+        void                                reset( );
+    private:
+        uint32_t                            m_top = 0;
+        uint64_t                            m_seen = 0;
+    };
+
+    namespace test
+    {
+        void                                testDatagram( );
+        //! logs the cpu cost of signing and verifying a datagram, and the one-way latency (p50 and
+        //! p99) of `sampleCount` ping-pongs over loopback UDP and TCP
+        void                                benchDatagram( size_t sampleCount = 10000 );
+    };
+}
+
+namespace grim::net
+{
+    void putDatagramField( char * out, uint64_t value, size_t bytes )
+    {
+        for ( size_t i = 0; i < bytes; i++ )
+            { out[i] = (char)( value >> ( 8 * ( bytes - 1 - i ) ) ); }
+    }
+
+    uint64_t getDatagramField( const char * in, size_t bytes )
+    {
+        uint64_t value = 0;
+        for ( size_t i = 0; i < bytes; i++ )
+            { value = ( value << 8 ) | (uint8_t)in[i]; }
+        return value;
+    }
+
+    uint64_t rotl( uint64_t x, int b )
+    {
+        return ( x << b ) | ( x >> ( 64 - b ) );
+    }
+
+    uint64_t sipHash( uint64_t k0, uint64_t k1, const char * data, size_t size )
+    {
+        uint64_t v0 = 0x736f6d6570736575ull ^ k0;
+        uint64_t v1 = 0x646f72616e646f6dull ^ k1;
+        uint64_t v2 = 0x6c7967656e657261ull ^ k0;
+        uint64_t v3 = 0x7465646279746573ull ^ k1;
+        auto round = [&]( )
+            {
+                v0 += v1; v1 = rotl( v1, 13 ); v1 ^= v0; v0 = rotl( v0, 32 );
+                v2 += v3; v3 = rotl( v3, 16 ); v3 ^= v2;
+                v0 += v3; v3 = rotl( v3, 21 ); v3 ^= v0;
+                v2 += v1; v1 = rotl( v1, 17 ); v1 ^= v2; v2 = rotl( v2, 32 );
+            };
+
+        size_t end = size - ( size % 8 );
+        for ( size_t i = 0; i < end; i += 8 )
+        {
+            uint64_t m = 0;
+            for ( size_t j = 0; j < 8; j++ )
+                { m |= (uint64_t)(uint8_t)data[i + j] << ( 8 * j ); }
+            v3 ^= m;
+            round( );
+            round( );
+            v0 ^= m;
+        }
+        uint64_t last = (uint64_t)( size & 0xff ) << 56;
+        for ( size_t j = 0; j < size % 8; j++ )
+            { last |= (uint64_t)(uint8_t)data[end + j] << ( 8 * j ); }
+        v3 ^= last;
+        round( );
+        round( );
+        v0 ^= last;
+
+        v2 ^= 0xff;
+        for ( int i = 0; i < 4; i++ )
+            { round( ); }
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+
+    uint64_t datagramTag( uint64_t key, const char * datagram, size_t size )
+    {
+        // the second half of the siphash key is derived from the session key
+        return sipHash( key, key ^ 0x9e3779b97f4a7c15ull, datagram, size - DatagramTagSize );
+    }
+
+    void encodeDatagram( std::string & out, const DatagramHeader & header, uint64_t key, const cpp::Memory & data )
+    {
+        size_t offset = out.size( );
+        size_t size = DatagramHeaderSize + data.length( ) + DatagramTagSize;
+        out.resize( offset + size );
+        char * datagram = out.data( ) + offset;
+        putDatagramField( datagram + 0, header.toSessionId, 8 );
+        if ( data.length( ) )
+            { std::memcpy( datagram + DatagramHeaderSize, data.data( ), data.length( ) ); }
+        signDatagram( datagram, size, header.fromSessionId, header.seq, key );
+    }
+
+    bool decodeDatagram( const cpp::Memory & datagram, DatagramHeader * header, cpp::Memory * data )
+    {
+        if ( datagram.length( ) < DatagramHeaderSize + DatagramTagSize || datagram.length( ) > MaxDatagramSize )
+            { return false; }
+        const char * in = datagram.data( );
+        header->toSessionId = getDatagramField( in + 0, 8 );
+        header->fromSessionId = getDatagramField( in + 8, 8 );
+        header->seq = (uint32_t)getDatagramField( in + 16, 4 );
+        *data = datagram.substr( DatagramHeaderSize, datagram.length( ) - DatagramHeaderSize - DatagramTagSize );
+        return true;
+    }
+
+    bool verifyDatagram( const cpp::Memory & datagram, uint64_t key )
+    {
+        size_t size = datagram.length( );
+        if ( size < DatagramHeaderSize + DatagramTagSize )
+            { return false; }
+        return getDatagramField( datagram.data( ) + size - DatagramTagSize, 8 ) == datagramTag( key, datagram.data( ), size );
+    }
+
+    void signDatagram( char * datagram, size_t size, uint64_t fromSessionId, uint32_t seq, uint64_t key )
+    {
+        putDatagramField( datagram + 8, fromSessionId, 8 );
+        putDatagramField( datagram + 16, seq, 4 );
+        putDatagramField( datagram + size - DatagramTagSize, datagramTag( key, datagram, size ), 8 );
+    }
+
+    bool ReplayWindow::accept( uint32_t seq )
+    {
+        // seqs wrap, so distances are taken modulo 2^32
+        int32_t ahead = (int32_t)( seq - m_top );
+        if ( ahead > 0 )
+        {
+            m_seen = ahead >= 64 ? 0 : m_seen << ahead;
+            m_seen |= 1;
+            m_top = seq;
+            return true;
+        }
+        uint32_t behind = (uint32_t)-ahead;
+        if ( behind >= 64 || ( m_seen & ( 1ull << behind ) ) )
+            { return false; }
+        m_seen |= 1ull << behind;
+        return true;
+    }
+
+    void ReplayWindow::reset( )
+    {
+        m_top = 0;
+        m_seen = 0;
+    }
+
+    namespace test
+    {
+        void testDatagram( )
+        {
+            const uint64_t Key = 0x0123456789abcdefull;
+            std::string datagram;
+            encodeDatagram( datagram, DatagramHeader{ 2, 1, 7 }, Key, std::string{ "view update" } );
+
+            DatagramHeader header;
+            cpp::Memory data;
+            if ( !decodeDatagram( datagram, &header, &data ) || header.toSessionId != 2 || header.fromSessionId != 1 || header.seq != 7 || std::string{ data } != "view update" )
+                { throw std::exception{ "decodeDatagram( )" }; }
+            if ( !verifyDatagram( datagram, Key ) || verifyDatagram( datagram, Key + 1 ) )
+                { throw std::exception{ "verifyDatagram( key )" }; }
+            std::string tampered = datagram;
+            tampered[DatagramHeaderSize] ^= 1;
+            if ( verifyDatagram( tampered, Key ) )
+                { throw std::exception{ "verifyDatagram( tampered )" }; }
+
+            // the proxy re-signs for the receiver
+            signDatagram( datagram.data( ), datagram.size( ), 1, 100, Key + 1 );
+            if ( !verifyDatagram( datagram, Key + 1 ) || verifyDatagram( datagram, Key ) )
+                { throw std::exception{ "signDatagram( )" }; }
+
+            ReplayWindow window;
+            if ( !window.accept( 1 ) || !window.accept( 3 ) || !window.accept( 2 ) || window.accept( 2 ) || window.accept( 3 ) )
+                { throw std::exception{ "window.accept( )" }; }
+            if ( !window.accept( 100 ) || window.accept( 36 ) || !window.accept( 37 ) )
+                { throw std::exception{ "window.accept( late )" }; }
+        }
+
+        void benchDatagram( size_t sampleCount )
+        {
+            const uint64_t Key = 0x0123456789abcdefull;
+            using Clock = std::chrono::steady_clock;
+
+            // cpu cost, a typical view update is a few hundred bytes
+            {
+                std::string payload( 256, 'x' );
+                std::string datagram;
+                size_t count = sampleCount * 100;
+                size_t verified = 0;
+                auto start = Clock::now( );
+                for ( size_t i = 0; i < count; i++ )
+                {
+                    datagram.clear( );
+                    encodeDatagram( datagram, DatagramHeader{ 2, 1, (uint32_t)i }, Key, payload );
+                    verified += verifyDatagram( datagram, Key );
+                }
+                std::chrono::duration<double, std::nano> elapsed = Clock::now( ) - start;
+                if ( verified != count )
+                    { throw std::exception{ "benchDatagram( verify )" }; }
+                cpp::Log::info( "datagram : sign + verify {:.0f}ns/packet", elapsed.count( ) / count );
+            }
+
+            auto report = [&]( const char * name, std::vector<double> & latency )
+                {
+                    std::sort( latency.begin( ), latency.end( ) );
+                    if ( latency.empty( ) )
+                        { cpp::Log::error( "{} : no samples", name ); return; }
+                    cpp::Log::info( "{} : {} samples, p50 {:.1f}us, p99 {:.1f}us", name, latency.size( ),
+                        latency[latency.size( ) / 2], latency[latency.size( ) * 99 / 100] );
+                };
+            auto stamp = []( )
+                { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now( ).time_since_epoch( ) ).count( ); };
+            auto elapsedMicros = [&]( uint64_t sent )
+                { return ( stamp( ) - sent ) / 1000.0; };
+
+            // udp: one signed datagram at a time, echoed back, each leg timed
+            {
+                cpp::AsyncContext io;
+                cpp::UdpClient a;
+                cpp::UdpClient b;
+                std::vector<double> latency;
+                latency.reserve( sampleCount * 2 );
+                auto send = [&]( cpp::UdpClient & from, const std::string & to )
+                    {
+                        std::string datagram;
+                        uint64_t sent = stamp( );
+                        encodeDatagram( datagram, DatagramHeader{ 2, 1, (uint32_t)latency.size( ) }, Key, cpp::Memory::ofValue( sent ) );
+                        from.send( to, datagram );
+                    };
+                auto recv = [&]( cpp::UdpClient & self, cpp::Memory from, cpp::Memory datagram )
+                    {
+                        DatagramHeader header;
+                        cpp::Memory data;
+                        if ( !decodeDatagram( datagram, &header, &data ) || !verifyDatagram( datagram, Key ) || data.length( ) < 8 )
+                            { return; }
+                        uint64_t sent;
+                        std::memcpy( &sent, data.data( ), 8 );
+                        latency.push_back( elapsedMicros( sent ) );
+                        if ( latency.size( ) < sampleCount * 2 )
+                            { send( self, from ); }
+                        else
+                        {
+                            a.close( );
+                            b.close( );
+                        }
+                    };
+                a.bind( io, "127.0.0.1:0", [&]( cpp::Memory from, cpp::Memory data ) { recv( a, from, data ); }, []( std::error_code ) { } );
+                b.bind( io, "127.0.0.1:0", [&]( cpp::Memory from, cpp::Memory data ) { recv( b, from, data ); }, []( std::error_code ) { } );
+                send( a, b.localAddress( ) );
+                io.run( );
+                report( "udp one-way", latency );
+            }
+
+            // tcp: the same exchange as message frames over one connection
+            {
+                cpp::AsyncContext io;
+                cpp::TcpServer server;
+                cpp::TcpClient client;
+                MessageReader serverReader;
+                MessageReader clientReader;
+                std::vector<double> latency;
+                latency.reserve( sampleCount * 2 );
+                auto frame = [&]( )
+                    {
+                        MessageWriter writer;
+                        Message message{ };
+                        message.len = 1;
+                        message.fromSessionId = 1;
+                        message.toSessionId = 2;
+                        writer.put( message, cpp::Memory::ofValue( stamp( ) ) );
+                        return std::string{ writer.getAll( ) };
+                    };
+                // returns false once every sample is taken
+                auto recv = [&]( MessageReader & reader, std::string & recvBuffer )
+                    {
+                        bool isDone = false;
+                        reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                            {
+                                uint64_t sent;
+                                std::memcpy( &sent, data.data( ), 8 );
+                                latency.push_back( elapsedMicros( sent ) );
+                                isDone = latency.size( ) >= sampleCount * 2;
+                            } );
+                        return !isDone;
+                    };
+                server.open( io, "127.0.0.1:43299", "",
+                    []( std::error_code, const std::string & ) { },
+                    [&]( const std::string & addr, std::string & recvBuffer )
+                    {
+                        if ( recv( serverReader, recvBuffer ) )
+                            { server.send( addr, frame( ) ); }
+                        else
+                            { client.close( ); server.close( ); }
+                    },
+                    []( const std::string &, std::error_code ) { },
+                    nullptr );
+                client.connect( *io, "127.0.0.1:43299",
+                    [&]( std::error_code connectResult )
+                    {
+                        if ( !connectResult )
+                            { client.send( frame( ) ); }
+                    },
+                    [&]( std::string & recvBuffer )
+                    {
+                        if ( recv( clientReader, recvBuffer ) )
+                            { client.send( frame( ) ); }
+                        else
+                            { client.close( ); server.close( ); }
+                    },
+                    []( std::error_code ) { }, "" );
+                io.run( );
+                report( "tcp one-way", latency );
+            }
+        }
+    }
+}
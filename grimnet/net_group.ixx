@@ -0,0 +1,165 @@
+module;
+
+#include <algorithm>
+#include <cinttypes>
+#include <compare>
+#include <exception>
+#include <map>
+#include <vector>
+
+export module grim.net.group;
+
+import grim.arch.net;
+
+export namespace grim::net
+{
+    //! The groups of sessions a proxy shard keeps for the sessions connected to it, so a service
+    //! sends a view update once and the proxy copies it to each member (see ProxyServer::sendGroup).
+    //! Groups are keyed by their owner as well as their id, so services choose ids without
+    //! colliding.  Members are kept in join order; groups are small enough that a scan beats a set.
+    //! Each owner's groups, and each group's members, are capped so one session cannot grow a
+    //! shard's table without bound.
+    class GroupTable
+    {
+    public:
+        static constexpr size_t             MaxMembers = 4096;
+        static constexpr size_t             MaxGroupsPerOwner = 1024;
+
+        //! creates the group with its first member.  Joining again is Ok (a client rejoins after
+        //! a reconnect); Result::Arg for no session, Result::Retry if the group has MaxMembers or
+        //! would be its owner's group past MaxGroupsPerOwner.
+        Result                              join( uint64_t owner, uint64_t groupId, uint64_t sessionId );
+        //! the group is closed with its last member
+        bool                                leave( uint64_t owner, uint64_t groupId, uint64_t sessionId );
+        bool                                close( uint64_t owner, uint64_t groupId );
+        //! closes every group `owner` has, once its session is gone
+        size_t                              closeAll( uint64_t owner );
+        //! nullptr if there is no such group
+        const std::vector<uint64_t> *       find( uint64_t owner, uint64_t groupId ) const;
+        size_t                              size( ) const;
+    private:
+        struct Key
+        {
+            uint64_t                        owner;
+            uint64_t                        groupId;
+            auto                            operator<=>( const Key & ) const = default;
+        };
+        std::map<Key, std::vector<uint64_t>> m_groups;
+    };
+
+    namespace test
+    {
+        void                                testGroupTable( );
+    };
+}
+
+namespace grim::net
+{
+    Result GroupTable::join( uint64_t owner, uint64_t groupId, uint64_t sessionId )
+    {
+        if ( !sessionId )
+            { return Result::Arg; }
+        auto itr = m_groups.find( Key{ owner, groupId } );
+        if ( itr == m_groups.end( ) )
+        {
+            // an owner's groups are adjacent, and only counted as far as the cap
+            size_t count = 0;
+            for ( auto other = m_groups.lower_bound( Key{ owner, 0 } ); other != m_groups.end( ) && other->first.owner == owner; ++other )
+            {
+                if ( ++count >= MaxGroupsPerOwner )
+                    { return Result::Retry; }
+            }
+            m_groups[Key{ owner, groupId }].push_back( sessionId );
+            return Result::Ok;
+        }
+        auto & members = itr->second;
+        if ( std::find( members.begin( ), members.end( ), sessionId ) != members.end( ) )
+            { return Result::Ok; }
+        if ( members.size( ) >= MaxMembers )
+            { return Result::Retry; }
+        members.push_back( sessionId );
+        return Result::Ok;
+    }
+
+    bool GroupTable::leave( uint64_t owner, uint64_t groupId, uint64_t sessionId )
+    {
+        auto itr = m_groups.find( Key{ owner, groupId } );
+        if ( itr == m_groups.end( ) )
+            { return false; }
+        auto & members = itr->second;
+        auto member = std::find( members.begin( ), members.end( ), sessionId );
+        if ( member == members.end( ) )
+            { return false; }
+        members.erase( member );
+        if ( members.empty( ) )
+            { m_groups.erase( itr ); }
+        return true;
+    }
+
+    bool GroupTable::close( uint64_t owner, uint64_t groupId )
+    {
+        return m_groups.erase( Key{ owner, groupId } ) != 0;
+    }
+
+    size_t GroupTable::closeAll( uint64_t owner )
+    {
+        auto first = m_groups.lower_bound( Key{ owner, 0 } );
+        auto last = first;
+        size_t count = 0;
+        for ( ; last != m_groups.end( ) && last->first.owner == owner; ++last )
+            { count++; }
+        m_groups.erase( first, last );
+        return count;
+    }
+
+    const std::vector<uint64_t> * GroupTable::find( uint64_t owner, uint64_t groupId ) const
+    {
+        auto itr = m_groups.find( Key{ owner, groupId } );
+        return itr == m_groups.end( ) ? nullptr : &itr->second;
+    }
+
+    size_t GroupTable::size( ) const
+    {
+        return m_groups.size( );
+    }
+
+    namespace test
+    {
+        void testGroupTable( )
+        {
+            GroupTable groups;
+            for ( uint64_t sessionId = 1; sessionId <= 100; sessionId++ )
+                { groups.join( 7, 1, sessionId ); }
+            groups.join( 7, 2, 50 );
+            groups.join( 8, 1, 50 );
+            if ( groups.join( 7, 1, 50 ) != Result::Ok || groups.join( 7, 1, 0 ) != Result::Arg )
+                { throw std::exception{ "groups.join( )" }; }
+            auto members = groups.find( 7, 1 );
+            if ( !members || members->size( ) != 100 || members->front( ) != 1 || groups.find( 9, 1 ) || groups.size( ) != 3 )
+                { throw std::exception{ "groups.find( )" }; }
+
+            for ( uint64_t sessionId = 1; sessionId <= 100; sessionId += 2 )
+                { groups.leave( 7, 1, sessionId ); }
+            if ( groups.leave( 7, 1, 1 ) || groups.find( 7, 1 )->size( ) != 50 || groups.find( 7, 1 )->front( ) != 2 )
+                { throw std::exception{ "groups.leave( )" }; }
+            // the last member out closes the group
+            groups.leave( 7, 2, 50 );
+            if ( groups.find( 7, 2 ) || groups.size( ) != 2 )
+                { throw std::exception{ "groups.leave( last )" }; }
+
+            // another owner's group of the same id is untouched
+            if ( groups.closeAll( 7 ) != 1 || groups.find( 7, 1 ) || !groups.find( 8, 1 ) || groups.close( 8, 2 ) || !groups.close( 8, 1 ) )
+                { throw std::exception{ "groups.closeAll( )" }; }
+
+            // full groups, and an owner with too many, take no more; other owners are unaffected
+            for ( uint64_t sessionId = 1; sessionId <= GroupTable::MaxMembers; sessionId++ )
+                { groups.join( 9, 1, sessionId ); }
+            if ( groups.join( 9, 1, GroupTable::MaxMembers + 1 ) != Result::Retry || groups.join( 9, 1, 1 ) != Result::Ok )
+                { throw std::exception{ "groups.join( MaxMembers )" }; }
+            for ( uint64_t groupId = 2; groupId <= GroupTable::MaxGroupsPerOwner; groupId++ )
+                { groups.join( 9, groupId, 1 ); }
+            if ( groups.join( 9, GroupTable::MaxGroupsPerOwner + 1, 1 ) != Result::Retry || groups.join( 9, 2, 2 ) != Result::Ok || groups.join( 10, 1, 1 ) != Result::Ok )
+                { throw std::exception{ "groups.join( MaxGroupsPerOwner )" }; }
+        }
+    }
+}
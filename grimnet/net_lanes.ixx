@@ -0,0 +1,246 @@
+module;
+
+#include <array>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <string>
+#include <utility>
+
+export module grim.net.lanes;
+
+import cpp.memory;
+import grim.arch.net;
+import grim.net.message;
+import grim.net.stream;
+
+export namespace grim::net
+{
+    //! A connection's outbound frames by priority.  Frames of the types set to the bulk lane
+    //! (content downloads, say) go out at most BulkQuantum bytes per flush, at frame boundaries, so
+    //! control frames queued behind a large transfer wait for one quantum rather than all of it.
+    //! Frames keep their order within a lane, so a type's messages (and a stream's parts) are
+    //! never reordered.  Frames to or from the server itself (session id 0) are always control.
+    enum class                              Lane : uint8_t { Control, Bulk };
+    //! one stream part; at least one bulk frame is taken per flush, however large
+    constexpr size_t                        BulkQuantum = StreamPartSize;
+
+    class LaneWriter
+    {
+    public:
+        using                               FrameFn = std::function<void( const char * frame, size_t frameSize )>;
+
+        void                                setLane( uint8_t type, Lane lane );
+        Lane                                laneOf( const Message & message ) const;
+
+        void                                put( const Message & message, const cpp::Memory & data );
+        void                                putFrame( const char * frame, size_t frameSize );
+        //! frames sent once already and held for replay (see ReplayBuffer): they go ahead of
+        //! everything else, and are not handed to take()'s `fn` again
+        void                                putResent( const char * frames, size_t size );
+
+        //! what goes on the wire now: the resent frames, every control frame, then bulk frames up
+        //! to BulkQuantum.  `fn` is given each frame taken (besides those resent) in the order they
+        //! are sent, so the caller numbers them for replay in wire order.  The view is valid until
+        //! the next call which changes the writer.
+        cpp::Memory                         take( const FrameFn & fn );
+        //! hands every frame not yet taken to `fn`, in the order take( ) would, and empties the writer
+        void                                drain( const FrameFn & fn );
+
+        bool                                isEmpty( ) const;
+        size_t                              size( ) const;
+        void                                clear( );
+    private:
+        static void                         each( const char * frames, size_t size, const FrameFn & fn );
+
+        std::array<Lane, 256>               m_lanes{ };
+        MessageWriter                       m_resent;
+        MessageWriter                       m_control;
+        //! taken from the front, so the consumed bytes are tracked by offset
+        std::string                         m_bulk;
+        size_t                              m_bulkOffset = 0;
+        MessageWriter                       m_batch;
+    };
+
+    namespace test
+    {
+        void                                testLaneWriter( );
+    };
+}
+
+namespace grim::net
+{
+    void LaneWriter::setLane( uint8_t type, Lane lane )
+    {
+        m_lanes[type] = lane;
+    }
+
+    Lane LaneWriter::laneOf( const Message & message ) const
+    {
+        if ( !message.toSessionId || !message.fromSessionId )
+            { return Lane::Control; }
+        return m_lanes[message.type];
+    }
+
+    void LaneWriter::put( const Message & message, const cpp::Memory & data )
+    {
+        if ( laneOf( message ) == Lane::Control )
+            { m_control.put( message, data ); return; }
+        size_t offset = m_bulk.size( );
+        // resize zero fills, which also writes the padding
+        m_bulk.resize( offset + MessageHeaderSize + data.length( ) + paddingOf( data.length( ) ) );
+        encodeHeader( m_bulk.data( ) + offset, message );
+        if ( data.length( ) )
+            { std::memcpy( m_bulk.data( ) + offset + MessageHeaderSize, data.data( ), data.length( ) ); }
+    }
+
+    void LaneWriter::putFrame( const char * frame, size_t frameSize )
+    {
+        if ( laneOf( decodeHeader( frame ) ) == Lane::Control )
+            { m_control.putFrame( frame, frameSize ); }
+        else
+            { m_bulk.append( frame, frameSize ); }
+    }
+
+    void LaneWriter::putResent( const char * frames, size_t size )
+    {
+        m_resent.putFrame( frames, size );
+    }
+
+    void LaneWriter::each( const char * frames, size_t size, const FrameFn & fn )
+    {
+        for ( size_t offset = 0; offset + MessageHeaderSize <= size; )
+        {
+            Message header = decodeHeader( frames + offset );
+            size_t frameSize = MessageHeaderSize + (size_t)header.len * MessageAlignment;
+            fn( frames + offset, frameSize );
+            offset += frameSize;
+        }
+    }
+
+    cpp::Memory LaneWriter::take( const FrameFn & fn )
+    {
+        auto control = m_control.getAll( );
+        each( control.data( ), control.length( ), fn );
+        // with nothing resent or bulk, the control frames are the batch as they are
+        if ( m_resent.isEmpty( ) && m_bulkOffset == m_bulk.size( ) )
+        {
+            std::swap( m_batch, m_control );
+            m_control.clear( );
+            return m_batch.getAll( );
+        }
+
+        m_batch.clear( );
+        auto resent = m_resent.getAll( );
+        m_batch.putFrame( resent.data( ), resent.length( ) );
+        m_batch.putFrame( control.data( ), control.length( ) );
+        m_resent.clear( );
+        m_control.clear( );
+        size_t taken = 0;
+        while ( m_bulkOffset + MessageHeaderSize <= m_bulk.size( ) && ( taken == 0 || taken < BulkQuantum ) )
+        {
+            const char * frame = m_bulk.data( ) + m_bulkOffset;
+            Message header = decodeHeader( frame );
+            size_t frameSize = MessageHeaderSize + (size_t)header.len * MessageAlignment;
+            fn( frame, frameSize );
+            m_batch.putFrame( frame, frameSize );
+            m_bulkOffset += frameSize;
+            taken += frameSize;
+        }
+        // compacted once half is consumed, so a long transfer is not shifted once per quantum
+        if ( m_bulkOffset == m_bulk.size( ) )
+        {
+            m_bulk.clear( );
+            m_bulkOffset = 0;
+        }
+        else if ( m_bulkOffset > m_bulk.size( ) / 2 )
+        {
+            m_bulk.erase( 0, m_bulkOffset );
+            m_bulkOffset = 0;
+        }
+        return m_batch.getAll( );
+    }
+
+    void LaneWriter::drain( const FrameFn & fn )
+    {
+        auto control = m_control.getAll( );
+        each( control.data( ), control.length( ), fn );
+        each( m_bulk.data( ) + m_bulkOffset, m_bulk.size( ) - m_bulkOffset, fn );
+        clear( );
+    }
+
+    bool LaneWriter::isEmpty( ) const
+    {
+        return m_resent.isEmpty( ) && m_control.isEmpty( ) && m_bulkOffset == m_bulk.size( );
+    }
+
+    size_t LaneWriter::size( ) const
+    {
+        return m_resent.size( ) + m_control.size( ) + m_bulk.size( ) - m_bulkOffset;
+    }
+
+    void LaneWriter::clear( )
+    {
+        m_resent.clear( );
+        m_control.clear( );
+        m_bulk.clear( );
+        m_bulkOffset = 0;
+    }
+
+    namespace test
+    {
+        void testLaneWriter( )
+        {
+            constexpr uint8_t ContentType = 9;
+            constexpr uint8_t InputType = 3;
+            LaneWriter writer;
+            writer.setLane( ContentType, Lane::Bulk );
+
+            Message message{ };
+            message.toSessionId = 2;
+            message.fromSessionId = 1;
+            std::string part( StreamPartSize, 'c' );
+            message.len = StreamPartSize / MessageAlignment;
+            message.type = ContentType;
+            message.result = (uint8_t)Result::More;
+            for ( int i = 0; i < 8; i++ )
+                { writer.put( message, part ); }
+            // queued behind 512 KB of content
+            message.len = 2;
+            message.type = InputType;
+            message.result = 0;
+            writer.put( message, std::string( 16, 'i' ) );
+            MessageWriter resent;
+            message.len = 1;
+            resent.put( message, std::string( 8, 'r' ) );
+            writer.putResent( resent.getAll( ).data( ), resent.size( ) );
+
+            std::string types;
+            auto batch = writer.take( [&]( const char * frame, size_t ) { types += std::to_string( decodeHeader( frame ).type ) + " "; } );
+            size_t expected = resent.size( ) + MessageHeaderSize + 16 + MessageHeaderSize + StreamPartSize;
+            if ( types != "3 9 " || batch.length( ) != expected || decodeHeader( batch.data( ) + resent.size( ) ).type != InputType )
+                { throw std::exception{ "writer.take( )" }; }
+
+            // the rest of the transfer goes a part at a time, in order
+            size_t parts = 0;
+            while ( !writer.isEmpty( ) )
+            {
+                batch = writer.take( [&]( const char *, size_t ) { parts++; } );
+                if ( batch.length( ) != MessageHeaderSize + StreamPartSize )
+                    { throw std::exception{ "writer.take( bulk )" }; }
+                if ( parts == 3 )
+                    { break; }
+            }
+            // frames to the server itself are never bulk, whatever their type
+            message.len = 1;
+            message.type = ContentType;
+            message.toSessionId = 0;
+            writer.put( message, std::string( 8, 'a' ) );
+            std::string drained;
+            writer.drain( [&]( const char * frame, size_t ) { drained += decodeHeader( frame ).toSessionId ? "b" : "a"; } );
+            if ( drained != "abbbb" || !writer.isEmpty( ) || writer.size( ) != 0 )
+                { throw std::exception{ "writer.drain( )" }; }
+        }
+    }
+}
@@ -0,0 +1,491 @@
+module;
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+export module grim.net.loopback;
+
+import cpp.asio;
+import cpp.log;
+import cpp.memory;
+import grim.arch.net;
+import grim.net.message;
+
+export namespace grim::net
+{
+    //! addresses of the in-process transport look like "loop:name:port"
+    constexpr std::string_view              LoopScheme = "loop:";
+    bool                                    isLoopAddress( std::string_view addr );
+
+    //! In-process stand-in for cpp::TcpServer (see TransportServer), so the session server,
+    //! proxies and clients can run in one process without sockets.  A send is appended to the
+    //! peer's inbound buffer and delivered by a post to the peer's io context; a peer which has
+    //! consumed everything it was given gets the whole buffer swapped in, so bytes are copied
+    //! once and no syscall is made.  Handlers run on the io context each side opened with, and in
+    //! the order they would over tcp, so a run on one io context is deterministic.
+    class LoopServer
+    {
+    public:
+        using                               ConnectFn = std::function<void( std::error_code error, const std::string & addr )>;
+        using                               RecvFn = std::function<void( const std::string & addr, std::string & recvBuffer )>;
+        using                               DisconnectFn = std::function<void( const std::string & addr, std::error_code reason )>;
+
+                                            LoopServer( ) = default;
+                                            ~LoopServer( );
+                                            LoopServer( const LoopServer & ) = delete;
+        LoopServer &                        operator=( const LoopServer & ) = delete;
+
+        void                                open( cpp::AsyncContext & io, StrArg listenAddress, ConnectFn, RecvFn, DisconnectFn );
+        void                                close( );
+        void                                send( const std::string & addr, const cpp::Memory & data );
+        void                                disconnect( const std::string & addr, std::error_code reason );
+
+        struct                              Listener;
+    private:
+        std::shared_ptr<Listener>           m_listener;
+    };
+
+    //! In-process stand-in for cpp::TcpClient, see LoopServer.
+    class LoopClient
+    {
+    public:
+        using                               ConnectFn = std::function<void( std::error_code error )>;
+        using                               RecvFn = std::function<void( std::string & recvBuffer )>;
+        using                               DisconnectFn = std::function<void( std::error_code reason )>;
+
+                                            LoopClient( ) = default;
+                                            ~LoopClient( );
+                                            LoopClient( const LoopClient & ) = delete;
+        LoopClient &                        operator=( const LoopClient & ) = delete;
+
+        void                                connect( cpp::AsyncContext & io, StrArg addr, ConnectFn, RecvFn, DisconnectFn );
+        void                                send( const cpp::Memory & data );
+        void                                disconnect( );
+
+        struct                              Link;
+    private:
+        std::shared_ptr<Link>               m_link;
+    };
+
+    namespace test
+    {
+        void                                testLoopback( );
+        //! `clientCount` clients connect to one echo server on one io context, and each makes
+        //! `roundTrips` requests in turn; logs round trips per second with no kernel in the path
+        void                                benchLoopback( size_t clientCount = 100000, size_t roundTrips = 10 );
+    };
+}
+
+namespace grim::net
+{
+    struct LoopServer::Listener
+    {
+        std::string                         addr;
+        cpp::AsyncContext                   io;
+        ConnectFn                           onConnect;
+        RecvFn                              onRecv;
+        DisconnectFn                        onDisconnect;
+        //! accepted connections, only used on io
+        std::map<std::string, std::shared_ptr<LoopClient::Link>> links;
+        std::atomic<bool>                   isOpen = true;
+    };
+
+    //! both directions of one connection; inbox[Server] holds what the client sent
+    struct LoopClient::Link
+    {
+        enum                                Side { Server, Client };
+        struct Inbox
+        {
+            cpp::AsyncContext               io;
+            //! appended to by the sender, under lock
+            std::string                     pending;
+            bool                            isDeliveryPending = false;
+            //! only used on io
+            std::string                     recvBuffer;
+        };
+
+        std::mutex                          lock;
+        Inbox                               inbox[2];
+        bool                                isOpen = true;
+        //! the client's address, as the server sees it
+        std::string                         addr;
+        std::shared_ptr<LoopServer::Listener> listener;
+        LoopClient::RecvFn                  onRecv;
+        LoopClient::DisconnectFn            onDisconnect;
+        //! set once the LoopClient is gone, only used on the client's io
+        bool                                isDetached = false;
+    };
+
+    struct LoopRegistry
+    {
+        std::mutex                          lock;
+        std::map<std::string, std::weak_ptr<LoopServer::Listener>, std::less<>> listeners;
+        std::atomic<uint64_t>               nextPort = 0;
+    };
+
+    LoopRegistry & loopRegistry( )
+    {
+        static LoopRegistry registry;
+        return registry;
+    }
+
+    bool isLoopOpen( LoopClient::Link & link )
+    {
+        std::lock_guard<std::mutex> guard{ link.lock };
+        return link.isOpen;
+    }
+
+    void loopDeliver( const std::shared_ptr<LoopClient::Link> & link, LoopClient::Link::Side to )
+    {
+        auto & inbox = link->inbox[to];
+        {
+            std::lock_guard<std::mutex> guard{ link->lock };
+            inbox.isDeliveryPending = false;
+            if ( inbox.recvBuffer.empty( ) )
+                { std::swap( inbox.recvBuffer, inbox.pending ); }
+            else
+            {
+                inbox.recvBuffer.append( inbox.pending );
+                inbox.pending.clear( );
+            }
+        }
+        // anything sent before a disconnect still arrives, ahead of the disconnect
+        if ( inbox.recvBuffer.empty( ) )
+            { return; }
+        if ( to == LoopClient::Link::Server )
+        {
+            if ( link->listener->isOpen )
+                { link->listener->onRecv( link->addr, inbox.recvBuffer ); }
+        }
+        else if ( !link->isDetached )
+            { link->onRecv( inbox.recvBuffer ); }
+    }
+
+    void loopSend( const std::shared_ptr<LoopClient::Link> & link, LoopClient::Link::Side to, const cpp::Memory & data )
+    {
+        bool isPost = false;
+        {
+            std::lock_guard<std::mutex> guard{ link->lock };
+            if ( !link->isOpen )
+                { return; }
+            auto & inbox = link->inbox[to];
+            inbox.pending.append( data.data( ), data.length( ) );
+            // one delivery per batch of sends, as a read returns whatever has arrived
+            isPost = !std::exchange( inbox.isDeliveryPending, true );
+        }
+        if ( isPost )
+            { link->inbox[to].io.post( [link, to]( ) { loopDeliver( link, to ); } ); }
+    }
+
+    void loopClose( const std::shared_ptr<LoopClient::Link> & link, std::error_code reason )
+    {
+        {
+            std::lock_guard<std::mutex> guard{ link->lock };
+            if ( !link->isOpen )
+                { return; }
+            link->isOpen = false;
+        }
+        // each side hears of it on its own io context
+        link->inbox[LoopClient::Link::Server].io.post( [link, reason]( )
+            {
+                auto & listener = *link->listener;
+                if ( listener.links.erase( link->addr ) && listener.isOpen && listener.onDisconnect )
+                    { listener.onDisconnect( link->addr, reason ); }
+            } );
+        link->inbox[LoopClient::Link::Client].io.post( [link, reason]( )
+            {
+                if ( !link->isDetached && link->onDisconnect )
+                    { link->onDisconnect( reason ); }
+            } );
+    }
+
+    bool isLoopAddress( std::string_view addr )
+    {
+        return addr.starts_with( LoopScheme );
+    }
+
+    LoopServer::~LoopServer( )
+    {
+        close( );
+    }
+
+    void LoopServer::open( cpp::AsyncContext & io, StrArg listenAddress, ConnectFn onConnect, RecvFn onRecv, DisconnectFn onDisconnect )
+    {
+        close( );
+        auto listener = std::make_shared<Listener>( );
+        listener->addr = listenAddress;
+        listener->io = io;
+        listener->onConnect = std::move( onConnect );
+        listener->onRecv = std::move( onRecv );
+        listener->onDisconnect = std::move( onDisconnect );
+
+        auto & registry = loopRegistry( );
+        std::lock_guard<std::mutex> guard{ registry.lock };
+        auto & registered = registry.listeners[listener->addr];
+        if ( auto other = registered.lock( ); other && other->isOpen )
+        {
+            cpp::Log::error( "LoopServer::open() : addr='{}' msg='address in use'", listener->addr );
+            return;
+        }
+        registered = listener;
+        m_listener = std::move( listener );
+    }
+
+    void LoopServer::close( )
+    {
+        if ( !m_listener )
+            { return; }
+        auto listener = std::move( m_listener );
+        listener->isOpen = false;
+        {
+            auto & registry = loopRegistry( );
+            std::lock_guard<std::mutex> guard{ registry.lock };
+            if ( auto itr = registry.listeners.find( listener->addr ); itr != registry.listeners.end( ) && itr->second.lock( ) == listener )
+                { registry.listeners.erase( itr ); }
+        }
+        // the links are only touched on the listener's io context
+        listener->io.post( [listener]( )
+            {
+                auto links = std::move( listener->links );
+                for ( auto & [addr, link] : links )
+                    { loopClose( link, std::make_error_code( std::errc::connection_aborted ) ); }
+            } );
+    }
+
+    void LoopServer::send( const std::string & addr, const cpp::Memory & data )
+    {
+        if ( !m_listener )
+            { return; }
+        if ( auto itr = m_listener->links.find( addr ); itr != m_listener->links.end( ) )
+            { loopSend( itr->second, LoopClient::Link::Client, data ); }
+    }
+
+    void LoopServer::disconnect( const std::string & addr, std::error_code reason )
+    {
+        if ( !m_listener )
+            { return; }
+        if ( auto itr = m_listener->links.find( addr ); itr != m_listener->links.end( ) )
+            { loopClose( itr->second, reason ); }
+    }
+
+    LoopClient::~LoopClient( )
+    {
+        if ( !m_link )
+            { return; }
+        m_link->isDetached = true;
+        loopClose( m_link, std::make_error_code( std::errc::connection_aborted ) );
+    }
+
+    void LoopClient::connect( cpp::AsyncContext & io, StrArg addr, ConnectFn onConnect, RecvFn onRecv, DisconnectFn onDisconnect )
+    {
+        if ( m_link )
+        {
+            m_link->isDetached = true;
+            loopClose( m_link, std::make_error_code( std::errc::connection_aborted ) );
+            m_link.reset( );
+        }
+
+        std::shared_ptr<LoopServer::Listener> listener;
+        auto & registry = loopRegistry( );
+        {
+            std::lock_guard<std::mutex> guard{ registry.lock };
+            if ( auto itr = registry.listeners.find( std::string_view{ addr.data( ), addr.length( ) } ); itr != registry.listeners.end( ) )
+                { listener = itr->second.lock( ); }
+        }
+        if ( !listener || !listener->isOpen )
+        {
+            io.post( [onConnect]( ) { onConnect( std::make_error_code( std::errc::connection_refused ) ); } );
+            return;
+        }
+
+        auto link = std::make_shared<Link>( );
+        link->inbox[Link::Server].io = listener->io;
+        link->inbox[Link::Client].io = io;
+        link->addr = std::string{ LoopScheme } + "peer:" + std::to_string( ++registry.nextPort );
+        link->listener = listener;
+        link->onRecv = std::move( onRecv );
+        link->onDisconnect = std::move( onDisconnect );
+        m_link = link;
+
+        // accepted on the server's io context, then connected on the client's
+        listener->io.post( [link, onConnect]( )
+            {
+                auto & listener = *link->listener;
+                if ( !listener.isOpen || !isLoopOpen( *link ) )
+                {
+                    link->inbox[Link::Client].io.post( [link, onConnect]( )
+                        {
+                            if ( !link->isDetached )
+                                { onConnect( std::make_error_code( std::errc::connection_refused ) ); }
+                        } );
+                    return;
+                }
+                listener.links[link->addr] = link;
+                listener.onConnect( std::error_code{ }, link->addr );
+                link->inbox[Link::Client].io.post( [link, onConnect]( )
+                    {
+                        if ( !link->isDetached )
+                            { onConnect( std::error_code{ } ); }
+                    } );
+            } );
+    }
+
+    void LoopClient::send( const cpp::Memory & data )
+    {
+        if ( m_link )
+            { loopSend( m_link, Link::Server, data ); }
+    }
+
+    void LoopClient::disconnect( )
+    {
+        if ( m_link )
+            { loopClose( m_link, std::make_error_code( std::errc::connection_aborted ) ); }
+    }
+
+    namespace test
+    {
+        void testLoopback( )
+        {
+            cpp::AsyncContext io;
+            LoopServer server;
+            std::vector<std::string> accepted;
+            std::vector<std::string> closed;
+            std::string serverRecv;
+            server.open( io, "loop:test:1",
+                [&]( std::error_code error, const std::string & addr )
+                    { accepted.push_back( addr ); },
+                [&]( const std::string & addr, std::string & recvBuffer )
+                {
+                    // echoed back, and consumed
+                    serverRecv += recvBuffer;
+                    server.send( addr, recvBuffer );
+                    recvBuffer.clear( );
+                },
+                [&]( const std::string & addr, std::error_code reason )
+                    { closed.push_back( addr ); } );
+
+            LoopClient client;
+            std::error_code connectResult = std::make_error_code( std::errc::timed_out );
+            std::string clientRecv;
+            bool isClientClosed = false;
+            client.connect( io, "loop:test:1",
+                [&]( std::error_code error )
+                {
+                    connectResult = error;
+                    // two sends in one turn arrive as one read
+                    client.send( std::string{ "hello " } );
+                    client.send( std::string{ "world" } );
+                },
+                [&]( std::string & recvBuffer )
+                {
+                    clientRecv += recvBuffer;
+                    recvBuffer.clear( );
+                    if ( clientRecv.size( ) == 11 )
+                        { client.disconnect( ); }
+                },
+                [&]( std::error_code reason )
+                    { isClientClosed = true; } );
+
+            LoopClient refused;
+            std::error_code refusedResult;
+            refused.connect( io, "loop:test:2",
+                [&]( std::error_code error )
+                    { refusedResult = error; },
+                []( std::string & ) { },
+                []( std::error_code ) { } );
+            io.run( );
+
+            if ( connectResult || accepted.size( ) != 1 || !isLoopAddress( accepted[0] ) )
+                { throw std::exception{ "loop.connect( )" }; }
+            if ( serverRecv != "hello world" || clientRecv != "hello world" )
+                { throw std::exception{ "loop.send( )" }; }
+            if ( !isClientClosed || closed.size( ) != 1 || closed[0] != accepted[0] )
+                { throw std::exception{ "loop.disconnect( )" }; }
+            if ( refusedResult != std::make_error_code( std::errc::connection_refused ) )
+                { throw std::exception{ "loop.connect( refused )" }; }
+            server.close( );
+        }
+
+        void benchLoopback( size_t clientCount, size_t roundTrips )
+        {
+            using Clock = std::chrono::steady_clock;
+            cpp::AsyncContext io;
+
+            // echoes each frame, as a server replies to a request
+            LoopServer server;
+            std::map<std::string, MessageReader> readers;
+            MessageWriter reply;
+            server.open( io, "loop:bench:1",
+                [&]( std::error_code, const std::string & addr ) { readers[addr]; },
+                [&]( const std::string & addr, std::string & recvBuffer )
+                {
+                    readers[addr].read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                        { reply.put( message, data ); } );
+                    server.send( addr, reply.getAll( ) );
+                    reply.clear( );
+                },
+                [&]( const std::string & addr, std::error_code ) { readers.erase( addr ); } );
+
+            struct BenchClient
+            {
+                LoopClient                  loop;
+                MessageReader               reader;
+                size_t                      received = 0;
+            };
+            std::vector<std::unique_ptr<BenchClient>> clients;
+            std::string payload( 64, 'x' );
+            Message request{ };
+            request.len = payload.size( ) / MessageAlignment;
+            request.bind = 1;
+            request.type = 7;
+            MessageWriter requestFrame;
+            requestFrame.put( request, payload );
+            size_t connected = 0;
+            size_t finished = 0;
+
+            auto start = Clock::now( );
+            for ( size_t i = 0; i < clientCount; i++ )
+            {
+                clients.push_back( std::make_unique<BenchClient>( ) );
+                auto * client = clients.back( ).get( );
+                client->loop.connect( io, "loop:bench:1",
+                    [&, client]( std::error_code error )
+                    {
+                        if ( error )
+                            { return; }
+                        connected++;
+                        client->loop.send( requestFrame.getAll( ) );
+                    },
+                    [&, client]( std::string & recvBuffer )
+                    {
+                        client->reader.read( recvBuffer, [&]( const Message &, const cpp::Memory & )
+                            { client->received++; } );
+                        if ( client->received < roundTrips )
+                            { client->loop.send( requestFrame.getAll( ) ); }
+                        else if ( ++finished == clientCount )
+                            { server.close( ); }
+                    },
+                    []( std::error_code ) { } );
+            }
+            io.run( );
+            std::chrono::duration<double> elapsed = Clock::now( ) - start;
+
+            if ( connected != clientCount || finished != clientCount )
+                { throw std::exception{ "benchLoopback( )" }; }
+            size_t total = clientCount * roundTrips;
+            cpp::Log::info( "loopback : {} clients, {} round trips in {:.2f} sec, {:.0f} round trips/sec on one io context",
+                clientCount, total, elapsed.count( ), elapsed.count( ) > 0 ? total / elapsed.count( ) : 0.0 );
+        }
+    }
+}
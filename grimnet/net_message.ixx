@@ -0,0 +1,377 @@
+module;
+
+#include <bit>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+export module grim.net.message;
+
+import cpp.log;
+import cpp.memory;
+import grim.arch.net;
+
+export namespace grim::net
+{
+    constexpr size_t                        MessageHeaderSize = sizeof( Message );
+    constexpr size_t                        MessageAlignment = 8;
+    constexpr size_t                        MaxMessageDataSize = 0xffff * MessageAlignment;
+
+    //! writes `message` to `out` (MessageHeaderSize bytes) using the wire byte order
+    void                                    encodeHeader( char * out, const Message & message );
+    //! reads a Message from `in` (MessageHeaderSize bytes) using the wire byte order
+    Message                                 decodeHeader( const char * in );
+    //! rewrites the fromSessionId of an encoded frame in place
+    void                                    setFromSessionId( char * frame, uint64_t sessionId );
+    //! number of zero bytes which follow `dataLength` bytes of data on the wire
+    constexpr size_t                        paddingOf( size_t dataLength )
+                                                { return ( MessageAlignment - ( dataLength % MessageAlignment ) ) % MessageAlignment; }
+
+    //! Per-connection outbound buffer.  Each put() gathers header, data and padding into one
+    //! contiguous frame so a connection can flush every queued message with a single send.  The
+    //! buffer is cleared (not released) after each flush so its capacity is reused.
+    class MessageWriter
+    {
+    public:
+        void                                put( const Message & message, const cpp::Memory & data );
+        //! appends an already encoded frame (header, data and padding)
+        void                                putFrame( const char * frame, size_t frameSize );
+        //! appends a frame with `dataLength` zeroed bytes of data (`message.len` is set to fit),
+        //! and returns where the data goes so it can be encoded in place
+        char *                              reserve( Message message, size_t dataLength );
+
+        bool                                isEmpty( ) const;
+        size_t                              size( ) const;
+        cpp::Memory                         getAll( ) const;
+        void                                clear( );
+    private:
+        std::string                         m_buffer;
+    };
+
+    //! Per-connection inbound decoder.  Frames are decoded in place from the connection's receive
+    //! buffer and handed out as views, so no payload is copied.  Consumed bytes are tracked by
+    //! offset and only compacted away once the buffer is fully read (a clear) or the offset passes
+    //! half of the buffer (a single erase), which keeps pipelined input linear rather than
+    //! quadratic.
+    class MessageReader
+    {
+    public:
+        using                               FrameFn = std::function<void( const Message & message, const cpp::Memory & data )>;
+        using                               RelayFn = std::function<void( const Message & message, char * frame, size_t frameSize )>;
+
+        //! calls `fn` for each complete frame in `recvBuffer`; views passed to `fn` are only valid
+        //! during the call
+        void                                read( std::string & recvBuffer, const FrameFn & fn );
+        //! like read(), but hands out each whole encoded frame so it can be patched in place and
+        //! relayed without being serialized again
+        void                                relay( std::string & recvBuffer, const RelayFn & fn );
+        void                                reset( );
+    private:
+        void                                compact( std::string & recvBuffer );
+
+        size_t                              m_offset = 0;
+    };
+
+    namespace test
+    {
+        void                                testMessageReader( );
+        //! messages/sec of 64 byte and 4 KB payloads, sent as header, payload and padding each
+        //! handed to the socket (as Client::send did) and gathered by a MessageWriter into one send
+        //! per turn
+        void                                benchMessageWriter( size_t messageCount = 1000000 );
+    };
+}
+
+namespace grim::net
+{
+    void putBigEndian( char * out, uint64_t value, size_t bytes )
+    {
+        for ( size_t i = 0; i < bytes; i++ )
+            { out[i] = (char)( value >> ( 8 * ( bytes - 1 - i ) ) ); }
+    }
+
+    uint64_t getBigEndian( const char * in, size_t bytes )
+    {
+        uint64_t value = 0;
+        for ( size_t i = 0; i < bytes; i++ )
+            { value = ( value << 8 ) | (uint8_t)in[i]; }
+        return value;
+    }
+
+    void encodeHeader( char * out, const Message & message )
+    {
+        static_assert( ByteOrder == std::endian::big );
+        putBigEndian( out + 0, message.len, 2 );
+        putBigEndian( out + 2, message.moniker, 2 );
+        putBigEndian( out + 4, message.bind, 2 );
+        putBigEndian( out + 6, message.type, 1 );
+        putBigEndian( out + 7, message.result, 1 );
+        putBigEndian( out + 8, message.toSessionId, 8 );
+        putBigEndian( out + 16, message.fromSessionId, 8 );
+    }
+
+    Message decodeHeader( const char * in )
+    {
+        Message message;
+        message.len = getBigEndian( in + 0, 2 );
+        message.moniker = getBigEndian( in + 2, 2 );
+        message.bind = getBigEndian( in + 4, 2 );
+        message.type = getBigEndian( in + 6, 1 );
+        message.result = getBigEndian( in + 7, 1 );
+        message.toSessionId = getBigEndian( in + 8, 8 );
+        message.fromSessionId = getBigEndian( in + 16, 8 );
+        return message;
+    }
+
+    void setFromSessionId( char * frame, uint64_t sessionId )
+    {
+        putBigEndian( frame + 16, sessionId, 8 );
+    }
+
+    void MessageWriter::put( const Message & message, const cpp::Memory & data )
+    {
+        size_t offset = m_buffer.size( );
+        size_t frameSize = MessageHeaderSize + data.length( ) + paddingOf( data.length( ) );
+        // resize zero fills, which also writes the padding
+        m_buffer.resize( offset + frameSize );
+        char * frame = m_buffer.data( ) + offset;
+        encodeHeader( frame, message );
+        if ( data.length( ) )
+            { std::memcpy( frame + MessageHeaderSize, data.data( ), data.length( ) ); }
+    }
+
+    void MessageWriter::putFrame( const char * frame, size_t frameSize )
+    {
+        m_buffer.append( frame, frameSize );
+    }
+
+    char * MessageWriter::reserve( Message message, size_t dataLength )
+    {
+        size_t offset = m_buffer.size( );
+        size_t paddedLength = dataLength + paddingOf( dataLength );
+        message.len = paddedLength / MessageAlignment;
+        m_buffer.resize( offset + MessageHeaderSize + paddedLength );
+        char * frame = m_buffer.data( ) + offset;
+        encodeHeader( frame, message );
+        return frame + MessageHeaderSize;
+    }
+
+    bool MessageWriter::isEmpty( ) const
+    {
+        return m_buffer.empty( );
+    }
+
+    size_t MessageWriter::size( ) const
+    {
+        return m_buffer.size( );
+    }
+
+    cpp::Memory MessageWriter::getAll( ) const
+    {
+        return cpp::Memory{ m_buffer };
+    }
+
+    void MessageWriter::clear( )
+    {
+        m_buffer.clear( );
+    }
+
+    void MessageReader::read( std::string & recvBuffer, const FrameFn & fn )
+    {
+        while ( recvBuffer.size( ) - m_offset >= MessageHeaderSize )
+        {
+            Message message = decodeHeader( recvBuffer.data( ) + m_offset );
+            size_t dataLength = (size_t)message.len * MessageAlignment;
+            if ( recvBuffer.size( ) - m_offset < MessageHeaderSize + dataLength )
+                { break; }
+            auto data = cpp::Memory{ recvBuffer }.substr( m_offset + MessageHeaderSize, dataLength );
+            m_offset += MessageHeaderSize + dataLength;
+            fn( message, data );
+        }
+        compact( recvBuffer );
+    }
+
+    void MessageReader::relay( std::string & recvBuffer, const RelayFn & fn )
+    {
+        while ( recvBuffer.size( ) - m_offset >= MessageHeaderSize )
+        {
+            char * frame = recvBuffer.data( ) + m_offset;
+            Message message = decodeHeader( frame );
+            size_t frameSize = MessageHeaderSize + (size_t)message.len * MessageAlignment;
+            if ( recvBuffer.size( ) - m_offset < frameSize )
+                { break; }
+            m_offset += frameSize;
+            fn( message, frame, frameSize );
+        }
+        compact( recvBuffer );
+    }
+
+    void MessageReader::compact( std::string & recvBuffer )
+    {
+        if ( m_offset == recvBuffer.size( ) )
+        {
+            recvBuffer.clear( );
+            m_offset = 0;
+        }
+        else if ( m_offset > recvBuffer.size( ) / 2 )
+        {
+            recvBuffer.erase( 0, m_offset );
+            m_offset = 0;
+        }
+    }
+
+    void MessageReader::reset( )
+    {
+        m_offset = 0;
+    }
+
+    namespace test
+    {
+        void testMessageReader( )
+        {
+            auto frameOf = []( uint64_t toSessionId, const std::string & data )
+                {
+                    Message message{ };
+                    message.len = ( data.size( ) + paddingOf( data.size( ) ) ) / MessageAlignment;
+                    message.toSessionId = toSessionId;
+                    MessageWriter frame;
+                    frame.put( message, data );
+                    return std::string{ frame.getAll( ).data( ), frame.getAll( ).length( ) };
+                };
+            MessageReader reader;
+            std::string recvBuffer;
+            std::vector<std::pair<uint64_t, std::string>> frames;
+            auto read = [&]( )
+                {
+                    reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                        { frames.emplace_back( message.toSessionId, std::string{ data.data( ), data.length( ) } ); } );
+                };
+
+            // a header split across reads waits for the rest
+            std::string one = frameOf( 1, "12345678" );
+            recvBuffer = one.substr( 0, 10 );
+            read( );
+            if ( !frames.empty( ) || recvBuffer.size( ) != 10 )
+                { throw std::exception{ "reader.read( split header )" }; }
+            recvBuffer += one.substr( 10 );
+            read( );
+            if ( frames.size( ) != 1 || frames[0] != std::pair<uint64_t, std::string>{ 1, "12345678" } || !recvBuffer.empty( ) )
+                { throw std::exception{ "reader.read( header rest )" }; }
+
+            // as does a frame split in its data
+            std::string two = frameOf( 2, std::string( 64, 'b' ) );
+            recvBuffer = two.substr( 0, MessageHeaderSize + 20 );
+            read( );
+            if ( frames.size( ) != 1 )
+                { throw std::exception{ "reader.read( split frame )" }; }
+            recvBuffer += two.substr( MessageHeaderSize + 20 );
+            read( );
+            if ( frames.size( ) != 2 || frames[1].first != 2 || frames[1].second != std::string( 64, 'b' ) || !recvBuffer.empty( ) )
+                { throw std::exception{ "reader.read( frame rest )" }; }
+
+            // several frames in one buffer are all read, and the buffer cleared once they are
+            frames.clear( );
+            recvBuffer = frameOf( 3, "a" ) + frameOf( 4, "bc" ) + frameOf( 5, "" );
+            read( );
+            if ( frames.size( ) != 3 || frames[0].first != 3 || frames[1].first != 4 || frames[2].first != 5
+                || frames[0].second != std::string( "a" ) + std::string( 7, '\0' ) || !frames[2].second.empty( ) || !recvBuffer.empty( ) )
+                { throw std::exception{ "reader.read( several )" }; }
+
+            // a partial frame behind less than half the buffer is left in place...
+            frames.clear( );
+            std::string big = frameOf( 6, std::string( 256, 'c' ) );
+            recvBuffer = one + big.substr( 0, 100 );
+            read( );
+            if ( frames.size( ) != 1 || recvBuffer.size( ) != one.size( ) + 100 )
+                { throw std::exception{ "reader.read( no compaction )" }; }
+            recvBuffer += big.substr( 100 );
+            read( );
+            if ( frames.size( ) != 2 || frames[1].second != std::string( 256, 'c' ) || !recvBuffer.empty( ) )
+                { throw std::exception{ "reader.read( after no compaction )" }; }
+
+            // ...and behind more than half, the bytes read are erased in front of it
+            frames.clear( );
+            recvBuffer = big + one + big.substr( 0, 12 );
+            read( );
+            if ( frames.size( ) != 2 || recvBuffer != big.substr( 0, 12 ) )
+                { throw std::exception{ "reader.read( half compaction )" }; }
+            recvBuffer += big.substr( 12 );
+            read( );
+            if ( frames.size( ) != 3 || frames[2].first != 6 || !recvBuffer.empty( ) )
+                { throw std::exception{ "reader.read( after half compaction )" }; }
+
+            // relay hands out the whole encoded frame, which is patched in place
+            recvBuffer = one + two;
+            std::vector<std::string> relayed;
+            reader.relay( recvBuffer, [&]( const Message &, char * frame, size_t frameSize )
+                {
+                    setFromSessionId( frame, 0x77 );
+                    relayed.emplace_back( frame, frameSize );
+                } );
+            if ( relayed.size( ) != 2 || relayed[0].size( ) != one.size( ) || decodeHeader( relayed[1].data( ) ).fromSessionId != 0x77 || !recvBuffer.empty( ) )
+                { throw std::exception{ "reader.relay( )" }; }
+        }
+
+        void benchMessageWriter( size_t messageCount )
+        {
+            using Clock = std::chrono::steady_clock;
+            const size_t MessagesPerTurn = 32;
+
+            for ( size_t payloadSize : { (size_t)64, (size_t)4096 } )
+            {
+                // the socket only copies what it is handed, as the transport's send queue does
+                std::string socket;
+                size_t sendCount = 0;
+                auto send = [&]( const char * data, size_t length )
+                    {
+                        if ( socket.size( ) > ( 1 << 20 ) )
+                            { socket.clear( ); }
+                        socket.append( data, length );
+                        sendCount++;
+                    };
+                std::string payload( payloadSize - 3, 'x' );
+                Message message{ };
+                message.len = ( payload.size( ) + paddingOf( payload.size( ) ) ) / MessageAlignment;
+                message.toSessionId = 0x22;
+                message.fromSessionId = 0x11;
+
+                // before: a header buffer, and a padding string, per message and three sends
+                auto start = Clock::now( );
+                for ( size_t i = 0; i < messageCount; i++ )
+                {
+                    std::string header( MessageHeaderSize, '\0' );
+                    encodeHeader( header.data( ), message );
+                    std::string padding( paddingOf( payload.size( ) ), '\0' );
+                    send( header.data( ), header.size( ) );
+                    send( payload.data( ), payload.size( ) );
+                    send( padding.data( ), padding.size( ) );
+                }
+                std::chrono::duration<double> splitElapsed = Clock::now( ) - start;
+                size_t splitSends = std::exchange( sendCount, 0 );
+
+                // after: each turn's messages gathered into one frame buffer, and one send
+                MessageWriter writer;
+                start = Clock::now( );
+                for ( size_t i = 0; i < messageCount; i++ )
+                {
+                    writer.put( message, payload );
+                    if ( ( i + 1 ) % MessagesPerTurn == 0 || i + 1 == messageCount )
+                    {
+                        auto frames = writer.getAll( );
+                        send( frames.data( ), frames.length( ) );
+                        writer.clear( );
+                    }
+                }
+                std::chrono::duration<double> writerElapsed = Clock::now( ) - start;
+
+                cpp::Log::info( "message writer : {} byte payloads, split {:.0f} msgs/sec ({} sends), writer {:.0f} msgs/sec ({} sends)",
+                    payloadSize, messageCount / splitElapsed.count( ), splitSends, messageCount / writerElapsed.count( ), sendCount );
+            }
+        }
+    }
+}
@@ -0,0 +1,176 @@
+module;
+
+#include <cinttypes>
+#include <string>
+#include <tuple>
+
+export module grim.net.proxy_api;
+
+import grim.arch.net;
+import grim.net.schema;
+
+export namespace grim::net
+{
+    //! The data of each IProxyApi message, see grim.net.schema.  A request and its reply share
+    //! the request's MessageType.
+
+    //! a proxy's shard N listens on its first address's port + N
+    std::string                             shardAddress( const std::string & addr, uint32_t shardIndex );
+
+    struct HelloRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Hello;
+        uint64_t                            authToken;
+        static constexpr auto               Fields = std::tuple{ &HelloRequest::authToken };
+    };
+
+    struct HelloReply
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Hello;
+        std::string                         email;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &HelloReply::email, &HelloReply::sessionId };
+    };
+
+    //! a rello which is to be verified with the session service
+    struct RelloRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Rello;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &RelloRequest::sessionId };
+    };
+
+    //! a rello which also resumes the stream (see grim.net.replay)
+    struct ResumeRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Rello;
+        uint64_t                            sessionId;
+        uint64_t                            receivedCount;
+        static constexpr auto               Fields = std::tuple{ &ResumeRequest::sessionId, &ResumeRequest::receivedCount };
+    };
+
+    //! only sent if the stream was resumed, a proxy which could not resume it replies without data
+    struct ResumeReply
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Rello;
+        uint64_t                            proxyReceived;
+        static constexpr auto               Fields = std::tuple{ &ResumeReply::proxyReceived };
+    };
+
+    struct AuthServerRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::AuthServer;
+        std::string                         svcName;
+        int32_t                             nodeId;
+        static constexpr auto               Fields = std::tuple{ &AuthServerRequest::svcName, &AuthServerRequest::nodeId };
+    };
+
+    struct AuthServerReply
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::AuthServer;
+        std::string                         email;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &AuthServerReply::email, &AuthServerReply::sessionId };
+    };
+
+    struct FindServerRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::FindServer;
+        std::string                         svcName;
+        int32_t                             nodeId;
+        static constexpr auto               Fields = std::tuple{ &FindServerRequest::svcName, &FindServerRequest::nodeId };
+    };
+
+    struct FindServerReply
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::FindServer;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &FindServerReply::sessionId };
+    };
+
+    struct OpenUdpRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::OpenUdp;
+        std::string                         intAddr;
+        static constexpr auto               Fields = std::tuple{ &OpenUdpRequest::intAddr };
+    };
+
+    struct OpenUdpReply
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::OpenUdp;
+        uint64_t                            key;
+        uint16_t                            proxyPort;
+        static constexpr auto               Fields = std::tuple{ &OpenUdpReply::key, &OpenUdpReply::proxyPort };
+    };
+
+    struct CloseUdpRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::CloseUdp;
+        static constexpr auto               Fields = std::tuple{ };
+    };
+
+    struct ProbeRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Probe;
+        static constexpr auto               Fields = std::tuple{ };
+    };
+
+    //! the proxy's connection count, and the shard (see shardAddress) the client should connect
+    //! to, so a proxy's clients are spread over its shards
+    struct ProbeReply
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Probe;
+        uint32_t                            load;
+        uint16_t                            shardIndex;
+        static constexpr auto               Fields = std::tuple{ &ProbeReply::load, &ProbeReply::shardIndex };
+    };
+
+    //! adds `sessionId` to one of the sender's groups, creating it.  Only a session authed as a
+    //! server node (AuthServerRequest) owns groups, else Result::Access; Result::Retry past the
+    //! limits of GroupTable.  A bound join is replied to with its result, the other group
+    //! messages are not replied to.
+    struct GroupJoinRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::GroupJoin;
+        uint64_t                            groupId;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &GroupJoinRequest::groupId, &GroupJoinRequest::sessionId };
+    };
+
+    struct GroupLeaveRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::GroupLeave;
+        uint64_t                            groupId;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &GroupLeaveRequest::groupId, &GroupLeaveRequest::sessionId };
+    };
+
+    struct GroupCloseRequest
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::GroupClose;
+        uint64_t                            groupId;
+        static constexpr auto               Fields = std::tuple{ &GroupCloseRequest::groupId };
+    };
+
+    //! the number of sequenced frames received
+    struct Ack
+    {
+        static constexpr auto               Type = IProxyApi::MessageType::Ack;
+        uint64_t                            received;
+        static constexpr auto               Fields = std::tuple{ &Ack::received };
+    };
+
+    static_assert( isFixedSize<Ack>( ) && minSizeOf<Ack>( ) == 8 );
+}
+
+namespace grim::net
+{
+    std::string shardAddress( const std::string & addr, uint32_t shardIndex )
+    {
+        auto pos = addr.find_last_of( ':' );
+        if ( !shardIndex || pos == std::string::npos )
+            { return addr; }
+        int port = std::stoi( addr.substr( pos + 1 ) ) + (int)shardIndex;
+        return addr.substr( 0, pos + 1 ) + std::to_string( port );
+    }
+}
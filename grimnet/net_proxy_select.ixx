@@ -0,0 +1,221 @@
+module;
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <exception>
+#include <string>
+#include <vector>
+
+export module grim.net.proxy_select;
+
+import cpp.random;
+
+export namespace grim::net
+{
+    //! Picks the proxy a client connects to.  Each proxy keeps an EWMA of its round trip time and
+    //! the load it last reported (its connection count); the healthy proxy with the lowest
+    //! rtt * ( 1 + load / LoadScale ) is preferred.  A proxy which fails to connect (or drops the
+    //! connection) is skipped until its backoff expires; the backoff doubles with each failure
+    //! in a row and is jittered, so clients which lost the same proxy do not all return at once.
+    class ProxySelector
+    {
+    public:
+        using                               Clock = std::chrono::steady_clock;
+
+        //! an unprobed proxy is assumed to be this far away
+        static constexpr double             UnprobedMillis = 1000;
+        //! a proxy with this many connections counts as twice as far away
+        static constexpr double             LoadScale = 1000;
+        static constexpr Clock::duration    MinBackoff = std::chrono::milliseconds( 250 );
+        static constexpr Clock::duration    MaxBackoff = std::chrono::seconds( 30 );
+
+        struct Proxy
+        {
+            //! as configured, and the resolved address which won the last connect race
+            std::string                     addr;
+            std::string                     connectAddr;
+            //! 0 until probed
+            double                          rttMillis = 0;
+            uint32_t                        load = 0;
+            uint32_t                        failures = 0;
+            Clock::time_point               retryAt{ };
+        };
+
+        void                                setAddrs( const std::vector<std::string> & addrs );
+        size_t                              size( ) const;
+        const Proxy &                       proxy( size_t index ) const;
+
+        void                                setConnectAddr( size_t index, std::string connectAddr );
+        void                                recordRtt( size_t index, Clock::duration rtt );
+        void                                recordLoad( size_t index, uint32_t load );
+        void                                recordSuccess( size_t index );
+        void                                recordFailure( size_t index, Clock::time_point now );
+
+        //! false if every proxy is backing off (see retryDelay( ))
+        bool                                select( Clock::time_point now, size_t * index );
+        //! how long until a proxy can be tried again
+        Clock::duration                     retryDelay( Clock::time_point now ) const;
+        Clock::duration                     backoff( uint32_t failures );
+    private:
+        double                              scoreOf( const Proxy & proxy ) const;
+
+        std::vector<Proxy>                  m_proxies;
+        cpp::Random                         m_rng;
+    };
+
+    namespace test
+    {
+        void                                testProxySelector( );
+    };
+}
+
+namespace grim::net
+{
+    void ProxySelector::setAddrs( const std::vector<std::string> & addrs )
+    {
+        m_proxies.clear( );
+        for ( auto & addr : addrs )
+            { m_proxies.push_back( Proxy{ .addr = addr, .connectAddr = addr } ); }
+    }
+
+    size_t ProxySelector::size( ) const
+    {
+        return m_proxies.size( );
+    }
+
+    const ProxySelector::Proxy & ProxySelector::proxy( size_t index ) const
+    {
+        return m_proxies[index];
+    }
+
+    void ProxySelector::setConnectAddr( size_t index, std::string connectAddr )
+    {
+        m_proxies[index].connectAddr = std::move( connectAddr );
+    }
+
+    void ProxySelector::recordRtt( size_t index, Clock::duration rtt )
+    {
+        // the same gain as TCP's smoothed rtt
+        double sample = std::chrono::duration<double, std::milli>( rtt ).count( );
+        auto & proxy = m_proxies[index];
+        proxy.rttMillis = proxy.rttMillis ? proxy.rttMillis + ( sample - proxy.rttMillis ) / 8 : sample;
+    }
+
+    void ProxySelector::recordLoad( size_t index, uint32_t load )
+    {
+        m_proxies[index].load = load;
+    }
+
+    void ProxySelector::recordSuccess( size_t index )
+    {
+        m_proxies[index].failures = 0;
+        m_proxies[index].retryAt = { };
+    }
+
+    void ProxySelector::recordFailure( size_t index, Clock::time_point now )
+    {
+        auto & proxy = m_proxies[index];
+        proxy.failures++;
+        proxy.retryAt = now + backoff( proxy.failures );
+    }
+
+    bool ProxySelector::select( Clock::time_point now, size_t * index )
+    {
+        // until something has been probed, clients are spread over the healthy proxies
+        std::vector<size_t> healthy;
+        size_t best = m_proxies.size( );
+        for ( size_t i = 0; i < m_proxies.size( ); i++ )
+        {
+            if ( m_proxies[i].retryAt > now )
+                { continue; }
+            healthy.push_back( i );
+            if ( m_proxies[i].rttMillis && ( best == m_proxies.size( ) || scoreOf( m_proxies[i] ) < scoreOf( m_proxies[best] ) ) )
+                { best = i; }
+        }
+        if ( healthy.empty( ) )
+            { return false; }
+        *index = best < m_proxies.size( ) ? best : healthy[m_rng.rand( ) % healthy.size( )];
+        return true;
+    }
+
+    ProxySelector::Clock::duration ProxySelector::retryDelay( Clock::time_point now ) const
+    {
+        Clock::time_point retryAt = Clock::time_point::max( );
+        for ( auto & proxy : m_proxies )
+            { retryAt = std::min( retryAt, proxy.retryAt ); }
+        return retryAt > now ? retryAt - now : Clock::duration::zero( );
+    }
+
+    ProxySelector::Clock::duration ProxySelector::backoff( uint32_t failures )
+    {
+        if ( !failures )
+            { return Clock::duration::zero( ); }
+        auto limit = MinBackoff * ( 1ll << std::min<uint32_t>( failures - 1, 16 ) );
+        if ( limit > MaxBackoff )
+            { limit = MaxBackoff; }
+        // somewhere in the upper half, so a retry is never immediate
+        auto half = limit / 2;
+        return half + Clock::duration( (Clock::rep)( m_rng.rand( ) % ( half.count( ) + 1 ) ) );
+    }
+
+    double ProxySelector::scoreOf( const Proxy & proxy ) const
+    {
+        double rtt = proxy.rttMillis ? proxy.rttMillis : UnprobedMillis;
+        return rtt * ( 1 + proxy.load / LoadScale );
+    }
+
+    namespace test
+    {
+        void testProxySelector( )
+        {
+            using namespace std::chrono_literals;
+            ProxySelector proxies;
+            proxies.setAddrs( { "10.0.0.1:1", "10.0.0.2:1", "10.0.0.3:1" } );
+            auto now = ProxySelector::Clock::now( );
+            size_t index = 0;
+
+            proxies.recordRtt( 0, 40ms );
+            proxies.recordRtt( 1, 10ms );
+            proxies.recordRtt( 2, 20ms );
+            if ( !proxies.select( now, &index ) || index != 1 )
+                { throw std::exception{ "proxies.select( fastest )" }; }
+
+            // one slow sample moves the average an eighth of the way
+            proxies.recordRtt( 1, 90ms );
+            if ( proxies.proxy( 1 ).rttMillis < 19.9 || proxies.proxy( 1 ).rttMillis > 20.1 )
+                { throw std::exception{ "proxies.recordRtt( )" }; }
+
+            // a hot proxy is passed over for a slightly slower one
+            proxies.recordRtt( 1, 10ms );
+            proxies.recordLoad( 1, 2000 );
+            if ( !proxies.select( now, &index ) || index != 2 )
+                { throw std::exception{ "proxies.select( load )" }; }
+
+            proxies.recordFailure( 2, now );
+            if ( !proxies.select( now, &index ) || index != 0 )
+                { throw std::exception{ "proxies.select( failed )" }; }
+
+            proxies.recordFailure( 0, now );
+            proxies.recordFailure( 1, now );
+            proxies.recordFailure( 1, now );
+            if ( proxies.select( now, &index ) )
+                { throw std::exception{ "proxies.select( none )" }; }
+            auto delay = proxies.retryDelay( now );
+            if ( delay < ProxySelector::MinBackoff / 2 || delay > ProxySelector::MinBackoff )
+                { throw std::exception{ "proxies.retryDelay( )" }; }
+            if ( !proxies.select( now + ProxySelector::MaxBackoff, &index ) )
+                { throw std::exception{ "proxies.select( retry )" }; }
+
+            for ( uint32_t failures = 1; failures < 40; failures++ )
+            {
+                auto backoff = proxies.backoff( failures );
+                if ( backoff < ProxySelector::MinBackoff / 2 || backoff > ProxySelector::MaxBackoff )
+                    { throw std::exception{ "proxies.backoff( )" }; }
+            }
+            proxies.recordSuccess( 1 );
+            if ( proxies.proxy( 1 ).failures || !proxies.select( now, &index ) || index != 1 )
+                { throw std::exception{ "proxies.recordSuccess( )" }; }
+        }
+    }
+}
@@ -1,319 +1,2018 @@
-module;
-
-#include <cinttypes>
-#include <functional>
-#include <map>
-#include <set>
-#include <system_error>
-
-export module grim.net.proxy_server;
-
-import cpp.asio.ip;
-import cpp.asio.tcp;
-import cpp.log;
-import grim.arch.net;
-import grim.auth;
-import grim.net.session_server;
-
-
-export namespace grim::net
-{
-    class ProxyServer
-        : public IProxyServer
-    {
-    public:
-                                            ProxyServer( );
-
-        void                                open(
-                                                cpp::AsyncContext & io,
-                                                StrArg listenAddress4,
-                                                StrArg listenAddress6,
-                                                StrArg sessionAddress,
-                                                StrArg email,
-                                                uint8_t nodeId ) override;
-        void                                close( ) override;
-
-        void                                onAuthing( AuthingFn ) override;
-        void                                onAuth( AuthFn ) override;
-        void                                onReady( ReadyFn ) override;
-
-        void                                auth(
-                                                int timeoutSeconds,
-                                                AuthFn ) override;
-        bool                                auth(
-                                                int timeoutSeconds,
-                                                StrOut email,
-                                                uint64_t * sessionId,
-                                                Result * result ) override;
-
-        void                                ready(
-                                                int timeoutSeconds,
-                                                ReadyFn ) override;
-        bool                                ready(
-                                                int timeoutSeconds,
-                                                Result * result ) override;
-
-        class                               Data;
-
-    private:
-        void                                notifyAuthing( );
-        void                                notifyAuth( );
-        void                                notifyReady( );
-        // initialization
-        void                                doAuthLogin( );
-        void                                authLogin( grim::auth::Result result, grim::auth::AuthToken authToken );
-        void                                doSessionHello( );
-        void                                sessionHello( grim::auth::Result result, grim::auth::AuthToken authToken );
-        void                                doAuthReady( );
-        void                                authReady( grim::auth::Result result );
-        void                                doListen( );
-        // tcp handlers
-        void                                connect( std::error_code acceptError, const std::string & addr );
-        void                                receive( const std::string & addr, std::string & recvBuffer );
-        void                                disconnect( const std::string & addr, std::error_code reason );
-        // request handlers
-        void                                onConnect( StrArg ip ) override;
-        void                                onDisconnect( StrArg ip ) override;
-        void                                onHello( StrArg ip, uint64_t authToken, int nodeId ) override;
-        void                                onRello( StrArg ip, uint64_t sessionId, int nodeId ) override;
-        void                                onAuth( StrArg ip, StrArg extIp, uint64_t authToken );
-        void                                onReauth( StrArg ip, StrArg extIp, uint64_t sessionId );
-        void                                onAuthServer( StrArg ip, uint64_t sessionId, StrArg svcName, int nodeId );
-        void                                onLookupSession( StrArg ip, uint64_t sessionId );
-        void                                onLookupServer( StrArg ip, StrArg svcName, int nodeId );
-
-    private:
-        struct                              Detail;
-        std::unique_ptr<Detail>             detail = std::make_unique<Detail>( );
-    };
-
-
-    class ProxyServer::Data
-    {
-    public:
-        Result                              connected( std::string clientAddr );
-        Result                              disconnected( std::string clientAddr );
-        Result                              hello(
-                                                std::string clientAddr,
-                                                uint64_t authToken,
-                                                int nodeId,
-                                                uint64_t * sessionId );
-        Result                              rello(
-                                                std::string clientAddr,
-                                                uint64_t sessionId );
-
-        Result                              auth(
-                                                std::string clientAddr,
-                                                uint64_t authToken,
-                                                std::string extAddr,
-                                                uint64_t * sessionId );
-        Result                              reauth(
-                                                std::string clientAddr,
-                                                uint64_t sessionId,
-                                                std::string extAddr,
-                                                std::string * oldExtAddr );
-        Result                              authServerNode(
-                                                std::string clientAddr,
-                                                uint64_t sessionId,
-                                                std::string svcName, int nodeId );
-
-        Result                              openUdp(
-                                                uint64_t sessionId,
-                                                std::string intAddr,
-                                                std::string udpAddr );
-        Result                              closeUdp( uint64_t sessionId );
-        Result                              lookupUdp(
-                                                uint64_t sessionId,
-                                                std::string * extAddr,
-                                                std::string * intAddr,
-                                                std::string * udpAddr,
-                                                uint64_t * key );
-    public:
-        struct ServerNode
-        {
-            std::string                     service;
-            int                             nodeId;
-        };
-        struct SessionInfo
-        {
-            std::string                     extAddr;
-            std::string                     email;
-            uint64_t                        userId;
-            uint64_t                        proxySessionId;
-        };
-        struct SessionUdpInfo
-        {
-            std::string                     intAddr;
-            std::string                     udpAddr;
-            uint64_t                        key;
-        };
-        using                               SessionSet = std::set<uint64_t>;
-        using                               SessionUdpMap = std::map<uint64_t, SessionUdpInfo>;
-    private:
-        Result                              verifyConnection(
-                                                const std::string & clientAddr,
-                                                uint64_t * sessionId );
-        Result                              verifyServer(
-                                                uint64_t sessionId,
-                                                std::string_view * service,
-                                                int * nodeId );
-        Result                              verifySession(
-                                                uint64_t sessionId,
-                                                std::string_view * extAddr,
-                                                std::string_view * email,
-                                                uint64_t * userId,
-                                                uint64_t * proxySessionId );
-        Result                              verifyServerNetwork(
-                                                std::string serviceName,
-                                                std::string addr );
-        Result                              grimauth(
-                                                const std::string & extAddr,
-                                                uint64_t authToken,
-                                                const std::string & svc,
-                                                uint64_t * userId,
-                                                std::string * email );
-        uint64_t                            makeSessionId( );
-    private:
-        std::map<std::string, uint64_t>     clientSessions;
-        std::map<uint64_t, SessionSet>      proxySessions;
-        std::map<ServerNode, uint64_t>      serviceSessionMap;
-        std::map<uint64_t, ServerNode>      sessionServiceMap;
-        std::map<uint64_t, SessionInfo>     sessions;
-    };
-    namespace test
-    {
-        void                                testProxyServerData( );
-    };
-}
-
-namespace grim::net
-{
-    struct ProxyServer::Detail
-    {
-        std::string                         email;
-        std::string                         bindAddress4;
-        std::string                         bindAddress6;
-        cpp::AsyncContext                   io;
-        cpp::TcpServer                      tcp;
-        grim::net::SessionServer::Client    sessionClient;
-        grim::auth::Client                  grimauth;
-        grim::auth::AuthToken               authToken;
-
-        AuthingFn                           onAuthingHandler;
-        AuthFn                              onAuthHandler;
-        ReadyFn                             onReadyHandler;
-        ConnectFn                           onConnectHandler;
-        DisconnectFn                        onDisconnectHandler;
-
-        AuthFn                              authHandler;
-        ReadyFn                             readyHandler;
-        cpp::AsyncTimer                     handlerTimer;
-
-        uint64_t                            isAuthed : 1;
-        uint64_t                            isReady : 1;
-
-        Data                                data;
-    };
-
-    ProxyServer::ProxyServer( ) :
-        detail( std::make_unique<Detail>( ) )
-    {
-    }
-
-    void ProxyServer::open(
-            cpp::AsyncContext & io,
-            StrArg listenAddress4,
-            StrArg listenAddress6,
-            StrArg sessionAddress,
-            StrArg email,
-            uint8_t nodeId )
-    {
-        detail->isAuthed = false;
-        detail->isReady = false;
-
-        detail->io = io;
-        detail->bindAddress4 = listenAddress4;
-        detail->bindAddress6 = listenAddress6;
-        detail->email = email;
-        detail->grimauth.setAsyncContext( io );
-        doAuthLogin( );
-    }
-
-    void ProxyServer::close( )
-    {
-        detail->tcp.close( );
-    }
-
-    void ProxyServer::onAuthing( AuthingFn fn )
-    {
-        detail->onAuthingHandler = fn;
-    }
-
-    void ProxyServer::onAuth( AuthFn fn )
-    {
-        detail->onAuthHandler = fn;
-    }
-
-    void ProxyServer::onReady( ReadyFn fn )
-    {
-        detail->onReadyHandler = fn;
-    }
-
-    void ProxyServer::auth( int timeoutSeconds, AuthFn fn )
-    {
-        // if isReady, post result immediately
-        if ( detail->isAuthed )
-        { detail->io.post( [this, fn]( ) { fn( detail->email, 0, Result::Ok ); } ); return; }
-
-        // start a timer that will return timeout if it elapses before the readyHandler is called
-        detail->authHandler = fn;
-        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
-            { detail->authHandler( detail->email, 0, Result::Timeout ); } );
-    }
-
-    bool ProxyServer::auth(
-        int timeoutSeconds,
-        StrOut email,
-        uint64_t * sessionId,
-        Result * result )
-    {
-        *result = Result::Ok;
-        if ( !detail->isAuthed )
-        {
-            auto isAuthed = detail->io.createCondition<Result>( );
-            ready( timeoutSeconds, [&]( Result result )
-                { isAuthed.notify( result ); } );
-            *result = isAuthed.wait( );
-        }
-        *email = detail->email;
-        *sessionId = 0;
-
-        return *result == Result::Ok;
-    }
-
-    void ProxyServer::ready( int timeoutSeconds, ReadyFn fn )
-    {
-        // if isReady, post result immediately
-        if ( detail->isReady )
-        { detail->io.post( [fn]( ) { fn( Result::Ok ); } ); return; }
-
-        // start a timer that will return timeout if it elapses before the readyHandler is called
-        detail->readyHandler = fn;
-        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
-            { detail->readyHandler( Result::Timeout ); } );
-    }
-
-    bool ProxyServer::ready( int timeoutSeconds, Result * result )
-    {
-        *result = Result::Ok;
-        if ( !detail->isReady )
-        {
-            auto isReady = detail->io.createCondition<Result>( );
-            ready( timeoutSeconds, [&]( Result result )
-                { isReady.notify( result ); } );
-            *result = isReady.wait( );
-        }
-        return *result == Result::Ok;
-    }
-
-}
\ No newline at end of file
+module;
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+export module grim.net.proxy_server;
+
+import cpp.asio.ip;
+import cpp.asio.tcp;
+import cpp.log;
+import grim.arch.net;
+import grim.auth;
+import grim.net.bind;
+import grim.net.client;
+import grim.net.group;
+import grim.net.lanes;
+import grim.net.loopback;
+import grim.net.message;
+import grim.net.proxy_api;
+import grim.net.queue;
+import grim.net.relay;
+import grim.net.replay;
+import grim.net.route;
+import grim.net.schema;
+import grim.net.send_queue;
+import grim.net.session_server;
+import grim.net.stats;
+import grim.net.stream;
+import grim.net.tls;
+import grim.net.transport;
+
+
+export namespace grim::net
+{
+    class ProxyServer
+        : public IProxyServer
+    {
+    public:
+                                            ProxyServer( );
+
+        void                                open(
+                                                cpp::AsyncContext & io,
+                                                StrArg listenAddress4,
+                                                StrArg listenAddress6,
+                                                StrArg sessionAddress,
+                                                StrArg email,
+                                                uint8_t nodeId ) override;
+        //! runs `shardCount` accept loops, each on its own io context and thread (shard 0 runs on
+        //! `io`).  Connections stay on the shard that accepted them; shard N listens on the listen
+        //! port + N.
+        void                                open(
+                                                cpp::AsyncContext & io,
+                                                StrArg listenAddress4,
+                                                StrArg listenAddress6,
+                                                StrArg sessionAddress,
+                                                StrArg email,
+                                                uint8_t nodeId,
+                                                uint32_t shardCount );
+        //! listens on `shardCount` shards without logging in, and verifies client hellos and
+        //! rellos with `sessions` rather than the session service; for in-process ("loop:") tests
+        void                                openLocal(
+                                                cpp::AsyncContext & io,
+                                                StrArg listenAddress,
+                                                ISessionApi & sessions,
+                                                uint32_t shardCount );
+        void                                close( ) override;
+
+        void                                onAuthing( AuthingFn ) override;
+        void                                onAuth( AuthFn ) override;
+        void                                onReady( ReadyFn ) override;
+        void                                onBackpressure( BackpressureFn ) override;
+        void                                setSendLimits( const SendLimits & limits ) override;
+        //! frames of `type` between sessions go in `lane` on the way to clients (see grim.net.lanes);
+        //! applies to connections made after
+        void                                setLane( uint8_t type, Lane lane );
+        //! before open( ): clients connect over TLS, terminated here (see grim.net.tls).  Every
+        //! shard shares the session cache and ticket keys, so a client resumes on any of them, and
+        //! on any proxy given the same ticket key file.  Arg if the certificate or keys don't load.
+        Result                              setTls( const TlsServerConfig & config );
+        //! adds every shard's counters and latencies to `total` (see grim.net.stats); callable
+        //! from any thread while the proxy is open
+        void                                stats( NetStats * total ) const;
+
+        void                                auth(
+                                                int timeoutSeconds,
+                                                AuthFn ) override;
+        bool                                auth(
+                                                int timeoutSeconds,
+                                                StrOut email,
+                                                uint64_t * sessionId,
+                                                Result * result ) override;
+
+        void                                ready(
+                                                int timeoutSeconds,
+                                                ReadyFn ) override;
+        bool                                ready(
+                                                int timeoutSeconds,
+                                                Result * result ) override;
+
+        class                               Data;
+
+    private:
+        void                                notifyAuthing( );
+        void                                notifyAuth( );
+        void                                notifyReady( );
+        // initialization
+        void                                openShards( cpp::AsyncContext & io, uint32_t shardCount );
+        void                                doAuthLogin( );
+        void                                authLogin( grim::auth::Result result, grim::auth::AuthToken authToken );
+        void                                doSessionHello( );
+        void                                sessionHello( grim::auth::Result result, grim::auth::AuthToken authToken );
+        void                                doAuthReady( );
+        void                                authReady( grim::auth::Result result );
+        void                                doListen( );
+        // tcp handlers
+        struct                              Shard;
+        struct                              ShardMessage;
+        void                                connect( Shard & shard, std::error_code acceptError, const std::string & addr );
+        void                                receive( Shard & shard, const std::string & addr, std::string & recvBuffer );
+        void                                disconnect( Shard & shard, const std::string & addr, std::error_code reason );
+        void                                keepAlive( Shard & shard );
+        // sessions, verified with the session service on the main io context
+        void                                hello( Shard & shard, uint32_t connectionId, const Message & message, uint64_t authToken );
+        //! a server node's session may own groups (see grim.net.group)
+        void                                authServer( Shard & shard, uint32_t connectionId, const Message & message, const AuthServerRequest & request );
+        void                                joinGroup( Shard & shard, uint32_t connectionId, const Message & message, const GroupJoinRequest & request );
+        //! `clientReceived` is set for a rello which also resumes the stream, see resume( )
+        void                                rello( Shard & shard, uint32_t connectionId, const Message & message, uint64_t sessionId, std::optional<uint64_t> clientReceived );
+        //! false once the connection closed, e.g. while its hello was being verified
+        bool                                isCurrent( Shard & shard, ConnectionHandle handle ) const;
+        //! makes the connection the session's, on this shard and (by a broadcast Route) every other
+        void                                routeSession( Shard & shard, uint32_t connectionId, uint64_t sessionId );
+        //! a session routed to another shard no longer owns its connection or held frames here
+        void                                releaseSession( Shard & shard, uint64_t sessionId );
+        void                                reply( Shard & shard, uint32_t connectionId, const Message & request, Result result );
+        template<Schema T>
+        void                                reply( Shard & shard, uint32_t connectionId, const Message & request, Result result, const T & data );
+        // forwarding
+        void                                forward( Shard & shard, uint32_t connectionId, const Message & message, char * frame, size_t frameSize );
+        //! copies a frame sent to one of the sender's groups to each member
+        void                                sendGroup( Shard & shard, uint32_t connectionId, const Message & message, char * frame, size_t frameSize );
+        void                                replyRoute( Shard & shard, uint32_t connectionId, const Message & request );
+        void                                queueFrame( Shard & shard, uint32_t connectionId, const char * frame, size_t frameSize );
+        void                                scheduleFlush( Shard & shard, uint32_t connectionId );
+        void                                notifyBackpressure( Shard & shard, uint32_t connectionId );
+        void                                didAck( Shard & shard, uint32_t connectionId, uint64_t received );
+        // resumption
+        //! once the rello is verified, attaches the session detached here if it dropped from the
+        //! same host and its replay still has every frame the client missed; false otherwise
+        bool                                resume( Shard & shard, uint32_t connectionId, const Message & message, uint64_t sessionId, uint64_t clientReceived );
+        bool                                hold( Shard & shard, uint64_t sessionId, const char * frame, size_t frameSize );
+        void                                expire( Shard & shard, uint64_t sessionId );
+        void                                broadcast( Shard & shard, const ShardMessage & message );
+        void                                post( Shard & shard, ShardMessage message );
+        void                                drain( Shard & shard );
+        void                                flush( Shard & shard );
+        // datagram relay, on the main io context
+        void                                openUdp( Shard & shard, uint32_t connectionId, const Message & message, const std::string & intAddr );
+        void                                closeUdp( uint64_t sessionId );
+        void                                replyUdp( Shard & shard, const std::string & addr, const Message & request, Result result, uint64_t key );
+        void                                replyProbe( Shard & shard, uint32_t connectionId, const Message & request );
+        //! ties are taken in turn, so clients probing at once are spread out rather than all sent
+        //! to the same shard
+        uint16_t                            leastLoadedShard( );
+        void                                replyStats( Shard & shard, uint32_t connectionId, const Message & request );
+        // request handlers
+        void                                onConnect( StrArg ip ) override;
+        void                                onDisconnect( StrArg ip ) override;
+        void                                onRecv( ConnectionHandle connection, const Message & message, const cpp::Memory & data ) override;
+        void                                onHello( StrArg ip, uint64_t authToken, int nodeId );
+        void                                onRello( StrArg ip, uint64_t sessionId, int nodeId );
+        void                                onAuth( StrArg ip, StrArg extIp, uint64_t authToken );
+        void                                onReauth( StrArg ip, StrArg extIp, uint64_t sessionId );
+        void                                onAuthServer( StrArg ip, uint64_t sessionId, StrArg svcName, int nodeId );
+        void                                onLookupSession( StrArg ip, uint64_t sessionId );
+        void                                onLookupServer( StrArg ip, StrArg svcName, int nodeId );
+
+    private:
+        struct                              Detail;
+        std::unique_ptr<Detail>             detail = std::make_unique<Detail>( );
+    };
+
+
+    class ProxyServer::Data
+    {
+    public:
+        Result                              hello(
+                                                std::string clientAddr,
+                                                uint64_t authToken,
+                                                int nodeId,
+                                                uint64_t * sessionId );
+        Result                              rello(
+                                                std::string clientAddr,
+                                                uint64_t sessionId );
+
+        Result                              auth(
+                                                std::string clientAddr,
+                                                uint64_t authToken,
+                                                std::string extAddr,
+                                                uint64_t * sessionId );
+        Result                              reauth(
+                                                std::string clientAddr,
+                                                uint64_t sessionId,
+                                                std::string extAddr,
+                                                std::string * oldExtAddr );
+        Result                              authServerNode(
+                                                std::string clientAddr,
+                                                uint64_t sessionId,
+                                                std::string svcName, int nodeId );
+
+        Result                              openUdp(
+                                                uint64_t sessionId,
+                                                std::string intAddr,
+                                                std::string udpAddr );
+        Result                              closeUdp( uint64_t sessionId );
+        Result                              lookupUdp(
+                                                uint64_t sessionId,
+                                                std::string * extAddr,
+                                                std::string * intAddr,
+                                                std::string * udpAddr,
+                                                uint64_t * key );
+    public:
+        struct ServerNode
+        {
+            std::string                     service;
+            int                             nodeId;
+        };
+        struct SessionInfo
+        {
+            std::string                     extAddr;
+            std::string                     email;
+            uint64_t                        userId;
+            uint64_t                        proxySessionId;
+        };
+        struct SessionUdpInfo
+        {
+            std::string                     intAddr;
+            std::string                     udpAddr;
+            uint64_t                        key;
+        };
+        using                               SessionSet = std::set<uint64_t>;
+        using                               SessionUdpMap = std::map<uint64_t, SessionUdpInfo>;
+    private:
+        Result                              verifyConnection(
+                                                const std::string & clientAddr,
+                                                uint64_t * sessionId );
+        Result                              verifyServer(
+                                                uint64_t sessionId,
+                                                std::string_view * service,
+                                                int * nodeId );
+        Result                              verifySession(
+                                                uint64_t sessionId,
+                                                std::string_view * extAddr,
+                                                std::string_view * email,
+                                                uint64_t * userId,
+                                                uint64_t * proxySessionId );
+        Result                              verifyServerNetwork(
+                                                std::string serviceName,
+                                                std::string addr );
+        Result                              grimauth(
+                                                const std::string & extAddr,
+                                                uint64_t authToken,
+                                                const std::string & svc,
+                                                uint64_t * userId,
+                                                std::string * email );
+        uint64_t                            makeSessionId( );
+    private:
+        std::map<std::string, uint64_t>     clientSessions;
+        std::map<uint64_t, SessionSet>      proxySessions;
+        std::map<ServerNode, uint64_t>      serviceSessionMap;
+        std::map<uint64_t, ServerNode>      sessionServiceMap;
+        std::map<uint64_t, SessionInfo>     sessions;
+    };
+    namespace test
+    {
+        void                                testProxyServerData( );
+        //! a frame between sessions on different shards, over the loop transport, and a probe
+        //! steered to the shard with fewer connections
+        void                                testProxyShards( );
+        //! a group frame to members on the sender's shard and another
+        void                                testProxyShardGroups( );
+        //! a resume is verified with the session service, and then gets the frame held for it
+        void                                testProxyResume( );
+        //! a stream longer than the credit window, between two Clients through the proxy
+        void                                testProxyStream( );
+        //! `sessionCount` sessions over the loop transport each send `framesPerSession` frames at
+        //! once through the proxy, then one frame hops from session to session `hopCount` times;
+        //! logs frames forwarded per second, and the latency one forward adds
+        void                                benchProxyRelay( size_t sessionCount = 10000, size_t framesPerSession = 16, size_t hopCount = 10000 );
+        //! the relay bench's burst on 1 to 16 shards; logs frames forwarded per second against one
+        //! shard's
+        void                                benchProxyShards( size_t sessionCount = 16000, size_t framesPerSession = 64 );
+    };
+}
+
+namespace grim::net
+{
+    struct ProxyServer::Detail
+    {
+        std::string                         email;
+        std::string                         bindAddress4;
+        std::string                         bindAddress6;
+        cpp::AsyncContext                   io;
+        grim::net::SessionServer::Client    sessionClient;
+        //! the session service, unless openLocal( ) was given another
+        ISessionApi *                       sessions = nullptr;
+        grim::auth::Client                  grimauth;
+        grim::auth::AuthToken               authToken;
+
+        AuthingFn                           onAuthingHandler;
+        AuthFn                              onAuthHandler;
+        ReadyFn                             onReadyHandler;
+        ConnectFn                           onConnectHandler;
+        DisconnectFn                        onDisconnectHandler;
+        //! called on the connection's shard
+        BackpressureFn                      onBackpressureHandler;
+        SendLimits                          sendLimits;
+        std::array<Lane, 256>               lanes{ };
+        //! null for plain tcp
+        std::unique_ptr<TlsServerContext>   tls;
+
+        AuthFn                              authHandler;
+        ReadyFn                             readyHandler;
+        cpp::AsyncTimer                     handlerTimer;
+
+        uint64_t                            isAuthed : 1;
+        uint64_t                            isReady : 1;
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        //! over every shard; reported to clients as the proxy's load
+        std::atomic<uint32_t>               connectionCount = 0;
+        //! where the next probe starts looking for the least loaded shard
+        std::atomic<uint32_t>               nextShard = 0;
+        Data                                data;
+
+        //! datagrams are relayed on the first listen address (as udp), by the main io context
+        DatagramRelay                       relay;
+        uint16_t                            udpPort = 0;
+
+        //! messages to the proxy itself, by type; anything else goes to onRecv
+        SchemaTable<Shard &, uint32_t>      control;
+    };
+
+    //! messages between shards; frames are batched per io turn, route changes are broadcast so
+    //! every shard's session -> shard replica stays current.  A group frame is posted once to each
+    //! shard with members, shared by all of them, with the members routed to that shard.
+    struct ProxyServer::ShardMessage
+    {
+        enum class                          Kind { Frames, Route, Unroute, Group };
+        Kind                                kind = Kind::Frames;
+        uint64_t                            sessionId = 0;
+        uint32_t                            shardIndex = 0;
+        std::string                         frames;
+        std::shared_ptr<const std::string>  frame;
+        std::vector<uint64_t>               members;
+    };
+
+    struct ProxyServer::Shard
+    {
+        //! a connection is addressed by index on the forwarding path, its address is only used to
+        //! find it once per receive callback
+        struct Connection
+        {
+            std::string                     addr;
+            //! bumped each time the slot is reused, see ConnectionHandle
+            uint32_t                        generation = 0;
+            uint64_t                        sessionId = 0;
+            MessageReader                   reader;
+            LaneWriter                      writer;
+            //! frames sent to the session which it has not acked, and the frames received from it
+            ReplayBuffer                    replay;
+            uint64_t                        received = 0;
+            uint64_t                        acked = 0;
+            size_t                          unackedBytes = 0;
+            //! bounds the writer and what was sent but not acked, for a slow client
+            SendQueue                       sendQueue;
+            ConnectionStats                 stats;
+            bool                            isUsed = false;
+            bool                            isFlushPending = false;
+            bool                            isDisconnecting = false;
+        };
+        //! a session whose connection dropped, kept for a rello from the same host; frames sent to
+        //! it meanwhile are held in its replay buffer
+        struct Detached
+        {
+            std::string                     host;
+            ReplayBuffer                    replay;
+            uint64_t                        received = 0;
+            cpp::AsyncTimer                 expiry;
+        };
+        static constexpr int                ResumeSeconds = 30;
+
+        uint32_t                            index = 0;
+        cpp::AsyncContext                   io;
+        TransportServer                     tcp;
+        std::thread                         thread;
+
+        std::map<std::string, uint32_t>     connectionIds;
+        std::vector<Connection>             connections;
+        std::vector<uint32_t>               freeConnections;
+        std::vector<uint32_t>               flushConnections;
+        std::vector<uint32_t>               reflushConnections;
+        bool                                isFlushPending = false;
+        //! sessions connected to this shard -> connection index
+        RouteTable                          routes;
+        //! every session -> owning shard, only used when there is more than one shard
+        RouteTable                          shardRoutes;
+        //! frames bound for other shards, indexed by shard
+        std::vector<std::string>            outbox;
+        //! members of the group being sent, routed to other shards, indexed by shard
+        std::vector<std::vector<uint64_t>>  groupMembers;
+        //! the groups of sessions on this shard, kept until the owner's session expires
+        GroupTable                          groups;
+        //! sessions on this shard verified as server nodes, the only owners of groups; kept as long
+        //! as their groups
+        std::set<uint64_t>                  serverNodes;
+        std::map<uint64_t, Detached>        detached;
+
+        MpscQueue<ShardMessage>             inbox;
+        std::atomic<bool>                   isDrainPending = false;
+        //! read by whichever shard answers a probe, to steer clients to the least loaded shard
+        std::atomic<uint32_t>               connectionCount = 0;
+
+        //! written by this shard only, see ProxyServer::stats( )
+        NetStats                            stats;
+        //! a loop listener holds no work as a tcp acceptor does, so this keeps the shard's thread
+        //! running until close( )
+        cpp::AsyncTimer                     idle;
+    };
+
+    std::string hostOf( const std::string & addr )
+    {
+        // as AuthCache keys its entries, the port of a reconnect is expected to differ
+        size_t colon = addr.find_last_of( ':' );
+        if ( colon != std::string::npos && addr.find( ']', colon ) == std::string::npos )
+            { return addr.substr( 0, colon ); }
+        return addr;
+    }
+
+    std::string ackFrame( uint64_t toSessionId, uint64_t received )
+    {
+        Message message{ };
+        message.toSessionId = toSessionId;
+        MessageWriter frame;
+        putMessage( frame, message, Ack{ received } );
+        return std::string{ frame.getAll( ) };
+    }
+
+    ProxyServer::ProxyServer( ) :
+        detail( std::make_unique<Detail>( ) )
+    {
+        detail->sessions = &detail->sessionClient;
+        auto & control = detail->control;
+        control.on<HelloRequest>( [this]( Shard & shard, uint32_t connectionId, const Message & message, const HelloRequest & request )
+            { hello( shard, connectionId, message, request.authToken ); } );
+        control.on<OpenUdpRequest>( [this]( Shard & shard, uint32_t connectionId, const Message & message, const OpenUdpRequest & request )
+            { openUdp( shard, connectionId, message, request.intAddr ); } );
+        control.on<CloseUdpRequest>( [this]( Shard & shard, uint32_t connectionId, const Message &, const CloseUdpRequest & )
+            {
+                uint64_t sessionId = shard.connections[connectionId].sessionId;
+                if ( sessionId )
+                    { detail->io.post( [this, sessionId]( ) { closeUdp( sessionId ); } ); }
+            } );
+        control.on<ProbeRequest>( [this]( Shard & shard, uint32_t connectionId, const Message & message, const ProbeRequest & )
+            { replyProbe( shard, connectionId, message ); } );
+        control.on<StatsRequest>( [this]( Shard & shard, uint32_t connectionId, const Message & message, const StatsRequest & )
+            { replyStats( shard, connectionId, message ); } );
+        control.on<AuthServerRequest>( [this]( Shard & shard, uint32_t connectionId, const Message & message, const AuthServerRequest & request )
+            { authServer( shard, connectionId, message, request ); } );
+        control.on<GroupJoinRequest>( [this]( Shard & shard, uint32_t connectionId, const Message & message, const GroupJoinRequest & request )
+            { joinGroup( shard, connectionId, message, request ); } );
+        control.on<GroupLeaveRequest>( [this]( Shard & shard, uint32_t connectionId, const Message &, const GroupLeaveRequest & request )
+            { shard.groups.leave( shard.connections[connectionId].sessionId, request.groupId, request.sessionId ); } );
+        control.on<GroupCloseRequest>( [this]( Shard & shard, uint32_t connectionId, const Message &, const GroupCloseRequest & request )
+            { shard.groups.close( shard.connections[connectionId].sessionId, request.groupId ); } );
+        control.on<Ack>( [this]( Shard & shard, uint32_t connectionId, const Message &, const Ack & ack )
+            { didAck( shard, connectionId, ack.received ); } );
+        // a rello which also resumes carries the client's count (see ResumeRequest)
+        control.on( (uint8_t)IProxyApi::MessageType::Rello, [this]( Shard & shard, uint32_t connectionId, const Message & message, const cpp::Memory & data )
+            {
+                ResumeRequest request{ };
+                if ( decode( data, &request ) )
+                    { rello( shard, connectionId, message, request.sessionId, request.receivedCount ); return; }
+                RelloRequest plain{ };
+                decode( data, &plain );
+                rello( shard, connectionId, message, plain.sessionId, std::nullopt );
+            } );
+        control.onInvalid( [this]( Shard & shard, uint32_t connectionId, const Message & message, const cpp::Memory & )
+            {
+                if ( message.type == (uint8_t)OpenUdpRequest::Type )
+                    { replyUdp( shard, shard.connections[connectionId].addr, message, Result::Arg, 0 ); }
+            } );
+    }
+
+    void ProxyServer::open(
+            cpp::AsyncContext & io,
+            StrArg listenAddress4,
+            StrArg listenAddress6,
+            StrArg sessionAddress,
+            StrArg email,
+            uint8_t nodeId )
+    {
+        open( io, listenAddress4, listenAddress6, sessionAddress, email, nodeId, 1 );
+    }
+
+    void ProxyServer::open(
+            cpp::AsyncContext & io,
+            StrArg listenAddress4,
+            StrArg listenAddress6,
+            StrArg sessionAddress,
+            StrArg email,
+            uint8_t nodeId,
+            uint32_t shardCount )
+    {
+        detail->isAuthed = false;
+        detail->isReady = false;
+        openShards( io, shardCount );
+
+        detail->io = io;
+        detail->bindAddress4 = listenAddress4;
+        detail->bindAddress6 = listenAddress6;
+        detail->email = email;
+        detail->sessions = &detail->sessionClient;
+        detail->grimauth.setAsyncContext( io );
+        doAuthLogin( );
+    }
+
+    void ProxyServer::openLocal(
+            cpp::AsyncContext & io,
+            StrArg listenAddress,
+            ISessionApi & sessions,
+            uint32_t shardCount )
+    {
+        detail->isAuthed = true;
+        detail->isReady = false;
+        openShards( io, shardCount );
+
+        detail->io = io;
+        detail->bindAddress4 = listenAddress;
+        detail->bindAddress6.clear( );
+        detail->sessions = &sessions;
+        doListen( );
+    }
+
+    void ProxyServer::openShards( cpp::AsyncContext & io, uint32_t shardCount )
+    {
+        shardCount = std::max( shardCount, 1u );
+        detail->shards.clear( );
+        for ( uint32_t i = 0; i < shardCount; i++ )
+        {
+            auto shard = std::make_unique<Shard>( );
+            shard->index = i;
+            if ( i == 0 )
+                { shard->io = io; }
+            shard->outbox.resize( shardCount );
+            shard->groupMembers.resize( shardCount );
+            detail->shards.push_back( std::move( shard ) );
+        }
+    }
+
+    void ProxyServer::close( )
+    {
+        detail->relay.close( );
+        // a detached session's timer would keep its shard running
+        auto closeShard = []( Shard & shard )
+            {
+                for ( auto & [sessionId, held] : shard.detached )
+                    { held.expiry.cancel( ); }
+                shard.detached.clear( );
+                shard.idle.cancel( );
+                shard.tcp.close( );
+            };
+        for ( auto & shard : detail->shards )
+        {
+            if ( shard->index == 0 )
+                { closeShard( *shard ); }
+            else
+                { shard->io.post( [s = shard.get( ), closeShard]( ) { closeShard( *s ); } ); }
+        }
+        // a shard's io context runs out of work once its listener and connections are closed
+        for ( auto & shard : detail->shards )
+        {
+            if ( shard->thread.joinable( ) )
+                { shard->thread.join( ); }
+        }
+    }
+
+    void ProxyServer::onAuthing( AuthingFn fn )
+    {
+        detail->onAuthingHandler = fn;
+    }
+
+    void ProxyServer::onAuth( AuthFn fn )
+    {
+        detail->onAuthHandler = fn;
+    }
+
+    void ProxyServer::onReady( ReadyFn fn )
+    {
+        detail->onReadyHandler = fn;
+    }
+
+    void ProxyServer::onBackpressure( BackpressureFn fn )
+    {
+        detail->onBackpressureHandler = fn;
+    }
+
+    void ProxyServer::setSendLimits( const SendLimits & limits )
+    {
+        detail->sendLimits = limits;
+    }
+
+    void ProxyServer::setLane( uint8_t type, Lane lane )
+    {
+        detail->lanes[type] = lane;
+    }
+
+    Result ProxyServer::setTls( const TlsServerConfig & config )
+    {
+        auto tls = std::make_unique<TlsServerContext>( );
+        Result result = tls->open( config );
+        if ( result == Result::Ok )
+            { detail->tls = std::move( tls ); }
+        return result;
+    }
+
+    void ProxyServer::auth( int timeoutSeconds, AuthFn fn )
+    {
+        // if isReady, post result immediately
+        if ( detail->isAuthed )
+        { detail->io.post( [this, fn]( ) { fn( detail->email, 0, Result::Ok ); } ); return; }
+
+        // start a timer that will return timeout if it elapses before the readyHandler is called
+        detail->authHandler = fn;
+        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
+            { detail->authHandler( detail->email, 0, Result::Timeout ); } );
+    }
+
+    bool ProxyServer::auth(
+        int timeoutSeconds,
+        StrOut email,
+        uint64_t * sessionId,
+        Result * result )
+    {
+        *result = Result::Ok;
+        if ( !detail->isAuthed )
+        {
+            auto isAuthed = detail->io.createCondition<Result>( );
+            ready( timeoutSeconds, [&]( Result result )
+                { isAuthed.notify( result ); } );
+            *result = isAuthed.wait( );
+        }
+        *email = detail->email;
+        *sessionId = 0;
+
+        return *result == Result::Ok;
+    }
+
+    void ProxyServer::ready( int timeoutSeconds, ReadyFn fn )
+    {
+        // if isReady, post result immediately
+        if ( detail->isReady )
+        { detail->io.post( [fn]( ) { fn( Result::Ok ); } ); return; }
+
+        // start a timer that will return timeout if it elapses before the readyHandler is called
+        detail->readyHandler = fn;
+        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
+            { detail->readyHandler( Result::Timeout ); } );
+    }
+
+    bool ProxyServer::ready( int timeoutSeconds, Result * result )
+    {
+        *result = Result::Ok;
+        if ( !detail->isReady )
+        {
+            auto isReady = detail->io.createCondition<Result>( );
+            ready( timeoutSeconds, [&]( Result result )
+                { isReady.notify( result ); } );
+            *result = isReady.wait( );
+        }
+        return *result == Result::Ok;
+    }
+
+
+    void ProxyServer::doListen( )
+    {
+        using namespace std::placeholders;
+        auto udpPortPos = detail->bindAddress4.find_last_of( ':' );
+        if ( udpPortPos != std::string::npos )
+            { detail->udpPort = (uint16_t)std::stoi( detail->bindAddress4.substr( udpPortPos + 1 ) ); }
+        // in process there is no udp to relay over
+        if ( !isLoopAddress( detail->bindAddress4 ) )
+            { detail->relay.open( detail->io, detail->bindAddress4 ); }
+
+        for ( auto & shard : detail->shards )
+        {
+            Shard * s = shard.get( );
+            auto listen = [this, s]( )
+                {
+                    s->tcp.setTls( detail->tls.get( ), &s->stats );
+                    s->tcp.open(
+                        s->io,
+                        shardAddress( detail->bindAddress4, s->index ),
+                        shardAddress( detail->bindAddress6, s->index ),
+                        std::bind( &ProxyServer::connect, this, std::ref( *s ), _1, _2 ),
+                        std::bind( &ProxyServer::receive, this, std::ref( *s ), _1, _2 ),
+                        std::bind( &ProxyServer::disconnect, this, std::ref( *s ), _1, _2 ) );
+                };
+            if ( s->index == 0 )
+                { listen( ); }
+            else
+            {
+                if ( isLoopAddress( detail->bindAddress4 ) )
+                    { keepAlive( *s ); }
+                s->io.post( listen );
+                s->thread = std::thread( [s]( ) { s->io.run( ); } );
+            }
+        }
+        notifyReady( );
+    }
+
+    void ProxyServer::keepAlive( Shard & shard )
+    {
+        shard.idle = shard.io.waitFor( cpp::Duration::ofSeconds( 60 ), [this, &shard]( ) { keepAlive( shard ); } );
+    }
+
+    void ProxyServer::connect( Shard & shard, std::error_code acceptError, const std::string & addr )
+    {
+        if ( acceptError )
+        {
+            cpp::Log::error( "connect() : addr='{}' msg='{}'", addr, acceptError.message( ) );
+            return;
+        }
+        cpp::Log::info( "connect() : addr='{}' shard={}", addr, shard.index );
+
+        uint32_t connectionId;
+        if ( !shard.freeConnections.empty( ) )
+        {
+            connectionId = shard.freeConnections.back( );
+            shard.freeConnections.pop_back( );
+        }
+        else
+        {
+            connectionId = (uint32_t)shard.connections.size( );
+            shard.connections.emplace_back( );
+        }
+        auto & connection = shard.connections[connectionId];
+        connection.addr = addr;
+        connection.generation++;
+        connection.sessionId = 0;
+        connection.reader.reset( );
+        connection.writer.clear( );
+        for ( size_t type = 0; type < detail->lanes.size( ); type++ )
+            { connection.writer.setLane( (uint8_t)type, detail->lanes[type] ); }
+        connection.replay.reset( );
+        connection.received = connection.acked = 0;
+        connection.unackedBytes = 0;
+        connection.sendQueue.reset( );
+        connection.sendQueue.setLimits( detail->sendLimits );
+        connection.stats.reset( );
+        connection.isUsed = true;
+        connection.isFlushPending = false;
+        connection.isDisconnecting = false;
+        shard.connectionIds[addr] = connectionId;
+        shard.stats.connects.add( );
+        detail->connectionCount++;
+        shard.connectionCount++;
+    }
+
+    void ProxyServer::receive( Shard & shard, const std::string & addr, std::string & recvBuffer )
+    {
+        auto itr = shard.connectionIds.find( addr );
+        if ( itr == shard.connectionIds.end( ) )
+            { return; }
+        uint32_t connectionId = itr->second;
+        auto & connection = shard.connections[connectionId];
+        connection.reader.relay( recvBuffer, [&]( const Message & message, char * frame, size_t frameSize )
+            {
+                shard.stats.countRecv( message.type, frameSize );
+                connection.stats.countRecv( frameSize );
+                if ( connection.sessionId && isSequenced( message ) )
+                {
+                    connection.received++;
+                    connection.unackedBytes += frameSize;
+                }
+                if ( message.toSessionId )
+                    { forward( shard, connectionId, message, frame, frameSize ); }
+                else
+                {
+                    auto data = cpp::Memory{ recvBuffer }.substr( frame - recvBuffer.data( ) + MessageHeaderSize, frameSize - MessageHeaderSize );
+                    if ( !detail->control.dispatch( shard, connectionId, message, data ) )
+                        { onRecv( ConnectionHandle{ connectionId, connection.generation }, message, data ); }
+                }
+            } );
+        if ( connection.sessionId && ( connection.received - connection.acked >= ReplayAckFrames || connection.unackedBytes >= ReplayAckBytes ) )
+        {
+            std::string ack = ackFrame( connection.sessionId, connection.received );
+            connection.acked = connection.received;
+            connection.unackedBytes = 0;
+            queueFrame( shard, connectionId, ack.data( ), ack.size( ) );
+        }
+    }
+
+    void ProxyServer::disconnect( Shard & shard, const std::string & addr, std::error_code reason )
+    {
+        cpp::Log::info( "disconnect() : addr='{}' msg='{}'", addr, reason.message( ) );
+        if ( auto itr = shard.connectionIds.find( addr ); itr != shard.connectionIds.end( ) )
+        {
+            uint32_t connectionId = itr->second;
+            auto & connection = shard.connections[connectionId];
+            // a rello may already have moved the session to a newer connection
+            if ( connection.sessionId && shard.routes.find( connection.sessionId ) == connectionId )
+            {
+                // what was not sent yet is held with the rest, for the resume
+                connection.writer.drain( [&connection]( const char * frame, size_t frameSize )
+                    {
+                        if ( isSequenced( decodeHeader( frame ) ) )
+                            { connection.replay.push( frame, frameSize ); }
+                    } );
+                // the session stays routed to this shard (and its udp endpoint open) until it expires
+                uint64_t sessionId = connection.sessionId;
+                shard.routes.erase( sessionId );
+                auto & held = shard.detached[sessionId];
+                held.expiry.cancel( );
+                held.host = hostOf( connection.addr );
+                held.replay = std::move( connection.replay );
+                held.received = connection.received;
+                held.expiry = shard.io.waitFor( cpp::Duration::ofSeconds( Shard::ResumeSeconds ), [this, &shard, sessionId]( )
+                    { expire( shard, sessionId ); } );
+            }
+            connection.addr.clear( );
+            connection.sessionId = 0;
+            connection.writer.clear( );
+            connection.replay.reset( );
+            connection.received = connection.acked = 0;
+            connection.sendQueue.reset( );
+            connection.isUsed = false;
+            shard.freeConnections.push_back( connectionId );
+            shard.connectionIds.erase( itr );
+            shard.stats.disconnects.add( );
+            detail->connectionCount--;
+            shard.connectionCount--;
+        }
+    }
+
+    void ProxyServer::hello( Shard & shard, uint32_t connectionId, const Message & message, uint64_t authToken )
+    {
+        auto & connection = shard.connections[connectionId];
+        // a connection has one session for as long as it is open
+        if ( connection.sessionId )
+            { reply( shard, connectionId, message, Result::Access ); return; }
+        ConnectionHandle handle{ connectionId, connection.generation };
+        std::string addr = connection.addr;
+        detail->io.post( [=, this, &shard]( )
+            {
+                auto done = [=, this, &shard]( Result result, uint64_t sessionId, std::string email )
+                    {
+                        shard.io.post( [=, this, &shard]( )
+                            {
+                                if ( !isCurrent( shard, handle ) || shard.connections[handle.index].sessionId )
+                                    { return; }
+                                if ( result == Result::Ok )
+                                    { routeSession( shard, handle.index, sessionId ); }
+                                reply( shard, handle.index, message, result, HelloReply{ email, sessionId } );
+                            } );
+                    };
+                detail->sessions->auth( addr, authToken, [=, this]( uint64_t sessionId, Result result )
+                    {
+                        if ( result != Result::Ok )
+                            { done( result, 0, { } ); return; }
+                        detail->sessions->lookupSession( sessionId, [=]( uint64_t, std::string email, Result lookupResult )
+                            { done( lookupResult, sessionId, email ); } );
+                    } );
+            } );
+    }
+
+    void ProxyServer::authServer( Shard & shard, uint32_t connectionId, const Message & message, const AuthServerRequest & request )
+    {
+        auto & connection = shard.connections[connectionId];
+        uint64_t sessionId = connection.sessionId;
+        if ( !sessionId )
+            { reply( shard, connectionId, message, Result::Access ); return; }
+        ConnectionHandle handle{ connectionId, connection.generation };
+        detail->io.post( [=, this, &shard]( )
+            {
+                auto done = [=, this, &shard]( Result result, std::string email )
+                    {
+                        shard.io.post( [=, this, &shard]( )
+                            {
+                                if ( !isCurrent( shard, handle ) || shard.connections[handle.index].sessionId != sessionId )
+                                    { return; }
+                                if ( result == Result::Ok )
+                                    { shard.serverNodes.insert( sessionId ); }
+                                reply( shard, handle.index, message, result, AuthServerReply{ email, sessionId } );
+                            } );
+                    };
+                // the session service checks the session's user may run the service
+                detail->sessions->authServerNode( sessionId, request.svcName, request.nodeId, [=, this]( uint64_t, Result result )
+                    {
+                        if ( result != Result::Ok )
+                            { done( result, { } ); return; }
+                        detail->sessions->lookupSession( sessionId, [=]( uint64_t, std::string email, Result lookupResult )
+                            { done( lookupResult, email ); } );
+                    } );
+            } );
+    }
+
+    void ProxyServer::joinGroup( Shard & shard, uint32_t connectionId, const Message & message, const GroupJoinRequest & request )
+    {
+        // any session could otherwise grow the shard's group table, so only server nodes own groups
+        uint64_t owner = shard.connections[connectionId].sessionId;
+        Result result = Result::Ok;
+        if ( !owner || !shard.serverNodes.contains( owner ) )
+            { result = Result::Access; }
+        else if ( !isGroupId( request.groupId ) )
+            { result = Result::Arg; }
+        else
+            { result = shard.groups.join( owner, request.groupId, request.sessionId ); }
+        if ( result != Result::Ok )
+            { cpp::Log::info( "joinGroup() : owner={:x} groupId={:x} result={}", owner, request.groupId, std::to_underlying( result ) ); }
+        reply( shard, connectionId, message, result );
+    }
+
+    void ProxyServer::rello( Shard & shard, uint32_t connectionId, const Message & message, uint64_t sessionId, std::optional<uint64_t> clientReceived )
+    {
+        auto & connection = shard.connections[connectionId];
+        if ( connection.sessionId || !sessionId )
+            { reply( shard, connectionId, message, connection.sessionId ? Result::Access : Result::Arg ); return; }
+        ConnectionHandle handle{ connectionId, connection.generation };
+        std::string addr = connection.addr;
+        detail->io.post( [=, this, &shard]( )
+            {
+                // the session service checks the session is from this client's host, before anything
+                // held for it is handed over
+                detail->sessions->reauth( addr, sessionId, [=, this, &shard]( uint64_t, Result result )
+                    {
+                        shard.io.post( [=, this, &shard]( )
+                            {
+                                if ( !isCurrent( shard, handle ) || shard.connections[handle.index].sessionId )
+                                    { return; }
+                                if ( result != Result::Ok )
+                                    { reply( shard, handle.index, message, result ); return; }
+                                if ( clientReceived && resume( shard, handle.index, message, sessionId, *clientReceived ) )
+                                    { return; }
+                                // the session starts over here, without what was held for it; the reply
+                                // has no count, so the client knows the stream was not resumed
+                                routeSession( shard, handle.index, sessionId );
+                                reply( shard, handle.index, message, result );
+                            } );
+                    } );
+            } );
+    }
+
+    bool ProxyServer::isCurrent( Shard & shard, ConnectionHandle handle ) const
+    {
+        if ( handle.index >= shard.connections.size( ) )
+            { return false; }
+        auto & connection = shard.connections[handle.index];
+        return connection.isUsed && connection.generation == handle.generation && !connection.isDisconnecting;
+    }
+
+    void ProxyServer::routeSession( Shard & shard, uint32_t connectionId, uint64_t sessionId )
+    {
+        releaseSession( shard, sessionId );
+        shard.connections[connectionId].sessionId = sessionId;
+        shard.routes.insert( sessionId, connectionId );
+        broadcast( shard, ShardMessage{ ShardMessage::Kind::Route, sessionId, shard.index } );
+    }
+
+    void ProxyServer::releaseSession( Shard & shard, uint64_t sessionId )
+    {
+        // a connection it left, whose drop has not been seen yet, relays nothing more as it
+        uint32_t connectionId = shard.routes.find( sessionId );
+        if ( connectionId != RouteTable::NoRoute )
+        {
+            shard.connections[connectionId].sessionId = 0;
+            shard.routes.erase( sessionId );
+        }
+        // and what was held for it is not resent
+        if ( auto itr = shard.detached.find( sessionId ); itr != shard.detached.end( ) )
+        {
+            itr->second.expiry.cancel( );
+            shard.detached.erase( itr );
+        }
+    }
+
+    void ProxyServer::reply( Shard & shard, uint32_t connectionId, const Message & request, Result result )
+    {
+        if ( !request.bind )
+            { return; }
+        Message message{ };
+        message.moniker = request.moniker;
+        message.bind = request.bind;
+        message.type = request.type;
+        message.result = (uint8_t)result;
+        message.toSessionId = shard.connections[connectionId].sessionId;
+        char header[MessageHeaderSize];
+        encodeHeader( header, message );
+        queueFrame( shard, connectionId, header, MessageHeaderSize );
+    }
+
+    template<Schema T>
+    void ProxyServer::reply( Shard & shard, uint32_t connectionId, const Message & request, Result result, const T & data )
+    {
+        if ( !request.bind )
+            { return; }
+        Message message{ };
+        message.moniker = request.moniker;
+        message.bind = request.bind;
+        message.result = (uint8_t)result;
+        message.toSessionId = shard.connections[connectionId].sessionId;
+        MessageWriter frame;
+        putMessage( frame, message, data );
+        auto encoded = frame.getAll( );
+        queueFrame( shard, connectionId, encoded.data( ), encoded.length( ) );
+    }
+
+    void ProxyServer::forward( Shard & shard, uint32_t connectionId, const Message & message, char * frame, size_t frameSize )
+    {
+        if ( isGroupId( message.toSessionId ) )
+        {
+            sendGroup( shard, connectionId, message, frame, frameSize );
+            return;
+        }
+        auto & from = shard.connections[connectionId];
+        uint32_t toConnectionId = RouteTable::NoRoute;
+        uint32_t toShardIndex = RouteTable::NoRoute;
+        if ( from.sessionId )
+        {
+            toConnectionId = shard.routes.find( message.toSessionId );
+            if ( toConnectionId == RouteTable::NoRoute && detail->shards.size( ) > 1 )
+                { toShardIndex = shard.shardRoutes.find( message.toSessionId ); }
+        }
+
+        if ( toConnectionId == RouteTable::NoRoute && ( toShardIndex == RouteTable::NoRoute || toShardIndex == shard.index ) )
+        {
+            if ( from.sessionId && shard.detached.contains( message.toSessionId ) )
+            {
+                setFromSessionId( frame, from.sessionId );
+                hold( shard, message.toSessionId, frame, frameSize );
+                return;
+            }
+            // unauthenticated sender or unknown destination
+            replyRoute( shard, connectionId, message );
+            return;
+        }
+
+        // the sender's session is authoritative, everything else is relayed as received
+        setFromSessionId( frame, from.sessionId );
+        if ( toConnectionId != RouteTable::NoRoute )
+            { queueFrame( shard, toConnectionId, frame, frameSize ); }
+        else
+        {
+            // batched with every other frame for that shard during this io turn
+            shard.outbox[toShardIndex].append( frame, frameSize );
+            if ( !shard.isFlushPending )
+            {
+                shard.isFlushPending = true;
+                shard.io.post( [this, &shard]( ) { flush( shard ); } );
+            }
+        }
+    }
+
+    void ProxyServer::sendGroup( Shard & shard, uint32_t connectionId, const Message & message, char * frame, size_t frameSize )
+    {
+        auto & from = shard.connections[connectionId];
+        auto members = from.sessionId ? shard.groups.find( from.sessionId, message.toSessionId ) : nullptr;
+        // nothing could tell the replies of many members apart, so a bound frame is refused
+        if ( !members || message.bind )
+        {
+            replyRoute( shard, connectionId, message );
+            return;
+        }
+
+        // the frame keeps the group id, so members can tell group messages apart
+        setFromSessionId( frame, from.sessionId );
+        for ( uint64_t sessionId : *members )
+        {
+            uint32_t toConnectionId = shard.routes.find( sessionId );
+            if ( toConnectionId != RouteTable::NoRoute )
+                { queueFrame( shard, toConnectionId, frame, frameSize ); continue; }
+            uint32_t toShardIndex = detail->shards.size( ) > 1 ? shard.shardRoutes.find( sessionId ) : RouteTable::NoRoute;
+            if ( toShardIndex == RouteTable::NoRoute || toShardIndex == shard.index )
+                { hold( shard, sessionId, frame, frameSize ); }
+            else
+                { shard.groupMembers[toShardIndex].push_back( sessionId ); }
+        }
+
+        std::shared_ptr<const std::string> shared;
+        for ( uint32_t i = 0; i < shard.groupMembers.size( ); i++ )
+        {
+            if ( shard.groupMembers[i].empty( ) )
+                { continue; }
+            if ( !shared )
+                { shared = std::make_shared<const std::string>( frame, frameSize ); }
+            // frames already batched for that shard go first, so each member sees the sender's order
+            if ( !shard.outbox[i].empty( ) )
+            {
+                ShardMessage frames;
+                frames.frames = std::move( shard.outbox[i] );
+                shard.outbox[i].clear( );
+                post( *detail->shards[i], std::move( frames ) );
+            }
+            ShardMessage group;
+            group.kind = ShardMessage::Kind::Group;
+            group.frame = shared;
+            group.members = std::move( shard.groupMembers[i] );
+            shard.groupMembers[i].clear( );
+            post( *detail->shards[i], std::move( group ) );
+        }
+    }
+
+    void ProxyServer::replyRoute( Shard & shard, uint32_t connectionId, const Message & request )
+    {
+        // a reply which cannot be delivered is not answered
+        if ( !request.bind || ( request.moniker & ReplyMoniker ) )
+            { return; }
+        Message reply{ };
+        // it stands in for the other session's reply (see ReplyMoniker)
+        reply.moniker = request.moniker | ReplyMoniker;
+        reply.bind = request.bind;
+        reply.type = request.type;
+        reply.result = (uint8_t)Result::Route;
+        reply.toSessionId = shard.connections[connectionId].sessionId;
+        reply.fromSessionId = request.toSessionId;
+        char header[MessageHeaderSize];
+        encodeHeader( header, reply );
+        queueFrame( shard, connectionId, header, MessageHeaderSize );
+    }
+
+    void ProxyServer::queueFrame( Shard & shard, uint32_t connectionId, const char * frame, size_t frameSize )
+    {
+        auto & connection = shard.connections[connectionId];
+        if ( connection.isDisconnecting )
+            { return; }
+        Message header = decodeHeader( frame );
+        // session to session frames without a bind are the ones nothing waits for
+        bool isDroppable = !header.bind && header.toSessionId && header.fromSessionId;
+        auto verdict = connection.sendQueue.admit( connection.writer.size( ), frameSize, isDroppable );
+        if ( verdict == SendQueue::Verdict::Disconnect )
+        {
+            cpp::Log::info( "queueFrame() : addr='{}' msg='send queue full' queued={}", connection.addr, connection.writer.size( ) + connection.sendQueue.inFlight( ) );
+            connection.isDisconnecting = true;
+            connection.writer.clear( );
+            notifyBackpressure( shard, connectionId );
+            shard.io.post( [&shard, addr = connection.addr]( )
+                { shard.tcp.disconnect( addr, std::make_error_code( std::errc::no_buffer_space ) ); } );
+            return;
+        }
+        if ( verdict == SendQueue::Verdict::Queue )
+        {
+            shard.stats.countSent( header.type, frameSize );
+            connection.stats.countSent( frameSize );
+            // pushed to the replay buffer as it is sent, see flush( )
+            connection.writer.putFrame( frame, frameSize );
+            scheduleFlush( shard, connectionId );
+        }
+        notifyBackpressure( shard, connectionId );
+    }
+
+    void ProxyServer::scheduleFlush( Shard & shard, uint32_t connectionId )
+    {
+        auto & connection = shard.connections[connectionId];
+        if ( !connection.isFlushPending )
+        {
+            connection.isFlushPending = true;
+            shard.flushConnections.push_back( connectionId );
+        }
+        // every frame relayed during this io turn is flushed with one send per connection
+        if ( !shard.isFlushPending )
+        {
+            shard.isFlushPending = true;
+            shard.io.post( [this, &shard]( ) { flush( shard ); } );
+        }
+    }
+
+    void ProxyServer::notifyBackpressure( Shard & shard, uint32_t connectionId )
+    {
+        auto & connection = shard.connections[connectionId];
+        if ( !connection.sendQueue.update( connection.writer.size( ) ) || !detail->onBackpressureHandler )
+            { return; }
+        detail->onBackpressureHandler( connection.addr, connection.sendQueue.isBlocked( ), connection.writer.size( ) + connection.sendQueue.inFlight( ) );
+    }
+
+    void ProxyServer::didAck( Shard & shard, uint32_t connectionId, uint64_t received )
+    {
+        auto & connection = shard.connections[connectionId];
+        connection.replay.ack( received );
+        connection.sendQueue.ack( received );
+        // the window may have reopened for whatever is waiting
+        if ( !connection.writer.isEmpty( ) )
+            { scheduleFlush( shard, connectionId ); }
+        notifyBackpressure( shard, connectionId );
+    }
+
+    bool ProxyServer::resume( Shard & shard, uint32_t connectionId, const Message & message, uint64_t sessionId, uint64_t clientReceived )
+    {
+        auto & connection = shard.connections[connectionId];
+        auto itr = shard.detached.find( sessionId );
+        if ( itr == shard.detached.end( ) || itr->second.host != hostOf( connection.addr ) )
+            { return false; }
+        // the gap is whatever the client has not received; if some of it was dropped the session
+        // is not resumed
+        MessageWriter gap;
+        if ( !itr->second.replay.resend( clientReceived, [&gap]( const char * frame, size_t frameSize ) { gap.putFrame( frame, frameSize ); } ) )
+            { return false; }
+
+        Shard::Detached held = std::move( itr->second );
+        shard.detached.erase( itr );
+        held.expiry.cancel( );
+        shard.stats.reconnects.add( );
+        routeSession( shard, connectionId, sessionId );
+        held.replay.ack( clientReceived );
+        connection.replay = std::move( held.replay );
+        connection.received = connection.acked = held.received;
+
+        // the reply is not sequenced, so it goes ahead of the gap
+        Message reply{ };
+        reply.moniker = message.moniker;
+        reply.bind = message.bind;
+        reply.result = (uint8_t)Result::Ok;
+        reply.toSessionId = sessionId;
+        MessageWriter frame;
+        putMessage( frame, reply, ResumeReply{ held.received } );
+        auto encoded = frame.getAll( );
+        shard.stats.countSent( (uint8_t)ResumeReply::Type, encoded.length( ) );
+        connection.stats.countSent( encoded.length( ) );
+        connection.writer.putResent( encoded.data( ), encoded.length( ) );
+        // already held in the replay buffer, so not queued (and pushed) again
+        auto frames = gap.getAll( );
+        connection.writer.putResent( frames.data( ), frames.length( ) );
+        scheduleFlush( shard, connectionId );
+        return true;
+    }
+
+    bool ProxyServer::hold( Shard & shard, uint64_t sessionId, const char * frame, size_t frameSize )
+    {
+        auto itr = shard.detached.find( sessionId );
+        if ( itr == shard.detached.end( ) )
+            { return false; }
+        itr->second.replay.push( frame, frameSize );
+        return true;
+    }
+
+    void ProxyServer::expire( Shard & shard, uint64_t sessionId )
+    {
+        if ( !shard.detached.erase( sessionId ) )
+            { return; }
+        shard.groups.closeAll( sessionId );
+        shard.serverNodes.erase( sessionId );
+        broadcast( shard, ShardMessage{ ShardMessage::Kind::Unroute, sessionId, shard.index } );
+        detail->io.post( [this, sessionId]( ) { closeUdp( sessionId ); } );
+    }
+
+    void ProxyServer::broadcast( Shard & shard, const ShardMessage & message )
+    {
+        if ( detail->shards.size( ) == 1 )
+            { return; }
+        for ( auto & other : detail->shards )
+            { post( *other, message ); }
+    }
+
+    void ProxyServer::post( Shard & shard, ShardMessage message )
+    {
+        shard.inbox.push( std::move( message ) );
+        // one drain is posted per batch of pushes, not per push
+        if ( !shard.isDrainPending.exchange( true ) )
+            { shard.io.post( [this, &shard]( ) { drain( shard ); } ); }
+    }
+
+    void ProxyServer::drain( Shard & shard )
+    {
+        shard.isDrainPending.store( false );
+        ShardMessage message;
+        while ( shard.inbox.pop( message ) )
+        {
+            switch ( message.kind )
+            {
+            case ShardMessage::Kind::Route:
+                shard.shardRoutes.insert( message.sessionId, message.shardIndex );
+                // the session moved to another shard (a rello which could not resume here), so the
+                // groups it had here go too; its client joins them again
+                if ( message.shardIndex != shard.index )
+                {
+                    releaseSession( shard, message.sessionId );
+                    shard.groups.closeAll( message.sessionId );
+                }
+                break;
+            case ShardMessage::Kind::Unroute:
+                if ( shard.shardRoutes.find( message.sessionId ) == message.shardIndex )
+                    { shard.shardRoutes.erase( message.sessionId ); }
+                break;
+            case ShardMessage::Kind::Frames:
+                for ( size_t offset = 0; offset + MessageHeaderSize <= message.frames.size( ); )
+                {
+                    const char * frame = message.frames.data( ) + offset;
+                    Message header = decodeHeader( frame );
+                    size_t frameSize = MessageHeaderSize + (size_t)header.len * MessageAlignment;
+                    // the session may have disconnected since the frame was sent, it is dropped
+                    uint32_t toConnectionId = shard.routes.find( header.toSessionId );
+                    if ( toConnectionId != RouteTable::NoRoute )
+                        { queueFrame( shard, toConnectionId, frame, frameSize ); }
+                    else
+                        { hold( shard, header.toSessionId, frame, frameSize ); }
+                    offset += frameSize;
+                }
+                break;
+            case ShardMessage::Kind::Group:
+                for ( uint64_t sessionId : message.members )
+                {
+                    uint32_t toConnectionId = shard.routes.find( sessionId );
+                    if ( toConnectionId != RouteTable::NoRoute )
+                        { queueFrame( shard, toConnectionId, message.frame->data( ), message.frame->size( ) ); }
+                    else
+                        { hold( shard, sessionId, message.frame->data( ), message.frame->size( ) ); }
+                }
+                break;
+            }
+        }
+    }
+
+    void ProxyServer::flush( Shard & shard )
+    {
+        shard.isFlushPending = false;
+        // connections with bulk frames left, flushed again next turn
+        std::vector<uint32_t> & again = shard.reflushConnections;
+        for ( uint32_t connectionId : shard.flushConnections )
+        {
+            auto & connection = shard.connections[connectionId];
+            connection.isFlushPending = false;
+            if ( !connection.isUsed || connection.writer.isEmpty( ) )
+                { continue; }
+            // a client which has not acked a window's worth gets nothing more until it does, the
+            // writer holds what is queued meanwhile (see SendQueue)
+            if ( !connection.sendQueue.canSend( ) )
+                { continue; }
+            // an ack rides along with anything else sent
+            if ( connection.sessionId && connection.received > connection.acked )
+            {
+                std::string ack = ackFrame( connection.sessionId, connection.received );
+                connection.writer.putFrame( ack.data( ), ack.size( ) );
+                connection.acked = connection.received;
+                connection.unackedBytes = 0;
+            }
+            // frames are numbered for replay in the order they go on the wire, which is the order
+            // the client counts them in (control frames overtake bulk ones)
+            auto batch = connection.writer.take( [&connection]( const char * frame, size_t frameSize )
+                {
+                    if ( connection.sessionId && isSequenced( decodeHeader( frame ) ) )
+                        { connection.replay.push( frame, frameSize ); }
+                } );
+            shard.tcp.send( connection.addr, batch );
+            if ( connection.sessionId )
+                { connection.sendQueue.sent( batch.length( ), connection.replay.sent( ) ); }
+            if ( !connection.writer.isEmpty( ) )
+                { again.push_back( connectionId ); }
+        }
+        shard.flushConnections.clear( );
+        for ( uint32_t connectionId : again )
+            { scheduleFlush( shard, connectionId ); }
+        again.clear( );
+
+        for ( uint32_t i = 0; i < shard.outbox.size( ); i++ )
+        {
+            if ( shard.outbox[i].empty( ) )
+                { continue; }
+            ShardMessage message;
+            message.frames = std::move( shard.outbox[i] );
+            shard.outbox[i].clear( );
+            post( *detail->shards[i], std::move( message ) );
+        }
+    }
+
+    void ProxyServer::openUdp( Shard & shard, uint32_t connectionId, const Message & message, const std::string & intAddr )
+    {
+        auto & connection = shard.connections[connectionId];
+        if ( !connection.sessionId )
+            { replyUdp( shard, connection.addr, message, Result::Access, 0 ); return; }
+
+        // the session service issues the key, the relay table belongs to the main io context
+        uint64_t sessionId = connection.sessionId;
+        std::string addr = connection.addr;
+        detail->io.post( [=, this, &shard]( )
+            {
+                detail->sessions->openUdp( sessionId, intAddr, detail->bindAddress4, [=, this, &shard]( uint64_t key, Result result )
+                    {
+                        if ( result == Result::Ok )
+                            { detail->relay.add( sessionId, key ); }
+                        shard.io.post( [=, this, &shard]( ) { replyUdp( shard, addr, message, result, key ); } );
+                    } );
+            } );
+    }
+
+    void ProxyServer::closeUdp( uint64_t sessionId )
+    {
+        if ( !detail->relay.contains( sessionId ) )
+            { return; }
+        detail->relay.remove( sessionId );
+        detail->sessions->closeUdp( sessionId, []( uint64_t, Result ) { } );
+    }
+
+    void ProxyServer::replyUdp( Shard & shard, const std::string & addr, const Message & request, Result result, uint64_t key )
+    {
+        auto itr = shard.connectionIds.find( addr );
+        if ( itr == shard.connectionIds.end( ) || !request.bind )
+            { return; }
+        Message reply{ };
+        reply.moniker = request.moniker;
+        reply.bind = request.bind;
+        reply.result = (uint8_t)result;
+        reply.toSessionId = shard.connections[itr->second].sessionId;
+        MessageWriter frame;
+        putMessage( frame, reply, OpenUdpReply{ key, detail->udpPort } );
+        auto encoded = frame.getAll( );
+        queueFrame( shard, itr->second, encoded.data( ), encoded.length( ) );
+    }
+
+    void ProxyServer::replyProbe( Shard & shard, uint32_t connectionId, const Message & request )
+    {
+        if ( !request.bind )
+            { return; }
+        Message reply{ };
+        reply.moniker = request.moniker;
+        reply.bind = request.bind;
+        reply.result = (uint8_t)Result::Ok;
+        MessageWriter frame;
+        putMessage( frame, reply, ProbeReply{ detail->connectionCount.load( ), leastLoadedShard( ) } );
+        auto encoded = frame.getAll( );
+        queueFrame( shard, connectionId, encoded.data( ), encoded.length( ) );
+    }
+
+    uint16_t ProxyServer::leastLoadedShard( )
+    {
+        auto & shards = detail->shards;
+        size_t first = detail->nextShard++ % shards.size( );
+        size_t best = first;
+        for ( size_t i = 1; i < shards.size( ); i++ )
+        {
+            size_t index = ( first + i ) % shards.size( );
+            if ( shards[index]->connectionCount < shards[best]->connectionCount )
+                { best = index; }
+        }
+        return (uint16_t)best;
+    }
+
+    void ProxyServer::replyStats( Shard & shard, uint32_t connectionId, const Message & request )
+    {
+        if ( !request.bind )
+            { return; }
+        NetStats total;
+        stats( &total );
+        Message reply{ };
+        reply.moniker = request.moniker;
+        reply.bind = request.bind;
+        reply.result = (uint8_t)Result::Ok;
+        reply.toSessionId = shard.connections[connectionId].sessionId;
+        MessageWriter frame;
+        putMessage( frame, reply, StatsReply{ total.dump( ) + shard.connections[connectionId].stats.dump( ) } );
+        auto encoded = frame.getAll( );
+        queueFrame( shard, connectionId, encoded.data( ), encoded.length( ) );
+    }
+
+    void ProxyServer::stats( NetStats * total ) const
+    {
+        for ( auto & shard : detail->shards )
+            { shard->stats.addTo( *total ); }
+    }
+
+    void ProxyServer::onConnect( StrArg ip )
+    {
+
+    }
+
+    void ProxyServer::onDisconnect( StrArg ip )
+    {
+
+    }
+
+    void ProxyServer::onRecv( ConnectionHandle connection, const Message & message, const cpp::Memory & data )
+    {
+
+    }
+
+    namespace test
+    {
+        //! gives each auth token the session of the same id, which rellos only from the host it
+        //! said hello from; any session may be a node of the "test" service
+        class TestSessions
+            : public ISessionApi
+        {
+        public:
+            void                            auth( std::string extAddr, uint64_t authToken, OnSessionResult fn ) override
+            {
+                hosts[authToken] = hostOf( extAddr );
+                fn( authToken, Result::Ok );
+            }
+            void                            reauth( std::string extAddr, uint64_t sessionId, OnSessionResult fn ) override
+            {
+                auto itr = hosts.find( sessionId );
+                fn( sessionId, itr != hosts.end( ) && itr->second == hostOf( extAddr ) ? Result::Ok : Result::Access );
+            }
+            void                            authServerNode( uint64_t sessionId, std::string svcName, int, OnSessionResult fn ) override
+                { fn( sessionId, svcName == "test" && hosts.contains( sessionId ) ? Result::Ok : Result::Access ); }
+            void                            lookupServerNode( std::string, int, OnSessionResult fn ) override
+                { fn( 0, Result::Route ); }
+            void                            lookupSession( uint64_t sessionId, OnLookupSession fn ) override
+                { fn( sessionId, "test@grimethos.com", hosts.contains( sessionId ) ? Result::Ok : Result::Route ); }
+            void                            openUdp( uint64_t, std::string, std::string, OnOpenUdp fn ) override
+                { fn( 0, Result::Access ); }
+            void                            closeUdp( uint64_t sessionId, OnSessionResult fn ) override
+                { fn( sessionId, Result::Ok ); }
+            void                            lookupUdp( uint64_t, OnLookupUdp fn ) override
+                { fn( { }, { }, { }, 0, Result::Route ); }
+
+            std::map<uint64_t, std::string> hosts;
+        };
+
+        //! a client of the proxy under test, which says hello (or rellos) once connected and keeps
+        //! the frames other sessions send it, and the proxy's replies; `onChange` is called after each
+        struct TestPeer
+        {
+            LoopClient                      loop;
+            MessageReader                   reader;
+            uint64_t                        sessionId = 0;
+            std::vector<std::pair<Message, std::string>> frames;
+            std::vector<std::pair<Message, std::string>> replies;
+
+            void hello( cpp::AsyncContext & io, const std::string & addr, uint64_t authToken, std::function<void( )> onChange )
+                { connect( io, addr, HelloRequest{ authToken }, onChange ); }
+            void resume( cpp::AsyncContext & io, const std::string & addr, uint64_t sessionId, uint64_t receivedCount, std::function<void( )> onChange )
+                { connect( io, addr, ResumeRequest{ sessionId, receivedCount }, onChange ); }
+
+            template<Schema T>
+            void connect( cpp::AsyncContext & io, const std::string & addr, const T & request, std::function<void( )> onChange )
+            {
+                loop.connect( io, addr,
+                    [this, request]( std::error_code error )
+                    {
+                        if ( error )
+                            { return; }
+                        Message message{ };
+                        message.bind = 1;
+                        MessageWriter frame;
+                        putMessage( frame, message, request );
+                        loop.send( frame.getAll( ) );
+                    },
+                    [this, onChange]( std::string & recvBuffer )
+                    {
+                        reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                            {
+                                HelloReply reply{ };
+                                if ( message.fromSessionId )
+                                    { frames.emplace_back( message, std::string{ data.data( ), data.length( ) } ); }
+                                else if ( message.bind )
+                                {
+                                    replies.emplace_back( message, std::string{ data.data( ), data.length( ) } );
+                                    bool isOk = message.result == (uint8_t)Result::Ok;
+                                    if ( isOk && message.type == (uint8_t)HelloReply::Type && decode( data, &reply ) )
+                                        { sessionId = reply.sessionId; }
+                                    else if ( isOk && message.type == (uint8_t)ResumeReply::Type )
+                                        { sessionId = message.toSessionId; }
+                                }
+                                else
+                                    { return; }
+                                onChange( );
+                            } );
+                    },
+                    []( std::error_code ) { } );
+            }
+
+            void send( uint64_t toSessionId, uint8_t type, const std::string & data )
+            {
+                Message message{ };
+                message.type = type;
+                message.toSessionId = toSessionId;
+                MessageWriter frame;
+                frame.put( message, data );
+                loop.send( frame.getAll( ) );
+            }
+        };
+
+        void testProxyShards( )
+        {
+            cpp::AsyncContext io;
+            TestSessions sessions;
+            ProxyServer proxy;
+            // shard 1 listens on the next port
+            proxy.openLocal( io, "loop:proxy:1", sessions, 2 );
+
+            TestPeer a;
+            TestPeer b;
+            TestPeer c;
+            bool isSent = false;
+            bool isClosed = false;
+            auto step = [&]( )
+                {
+                    if ( !isSent && a.sessionId && b.sessionId && c.sessionId )
+                    {
+                        isSent = true;
+                        a.send( b.sessionId, 42, "across shards" );
+                        // shard 0 has two connections, shard 1 one
+                        Message probe{ };
+                        probe.bind = 2;
+                        MessageWriter frame;
+                        putMessage( frame, probe, ProbeRequest{ } );
+                        c.loop.send( frame.getAll( ) );
+                    }
+                    if ( !isClosed && !b.frames.empty( ) && c.replies.size( ) == 2 )
+                    {
+                        isClosed = true;
+                        proxy.close( );
+                    }
+                };
+            a.hello( io, "loop:proxy:1", 0x11, step );
+            b.hello( io, "loop:proxy:2", 0x22, step );
+            c.hello( io, "loop:proxy:1", 0x33, step );
+            io.run( );
+
+            if ( a.sessionId != 0x11 || b.sessionId != 0x22 )
+                { throw std::exception{ "proxy.hello( )" }; }
+            ProbeReply probe{ };
+            if ( c.replies.size( ) != 2 || !decode( c.replies[1].second, &probe ) || probe.load != 3 || probe.shardIndex != 1 )
+                { throw std::exception{ "proxy.replyProbe( shard )" }; }
+            if ( shardAddress( "loop:proxy:1", probe.shardIndex ) != "loop:proxy:2" )
+                { throw std::exception{ "shardAddress( )" }; }
+            if ( b.frames.size( ) != 1 || b.frames[0].first.fromSessionId != a.sessionId || b.frames[0].first.type != 42
+                || b.frames[0].second.substr( 0, 13 ) != "across shards" )
+                { throw std::exception{ "proxy.forward( shards )" }; }
+        }
+
+        void testProxyShardGroups( )
+        {
+            cpp::AsyncContext io;
+            TestSessions sessions;
+            ProxyServer proxy;
+            proxy.openLocal( io, "loop:groups:1", sessions, 2 );
+
+            // the owner and one member on shard 0, the other member on shard 1
+            TestPeer owner;
+            TestPeer near;
+            TestPeer far;
+            uint64_t groupId = makeGroupId( 7 );
+            bool isAuthing = false;
+            bool isSent = false;
+            bool isClosed = false;
+            auto isReplied = []( TestPeer & peer, uint8_t type, Result result )
+                {
+                    return std::any_of( peer.replies.begin( ), peer.replies.end( ), [&]( auto & reply )
+                        { return reply.first.type == type && reply.first.result == (uint8_t)result; } );
+                };
+            auto step = [&]( )
+                {
+                    // only a server node's session owns groups
+                    if ( !isAuthing && owner.sessionId && near.sessionId && far.sessionId )
+                    {
+                        isAuthing = true;
+                        Message bound{ };
+                        bound.bind = 2;
+                        MessageWriter frames;
+                        putMessage( frames, bound, GroupJoinRequest{ groupId, owner.sessionId } );
+                        near.loop.send( frames.getAll( ) );
+                        frames.clear( );
+                        putMessage( frames, bound, AuthServerRequest{ "test", 1 } );
+                        owner.loop.send( frames.getAll( ) );
+                    }
+                    if ( !isSent && isReplied( owner, (uint8_t)AuthServerReply::Type, Result::Ok ) && isReplied( near, (uint8_t)GroupJoinRequest::Type, Result::Access ) )
+                    {
+                        isSent = true;
+                        MessageWriter frames;
+                        putMessage( frames, Message{ }, GroupJoinRequest{ groupId, near.sessionId } );
+                        putMessage( frames, Message{ }, GroupJoinRequest{ groupId, far.sessionId } );
+                        owner.loop.send( frames.getAll( ) );
+                        owner.send( groupId, 42, "to the group" );
+                    }
+                    if ( !isClosed && !near.frames.empty( ) && !far.frames.empty( ) )
+                    {
+                        isClosed = true;
+                        proxy.close( );
+                    }
+                };
+            owner.hello( io, "loop:groups:1", 0x11, step );
+            near.hello( io, "loop:groups:1", 0x22, step );
+            far.hello( io, "loop:groups:2", 0x33, step );
+            io.run( );
+
+            if ( !isSent )
+                { throw std::exception{ "proxy.joinGroup( server node )" }; }
+            for ( TestPeer * member : { &near, &far } )
+            {
+                if ( member->frames.size( ) != 1 || member->frames[0].first.fromSessionId != owner.sessionId
+                    || member->frames[0].first.toSessionId != groupId || member->frames[0].second.substr( 0, 12 ) != "to the group" )
+                    { throw std::exception{ "proxy.sendGroup( shards )" }; }
+            }
+        }
+
+        void testProxyResume( )
+        {
+            cpp::AsyncContext io;
+            TestSessions sessions;
+            ProxyServer proxy;
+            proxy.openLocal( io, "loop:resume:1", sessions, 1 );
+
+            TestPeer a;
+            TestPeer b;
+            TestPeer intruder;
+            TestPeer resumed;
+            cpp::AsyncTimer poll;
+            std::string host;
+            bool isDropped = false;
+            bool isClosed = false;
+            std::function<void( )> step;
+            // once the proxy has seen `a` drop, `b` sends it a frame to be held and the service stops
+            // vouching for its session
+            std::function<void( )> waitForDrop = [&]( )
+                {
+                    NetStats total;
+                    proxy.stats( &total );
+                    if ( !total.disconnects.get( ) )
+                        { poll = io.waitFor( cpp::Duration::ofMillis( 10 ), waitForDrop ); return; }
+                    b.send( 0x11, 42, "held" );
+                    host = sessions.hosts[0x11];
+                    sessions.hosts.erase( 0x11 );
+                    intruder.resume( io, "loop:resume:1", 0x11, 0, step );
+                };
+            step = [&]( )
+                {
+                    if ( !isDropped && a.sessionId && b.sessionId )
+                    {
+                        isDropped = true;
+                        a.loop.disconnect( );
+                        waitForDrop( );
+                    }
+                    // turned away, so the same session from the same host may now resume
+                    if ( intruder.replies.size( ) == 1 && resumed.replies.empty( ) && !sessions.hosts.contains( 0x11 ) )
+                    {
+                        sessions.hosts[0x11] = host;
+                        resumed.resume( io, "loop:resume:1", 0x11, 0, step );
+                    }
+                    if ( !isClosed && !resumed.frames.empty( ) )
+                    {
+                        isClosed = true;
+                        proxy.close( );
+                    }
+                };
+            a.hello( io, "loop:resume:1", 0x11, step );
+            b.hello( io, "loop:resume:1", 0x22, step );
+            io.run( );
+
+            if ( intruder.sessionId || intruder.replies.size( ) != 1 || intruder.replies[0].first.result != (uint8_t)Result::Access
+                || !intruder.frames.empty( ) )
+                { throw std::exception{ "proxy.resume( unverified )" }; }
+            ResumeReply reply{ };
+            if ( resumed.sessionId != 0x11 || resumed.replies.size( ) != 1 || !decode( resumed.replies[0].second.data( ), resumed.replies[0].second.size( ), &reply ) )
+                { throw std::exception{ "proxy.resume( )" }; }
+            if ( resumed.frames.size( ) != 1 || resumed.frames[0].first.fromSessionId != 0x22 || resumed.frames[0].second.substr( 0, 4 ) != "held" )
+                { throw std::exception{ "proxy.resume( gap )" }; }
+        }
+
+        void testProxyStream( )
+        {
+            cpp::AsyncContext io;
+            TestSessions sessions;
+            ProxyServer proxy;
+            proxy.openLocal( io, "loop:stream:1", sessions, 1 );
+
+            // three windows and a padded last part
+            std::string payload( 3 * StreamWindow * StreamPartSize + 13, '\0' );
+            for ( size_t i = 0; i < payload.size( ); i++ )
+                { payload[i] = (char)( i * 7 ); }
+            Client sender;
+            Client receiver;
+            std::string received;
+            int requests = 0;
+            Result result = Result::Unknown;
+            bool isSent = false;
+            cpp::AsyncTimer deadline;
+            auto finish = [&]( )
+                {
+                    deadline.cancel( );
+                    sender.close( );
+                    receiver.close( );
+                    proxy.close( );
+                };
+            receiver.onRecv( [&]( const Message & message, StrArg data )
+                {
+                    requests++;
+                    received.assign( data.data( ), data.length( ) );
+                    receiver.send( message.fromSessionId, message.moniker, message.bind, message.type, (uint8_t)Result::Ok, cpp::Memory{ } );
+                } );
+            auto onReady = [&]( Result readyResult )
+                {
+                    if ( readyResult != Result::Ok || isSent )
+                        { return; }
+                    isSent = true;
+                    sender.sendStream( 0x22, 42, payload, [&]( const Message & reply, StrArg )
+                        {
+                            result = (Result)reply.result;
+                            finish( );
+                        } );
+                };
+            receiver.onReady( [&]( Result readyResult )
+                {
+                    if ( readyResult == Result::Ok )
+                        { sender.open( io, "test@grimethos.com", auth::AuthToken{ 0x11 }, "loop:stream:1" ); }
+                } );
+            sender.onReady( onReady );
+            receiver.open( io, "test@grimethos.com", auth::AuthToken{ 0x22 }, "loop:stream:1" );
+            deadline = io.waitFor( cpp::Duration::ofSeconds( 10 ), finish );
+            io.run( );
+
+            if ( result != Result::Ok || requests != 1 )
+                { throw std::exception{ "client.sendStream( )" }; }
+            if ( received != payload )
+                { throw std::exception{ "client.sendStream( reassembled )" }; }
+        }
+
+        struct RelayBenchResult
+        {
+            size_t                          forwarded = 0;
+            double                          seconds = 0;
+            std::vector<double>             hopMicros;
+        };
+
+        //! the relay bench on `shardCount` shards.  The sessions of each shard are driven by a
+        //! thread of their own and send to sessions on the same shard, so neither side of the
+        //! proxy holds the shards back; hops are only timed when one frame is in flight.
+        RelayBenchResult runRelayBench( const std::string & addr, uint32_t shardCount, size_t sessionCount, size_t framesPerSession, size_t hopCount )
+        {
+            using Clock = std::chrono::steady_clock;
+            constexpr uint8_t BurstType = 40;
+            constexpr uint8_t HopType = 41;
+            sessionCount -= sessionCount % shardCount;
+            cpp::AsyncContext io;
+            TestSessions sessions;
+            ProxyServer proxy;
+            proxy.openLocal( io, addr, sessions, shardCount );
+
+            // a loop connection holds no work, so each io context is kept running until the end
+            struct BenchGroup
+            {
+                cpp::AsyncContext           io;
+                cpp::AsyncTimer             idle;
+                std::thread                 thread;
+            };
+            struct BenchPeer
+            {
+                LoopClient                  loop;
+                MessageReader               reader;
+                uint64_t                    sessionId = 0;
+            };
+            std::vector<std::unique_ptr<BenchGroup>> groups;
+            std::vector<std::unique_ptr<BenchPeer>> peers;
+            cpp::AsyncTimer idle = io.waitFor( cpp::Duration::ofSeconds( 3600 ), []( ) { } );
+            for ( uint32_t i = 0; i < shardCount; i++ )
+            {
+                groups.push_back( std::make_unique<BenchGroup>( ) );
+                groups.back( )->idle = groups.back( )->io.waitFor( cpp::Duration::ofSeconds( 3600 ), []( ) { } );
+            }
+
+            auto frameTo = []( MessageWriter & frames, uint8_t type, uint64_t toSessionId )
+                {
+                    // stamped as it is queued, so the receiver's clock gives the time in the proxy
+                    std::string payload( 64, 'x' );
+                    int64_t now = Clock::now( ).time_since_epoch( ).count( );
+                    std::memcpy( payload.data( ), &now, sizeof( now ) );
+                    Message message{ };
+                    message.len = payload.size( ) / MessageAlignment;
+                    message.type = type;
+                    message.toSessionId = toSessionId;
+                    frames.put( message, payload );
+                };
+            auto targetOf = [&]( size_t i, size_t step )
+                { return ( i + step * shardCount ) % sessionCount; };
+
+            RelayBenchResult result;
+            std::atomic<size_t> authed = 0;
+            std::atomic<size_t> forwarded = 0;
+            size_t hops = 0;
+            Clock::time_point start;
+            auto finish = [&]( )
+                {
+                    io.post( [&]( )
+                        {
+                            idle.cancel( );
+                            proxy.close( );
+                            for ( auto & group : groups )
+                                { group->io.post( [g = group.get( )]( ) { g->idle.cancel( ); } ); }
+                        } );
+                };
+            auto startBurst = [&]( )
+                {
+                    start = Clock::now( );
+                    for ( uint32_t g = 0; g < shardCount; g++ )
+                    {
+                        groups[g]->io.post( [&, g]( )
+                            {
+                                for ( size_t i = g; i < sessionCount; i += shardCount )
+                                {
+                                    MessageWriter frames;
+                                    for ( size_t j = 0; j < framesPerSession; j++ )
+                                        { frameTo( frames, BurstType, peers[targetOf( i, 1 )]->sessionId ); }
+                                    peers[i]->loop.send( frames.getAll( ) );
+                                }
+                            } );
+                    }
+                };
+            auto hop = [&]( size_t from )
+                {
+                    if ( hops++ == hopCount )
+                        { finish( ); return; }
+                    MessageWriter frame;
+                    frameTo( frame, HopType, peers[targetOf( from, 1 + hops % 7 )]->sessionId );
+                    peers[from]->loop.send( frame.getAll( ) );
+                };
+
+            for ( size_t i = 0; i < sessionCount; i++ )
+                { peers.push_back( std::make_unique<BenchPeer>( ) ); }
+            for ( size_t i = 0; i < sessionCount; i++ )
+            {
+                auto * peer = peers[i].get( );
+                uint32_t shardIndex = (uint32_t)( i % shardCount );
+                peer->loop.connect( groups[shardIndex]->io, shardAddress( addr, shardIndex ),
+                    [peer, i]( std::error_code error )
+                    {
+                        if ( error )
+                            { return; }
+                        Message message{ };
+                        message.bind = 1;
+                        MessageWriter frame;
+                        putMessage( frame, message, HelloRequest{ i + 1 } );
+                        peer->loop.send( frame.getAll( ) );
+                    },
+                    [&, peer, i]( std::string & recvBuffer )
+                    {
+                        peer->reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                            {
+                                HelloReply reply{ };
+                                if ( message.type == (uint8_t)HelloReply::Type && message.bind && decode( data, &reply ) )
+                                {
+                                    peer->sessionId = reply.sessionId;
+                                    if ( ++authed == sessionCount )
+                                        { startBurst( ); }
+                                    return;
+                                }
+                                if ( !message.fromSessionId )
+                                    { return; }
+                                int64_t sent = 0;
+                                std::memcpy( &sent, data.data( ), sizeof( sent ) );
+                                if ( message.type == BurstType && ++forwarded == sessionCount * framesPerSession )
+                                {
+                                    result.seconds = std::chrono::duration<double>( Clock::now( ) - start ).count( );
+                                    hop( i );
+                                }
+                                else if ( message.type == HopType )
+                                {
+                                    auto elapsed = Clock::now( ).time_since_epoch( ) - Clock::duration{ sent };
+                                    result.hopMicros.push_back( std::chrono::duration<double, std::micro>( elapsed ).count( ) );
+                                    hop( i );
+                                }
+                            } );
+                    },
+                    []( std::error_code ) { } );
+            }
+            for ( auto & group : groups )
+                { group->thread = std::thread( [g = group.get( )]( ) { g->io.run( ); } ); }
+            io.run( );
+            for ( auto & group : groups )
+                { group->thread.join( ); }
+
+            result.forwarded = forwarded;
+            if ( result.forwarded != sessionCount * framesPerSession || result.hopMicros.size( ) != hopCount )
+                { throw std::exception{ "benchProxyRelay( )" }; }
+            std::sort( result.hopMicros.begin( ), result.hopMicros.end( ) );
+            return result;
+        }
+
+        void benchProxyRelay( size_t sessionCount, size_t framesPerSession, size_t hopCount )
+        {
+            auto result = runRelayBench( "loop:relay:1", 1, sessionCount, framesPerSession, hopCount );
+            double mean = 0;
+            for ( double micros : result.hopMicros )
+                { mean += micros; }
+            mean /= std::max<size_t>( result.hopMicros.size( ), 1 );
+            cpp::Log::info( "proxy relay : {} sessions, {} frames in {:.2f} sec, {:.0f} forwarded/sec; one forward adds {:.1f} us mean, {:.1f} us p50, {:.1f} us p99",
+                sessionCount, result.forwarded, result.seconds, result.seconds > 0 ? result.forwarded / result.seconds : 0.0,
+                mean, result.hopMicros[result.hopMicros.size( ) / 2], result.hopMicros[result.hopMicros.size( ) * 99 / 100] );
+        }
+
+        void benchProxyShards( size_t sessionCount, size_t framesPerSession )
+        {
+            double baseline = 0;
+            for ( uint32_t shardCount : { 1u, 2u, 4u, 8u, 16u } )
+            {
+                auto result = runRelayBench( "loop:shards:" + std::to_string( 100 * shardCount ), shardCount, sessionCount, framesPerSession, 0 );
+                double rate = result.seconds > 0 ? result.forwarded / result.seconds : 0.0;
+                if ( shardCount == 1 )
+                    { baseline = rate; }
+                cpp::Log::info( "proxy shards : {}, {} frames in {:.2f} sec, {:.0f} forwarded/sec, {:.2f}x one shard ({} hardware threads)",
+                    shardCount, result.forwarded, result.seconds, rate, baseline > 0 ? rate / baseline : 0.0, std::thread::hardware_concurrency( ) );
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+module;
+
+#include <atomic>
+#include <utility>
+
+export module grim.net.queue;
+
+export namespace grim::net
+{
+    //! Unbounded lock-free multi-producer single-consumer queue (Vyukov).  push() may be called
+    //! from any thread; pop() only from the consuming thread.  A push is one exchange and one
+    //! store, so producers never wait on each other or on the consumer.
+    template <typename T>
+    class MpscQueue
+    {
+    public:
+                                            MpscQueue( );
+                                            ~MpscQueue( );
+                                            MpscQueue( const MpscQueue & ) = delete;
+        MpscQueue &                         operator=( const MpscQueue & ) = delete;
+
+        void                                push( T value );
+        bool                                pop( T & value );
+    private:
+        struct Node
+        {
+            T                               value;
+            std::atomic<Node *>             next = nullptr;
+        };
+        std::atomic<Node *>                 m_head;
+        Node *                              m_tail;
+    };
+}
+
+namespace grim::net
+{
+    template <typename T>
+    MpscQueue<T>::MpscQueue( )
+    {
+        // the tail is always a consumed (or stub) node
+        Node * stub = new Node{ };
+        m_head.store( stub, std::memory_order_relaxed );
+        m_tail = stub;
+    }
+
+    template <typename T>
+    MpscQueue<T>::~MpscQueue( )
+    {
+        T value;
+        while ( pop( value ) )
+            { }
+        delete m_tail;
+    }
+
+    template <typename T>
+    void MpscQueue<T>::push( T value )
+    {
+        Node * node = new Node{ std::move( value ) };
+        Node * prev = m_head.exchange( node, std::memory_order_acq_rel );
+        prev->next.store( node, std::memory_order_release );
+    }
+
+    template <typename T>
+    bool MpscQueue<T>::pop( T & value )
+    {
+        Node * tail = m_tail;
+        Node * next = tail->next.load( std::memory_order_acquire );
+        if ( !next )
+            { return false; }
+        value = std::move( next->value );
+        m_tail = next;
+        delete tail;
+        return true;
+    }
+}
@@ -0,0 +1,328 @@
+module;
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+export module grim.net.relay;
+
+import cpp.asio;
+import cpp.asio.udp;
+import cpp.log;
+import cpp.memory;
+import grim.arch.net;
+import grim.net.datagram;
+import grim.net.route;
+
+export namespace grim::net
+{
+    //! Relays datagrams between sessions which cannot reach each other directly (TURN style).  Each
+    //! session is added with its key; a datagram is relayed only if its tag checks out with the
+    //! sender's key and its seq has not been seen, and is signed again with the receiver's key.
+    //! A session's address is learned from its own datagrams, so an empty datagram to session 0
+    //! registers it, and a NAT rebinding is followed.
+    //! Datagrams relayed during an io turn are sent together at the end of the turn.
+    class DatagramRelay
+    {
+    public:
+        struct Stats
+        {
+            uint64_t                        received = 0;
+            uint64_t                        relayed = 0;
+            //! unsigned, replayed, or for a session without a known address
+            uint64_t                        dropped = 0;
+            uint64_t                        batches = 0;
+        };
+
+        void                                open( cpp::AsyncContext & io, StrArg bindAddress );
+        void                                close( );
+        std::string                         localAddress( ) const;
+
+        //! adds a session, or restarts it with a new key
+        void                                add( uint64_t sessionId, uint64_t key );
+        void                                remove( uint64_t sessionId );
+        bool                                contains( uint64_t sessionId ) const;
+
+        //! relays one datagram received from `from` (called by the socket, or directly by a test)
+        void                                receive( const cpp::Memory & from, const cpp::Memory & datagram );
+        //! sends every datagram relayed since the last flush
+        void                                flush( );
+
+        const Stats &                       stats( ) const;
+    private:
+        struct Session
+        {
+            uint64_t                        sessionId = 0;
+            uint64_t                        key = 0;
+            std::string                     addr;
+            ReplayWindow                    replay;
+            uint32_t                        sendSeq = 0;
+            bool                            isUsed = false;
+        };
+
+        cpp::AsyncContext                   m_io;
+        cpp::UdpClient                      m_udp;
+        //! session id -> m_sessions index
+        RouteTable                          m_routes;
+        std::vector<Session>                m_sessions;
+        std::vector<uint32_t>               m_free;
+        //! datagrams relayed during this io turn, back to back, and the (session, size) of each
+        std::string                         m_batch;
+        std::vector<std::pair<uint32_t, uint32_t>> m_sends;
+        bool                                m_isFlushPending = false;
+        Stats                               m_stats;
+    };
+
+    namespace test
+    {
+        void                                testDatagramRelay( );
+        //! one session sends `datagramCount` datagrams to another through a relay on its own thread
+        //! (over loopback), and logs the datagrams relayed per second by that one core
+        void                                benchDatagramRelay( size_t datagramCount = 1000000 );
+    };
+}
+
+namespace grim::net
+{
+    void DatagramRelay::open( cpp::AsyncContext & io, StrArg bindAddress )
+    {
+        m_io = io;
+        m_udp.bind( io, bindAddress,
+            [this]( cpp::Memory from, cpp::Memory datagram )
+                { receive( from, datagram ); },
+            []( std::error_code error )
+                { cpp::Log::error( "DatagramRelay::open() : msg='{}'", error.message( ) ); } );
+    }
+
+    void DatagramRelay::close( )
+    {
+        m_udp.close( );
+        m_batch.clear( );
+        m_sends.clear( );
+    }
+
+    std::string DatagramRelay::localAddress( ) const
+    {
+        return m_udp.localAddress( );
+    }
+
+    void DatagramRelay::add( uint64_t sessionId, uint64_t key )
+    {
+        uint32_t slot = m_routes.find( sessionId );
+        if ( slot == RouteTable::NoRoute )
+        {
+            if ( !m_free.empty( ) )
+            {
+                slot = m_free.back( );
+                m_free.pop_back( );
+            }
+            else
+            {
+                slot = (uint32_t)m_sessions.size( );
+                m_sessions.emplace_back( );
+            }
+            m_routes.insert( sessionId, slot );
+        }
+        m_sessions[slot] = Session{ .sessionId = sessionId, .key = key, .isUsed = true };
+    }
+
+    void DatagramRelay::remove( uint64_t sessionId )
+    {
+        uint32_t slot = m_routes.find( sessionId );
+        if ( slot == RouteTable::NoRoute )
+            { return; }
+        m_routes.erase( sessionId );
+        m_sessions[slot] = Session{ };
+        m_free.push_back( slot );
+    }
+
+    bool DatagramRelay::contains( uint64_t sessionId ) const
+    {
+        return m_routes.find( sessionId ) != RouteTable::NoRoute;
+    }
+
+    void DatagramRelay::receive( const cpp::Memory & from, const cpp::Memory & datagram )
+    {
+        m_stats.received++;
+        DatagramHeader header;
+        cpp::Memory data;
+        uint32_t fromSlot = RouteTable::NoRoute;
+        if ( decodeDatagram( datagram, &header, &data ) )
+            { fromSlot = m_routes.find( header.fromSessionId ); }
+        if ( fromSlot == RouteTable::NoRoute )
+            { m_stats.dropped++; return; }
+        auto & sender = m_sessions[fromSlot];
+        if ( !verifyDatagram( datagram, sender.key ) || !sender.replay.accept( header.seq ) )
+            { m_stats.dropped++; return; }
+        if ( sender.addr.size( ) != from.length( ) || std::memcmp( sender.addr.data( ), from.data( ), from.length( ) ) )
+            { sender.addr = from; }
+        if ( !header.toSessionId )
+            { return; }
+
+        uint32_t toSlot = m_routes.find( header.toSessionId );
+        if ( toSlot == RouteTable::NoRoute || m_sessions[toSlot].addr.empty( ) )
+            { m_stats.dropped++; return; }
+        auto & receiver = m_sessions[toSlot];
+
+        // relayed as received, signed again for the receiver
+        size_t offset = m_batch.size( );
+        m_batch.append( datagram.data( ), datagram.length( ) );
+        signDatagram( m_batch.data( ) + offset, datagram.length( ), header.fromSessionId, ++receiver.sendSeq, receiver.key );
+        m_sends.emplace_back( toSlot, (uint32_t)datagram.length( ) );
+        if ( !m_isFlushPending )
+        {
+            m_isFlushPending = true;
+            m_io.post( [this]( ) { flush( ); } );
+        }
+    }
+
+    void DatagramRelay::flush( )
+    {
+        m_isFlushPending = false;
+        if ( m_sends.empty( ) )
+            { return; }
+        m_stats.batches++;
+        size_t offset = 0;
+        for ( auto [slot, size] : m_sends )
+        {
+            // the receiver may have been removed since
+            auto & receiver = m_sessions[slot];
+            if ( receiver.isUsed && !receiver.addr.empty( ) )
+            {
+                m_udp.send( receiver.addr, cpp::Memory{ m_batch }.substr( offset, size ) );
+                m_stats.relayed++;
+            }
+            else
+                { m_stats.dropped++; }
+            offset += size;
+        }
+        m_batch.clear( );
+        m_sends.clear( );
+    }
+
+    const DatagramRelay::Stats & DatagramRelay::stats( ) const
+    {
+        return m_stats;
+    }
+
+    namespace test
+    {
+        void testDatagramRelay( )
+        {
+            const uint64_t Key1 = 0x1111;
+            const uint64_t Key2 = 0x2222;
+            cpp::AsyncContext io;
+            DatagramRelay relay;
+            relay.open( io, "127.0.0.1:0" );
+            relay.add( 1, Key1 );
+            relay.add( 2, Key2 );
+
+            auto datagram = []( uint64_t to, uint64_t from, uint32_t seq, uint64_t key )
+                {
+                    std::string out;
+                    encodeDatagram( out, DatagramHeader{ to, from, seq }, key, std::string{ "view" } );
+                    return out;
+                };
+
+            // session 2 has not registered an address, so nothing can reach it yet
+            relay.receive( "127.0.0.1:1001", datagram( 2, 1, 1, Key1 ) );
+            if ( relay.stats( ).dropped != 1 )
+                { throw std::exception{ "relay.receive( unregistered )" }; }
+            relay.receive( "127.0.0.1:1002", datagram( 0, 2, 1, Key2 ) );
+            relay.receive( "127.0.0.1:1001", datagram( 2, 1, 2, Key1 ) );
+            // replayed, and signed with the wrong key
+            relay.receive( "127.0.0.1:1001", datagram( 2, 1, 2, Key1 ) );
+            relay.receive( "127.0.0.1:1001", datagram( 2, 1, 3, Key2 ) );
+            relay.flush( );
+            if ( relay.stats( ).relayed != 1 || relay.stats( ).dropped != 3 )
+                { throw std::exception{ "relay.receive( )" }; }
+
+            relay.remove( 2 );
+            relay.receive( "127.0.0.1:1001", datagram( 2, 1, 4, Key1 ) );
+            if ( relay.contains( 2 ) || relay.stats( ).dropped != 4 )
+                { throw std::exception{ "relay.remove( )" }; }
+            relay.close( );
+        }
+
+        void benchDatagramRelay( size_t datagramCount )
+        {
+            const uint64_t Key1 = 0x1111;
+            const uint64_t Key2 = 0x2222;
+            const size_t BurstSize = 64;
+            using Clock = std::chrono::steady_clock;
+
+            // the relay has a core to itself
+            cpp::AsyncContext relayIo;
+            DatagramRelay relay;
+            relay.open( relayIo, "127.0.0.1:0" );
+            relay.add( 1, Key1 );
+            relay.add( 2, Key2 );
+            std::string relayAddr = relay.localAddress( );
+
+            cpp::AsyncContext io;
+            cpp::UdpClient sender;
+            cpp::UdpClient receiver;
+            size_t sent = 0;
+            size_t received = 0;
+            Clock::time_point start;
+            Clock::time_point last;
+            std::string payload( 256, 'x' );
+            std::string out;
+            sender.bind( io, "127.0.0.1:0", []( cpp::Memory, cpp::Memory ) { }, []( std::error_code ) { } );
+            receiver.bind( io, "127.0.0.1:0",
+                [&]( cpp::Memory, cpp::Memory )
+                {
+                    if ( !received++ )
+                        { start = Clock::now( ); }
+                    last = Clock::now( );
+                },
+                []( std::error_code ) { } );
+
+            auto send = [&]( cpp::UdpClient & from, uint64_t to, uint64_t fromId, uint32_t seq, uint64_t key )
+                {
+                    out.clear( );
+                    encodeDatagram( out, DatagramHeader{ to, fromId, seq }, key, payload );
+                    from.send( relayAddr, out );
+                };
+            // one burst per io turn, so the receiver is drained between bursts
+            std::function<void( )> burst = [&]( )
+                {
+                    for ( size_t i = 0; i < BurstSize && sent < datagramCount; i++ )
+                        { send( sender, 2, 1, (uint32_t)++sent + 1, Key1 ); }
+                    if ( sent < datagramCount )
+                        { io.post( burst ); }
+                    else
+                    {
+                        // whatever is still in flight after this is counted as lost
+                        io.waitFor( cpp::Duration::ofMillis( 500 ), [&]( )
+                            {
+                                sender.close( );
+                                receiver.close( );
+                                relayIo.post( [&]( ) { relay.close( ); } );
+                            } );
+                    }
+                };
+
+            std::thread relayThread{ [&]( ) { relayIo.run( ); } };
+            // register both addresses, then give the relay a moment to learn them
+            send( sender, 0, 1, 1, Key1 );
+            send( receiver, 0, 2, 1, Key2 );
+            io.waitFor( cpp::Duration::ofMillis( 100 ), burst );
+            io.run( );
+            relayThread.join( );
+
+            std::chrono::duration<double> elapsed = last - start;
+            auto & stats = relay.stats( );
+            cpp::Log::info( "relay : {} sent, {} received, {:.0f} datagrams/sec on one core, {} datagrams/batch, {} dropped by the relay",
+                datagramCount, received, elapsed.count( ) > 0 ? received / elapsed.count( ) : 0.0,
+                stats.batches ? stats.relayed / stats.batches : 0, stats.dropped );
+        }
+    }
+}
@@ -0,0 +1,227 @@
+module;
+
+#include <cinttypes>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <string>
+
+export module grim.net.replay;
+
+import grim.arch.net;
+import grim.net.message;
+
+export namespace grim::net
+{
+    //! a receiver acks at least this often (in frames, or bytes), and with anything it sends
+    constexpr uint64_t                      ReplayAckFrames = 32;
+    constexpr size_t                        ReplayAckBytes = 64 << 10;
+
+    //! Frames between a client and its proxy are counted in each direction so a rello can resume
+    //! the stream.  Hello, rello, ack and probe frames to or from the proxy itself carry the
+    //! resumption, and are not counted.
+    bool                                    isSequenced( const Message & message );
+
+    //! Outbound frames which the peer has not acked yet, so the gap can be sent again after a
+    //! rello.  Frames are numbered implicitly: the n'th frame pushed is frame n, and the peer acks
+    //! the number of frames it has received.  Once `maxBytes` are held the oldest frames are
+    //! dropped, and a resume which needs them fails (the session is re-synced instead).
+    class ReplayBuffer
+    {
+    public:
+        using                               FrameFn = std::function<void( const char * frame, size_t frameSize )>;
+
+        void                                setLimit( size_t maxBytes );
+        void                                push( const char * frame, size_t frameSize );
+        //! drops every frame the peer has received
+        void                                ack( uint64_t received );
+        //! calls `fn` for every frame after the first `received`; false if some were dropped
+        bool                                resend( uint64_t received, const FrameFn & fn ) const;
+        //! numbers the frames still held from 1, for a peer which starts counting over
+        void                                restart( );
+        void                                reset( );
+
+        uint64_t                            sent( ) const;
+        size_t                              size( ) const;
+        size_t                              bytes( ) const;
+    private:
+        void                                dropFront( );
+
+        //! frames back to back; bytes before m_offset are already dropped (compacted lazily)
+        std::string                         m_frames;
+        std::deque<uint32_t>                m_sizes;
+        size_t                              m_offset = 0;
+        //! the number of the first frame held
+        uint64_t                            m_first = 1;
+        uint64_t                            m_sent = 0;
+        size_t                              m_maxBytes = 1 << 20;
+    };
+
+    namespace test
+    {
+        void                                testReplayBuffer( );
+    };
+}
+
+namespace grim::net
+{
+    bool isSequenced( const Message & message )
+    {
+        if ( message.toSessionId && message.fromSessionId )
+            { return true; }
+        switch ( (IProxyApi::MessageType)message.type )
+        {
+        case IProxyApi::MessageType::Hello:
+        case IProxyApi::MessageType::Rello:
+        case IProxyApi::MessageType::Probe:
+        case IProxyApi::MessageType::Ack:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    void ReplayBuffer::setLimit( size_t maxBytes )
+    {
+        m_maxBytes = maxBytes;
+        while ( bytes( ) > m_maxBytes )
+            { dropFront( ); }
+    }
+
+    void ReplayBuffer::push( const char * frame, size_t frameSize )
+    {
+        m_frames.append( frame, frameSize );
+        m_sizes.push_back( (uint32_t)frameSize );
+        m_sent++;
+        while ( bytes( ) > m_maxBytes )
+            { dropFront( ); }
+    }
+
+    void ReplayBuffer::ack( uint64_t received )
+    {
+        while ( !m_sizes.empty( ) && m_first <= received )
+            { dropFront( ); }
+    }
+
+    bool ReplayBuffer::resend( uint64_t received, const FrameFn & fn ) const
+    {
+        if ( received + 1 < m_first || received > m_sent )
+            { return false; }
+        size_t offset = m_offset;
+        for ( size_t i = 0; i < m_sizes.size( ); i++ )
+        {
+            if ( m_first + i > received )
+                { fn( m_frames.data( ) + offset, m_sizes[i] ); }
+            offset += m_sizes[i];
+        }
+        return true;
+    }
+
+    void ReplayBuffer::restart( )
+    {
+        m_first = 1;
+        m_sent = m_sizes.size( );
+    }
+
+    void ReplayBuffer::reset( )
+    {
+        m_frames.clear( );
+        m_sizes.clear( );
+        m_offset = 0;
+        m_first = 1;
+        m_sent = 0;
+    }
+
+    uint64_t ReplayBuffer::sent( ) const
+    {
+        return m_sent;
+    }
+
+    size_t ReplayBuffer::size( ) const
+    {
+        return m_sizes.size( );
+    }
+
+    size_t ReplayBuffer::bytes( ) const
+    {
+        return m_frames.size( ) - m_offset;
+    }
+
+    void ReplayBuffer::dropFront( )
+    {
+        m_offset += m_sizes.front( );
+        m_sizes.pop_front( );
+        m_first++;
+        // like MessageReader, erased once rather than per frame
+        if ( m_sizes.empty( ) )
+        {
+            m_frames.clear( );
+            m_offset = 0;
+        }
+        else if ( m_offset > m_frames.size( ) / 2 )
+        {
+            m_frames.erase( 0, m_offset );
+            m_offset = 0;
+        }
+    }
+
+    namespace test
+    {
+        void testReplayBuffer( )
+        {
+            auto frameOf = []( uint64_t toSessionId, uint8_t type, std::string data )
+                {
+                    Message message{ };
+                    message.len = ( data.size( ) + paddingOf( data.size( ) ) ) / MessageAlignment;
+                    message.type = type;
+                    message.toSessionId = toSessionId;
+                    message.fromSessionId = 1;
+                    MessageWriter writer;
+                    writer.put( message, data );
+                    return std::string{ writer.getAll( ) };
+                };
+            auto collect = [&]( const ReplayBuffer & replay, uint64_t received, std::string * out )
+                {
+                    out->clear( );
+                    return replay.resend( received, [&]( const char * frame, size_t frameSize )
+                        { out->append( frame, frameSize ); } );
+                };
+
+            Message control{ };
+            control.type = (uint8_t)IProxyApi::MessageType::Ack;
+            control.fromSessionId = 1;
+            if ( isSequenced( control ) )
+                { throw std::exception{ "isSequenced( ack )" }; }
+            control.type = (uint8_t)IProxyApi::MessageType::OpenUdp;
+            if ( !isSequenced( control ) )
+                { throw std::exception{ "isSequenced( openUdp )" }; }
+
+            ReplayBuffer replay;
+            std::string frames[4];
+            for ( int i = 0; i < 4; i++ )
+            {
+                frames[i] = frameOf( 2, 7, std::string( 8 * ( i + 1 ), 'a' + i ) );
+                replay.push( frames[i].data( ), frames[i].size( ) );
+            }
+
+            // the peer received two, the gap is the last two
+            std::string gap;
+            replay.ack( 2 );
+            if ( replay.size( ) != 2 || !collect( replay, 2, &gap ) || gap != frames[2] + frames[3] )
+                { throw std::exception{ "replay.resend( gap )" }; }
+            if ( !collect( replay, 3, &gap ) || gap != frames[3] )
+                { throw std::exception{ "replay.resend( partial )" }; }
+            if ( collect( replay, 1, &gap ) || collect( replay, 5, &gap ) )
+                { throw std::exception{ "replay.resend( out of range )" }; }
+
+            // full, the oldest unacked frame is dropped and a resume from before it fails
+            replay.setLimit( frames[3].size( ) );
+            if ( replay.size( ) != 1 || collect( replay, 2, &gap ) || !collect( replay, 3, &gap ) )
+                { throw std::exception{ "replay.setLimit( )" }; }
+
+            replay.restart( );
+            if ( replay.sent( ) != 1 || !collect( replay, 0, &gap ) || gap != frames[3] )
+                { throw std::exception{ "replay.restart( )" }; }
+        }
+    }
+}
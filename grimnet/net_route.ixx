@@ -0,0 +1,179 @@
+module;
+
+#include <cinttypes>
+#include <exception>
+#include <utility>
+#include <vector>
+
+export module grim.net.route;
+
+export namespace grim::net
+{
+    //! Open addressing map from session id to connection index, used on the forwarding path.
+    //! Entries live in one flat array probed linearly, so a lookup is a hash and (usually) one
+    //! cache line.  Deletes shift the following entries back instead of leaving tombstones, so
+    //! lookups stay short under session churn.  Session id 0 marks an empty entry.
+    class RouteTable
+    {
+    public:
+        static constexpr uint32_t           NoRoute = 0xffffffff;
+
+        void                                reserve( size_t count );
+        void                                insert( uint64_t sessionId, uint32_t connection );
+        uint32_t                            find( uint64_t sessionId ) const;
+        bool                                erase( uint64_t sessionId );
+        size_t                              size( ) const;
+        size_t                              memoryUsage( ) const;
+    private:
+        struct Entry
+        {
+            uint64_t                        sessionId;
+            uint32_t                        connection;
+        };
+        size_t                              homeOf( uint64_t sessionId ) const;
+        void                                resize( size_t capacity );
+
+        std::vector<Entry>                  m_entries;
+        size_t                              m_mask = 0;
+        size_t                              m_size = 0;
+    };
+
+    namespace test
+    {
+        void                                testRouteTable( );
+    };
+}
+
+namespace grim::net
+{
+    size_t RouteTable::homeOf( uint64_t sessionId ) const
+    {
+        // splitmix64 finalizer, session ids are random but clients may pick patterned ones
+        uint64_t x = sessionId;
+        x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+        x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebull;
+        x = x ^ ( x >> 31 );
+        return (size_t)x & m_mask;
+    }
+
+    void RouteTable::reserve( size_t count )
+    {
+        size_t capacity = 16;
+        // keep the load factor at or below one half
+        while ( capacity < count * 2 )
+            { capacity *= 2; }
+        if ( capacity > m_entries.size( ) )
+            { resize( capacity ); }
+    }
+
+    void RouteTable::resize( size_t capacity )
+    {
+        std::vector<Entry> entries( capacity, Entry{ 0, NoRoute } );
+        std::swap( entries, m_entries );
+        m_mask = capacity - 1;
+        m_size = 0;
+        for ( auto & entry : entries )
+        {
+            if ( entry.sessionId )
+                { insert( entry.sessionId, entry.connection ); }
+        }
+    }
+
+    void RouteTable::insert( uint64_t sessionId, uint32_t connection )
+    {
+        if ( !sessionId )
+            { return; }
+        if ( ( m_size + 1 ) * 2 > m_entries.size( ) )
+            { resize( m_entries.empty( ) ? 16 : m_entries.size( ) * 2 ); }
+
+        for ( size_t i = homeOf( sessionId );; i = ( i + 1 ) & m_mask )
+        {
+            auto & entry = m_entries[i];
+            if ( entry.sessionId == sessionId )
+                { entry.connection = connection; return; }
+            if ( !entry.sessionId )
+            {
+                entry = Entry{ sessionId, connection };
+                m_size++;
+                return;
+            }
+        }
+    }
+
+    uint32_t RouteTable::find( uint64_t sessionId ) const
+    {
+        if ( !sessionId || m_entries.empty( ) )
+            { return NoRoute; }
+        for ( size_t i = homeOf( sessionId );; i = ( i + 1 ) & m_mask )
+        {
+            auto & entry = m_entries[i];
+            if ( entry.sessionId == sessionId )
+                { return entry.connection; }
+            if ( !entry.sessionId )
+                { return NoRoute; }
+        }
+    }
+
+    bool RouteTable::erase( uint64_t sessionId )
+    {
+        if ( !sessionId || m_entries.empty( ) )
+            { return false; }
+
+        size_t i = homeOf( sessionId );
+        while ( m_entries[i].sessionId != sessionId )
+        {
+            if ( !m_entries[i].sessionId )
+                { return false; }
+            i = ( i + 1 ) & m_mask;
+        }
+
+        // backward shift: pull later entries of the probe run into the hole if their home
+        // position does not lie strictly between the hole and their current position
+        for ( size_t j = ( i + 1 ) & m_mask; m_entries[j].sessionId; j = ( j + 1 ) & m_mask )
+        {
+            size_t home = homeOf( m_entries[j].sessionId );
+            bool isBetween = ( i <= j ) ? ( i < home && home <= j ) : ( i < home || home <= j );
+            if ( !isBetween )
+            {
+                m_entries[i] = m_entries[j];
+                i = j;
+            }
+        }
+        m_entries[i] = Entry{ 0, NoRoute };
+        m_size--;
+        return true;
+    }
+
+    size_t RouteTable::size( ) const
+    {
+        return m_size;
+    }
+
+    size_t RouteTable::memoryUsage( ) const
+    {
+        return m_entries.capacity( ) * sizeof( Entry );
+    }
+
+    namespace test
+    {
+        void testRouteTable( )
+        {
+            RouteTable routes;
+            for ( uint64_t sessionId = 1; sessionId <= 1000; sessionId++ )
+                { routes.insert( sessionId, (uint32_t)( sessionId % 7 ) ); }
+            if ( routes.size( ) != 1000 || routes.find( 500 ) != 500 % 7 || routes.find( 1001 ) != RouteTable::NoRoute )
+                { throw std::exception{ "routes.insert( )" }; }
+
+            for ( uint64_t sessionId = 1; sessionId <= 1000; sessionId += 2 )
+                { routes.erase( sessionId ); }
+            for ( uint64_t sessionId = 1; sessionId <= 1000; sessionId++ )
+            {
+                uint32_t expected = ( sessionId % 2 ) ? RouteTable::NoRoute : (uint32_t)( sessionId % 7 );
+                if ( routes.find( sessionId ) != expected )
+                    { throw std::exception{ "routes.erase( )" }; }
+            }
+            if ( routes.size( ) != 500 )
+                { throw std::exception{ "routes.size( )" }; }
+        }
+    }
+}
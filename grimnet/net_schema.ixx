@@ -0,0 +1,418 @@
+module;
+
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+export module grim.net.schema;
+
+import cpp.log;
+import cpp.memory;
+import grim.arch.net;
+import grim.net.message;
+
+export namespace grim::net
+{
+    //! A message's data, declared once, for instance:
+    //!
+    //!     struct OpenUdpReply
+    //!     {
+    //!         static constexpr auto       Type = IProxyApi::MessageType::OpenUdp;
+    //!         uint64_t                    key;
+    //!         uint16_t                    proxyPort;
+    //!         static constexpr auto       Fields = std::tuple{ &OpenUdpReply::key, &OpenUdpReply::proxyPort };
+    //!     };
+    //!
+    //! Fields go on the wire in order: integers and enums big endian at their own size, strings as
+    //! a uint32_t length and the bytes.  Decoding ignores anything after the last field (such as a
+    //! frame's padding), and fails rather than throws on short or malformed input.  Type is only
+    //! needed to send or dispatch a message, a reply shared by several requests leaves it out.
+    template<typename T>
+    concept Schema = requires { T::Fields; };
+
+    //! true if every field has a fixed size, and then minSizeOf is the exact size
+    template<Schema T> constexpr bool       isFixedSize( );
+    template<Schema T> constexpr size_t     minSizeOf( );
+    template<Schema T> size_t               encodedSize( const T & value );
+    //! false (and nothing written) if `capacity` is less than encodedSize( value )
+    template<Schema T> bool                 encode( const T & value, char * out, size_t capacity );
+    //! resizes `out`, which keeps its capacity from one message to the next
+    template<Schema T> void                 encode( const T & value, std::string * out );
+    template<Schema T> bool                 decode( const char * in, size_t size, T * value );
+    template<Schema T> bool                 decode( const cpp::Memory & data, T * value );
+    //! a frame of T::Type, encoded straight into `writer` (see MessageWriter::reserve)
+    template<Schema T> void                 putMessage( MessageWriter & writer, Message header, const T & value );
+
+    //! Handlers indexed by message type, each handed its message already decoded.  `Args` are
+    //! passed through from dispatch() to the handler (a shard and connection, say).  A message
+    //! which fails to decode goes to the onInvalid handler instead.
+    template<typename... Args>
+    class SchemaTable
+    {
+    public:
+        using                               RawFn = std::function<void( Args..., const Message & message, const cpp::Memory & data )>;
+
+        //! `fn( args..., const Message &, const T & )`
+        template<Schema T, typename Fn>
+        void                                on( Fn fn );
+        //! a type handled without a schema, given its data as is
+        void                                on( uint8_t type, RawFn fn );
+        void                                onInvalid( RawFn fn );
+        //! false if no handler is registered for the message's type
+        bool                                dispatch( Args... args, const Message & message, const cpp::Memory & data ) const;
+    private:
+        //! false if the message did not decode
+        using                               EntryFn = std::function<bool( Args..., const Message & message, const cpp::Memory & data )>;
+        std::array<EntryFn, 256>            m_handlers;
+        RawFn                               m_onInvalid;
+    };
+
+    namespace test
+    {
+        void                                testSchema( );
+        //! the cost per message of decoding and dispatching through a SchemaTable, against a switch
+        //! on the type with a lookup of the connection by address (as the servers did)
+        void                                benchSchemaDispatch( size_t messageCount = 10000000 );
+    };
+}
+
+namespace grim::net
+{
+    template<typename M>
+    struct MemberOf;
+
+    template<typename C, typename F>
+    struct MemberOf<F C::*>
+    {
+        using                               Type = F;
+    };
+
+    template<typename F>
+    struct FieldCodec
+    {
+        static_assert( std::is_integral_v<F> || std::is_enum_v<F>, "a schema field is an integer, an enum or a std::string" );
+        static constexpr bool               IsFixed = true;
+        static constexpr size_t             MinSize = sizeof( F );
+
+        static size_t size( const F & )
+        {
+            return sizeof( F );
+        }
+
+        static char * put( char * out, const F & value )
+        {
+            auto bits = (uint64_t)value;
+            for ( size_t i = 0; i < sizeof( F ); i++ )
+                { out[i] = (char)( bits >> ( 8 * ( sizeof( F ) - 1 - i ) ) ); }
+            return out + sizeof( F );
+        }
+
+        static bool get( const char *& in, const char * end, F * value )
+        {
+            if ( (size_t)( end - in ) < sizeof( F ) )
+                { return false; }
+            uint64_t bits = 0;
+            for ( size_t i = 0; i < sizeof( F ); i++ )
+                { bits = ( bits << 8 ) | (uint8_t)in[i]; }
+            *value = (F)bits;
+            in += sizeof( F );
+            return true;
+        }
+    };
+
+    template<>
+    struct FieldCodec<std::string>
+    {
+        static constexpr bool               IsFixed = false;
+        static constexpr size_t             MinSize = sizeof( uint32_t );
+
+        static size_t size( const std::string & value )
+        {
+            return sizeof( uint32_t ) + value.size( );
+        }
+
+        static char * put( char * out, const std::string & value )
+        {
+            out = FieldCodec<uint32_t>::put( out, (uint32_t)value.size( ) );
+            if ( !value.empty( ) )
+                { std::memcpy( out, value.data( ), value.size( ) ); }
+            return out + value.size( );
+        }
+
+        static bool get( const char *& in, const char * end, std::string * value )
+        {
+            uint32_t length = 0;
+            if ( !FieldCodec<uint32_t>::get( in, end, &length ) || (size_t)( end - in ) < length )
+                { return false; }
+            value->assign( in, length );
+            in += length;
+            return true;
+        }
+    };
+
+    template<typename M>
+    using                                   CodecOf = FieldCodec<typename MemberOf<M>::Type>;
+
+    template<Schema T>
+    constexpr bool isFixedSize( )
+    {
+        return std::apply( []( auto... fields ) { return ( CodecOf<decltype( fields )>::IsFixed && ... ); }, T::Fields );
+    }
+
+    template<Schema T>
+    constexpr size_t minSizeOf( )
+    {
+        return std::apply( []( auto... fields ) { return ( CodecOf<decltype( fields )>::MinSize + ... + 0 ); }, T::Fields );
+    }
+
+    template<Schema T>
+    size_t encodedSize( const T & value )
+    {
+        if constexpr ( isFixedSize<T>( ) )
+            { return minSizeOf<T>( ); }
+        else
+            { return std::apply( [&]( auto... fields ) { return ( CodecOf<decltype( fields )>::size( value.*fields ) + ... + 0 ); }, T::Fields ); }
+    }
+
+    template<Schema T>
+    bool encode( const T & value, char * out, size_t capacity )
+    {
+        if ( capacity < encodedSize( value ) )
+            { return false; }
+        std::apply( [&]( auto... fields ) { ( ( out = CodecOf<decltype( fields )>::put( out, value.*fields ) ), ... ); }, T::Fields );
+        return true;
+    }
+
+    template<Schema T>
+    void encode( const T & value, std::string * out )
+    {
+        out->resize( encodedSize( value ) );
+        encode( value, out->data( ), out->size( ) );
+    }
+
+    template<Schema T>
+    bool decode( const char * in, size_t size, T * value )
+    {
+        const char * end = in + size;
+        return std::apply( [&]( auto... fields ) { return ( CodecOf<decltype( fields )>::get( in, end, &( value->*fields ) ) && ... ); }, T::Fields );
+    }
+
+    template<Schema T>
+    bool decode( const cpp::Memory & data, T * value )
+    {
+        return decode( data.data( ), data.length( ), value );
+    }
+
+    template<Schema T>
+    void putMessage( MessageWriter & writer, Message header, const T & value )
+    {
+        header.type = (uint8_t)T::Type;
+        size_t size = encodedSize( value );
+        encode( value, writer.reserve( header, size ), size );
+    }
+
+    template<typename... Args>
+    template<Schema T, typename Fn>
+    void SchemaTable<Args...>::on( Fn fn )
+    {
+        m_handlers[(uint8_t)T::Type] = [fn = std::move( fn )]( Args... args, const Message & message, const cpp::Memory & data )
+            {
+                T value{ };
+                if ( !decode( data, &value ) )
+                    { return false; }
+                fn( args..., message, value );
+                return true;
+            };
+    }
+
+    template<typename... Args>
+    void SchemaTable<Args...>::on( uint8_t type, RawFn fn )
+    {
+        m_handlers[type] = [fn = std::move( fn )]( Args... args, const Message & message, const cpp::Memory & data )
+            {
+                fn( args..., message, data );
+                return true;
+            };
+    }
+
+    template<typename... Args>
+    void SchemaTable<Args...>::onInvalid( RawFn fn )
+    {
+        m_onInvalid = std::move( fn );
+    }
+
+    template<typename... Args>
+    bool SchemaTable<Args...>::dispatch( Args... args, const Message & message, const cpp::Memory & data ) const
+    {
+        auto & handler = m_handlers[message.type];
+        if ( !handler )
+            { return false; }
+        if ( !handler( args..., message, data ) && m_onInvalid )
+            { m_onInvalid( args..., message, data ); }
+        return true;
+    }
+
+    namespace test
+    {
+        struct TestRequest
+        {
+            static constexpr auto           Type = IProxyApi::MessageType::AuthServer;
+            std::string                     svcName;
+            int32_t                         nodeId;
+            static constexpr auto           Fields = std::tuple{ &TestRequest::svcName, &TestRequest::nodeId };
+        };
+
+        struct TestReply
+        {
+            static constexpr auto           Type = IProxyApi::MessageType::OpenUdp;
+            uint64_t                        key;
+            uint16_t                        proxyPort;
+            static constexpr auto           Fields = std::tuple{ &TestReply::key, &TestReply::proxyPort };
+        };
+        static_assert( isFixedSize<TestReply>( ) && minSizeOf<TestReply>( ) == 10 );
+        static_assert( !isFixedSize<TestRequest>( ) && minSizeOf<TestRequest>( ) == 8 );
+
+        void testSchema( )
+        {
+            TestRequest request{ "zone", -2 };
+            char buffer[32];
+            if ( encodedSize( request ) != 12 || encode( request, buffer, 11 ) || !encode( request, buffer, sizeof( buffer ) ) )
+                { throw std::exception{ "encode( )" }; }
+            if ( std::memcmp( buffer, "\0\0\0\4zone\xff\xff\xff\xfe", 12 ) )
+                { throw std::exception{ "encode( wire )" }; }
+
+            TestRequest decoded{ };
+            if ( !decode( buffer, 12, &decoded ) || decoded.svcName != "zone" || decoded.nodeId != -2 )
+                { throw std::exception{ "decode( )" }; }
+            // a string longer than what is left, and a short integer
+            if ( decode( buffer, 6, &decoded ) || decode( buffer, 10, &decoded ) )
+                { throw std::exception{ "decode( short )" }; }
+
+            // padded into a frame and back, through the table
+            MessageWriter writer;
+            Message header{ };
+            header.bind = 3;
+            putMessage( writer, header, TestReply{ 0x0102030405060708, 4000 } );
+            if ( writer.size( ) != MessageHeaderSize + 16 )
+                { throw std::exception{ "putMessage( )" }; }
+
+            SchemaTable<int &> table;
+            int calls = 0;
+            int invalid = 0;
+            table.on<TestReply>( []( int & count, const Message & message, const TestReply & reply )
+                {
+                    if ( message.bind == 3 && reply.key == 0x0102030405060708 && reply.proxyPort == 4000 )
+                        { count++; }
+                } );
+            table.onInvalid( [&invalid]( int &, const Message &, const cpp::Memory & ) { invalid++; } );
+            std::string recvBuffer{ writer.getAll( ) };
+            MessageReader reader;
+            reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                {
+                    if ( !table.dispatch( calls, message, data ) || !table.dispatch( calls, message, data.substr( 0, 4 ) ) )
+                        { throw std::exception{ "table.dispatch( )" }; }
+                    Message other = message;
+                    other.type = (uint8_t)IProxyApi::MessageType::Probe;
+                    if ( table.dispatch( calls, other, data ) )
+                        { throw std::exception{ "table.dispatch( unregistered )" }; }
+                } );
+            if ( calls != 1 || invalid != 1 )
+                { throw std::exception{ "table.on( )" }; }
+        }
+
+        void benchSchemaDispatch( size_t messageCount )
+        {
+            using Clock = std::chrono::steady_clock;
+            const size_t FrameCount = 4096;
+            const size_t ConnectionCount = 1024;
+
+            // a mix of fixed and variable size requests from many connections
+            MessageWriter writer;
+            for ( size_t i = 0; i < FrameCount; i++ )
+            {
+                Message header{ };
+                header.bind = 1;
+                if ( i % 2 )
+                    { putMessage( writer, header, TestReply{ i, (uint16_t)i } ); }
+                else
+                    { putMessage( writer, header, TestRequest{ "svc.backwater.grimethos.com", (int32_t)i } ); }
+            }
+            std::string frames{ writer.getAll( ) };
+            struct Frame
+            {
+                Message                     message;
+                cpp::Memory                 data;
+                uint32_t                    connection;
+                std::string                 addr;
+            };
+            std::vector<Frame> decoded;
+            std::string recvBuffer = frames;
+            MessageReader reader;
+            size_t offset = 0;
+            reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                {
+                    // recvBuffer is consumed by the reader, the frames are kept in `frames`
+                    uint32_t connection = (uint32_t)( decoded.size( ) % ConnectionCount );
+                    size_t dataLength = (size_t)message.len * MessageAlignment;
+                    decoded.push_back( Frame{ message, cpp::Memory{ frames }.substr( offset + MessageHeaderSize, dataLength ), connection, "10.0.0." + std::to_string( connection ) + ":4000" } );
+                    offset += MessageHeaderSize + dataLength;
+                } );
+            std::map<std::string, uint32_t> connectionIds;
+            for ( uint32_t i = 0; i < ConnectionCount; i++ )
+                { connectionIds["10.0.0." + std::to_string( i ) + ":4000"] = i; }
+
+            uint64_t sum = 0;
+            SchemaTable<uint32_t> table;
+            table.on<TestRequest>( [&sum]( uint32_t connection, const Message &, const TestRequest & request )
+                { sum += connection + request.nodeId; } );
+            table.on<TestReply>( [&sum]( uint32_t connection, const Message &, const TestReply & reply )
+                { sum += connection + reply.proxyPort; } );
+
+            auto start = Clock::now( );
+            for ( size_t i = 0; i < messageCount; i++ )
+            {
+                auto & frame = decoded[i % decoded.size( )];
+                table.dispatch( frame.connection, frame.message, frame.data );
+            }
+            std::chrono::duration<double, std::nano> tableElapsed = Clock::now( ) - start;
+
+            start = Clock::now( );
+            for ( size_t i = 0; i < messageCount; i++ )
+            {
+                auto & frame = decoded[i % decoded.size( )];
+                uint32_t connection = connectionIds.find( frame.addr )->second;
+                switch ( (IProxyApi::MessageType)frame.message.type )
+                {
+                case TestRequest::Type:
+                {
+                    TestRequest request{ };
+                    if ( decode( frame.data, &request ) )
+                        { sum += connection + request.nodeId; }
+                    break;
+                }
+                case TestReply::Type:
+                {
+                    TestReply reply{ };
+                    if ( decode( frame.data, &reply ) )
+                        { sum += connection + reply.proxyPort; }
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+            std::chrono::duration<double, std::nano> switchElapsed = Clock::now( ) - start;
+
+            cpp::Log::info( "dispatch : {} messages, table {:.1f} ns/msg, switch with address lookup {:.1f} ns/msg (sum {})",
+                messageCount, tableElapsed.count( ) / messageCount, switchElapsed.count( ) / messageCount, sum );
+        }
+    }
+}
@@ -0,0 +1,314 @@
+module;
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <deque>
+#include <exception>
+#include <string>
+#include <utility>
+
+export module grim.net.send_queue;
+
+import cpp.log;
+import grim.arch.net;
+import grim.net.message;
+
+export namespace grim::net
+{
+    //! Bounds what a connection holds for a slow reader.  A frame is counted from the time it is
+    //! queued until the peer acks it (see grim.net.replay): pending bytes are queued but not yet
+    //! handed to the socket, bytes in flight were sent and not acked.  Once the bytes in flight
+    //! reach the high water mark the queue is no longer handed to the socket, so the socket's own
+    //! buffer stays bounded as well.  Above the high water mark the connection is blocked until it
+    //! drains to the low water mark, and SendLimits::policy decides what happens to more frames.
+    //! Bytes sent to a peer which does not ack (e.g. before hello) are not counted in flight.
+    class SendQueue
+    {
+    public:
+        enum class                          Verdict { Queue, Drop, Disconnect };
+
+        void                                setLimits( const SendLimits & limits );
+        const SendLimits &                  limits( ) const;
+
+        //! whether a frame may be queued behind `pendingBytes`; a droppable frame is one nothing
+        //! waits for (it has no bind)
+        Verdict                             admit( size_t pendingBytes, size_t frameSize, bool isDroppable );
+        //! false while the bytes in flight are at the high water mark
+        bool                                canSend( ) const;
+        //! `bytes` were handed to the socket, the last sequenced frame among them is `sentCount`
+        void                                sent( size_t bytes, uint64_t sentCount );
+        //! the peer has received `received` sequenced frames
+        void                                ack( uint64_t received );
+        //! true if the connection was blocked or unblocked since the last update
+        bool                                update( size_t pendingBytes );
+        //! forgets the bytes in flight, which a new connection sends again, but stays blocked (if
+        //! it was) so the caller still hears when it drains
+        void                                restart( );
+        void                                reset( );
+
+        bool                                isBlocked( ) const;
+        size_t                              inFlight( ) const;
+        uint64_t                            dropped( ) const;
+    private:
+        struct Batch
+        {
+            uint64_t                        sentCount;
+            size_t                          bytes;
+        };
+
+        SendLimits                          m_limits;
+        std::deque<Batch>                   m_batches;
+        size_t                              m_inFlight = 0;
+        uint64_t                            m_acked = 0;
+        uint64_t                            m_dropped = 0;
+        bool                                m_isBlocked = false;
+        bool                                m_isChanged = false;
+    };
+
+    namespace test
+    {
+        void                                testSendQueue( );
+        //! a writer produces `frameCount` frames for a reader which stops acking, as a proxy would
+        //! forward them to a stalled client, and logs the most the connection held
+        void                                benchSendQueueStalled( size_t frameCount = 1000000 );
+    };
+}
+
+namespace grim::net
+{
+    void SendQueue::setLimits( const SendLimits & limits )
+    {
+        m_limits = limits;
+        m_limits.lowWater = std::min( m_limits.lowWater, m_limits.highWater );
+    }
+
+    const SendLimits & SendQueue::limits( ) const
+    {
+        return m_limits;
+    }
+
+    SendQueue::Verdict SendQueue::admit( size_t pendingBytes, size_t frameSize, bool isDroppable )
+    {
+        size_t queued = pendingBytes + m_inFlight + frameSize;
+        if ( queued <= m_limits.highWater )
+            { return Verdict::Queue; }
+        if ( !m_isBlocked )
+        {
+            m_isBlocked = true;
+            m_isChanged = true;
+        }
+        // frames a caller waits for are still queued, up to a hard limit
+        if ( m_limits.policy == BackpressurePolicy::Disconnect || queued > 2 * m_limits.highWater )
+            { return Verdict::Disconnect; }
+        if ( isDroppable )
+        {
+            m_dropped++;
+            return Verdict::Drop;
+        }
+        return Verdict::Queue;
+    }
+
+    bool SendQueue::canSend( ) const
+    {
+        return m_inFlight < m_limits.highWater;
+    }
+
+    void SendQueue::sent( size_t bytes, uint64_t sentCount )
+    {
+        if ( sentCount <= m_acked )
+            { return; }
+        // frames sent together are acked together, so one batch is enough
+        if ( !m_batches.empty( ) && m_batches.back( ).sentCount == sentCount )
+            { m_batches.back( ).bytes += bytes; }
+        else
+            { m_batches.push_back( Batch{ sentCount, bytes } ); }
+        m_inFlight += bytes;
+    }
+
+    void SendQueue::ack( uint64_t received )
+    {
+        m_acked = std::max( m_acked, received );
+        while ( !m_batches.empty( ) && m_batches.front( ).sentCount <= m_acked )
+        {
+            m_inFlight -= m_batches.front( ).bytes;
+            m_batches.pop_front( );
+        }
+    }
+
+    bool SendQueue::update( size_t pendingBytes )
+    {
+        size_t queued = pendingBytes + m_inFlight;
+        if ( !m_isBlocked && queued > m_limits.highWater )
+        {
+            m_isBlocked = true;
+            m_isChanged = true;
+        }
+        else if ( m_isBlocked && queued <= m_limits.lowWater )
+        {
+            m_isBlocked = false;
+            m_isChanged = true;
+        }
+        return std::exchange( m_isChanged, false );
+    }
+
+    void SendQueue::restart( )
+    {
+        m_batches.clear( );
+        m_inFlight = 0;
+        m_acked = 0;
+    }
+
+    void SendQueue::reset( )
+    {
+        m_batches.clear( );
+        m_inFlight = 0;
+        m_acked = 0;
+        m_isBlocked = false;
+        m_isChanged = false;
+    }
+
+    bool SendQueue::isBlocked( ) const
+    {
+        return m_isBlocked;
+    }
+
+    size_t SendQueue::inFlight( ) const
+    {
+        return m_inFlight;
+    }
+
+    uint64_t SendQueue::dropped( ) const
+    {
+        return m_dropped;
+    }
+
+    namespace test
+    {
+        void testSendQueue( )
+        {
+            SendQueue queue;
+            queue.setLimits( SendLimits{ .highWater = 1000, .lowWater = 400 } );
+
+            // 900 bytes in flight over three sends, the window is still open
+            queue.sent( 300, 1 );
+            queue.sent( 300, 2 );
+            queue.sent( 300, 3 );
+            if ( !queue.canSend( ) || queue.inFlight( ) != 900 || queue.update( 0 ) )
+                { throw std::exception{ "queue.sent( )" }; }
+
+            // a notification over the high water mark is dropped, a request is still queued
+            if ( queue.admit( 50, 100, true ) != SendQueue::Verdict::Drop || queue.dropped( ) != 1 )
+                { throw std::exception{ "queue.admit( drop )" }; }
+            if ( queue.admit( 50, 100, false ) != SendQueue::Verdict::Queue )
+                { throw std::exception{ "queue.admit( bound )" }; }
+            if ( !queue.update( 150 ) || !queue.isBlocked( ) )
+                { throw std::exception{ "queue.update( blocked )" }; }
+            queue.sent( 150, 4 );
+            if ( queue.canSend( ) )
+                { throw std::exception{ "queue.canSend( )" }; }
+            if ( queue.admit( 0, 1000, false ) != SendQueue::Verdict::Disconnect )
+                { throw std::exception{ "queue.admit( hard limit )" }; }
+
+            // still above the low water mark after the first ack, unblocked after the second
+            queue.ack( 2 );
+            if ( queue.inFlight( ) != 450 || !queue.canSend( ) || queue.update( 0 ) )
+                { throw std::exception{ "queue.ack( partial )" }; }
+            queue.ack( 3 );
+            if ( queue.inFlight( ) != 150 || !queue.update( 0 ) || queue.isBlocked( ) )
+                { throw std::exception{ "queue.update( unblocked )" }; }
+
+            // a reconnect starts the window over, blocked until what is held drains
+            queue.admit( 1200, 100, false );
+            queue.update( 1200 );
+            queue.restart( );
+            if ( queue.inFlight( ) || !queue.isBlocked( ) || queue.update( 600 ) || !queue.update( 400 ) || queue.isBlocked( ) )
+                { throw std::exception{ "queue.restart( )" }; }
+
+            queue.setLimits( SendLimits{ .highWater = 1000, .lowWater = 400, .policy = BackpressurePolicy::Disconnect } );
+            if ( queue.admit( 0, 900, true ) != SendQueue::Verdict::Disconnect )
+                { throw std::exception{ "queue.admit( disconnect )" }; }
+        }
+
+        void benchSendQueueStalled( size_t frameCount )
+        {
+            using Clock = std::chrono::steady_clock;
+            const SendLimits limits;
+            const size_t StallAfter = 1000;
+            const size_t FramesPerTurn = 64;
+
+            // the proxy side of one connection; frames which reach the "socket" are only counted
+            SendQueue queue;
+            queue.setLimits( limits );
+            MessageWriter writer;
+            std::string payload( 1024, 'x' );
+            uint64_t sentCount = 0;
+            uint64_t received = 0;
+            size_t socketBytes = 0;
+            size_t peak = 0;
+            size_t blocked = 0;
+            size_t disconnects = 0;
+
+            auto start = Clock::now( );
+            for ( size_t i = 0; i < frameCount; i++ )
+            {
+                // one in 16 is a request, which is never dropped
+                Message message{ };
+                message.len = payload.size( ) / MessageAlignment;
+                message.bind = ( i % 16 ) ? 0 : 1;
+                message.type = 7;
+                message.toSessionId = 2;
+                message.fromSessionId = 3;
+                size_t frameSize = MessageHeaderSize + payload.size( );
+                auto verdict = queue.admit( writer.size( ), frameSize, !message.bind );
+                if ( verdict == SendQueue::Verdict::Disconnect )
+                {
+                    // a reconnect starts with an empty queue
+                    disconnects++;
+                    writer.clear( );
+                    queue.reset( );
+                    continue;
+                }
+                if ( verdict == SendQueue::Verdict::Queue )
+                {
+                    writer.put( message, payload );
+                    sentCount++;
+                }
+
+                // the end of an io turn: flush if the window is open, the reader acks until it stalls
+                if ( i % FramesPerTurn == FramesPerTurn - 1 )
+                {
+                    if ( queue.canSend( ) && !writer.isEmpty( ) )
+                    {
+                        socketBytes += writer.size( );
+                        queue.sent( writer.size( ), sentCount );
+                        writer.clear( );
+                    }
+                    if ( i < StallAfter )
+                    {
+                        received = sentCount;
+                        queue.ack( received );
+                    }
+                    if ( queue.update( writer.size( ) ) && queue.isBlocked( ) )
+                        { blocked++; }
+                }
+                peak = std::max( peak, writer.size( ) + queue.inFlight( ) );
+                if ( peak > 2 * limits.highWater + frameSize )
+                    { throw std::exception{ "benchSendQueueStalled( unbounded )" }; }
+            }
+            std::chrono::duration<double> elapsed = Clock::now( ) - start;
+
+            // the reader catches up, and the connection unblocks
+            socketBytes += writer.size( );
+            queue.sent( writer.size( ), sentCount );
+            writer.clear( );
+            queue.ack( sentCount );
+            queue.update( 0 );
+            if ( !blocked || queue.isBlocked( ) || queue.inFlight( ) )
+                { throw std::exception{ "benchSendQueueStalled( unblock )" }; }
+            cpp::Log::info( "send queue : {} frames for a stalled reader, peak {} KB held (high water {} KB), {} KB to the socket, {} dropped, {} disconnects, {:.0f} frames/sec",
+                frameCount, peak >> 10, limits.highWater >> 10, socketBytes >> 10, queue.dropped( ), disconnects,
+                elapsed.count( ) > 0 ? frameCount / elapsed.count( ) : 0.0 );
+        }
+    }
+}
@@ -0,0 +1,147 @@
+module;
+
+#include <cinttypes>
+#include <string>
+#include <tuple>
+
+export module grim.net.session_api;
+
+import grim.net.schema;
+
+export namespace grim::net
+{
+    //! Messages between proxies (and peer shards) and the session service, see SessionServer.
+    enum class                              SessionMessageType : uint8_t { Hello, Rello, Auth, Reauth, AuthServer, LookupSession, LookupServer, ReplicateServer, OpenUdp, CloseUdp, LookupUdp, JoinShard };
+
+    //! The data of each session service request, and of the replies, see grim.net.schema.
+
+    struct SessionHello
+    {
+        static constexpr auto               Type = SessionMessageType::Hello;
+        uint64_t                            authToken;
+        int32_t                             nodeId;
+        static constexpr auto               Fields = std::tuple{ &SessionHello::authToken, &SessionHello::nodeId };
+    };
+
+    struct SessionRello
+    {
+        static constexpr auto               Type = SessionMessageType::Rello;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &SessionRello::sessionId };
+    };
+
+    struct SessionAuth
+    {
+        static constexpr auto               Type = SessionMessageType::Auth;
+        std::string                         extAddr;
+        uint64_t                            authToken;
+        static constexpr auto               Fields = std::tuple{ &SessionAuth::extAddr, &SessionAuth::authToken };
+    };
+
+    struct SessionReauth
+    {
+        static constexpr auto               Type = SessionMessageType::Reauth;
+        std::string                         extAddr;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &SessionReauth::extAddr, &SessionReauth::sessionId };
+    };
+
+    struct SessionAuthServer
+    {
+        static constexpr auto               Type = SessionMessageType::AuthServer;
+        uint64_t                            sessionId;
+        std::string                         svcName;
+        int32_t                             nodeId;
+        static constexpr auto               Fields = std::tuple{ &SessionAuthServer::sessionId, &SessionAuthServer::svcName, &SessionAuthServer::nodeId };
+    };
+
+    struct SessionLookupSession
+    {
+        static constexpr auto               Type = SessionMessageType::LookupSession;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &SessionLookupSession::sessionId };
+    };
+
+    struct SessionLookupServer
+    {
+        static constexpr auto               Type = SessionMessageType::LookupServer;
+        std::string                         svcName;
+        int32_t                             nodeId;
+        static constexpr auto               Fields = std::tuple{ &SessionLookupServer::svcName, &SessionLookupServer::nodeId };
+    };
+
+    //! a server node owned by the sending shard
+    struct SessionReplicateServer
+    {
+        static constexpr auto               Type = SessionMessageType::ReplicateServer;
+        uint64_t                            sessionId;
+        uint64_t                            userId;
+        std::string                         email;
+        std::string                         extAddr;
+        std::string                         service;
+        int32_t                             nodeId;
+        static constexpr auto               Fields = std::tuple{
+                                                &SessionReplicateServer::sessionId, &SessionReplicateServer::userId, &SessionReplicateServer::email,
+                                                &SessionReplicateServer::extAddr, &SessionReplicateServer::service, &SessionReplicateServer::nodeId };
+    };
+
+    //! the first request on a link from a peer shard, see SessionServer::onJoinShard( )
+    struct SessionJoinShard
+    {
+        static constexpr auto               Type = SessionMessageType::JoinShard;
+        uint64_t                            authToken;
+        static constexpr auto               Fields = std::tuple{ &SessionJoinShard::authToken };
+    };
+
+    struct SessionOpenUdp
+    {
+        static constexpr auto               Type = SessionMessageType::OpenUdp;
+        uint64_t                            sessionId;
+        std::string                         intAddr;
+        std::string                         udpAddr;
+        static constexpr auto               Fields = std::tuple{ &SessionOpenUdp::sessionId, &SessionOpenUdp::intAddr, &SessionOpenUdp::udpAddr };
+    };
+
+    struct SessionCloseUdp
+    {
+        static constexpr auto               Type = SessionMessageType::CloseUdp;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &SessionCloseUdp::sessionId };
+    };
+
+    struct SessionLookupUdp
+    {
+        static constexpr auto               Type = SessionMessageType::LookupUdp;
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &SessionLookupUdp::sessionId };
+    };
+
+    //! the reply to hello, auth and lookupServer
+    struct SessionIdReply
+    {
+        uint64_t                            sessionId;
+        static constexpr auto               Fields = std::tuple{ &SessionIdReply::sessionId };
+    };
+
+    struct SessionLookupSessionReply
+    {
+        uint64_t                            userId;
+        std::string                         email;
+        static constexpr auto               Fields = std::tuple{ &SessionLookupSessionReply::userId, &SessionLookupSessionReply::email };
+    };
+
+    struct SessionOpenUdpReply
+    {
+        uint64_t                            key;
+        static constexpr auto               Fields = std::tuple{ &SessionOpenUdpReply::key };
+    };
+
+    struct SessionLookupUdpReply
+    {
+        std::string                         extAddr;
+        std::string                         intAddr;
+        std::string                         udpAddr;
+        uint64_t                            key;
+        static constexpr auto               Fields = std::tuple{ &SessionLookupUdpReply::extAddr, &SessionLookupUdpReply::intAddr, &SessionLookupUdpReply::udpAddr, &SessionLookupUdpReply::key };
+    };
+}
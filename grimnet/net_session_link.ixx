@@ -0,0 +1,327 @@
+module;
+
+#include <algorithm>
+#include <cinttypes>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <utility>
+
+export module grim.net.session_link;
+
+import cpp.asio.tcp;
+import cpp.log;
+import cpp.thread;
+import grim.arch.net;
+import grim.net.bind;
+import grim.net.message;
+import grim.net.schema;
+import grim.net.send_queue;
+import grim.net.transport;
+
+export namespace grim::net
+{
+    //! A connection to one session server, from a proxy (see SessionServer::Client) or from a
+    //! peer shard.  Only session requests go over it: unlike net::Client it says no proxy hello,
+    //! keeps no replay buffer and sends no acks, so the session server's message types never meet
+    //! a proxy's.  Requests made while disconnected wait for the next connect, and those whose
+    //! replies can no longer arrive (the connection dropped) fail with Result::Retry.
+    //! The session server does not ack, so the SendQueue counts a request only until it is
+    //! handed to the socket: what fills it is what waits here (for a connect, or for the end of
+    //! the io turn).  A request is never dropped, one which finds the queue at its limit fails
+    //! with Result::Retry.
+    class SessionLink
+    {
+    public:
+        static constexpr int                RequestTimeoutSeconds = 30;
+        //! reconnects back off from the first to the last, doubling
+        static constexpr int                MinRetryMillis = 100;
+        static constexpr int                MaxRetryMillis = 10000;
+
+        void                                open( cpp::AsyncContext & io, StrArg addr );
+        void                                close( );
+        //! `fn` is called once connected, or with Result::Timeout
+        void                                ready( int timeoutSeconds, ReadyFn fn );
+        bool                                isConnected( ) const;
+        void                                setSendLimits( const SendLimits & limits );
+        void                                onBackpressure( BackpressureFn fn );
+
+        //! `fn` may be nullptr if no reply is wanted
+        template<Schema T>
+        void                                send( const T & request, BindFn fn );
+        //! `request` goes ahead of everything else on each connect, which is only ready (and
+        //! sends what is queued) once it is answered Ok; a refusal drops the connection.  Set
+        //! before open( ).
+        template<Schema T>
+        void                                greet( const T & request );
+    private:
+        using                               GreetFn = std::function<void( MessageWriter & writer, const Message & header )>;
+
+        void                                doConnect( );
+        void                                doGreet( );
+        void                                didConnect( );
+        void                                doRetry( );
+        void                                flush( );
+        void                                receive( const Message & message, const cpp::Memory & data );
+        uint16_t                            makeBind( BindFn fn, uint16_t * moniker );
+        void                                doExpireBinds( );
+        void                                failBinds( Result result );
+        void                                notifyReady( Result result );
+        void                                notifyBackpressure( );
+
+        cpp::AsyncContext                   m_io;
+        std::string                         m_addr;
+        TransportClient                     m_tcp;
+        MessageReader                       m_reader;
+        MessageWriter                       m_writer;
+        SendQueue                           m_sendQueue;
+        BindTable                           m_binds;
+        ReadyFn                             m_readyHandler;
+        BackpressureFn                      m_backpressureHandler;
+        GreetFn                             m_greet;
+        cpp::AsyncTimer                     m_readyTimer;
+        cpp::AsyncTimer                     m_retryTimer;
+        cpp::AsyncTimer                     m_bindTimer;
+        int                                 m_retryMillis = MinRetryMillis;
+        bool                                m_isOpen = false;
+        //! connected, and greeted if there is a greeting
+        bool                                m_isConnected = false;
+        bool                                m_isGreeting = false;
+        bool                                m_isFlushPending = false;
+        bool                                m_isBindTimerPending = false;
+    };
+}
+
+namespace grim::net
+{
+    void SessionLink::open( cpp::AsyncContext & io, StrArg addr )
+    {
+        m_io = io;
+        m_addr = addr;
+        m_isOpen = true;
+        m_retryMillis = MinRetryMillis;
+        doConnect( );
+    }
+
+    void SessionLink::close( )
+    {
+        m_isOpen = false;
+        m_retryTimer.cancel( );
+        m_readyTimer.cancel( );
+        m_bindTimer.cancel( );
+        m_isBindTimerPending = false;
+        m_tcp.disconnect( );
+        m_isConnected = m_isGreeting = false;
+        m_writer.clear( );
+        failBinds( Result::Retry );
+    }
+
+    void SessionLink::ready( int timeoutSeconds, ReadyFn fn )
+    {
+        if ( m_isConnected )
+            { m_io.post( [fn]( ) { fn( Result::Ok ); } ); return; }
+        m_readyHandler = fn;
+        m_readyTimer = m_io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
+            { notifyReady( Result::Timeout ); } );
+    }
+
+    bool SessionLink::isConnected( ) const
+    {
+        return m_isConnected;
+    }
+
+    void SessionLink::setSendLimits( const SendLimits & limits )
+    {
+        m_sendQueue.setLimits( limits );
+    }
+
+    void SessionLink::onBackpressure( BackpressureFn fn )
+    {
+        m_backpressureHandler = fn;
+    }
+
+    template<Schema T>
+    void SessionLink::send( const T & request, BindFn fn )
+    {
+        auto fail = [this, fn]( )
+            {
+                if ( fn )
+                    { m_io.post( [fn]( ) { Message reply{ }; reply.result = (uint8_t)Result::Retry; fn( reply, cpp::Memory{ } ); } ); }
+            };
+        size_t dataLength = encodedSize( request );
+        size_t frameSize = MessageHeaderSize + dataLength + paddingOf( dataLength );
+        if ( m_sendQueue.admit( m_writer.size( ), frameSize, false ) == SendQueue::Verdict::Disconnect )
+        {
+            notifyBackpressure( );
+            fail( );
+            return;
+        }
+        Message message{ };
+        if ( fn )
+        {
+            message.bind = makeBind( fn, &message.moniker );
+            if ( !message.bind )
+                { fail( ); return; }
+        }
+        putMessage( m_writer, message, request );
+        notifyBackpressure( );
+        // every request made during this io turn goes out with one send
+        if ( m_isConnected && !m_isFlushPending )
+        {
+            m_isFlushPending = true;
+            m_io.post( [this]( ) { flush( ); } );
+        }
+    }
+
+    template<Schema T>
+    void SessionLink::greet( const T & request )
+    {
+        m_greet = [request]( MessageWriter & writer, const Message & header ) { putMessage( writer, header, request ); };
+    }
+
+    void SessionLink::doConnect( )
+    {
+        m_tcp.connect( m_io, m_addr,
+            [this]( std::error_code error )
+            {
+                m_reader.reset( );
+                if ( error )
+                {
+                    cpp::Log::info( "doConnect() : addr='{}' msg='{}'", m_addr, error.message( ) );
+                    doRetry( );
+                    return;
+                }
+                m_retryMillis = MinRetryMillis;
+                if ( m_greet )
+                    { doGreet( ); }
+                else
+                    { didConnect( ); }
+            },
+            [this]( std::string & recvBuffer )
+            {
+                m_reader.read( recvBuffer, [this]( const Message & message, const cpp::Memory & data )
+                    { receive( message, data ); } );
+            },
+            [this]( std::error_code reason )
+            {
+                cpp::Log::info( "disconnect() : addr='{}' msg='{}'", m_addr, reason.message( ) );
+                // what was sent, or was to go with it, may or may not have been handled
+                m_isConnected = m_isGreeting = false;
+                m_writer.clear( );
+                notifyBackpressure( );
+                failBinds( Result::Retry );
+                doRetry( );
+            }, "" );
+    }
+
+    void SessionLink::doGreet( )
+    {
+        m_isGreeting = true;
+        Message header{ };
+        header.bind = makeBind( [this]( const Message & reply, StrArg )
+            {
+                // dropped meanwhile
+                if ( !m_isGreeting )
+                    { return; }
+                m_isGreeting = false;
+                if ( reply.result == (uint8_t)Result::Ok )
+                    { didConnect( ); return; }
+                cpp::Log::error( "doGreet() : addr='{}' result={}", m_addr, reply.result );
+                m_tcp.disconnect( );
+            }, &header.moniker );
+        MessageWriter frame;
+        m_greet( frame, header );
+        m_tcp.send( frame.getAll( ) );
+    }
+
+    void SessionLink::didConnect( )
+    {
+        m_isConnected = true;
+        notifyReady( Result::Ok );
+        flush( );
+    }
+
+    void SessionLink::doRetry( )
+    {
+        if ( !m_isOpen )
+            { return; }
+        m_retryTimer = m_io.waitFor( cpp::Duration::ofMillis( m_retryMillis ), [this]( ) { doConnect( ); } );
+        m_retryMillis = std::min( m_retryMillis * 2, MaxRetryMillis );
+    }
+
+    void SessionLink::flush( )
+    {
+        m_isFlushPending = false;
+        if ( !m_isConnected || m_writer.isEmpty( ) )
+            { return; }
+        m_tcp.send( m_writer.getAll( ) );
+        m_writer.clear( );
+        // nothing is acked, so what was handed to the socket no longer counts
+        notifyBackpressure( );
+    }
+
+    void SessionLink::receive( const Message & message, const cpp::Memory & data )
+    {
+        // the session server only replies
+        if ( BindFn fn = m_binds.remove( message.bind, message.moniker ) )
+            { fn( message, data ); }
+    }
+
+    uint16_t SessionLink::makeBind( BindFn fn, uint16_t * moniker )
+    {
+        uint64_t now = cpp::Time::now( ).sinceEpoch( ).millis( );
+        uint16_t bind = m_binds.add( std::move( fn ), now + RequestTimeoutSeconds * 1000, moniker );
+        if ( !bind )
+            { cpp::Log::error( "makeBind() : too many pending requests" ); }
+        if ( !m_isBindTimerPending )
+        {
+            m_isBindTimerPending = true;
+            m_bindTimer = m_io.waitFor( cpp::Duration::ofMillis( BindTable::TickMillis ), [this]( ) { doExpireBinds( ); } );
+        }
+        return bind;
+    }
+
+    void SessionLink::doExpireBinds( )
+    {
+        m_isBindTimerPending = false;
+        uint64_t now = cpp::Time::now( ).sinceEpoch( ).millis( );
+        m_binds.expire( now, []( uint16_t bind, uint16_t moniker, BindFn fn )
+            {
+                Message message{ };
+                message.moniker = moniker;
+                message.bind = bind;
+                message.result = (uint8_t)Result::Timeout;
+                fn( message, cpp::Memory{ } );
+            } );
+        if ( !m_binds.isEmpty( ) )
+        {
+            m_isBindTimerPending = true;
+            m_bindTimer = m_io.waitFor( cpp::Duration::ofMillis( BindTable::TickMillis ), [this]( ) { doExpireBinds( ); } );
+        }
+    }
+
+    void SessionLink::failBinds( Result result )
+    {
+        m_binds.clear( [result]( uint16_t bind, uint16_t moniker, BindFn fn )
+            {
+                Message message{ };
+                message.moniker = moniker;
+                message.bind = bind;
+                message.result = (uint8_t)result;
+                fn( message, cpp::Memory{ } );
+            } );
+    }
+
+    void SessionLink::notifyReady( Result result )
+    {
+        m_readyTimer.cancel( );
+        if ( auto fn = std::exchange( m_readyHandler, nullptr ) )
+            { fn( result ); }
+    }
+
+    void SessionLink::notifyBackpressure( )
+    {
+        if ( m_sendQueue.update( m_writer.size( ) ) && m_backpressureHandler )
+            { m_backpressureHandler( m_addr, m_sendQueue.isBlocked( ), m_writer.size( ) ); }
+    }
+}
@@ -0,0 +1,357 @@
+module;
+
+#include <cinttypes>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+export module grim.net.session_log;
+
+import cpp.buffer;
+import cpp.memory;
+import grim.arch.net;
+
+export namespace grim::net
+{
+    //! One change to SessionServer::Data.  Only the fields of the record's kind are used:
+    //!     * Create: sessionId, userId, proxySessionId, extAddr, email
+    //!     * Reauth: sessionId, extAddr, proxySessionId (0 keeps the current proxy)
+    //!     * ServerNode: sessionId, service, nodeId
+    struct SessionLogRecord
+    {
+        enum class Kind : uint8_t { Create = 1, Reauth = 2, ServerNode = 3 };
+
+        Kind                                kind = Kind::Create;
+        uint64_t                            sessionId = 0;
+        uint64_t                            userId = 0;
+        uint64_t                            proxySessionId = 0;
+        std::string                         extAddr;
+        std::string                         email;
+        std::string                         service;
+        int                                 nodeId = 0;
+    };
+
+    //! Append-only log of SessionLogRecords.  Each record is written as a uint32_t length followed
+    //! by the record, so a record torn by a crash is detected and dropped on open.  Appends are
+    //! buffered until flush(), which the server calls once per batch of requests.
+    class SessionLog
+    {
+    public:
+        using                               RecordFn = std::function<void( const SessionLogRecord & record )>;
+
+                                            ~SessionLog( );
+
+        //! calls `fn` for each complete record in `path`, then opens it for appending
+        Result                              open( const std::filesystem::path & path, const RecordFn & fn );
+        void                                close( );
+        bool                                isOpen( ) const;
+
+        void                                append( const SessionLogRecord & record );
+        void                                flush( );
+        //! discards every record, called once they are all in a snapshot
+        void                                truncate( );
+    private:
+        std::filesystem::path               m_path;
+        std::ofstream                       m_file;
+        std::string                         m_buffer;
+    };
+
+    //! Compact image of every session:
+    //!     * header: magic, version, string count, record count
+    //!     * string table: every distinct address, email and service name
+    //!     * records: fixed size, strings referenced by index
+    //! A snapshot is loaded with a single read and decoded in one pass.
+    class SessionSnapshot
+    {
+    public:
+        struct Record
+        {
+            uint64_t                        sessionId;
+            uint64_t                        userId;
+            uint64_t                        proxySessionId;
+            uint32_t                        extAddr;
+            uint32_t                        email;
+            //! 0 (the empty string) unless the session is a server node
+            uint32_t                        service;
+            int32_t                         nodeId;
+        };
+
+        uint32_t                            addString( std::string_view value );
+        void                                addRecord( const Record & record );
+        //! writes to a temporary file which then replaces `path`, so a crash leaves the old snapshot
+        Result                              save( const std::filesystem::path & path ) const;
+
+        Result                              load( const std::filesystem::path & path );
+        std::string_view                    string( uint32_t index ) const;
+        const std::vector<Record> &         records( ) const;
+    private:
+        static constexpr uint32_t           Magic = 0x47535331;
+        static constexpr uint32_t           Version = 1;
+
+        std::deque<std::string>             m_strings;
+        std::unordered_map<std::string_view, uint32_t> m_stringIds;
+        std::vector<Record>                 m_records;
+    };
+}
+
+namespace grim::net
+{
+    std::string encodeLogRecord( const SessionLogRecord & record )
+    {
+        auto out = cpp::StringBuffer::writeTo( 64 );
+        out.putBinary( (uint8_t)record.kind, ByteOrder );
+        out.putBinary( record.sessionId, ByteOrder );
+        switch ( record.kind )
+        {
+        case SessionLogRecord::Kind::Create:
+            out.putBinary( record.userId, ByteOrder );
+            out.putBinary( record.proxySessionId, ByteOrder );
+            out.putBinary( record.extAddr, ByteOrder );
+            out.putBinary( record.email, ByteOrder );
+            break;
+        case SessionLogRecord::Kind::Reauth:
+            out.putBinary( record.proxySessionId, ByteOrder );
+            out.putBinary( record.extAddr, ByteOrder );
+            break;
+        case SessionLogRecord::Kind::ServerNode:
+            out.putBinary( record.service, ByteOrder );
+            out.putBinary( (int32_t)record.nodeId, ByteOrder );
+            break;
+        }
+        return out.getAll( );
+    }
+
+    bool decodeLogRecord( const cpp::Memory & data, SessionLogRecord * record )
+    {
+        try
+        {
+            cpp::DataBuffer in{ data };
+            uint8_t kind;
+            in.getBinary( kind, ByteOrder );
+            in.getBinary( record->sessionId, ByteOrder );
+            record->kind = (SessionLogRecord::Kind)kind;
+            switch ( record->kind )
+            {
+            case SessionLogRecord::Kind::Create:
+                in.getBinary( record->userId, ByteOrder );
+                in.getBinary( record->proxySessionId, ByteOrder );
+                in.getBinary( record->extAddr, ByteOrder );
+                in.getBinary( record->email, ByteOrder );
+                break;
+            case SessionLogRecord::Kind::Reauth:
+                in.getBinary( record->proxySessionId, ByteOrder );
+                in.getBinary( record->extAddr, ByteOrder );
+                break;
+            case SessionLogRecord::Kind::ServerNode:
+            {
+                int32_t nodeId;
+                in.getBinary( record->service, ByteOrder );
+                in.getBinary( nodeId, ByteOrder );
+                record->nodeId = nodeId;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        catch ( std::exception & ) { return false; }
+        return true;
+    }
+
+    Result SessionLog::open( const std::filesystem::path & path, const RecordFn & fn )
+    {
+        close( );
+        m_path = path;
+
+        // replay, and find where the last complete record ends
+        size_t validSize = 0;
+        {
+            std::ifstream in{ path, std::ios::binary };
+            std::string log{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{ } };
+            cpp::Memory data{ log };
+            while ( log.size( ) - validSize >= 4 )
+            {
+                uint32_t length = 0;
+                cpp::DataBuffer{ data.substr( validSize, 4 ) }.getBinary( length, ByteOrder );
+                if ( log.size( ) - validSize - 4 < length )
+                    { break; }
+                SessionLogRecord record;
+                if ( !decodeLogRecord( data.substr( validSize + 4, length ), &record ) )
+                    { break; }
+                fn( record );
+                validSize += 4 + length;
+            }
+        }
+
+        std::error_code error;
+        if ( std::filesystem::exists( path, error ) )
+            { std::filesystem::resize_file( path, validSize, error ); }
+        if ( error )
+            { return Result::Unknown; }
+        m_file.open( path, std::ios::binary | std::ios::app );
+        return m_file ? Result::Ok : Result::Unknown;
+    }
+
+    SessionLog::~SessionLog( )
+    {
+        close( );
+    }
+
+    void SessionLog::close( )
+    {
+        if ( !isOpen( ) )
+            { return; }
+        flush( );
+        m_file.close( );
+    }
+
+    bool SessionLog::isOpen( ) const
+    {
+        return m_file.is_open( );
+    }
+
+    void SessionLog::append( const SessionLogRecord & record )
+    {
+        if ( !isOpen( ) )
+            { return; }
+        std::string data = encodeLogRecord( record );
+        auto length = cpp::StringBuffer::writeTo( 4 );
+        length.putBinary( (uint32_t)data.size( ), ByteOrder );
+        m_buffer += length.getAll( );
+        m_buffer += data;
+    }
+
+    void SessionLog::flush( )
+    {
+        if ( m_buffer.empty( ) )
+            { return; }
+        m_file.write( m_buffer.data( ), m_buffer.size( ) );
+        m_file.flush( );
+        m_buffer.clear( );
+    }
+
+    void SessionLog::truncate( )
+    {
+        if ( !isOpen( ) )
+            { return; }
+        m_buffer.clear( );
+        m_file.close( );
+        m_file.open( m_path, std::ios::binary | std::ios::trunc );
+    }
+
+    uint32_t SessionSnapshot::addString( std::string_view value )
+    {
+        // index 0 is always the empty string
+        if ( m_strings.empty( ) )
+        {
+            m_strings.emplace_back( );
+            m_stringIds[m_strings.back( )] = 0;
+        }
+        if ( auto itr = m_stringIds.find( value ); itr != m_stringIds.end( ) )
+            { return itr->second; }
+        uint32_t index = (uint32_t)m_strings.size( );
+        m_strings.emplace_back( value );
+        m_stringIds[m_strings.back( )] = index;
+        return index;
+    }
+
+    void SessionSnapshot::addRecord( const Record & record )
+    {
+        m_records.push_back( record );
+    }
+
+    Result SessionSnapshot::save( const std::filesystem::path & path ) const
+    {
+        auto out = cpp::StringBuffer::writeTo( 64 + m_records.size( ) * sizeof( Record ) );
+        out.putBinary( Magic, ByteOrder );
+        out.putBinary( Version, ByteOrder );
+        out.putBinary( (uint32_t)m_strings.size( ), ByteOrder );
+        out.putBinary( (uint64_t)m_records.size( ), ByteOrder );
+        for ( auto & value : m_strings )
+            { out.putBinary( value, ByteOrder ); }
+        for ( auto & record : m_records )
+        {
+            out.putBinary( record.sessionId, ByteOrder );
+            out.putBinary( record.userId, ByteOrder );
+            out.putBinary( record.proxySessionId, ByteOrder );
+            out.putBinary( record.extAddr, ByteOrder );
+            out.putBinary( record.email, ByteOrder );
+            out.putBinary( record.service, ByteOrder );
+            out.putBinary( record.nodeId, ByteOrder );
+        }
+
+        auto tmpPath = path;
+        tmpPath += ".tmp";
+        {
+            std::ofstream file{ tmpPath, std::ios::binary | std::ios::trunc };
+            std::string data = out.getAll( );
+            file.write( data.data( ), data.size( ) );
+            if ( !file )
+                { return Result::Unknown; }
+        }
+        std::error_code error;
+        std::filesystem::rename( tmpPath, path, error );
+        return error ? Result::Unknown : Result::Ok;
+    }
+
+    Result SessionSnapshot::load( const std::filesystem::path & path )
+    {
+        m_strings.clear( );
+        m_stringIds.clear( );
+        m_records.clear( );
+
+        std::ifstream file{ path, std::ios::binary | std::ios::ate };
+        if ( !file )
+            { return Result::Arg; }
+        std::string data( (size_t)file.tellg( ), '\0' );
+        file.seekg( 0 );
+        file.read( data.data( ), data.size( ) );
+
+        try
+        {
+            cpp::DataBuffer in{ cpp::Memory{ data } };
+            uint32_t magic, version, stringCount;
+            uint64_t recordCount;
+            in.getBinary( magic, ByteOrder );
+            in.getBinary( version, ByteOrder );
+            if ( magic != Magic || version != Version )
+                { return Result::Arg; }
+            in.getBinary( stringCount, ByteOrder );
+            in.getBinary( recordCount, ByteOrder );
+
+            for ( uint32_t i = 0; i < stringCount; i++ )
+                { in.getBinary( m_strings.emplace_back( ), ByteOrder ); }
+            m_records.resize( recordCount );
+            for ( auto & record : m_records )
+            {
+                in.getBinary( record.sessionId, ByteOrder );
+                in.getBinary( record.userId, ByteOrder );
+                in.getBinary( record.proxySessionId, ByteOrder );
+                in.getBinary( record.extAddr, ByteOrder );
+                in.getBinary( record.email, ByteOrder );
+                in.getBinary( record.service, ByteOrder );
+                in.getBinary( record.nodeId, ByteOrder );
+                if ( record.extAddr >= stringCount || record.email >= stringCount || record.service >= stringCount )
+                    { return Result::Arg; }
+            }
+        }
+        catch ( std::exception & ) { return Result::Arg; }
+        return Result::Ok;
+    }
+
+    std::string_view SessionSnapshot::string( uint32_t index ) const
+    {
+        return m_strings[index];
+    }
+
+    const std::vector<SessionSnapshot::Record> & SessionSnapshot::records( ) const
+    {
+        return m_records;
+    }
+}
@@ -1,918 +1,2346 @@
-module;
-
-#include <cinttypes>
-#include <set>
-#include <map>
-#include <functional>
-#include <system_error>
-#include <memory>
-
-export module grim.net.session_server;
-
-import cpp.random;
-import cpp.log;
-import cpp.asio.ip;
-import cpp.asio.tcp;
-import grim.arch.net;
-import grim.auth;
-
-export namespace grim::net
-{
-    class SessionServer 
-        : public ISessionServer
-    {
-    public:
-                                            SessionServer( );
-
-        void                                open(
-                                                cpp::AsyncContext & io,
-                                                StrArg listenAddress4,
-                                                StrArg listenAddress6,
-                                                StrArg email ) override;
-        void                                close( ) override;
-
-        void                                onAuthing( AuthingFn ) override;
-        void                                onAuth( AuthFn ) override;
-        void                                onReady( ReadyFn ) override;
-
-        void                                auth(
-                                                int timeoutSeconds,
-                                                AuthFn ) override;
-        bool                                auth(
-                                                int timeoutSeconds,
-                                                StrOut email,
-                                                uint64_t * sessionId,
-                                                Result * result ) override;
-
-        void                                ready(
-                                                int timeoutSeconds,
-                                                ReadyFn ) override;
-        bool                                ready(
-                                                int timeoutSeconds,
-                                                Result * result ) override;
-
-        class                               Data;
-        class                               Client;
-
-    private:
-        void                                notifyAuthing( );
-        void                                notifyAuth( );
-        void                                notifyReady( );
-        // initialization
-        void                                doAuthLogin( );
-        void                                authLogin( grim::auth::Result result, grim::auth::AuthToken authToken );
-        void                                doAuthReady( );
-        void                                authReady( grim::auth::Result result );
-        void                                doListen( );
-        // tcp handlers
-        void                                connect( std::error_code acceptError, const std::string & addr );
-        void                                receive( const std::string & addr, std::string & recvBuffer );
-        void                                disconnect( const std::string & addr, std::error_code reason );
-        // request handlers
-        void                                onConnect( StrArg ip ) override;
-        void                                onDisconnect( StrArg ip ) override;
-        void                                onHello( StrArg ip, uint64_t authToken, int nodeId ) override;
-        void                                onRello( StrArg ip, uint64_t sessionId, int nodeId ) override;
-        void                                onAuth( StrArg ip, StrArg extIp, uint64_t authToken ) override;
-        void                                onReauth( StrArg ip, StrArg extIp, uint64_t sessionId ) override;
-        void                                onAuthServer( StrArg ip, uint64_t sessionId, StrArg svcName, int nodeId ) override;
-        void                                onLookupSession( StrArg ip, uint64_t sessionId ) override;
-        void                                onLookupServer( StrArg ip, StrArg svcName, int nodeId ) override;
-
-    private:
-        struct                              Detail;
-        std::unique_ptr<Detail>             detail = std::make_unique<Detail>( );
-    };
-
-    class SessionServer::Client
-        : public ISessionServer::ClientApi
-    {
-    public:
-        Client( );
-
-        void                                open( cpp::AsyncContext & io, std::string addr, std::string authToken );
-        void                                close( );
-
-        void                                ready( int timeoutSeconds, net::ReadyFn );
-
-    private:
-        void                                hello( uint64_t authToken, uint8_t nodeId ) override;
-        void                                rello( uint64_t sessionId ) override;
-        void                                auth( uint64_t authToken, std::string extAddr, onAuth );
-        void                                reauth( uint64_t sessionId, std::string extAddr, onAuth );
-        void                                authServerNode( uint64_t sessionId, std::string svcName, int nodeId, onAuth );
-        void                                lookupSession( uint64_t sessionId, onLookupSession ) override;
-        void                                lookupServerNode( std::string svcName, int nodeId, onLookupServerNode ) override;
-
-
-    private:
-        struct                              Detail;
-        std::unique_ptr<Detail>             detail = std::make_unique<Detail>( );
-    };
-
-    class SessionServer::Data
-    {
-    public:
-        Result                              connected( std::string clientAddr );
-        Result                              disconnected( std::string clientAddr );
-        Result                              hello(
-                                                std::string clientAddr,
-                                                uint64_t authToken,
-                                                int nodeId,
-                                                uint64_t * sessionId );
-        Result                              rello(
-                                                std::string clientAddr,
-                                                uint64_t sessionId );
-
-        Result                              auth(
-                                                std::string clientAddr,
-                                                uint64_t authToken,
-                                                std::string extAddr,
-                                                uint64_t * sessionId );
-        Result                              reauth(
-                                                std::string clientAddr,
-                                                uint64_t sessionId,
-                                                std::string extAddr,
-                                                std::string * oldExtAddr );
-        Result                              authServerNode(
-                                                std::string clientAddr,
-                                                uint64_t sessionId,
-                                                std::string svcName, int nodeId );
-
-        Result                              openUdp(
-                                                uint64_t sessionId,
-                                                std::string intAddr,
-                                                std::string udpAddr );
-        Result                              closeUdp( uint64_t sessionId );
-        Result                              lookupUdp(
-                                                uint64_t sessionId,
-                                                std::string * extAddr,
-                                                std::string * intAddr,
-                                                std::string * udpAddr,
-                                                uint64_t * key );
-    public:
-        struct ServerNode
-        {
-            std::string                     service;
-            int                             nodeId;
-        };
-        struct SessionInfo
-        {
-            std::string                     extAddr;
-            std::string                     email;
-            uint64_t                        userId;
-            uint64_t                        proxySessionId;
-        };
-        struct SessionUdpInfo
-        {
-            std::string                     intAddr;
-            std::string                     udpAddr;
-            uint64_t                        key;
-        };
-        using                               SessionSet = std::set<uint64_t>;
-        using                               SessionUdpMap = std::map<uint64_t, SessionUdpInfo>;
-    private:
-        Result                              verifyConnection(
-                                                const std::string & clientAddr,
-                                                uint64_t * sessionId );
-        Result                              verifyServer(
-                                                uint64_t sessionId,
-                                                std::string_view * service,
-                                                int * nodeId );
-        Result                              verifySession(
-                                                uint64_t sessionId,
-                                                std::string_view * extAddr,
-                                                std::string_view * email,
-                                                uint64_t * userId,
-                                                uint64_t * proxySessionId );
-        Result                              verifyServerNetwork(
-                                                std::string serviceName,
-                                                std::string addr );
-        Result                              grimauth(
-                                                const std::string & extAddr,
-                                                uint64_t authToken,
-                                                const std::string & svc,
-                                                uint64_t * userId,
-                                                std::string * email );
-        uint64_t                            makeSessionId( );
-    private:
-        cpp::Random                         rng;
-        std::map<std::string, uint64_t>     clientSessions;
-        std::map<uint64_t, SessionSet>      proxySessions;
-        std::map<ServerNode, uint64_t>      serviceSessionMap;
-        std::map<uint64_t, ServerNode>      sessionServiceMap;
-        std::map<uint64_t, SessionInfo>     sessions;
-        SessionUdpMap                       sessionUdp;
-    };
-    namespace test
-    {
-        void                                testSessionServerData( );
-    };
-}
-
-namespace grim::net
-{
-    const char * AuthServiceId = "grimethos.com";
-    const char * ProxyServiceId = "proxy.grimethos.com";
-    std::map<std::string, std::vector<std::string>> ServiceNetwork =
-    {
-        { ProxyServiceId, { } },
-    };
-
-    bool operator<( const SessionServer::Data::ServerNode & x, const SessionServer::Data::ServerNode & y ) {
-        return std::tie( x.service, x.nodeId ) < std::tie( y.service, y.nodeId );
-    }
-
-    struct SessionServer::Client::Detail
-    {
-        std::unique_ptr<net::IClient>       client;
-    };
-
-    struct SessionServer::Detail
-    {
-        std::string                         email;
-        std::string                         bindAddress4;
-        std::string                         bindAddress6;
-        cpp::AsyncContext                   io;
-        cpp::TcpServer                      tcp;
-        grim::auth::Client                  grimauth;
-        grim::auth::AuthToken               authToken;
-
-        AuthingFn                           onAuthingHandler;
-        AuthFn                              onAuthHandler;
-        ReadyFn                             onReadyHandler;
-        ConnectFn                           onConnectHandler;
-        DisconnectFn                        onDisconnectHandler;
-
-        AuthFn                              authHandler;
-        ReadyFn                             readyHandler;
-        cpp::AsyncTimer                     handlerTimer;
-
-        uint64_t                            isAuthed : 1;
-        uint64_t                            isReady : 1;
-
-        Data                                data;
-    };
-
-    SessionServer::SessionServer( ) :
-        detail( std::make_unique<Detail>() )
-    {
-    }
-
-    void SessionServer::open(
-            cpp::AsyncContext & io,
-            StrArg listenAddress4,
-            StrArg listenAddress6,
-            StrArg email )
-    {
-        detail->isAuthed = false;
-        detail->isReady = false;
-
-        detail->io = io;
-        detail->bindAddress4 = listenAddress4;
-        detail->bindAddress6 = listenAddress6;
-        detail->email = email;
-        detail->grimauth.setAsyncContext( io );
-        doAuthLogin( );
-    }
-
-    void SessionServer::close( )
-    {
-        detail->tcp.close( );
-    }
-
-    void SessionServer::onAuthing( AuthingFn fn )
-    {
-        detail->onAuthingHandler = fn;
-    }
-
-    void SessionServer::onAuth( AuthFn fn )
-    {
-        detail->onAuthHandler = fn;
-    }
-
-    void SessionServer::onReady( ReadyFn fn )
-    {
-        detail->onReadyHandler = fn;
-    }
-
-    void SessionServer::auth( int timeoutSeconds, AuthFn fn )
-    {
-        // if isReady, post result immediately
-        if ( detail->isAuthed )
-            { detail->io.post( [this, fn]( ) { fn( detail->email, 0, Result::Ok ); } ); return; }
-
-        // start a timer that will return timeout if it elapses before the readyHandler is called
-        detail->authHandler = fn;
-        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
-            { detail->authHandler( detail->email, 0, Result::Timeout ); } );
-    }
-
-    bool SessionServer::auth(
-        int timeoutSeconds,
-        StrOut email,
-        uint64_t * sessionId,
-        Result * result )
-    {
-        *result = Result::Ok;
-        if ( !detail->isAuthed )
-        {
-            auto isAuthed = detail->io.createCondition<Result>( );
-            ready( timeoutSeconds, [&]( Result result )
-                { isAuthed.notify( result ); } );
-            *result = isAuthed.wait( );
-        }
-        *email = detail->email;
-        *sessionId = 0;
-
-        return *result == Result::Ok;
-    }
-
-    void SessionServer::ready( int timeoutSeconds, ReadyFn fn )
-    {
-        // if isReady, post result immediately
-        if ( detail->isReady )
-            { detail->io.post( [fn]( ) { fn( Result::Ok ); } ); return; }
-
-        // start a timer that will return timeout if it elapses before the readyHandler is called
-        detail->readyHandler = fn;
-        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( ) 
-            { detail->readyHandler( Result::Timeout ); } );
-    }
-
-    bool SessionServer::ready( int timeoutSeconds, Result * result )
-    {
-        *result = Result::Ok;
-        if ( !detail->isReady )
-        {
-            auto isReady = detail->io.createCondition<Result>( );
-            ready( timeoutSeconds, [&]( Result result )
-                { isReady.notify( result ); } );
-            *result = isReady.wait( );
-        }
-        return *result == Result::Ok;
-    }
-
-    void SessionServer::onConnect( StrArg ip )
-    {
-
-    }
-
-    void SessionServer::onDisconnect( StrArg ip )
-    {
-
-    }
-
-    void SessionServer::onHello( StrArg ip, uint64_t authToken, int nodeId )
-    {
-
-    }
-    void SessionServer::onRello( StrArg ip, uint64_t sessionId, int nodeId )
-    {
-
-    }
-
-    void SessionServer::onAuth( StrArg ip, StrArg extIp, uint64_t authToken )
-    {
-
-    }
-    void SessionServer::onReauth( StrArg ip, StrArg extIp, uint64_t sessionId )
-    {
-
-    }
-    void SessionServer::onAuthServer( StrArg ip, uint64_t sessionId, StrArg svcName, int nodeId )
-    {
-
-    }
-
-    void SessionServer::onLookupSession( StrArg ip, uint64_t sessionId )
-    {
-
-    }
-    void SessionServer::onLookupServer( StrArg ip, StrArg svcName, int nodeId )
-    {
-
-    }
-
-    void SessionServer::notifyAuthing( )
-    {
-        if ( detail->onAuthingHandler ) 
-            { detail->onAuthingHandler( detail->email, "" ); }
-    }
-
-    void SessionServer::notifyAuth( )
-    {
-        detail->isAuthed = true;
-        detail->handlerTimer.cancel( );
-        if ( detail->onAuthHandler )
-            { detail->onAuthHandler( detail->email, 0, Result::Ok ); }
-        if ( detail->authHandler )
-            { detail->authHandler( detail->email, 0, Result::Ok ); }
-    }
-
-    void SessionServer::notifyReady( )
-    {
-        detail->isReady = true;
-        detail->handlerTimer.cancel( );
-        if ( detail->onReadyHandler )
-            { detail->onReadyHandler( Result::Ok ); }
-        if ( detail->readyHandler )
-            { detail->readyHandler( Result::Ok ); }
-    }
-
-    void SessionServer::doAuthLogin( )
-    {
-        using namespace std::placeholders;
-        int options = grim::auth::LoginOption::Default;
-        detail->grimauth.login(
-            grim::auth::UserEmail{ detail->email },
-            grim::auth::ServiceId{ "backwater.grimethos.com" },
-            options,
-            5,
-            std::bind(&SessionServer::authLogin, this, _1, _2));
-        notifyAuthing( );
-    }
-
-    void SessionServer::authLogin( grim::auth::Result result, grim::auth::AuthToken authToken )
-    {
-        using grim::auth::Result;
-
-        switch ( result )
-        {
-        case Result::Ok:
-            detail->authToken = authToken;
-            doAuthReady( );
-            break;
-        case Result::Pending:
-            // this shouldn't happen
-            break;
-        case Result::Denied:
-            cpp::Log::notice( "Authentication denied by {}", detail->email );
-            break;
-        case Result::Timeout:
-            // todo: is this correct?
-            doAuthLogin( );
-            break;
-        case Result::Retry:
-            detail->io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( ) { doAuthLogin( ); } );
-            break;
-        }
-    }
-
-    void SessionServer::doAuthReady( )
-    {
-        using namespace std::placeholders;
-
-        notifyAuth( );
-
-        int options = grim::auth::LoginOption::Default;
-        detail->grimauth.authInit(
-            grim::auth::AuthToken{ detail->authToken },
-            std::bind( &SessionServer::authReady, this, _1 ) );
-    }
-
-    void SessionServer::authReady( grim::auth::Result result )
-    {
-        if ( result != grim::auth::Result::Ok )
-        {
-            cpp::Log::error( "authReady() : result={}", std::to_underlying(result) );
-            detail->io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( ) { doAuthLogin( ); } );
-            return;
-        }
-        doListen( );
-    }
-
-    void SessionServer::doListen( )
-    {
-        using namespace std::placeholders;
-        cpp::TcpServer::TlsInfo tlsInfo;
-        detail->tcp.open(
-            detail->io,
-            detail->bindAddress4,
-            detail->bindAddress6,
-            std::bind( &SessionServer::connect, this, _1, _2 ),
-            std::bind( &SessionServer::receive, this, _1, _2 ),
-            std::bind( &SessionServer::disconnect, this, _1, _2 ),
-            nullptr );
-        notifyReady( );
-    }
-
-    void SessionServer::connect( std::error_code acceptError, const std::string & addr )
-    {
-        if ( acceptError )
-        {
-            cpp::Log::error( "connect() : addr='{}' msg='{}'", addr, acceptError.message( ) );
-            return;
-        }
-        cpp::Log::info( "connect() : addr='{}'", addr );
-        detail->data.connected( addr );
-    }
-
-    void SessionServer::receive( const std::string & addr, std::string & recvBuffer )
-    {
-    }
-
-    void SessionServer::disconnect( const std::string & addr, std::error_code reason )
-    {
-        cpp::Log::info( "disconnect() : addr='{}' msg='{}'", addr, reason.message( ) );
-
-    }
-
-    SessionServer::Client::Client( )
-    {
-
-    }
-
-    void SessionServer::Client::open( cpp::AsyncContext & io, std::string addr, std::string authToken )
-    {
-
-    }
-
-    void SessionServer::Client::close( )
-    {
-
-    }
-
-    void SessionServer::Client::ready( int timeoutSeconds, net::ReadyFn )
-    {
-
-    }
-
-    void SessionServer::Client::auth( uint64_t authToken, std::string extAddr, onAuth )
-    {
-
-    }
-
-    void SessionServer::Client::reauth( uint64_t sessionId, std::string extAddr, onAuth )
-    {
-
-    }
-
-    void SessionServer::Client::authServerNode( uint64_t sessionId, std::string svcName, int nodeId, onAuth )
-    {
-
-    }
-
-    void SessionServer::Client::lookupSession( uint64_t sessionId, onLookupSession )
-    {
-
-    }
-
-    void SessionServer::Client::lookupServerNode( std::string svcName, int nodeId, onLookupServerNode )
-    {
-
-    }
-
-
-    Result SessionServer::Data::verifyConnection( const std::string & clientAddr, uint64_t * sessionId )
-    {
-        // verify clientAddr
-        auto itr = clientSessions.find( clientAddr );
-        if ( itr == clientSessions.end( ) )
-            { return Result::Arg; }
-        *sessionId = itr->second;
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::verifyServer( uint64_t sessionId, std::string_view * service, int * nodeId )
-    {
-        auto itr = sessionServiceMap.find( sessionId );
-        if ( itr == sessionServiceMap.end( ) )
-            { return Result::Arg; }
-        auto & serverNode = itr->second;
-        *service = serverNode.service;
-        *nodeId = serverNode.nodeId;
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::verifyServerNetwork( std::string serviceName, std::string serverAddr )
-    {
-        auto addr = cpp::Inet4::toTcpEndpoint( serverAddr );
-        auto serverNetwork = cpp::Inet4::toAddress( addr.address( ).to_string( ) );
-
-        auto itr = ServiceNetwork.find( serviceName );
-        if ( itr == ServiceNetwork.end( ) )
-            { return Result::Ok; }
-
-        auto & validNetworks = itr->second;
-        bool isSafeNetwork = validNetworks.empty( );
-        for ( auto validNetwork : validNetworks )
-        {
-            auto network = cpp::Inet4::toAddress( validNetwork );
-            if ( serverNetwork.is_subnet_of( network ) )
-            { isSafeNetwork = true; break; }
-        }
-        if ( !isSafeNetwork )
-            { return Result::Access; }
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::grimauth(
-        const std::string & extAddr,
-        uint64_t authToken,
-        const std::string & svc,
-        uint64_t * userId,
-        std::string * email )
-    {
-        if ( authToken == 1 )
-        {
-            *userId = 1;
-            *email = "monkeysmarts@gmail.com";
-        }
-        else if ( authToken == 2 )
-        {
-            *userId = 2;
-            *email = "thomas.farthing@grimethos.com";
-        }
-        else
-        {
-            return Result::Access;
-        }
-        return Result::Ok;
-    }
-
-    uint64_t SessionServer::Data::makeSessionId( )
-    {
-        uint64_t sessionId = 0;
-        while ( !sessionId || sessions.count( sessionId ) )
-        { sessionId = rng.rand( ); }
-        return sessionId;
-    }
-
-    Result SessionServer::Data::verifySession(
-        uint64_t sessionId,
-        std::string_view * extAddr,
-        std::string_view * email,
-        uint64_t * userId,
-        uint64_t * proxySessionId )
-    {
-        auto itr = sessions.find( sessionId );
-        if ( itr == sessions.end( ) )
-        { return Result::Arg; }
-        auto & sessionInfo = itr->second;
-        *extAddr = sessionInfo.extAddr;
-        *email = sessionInfo.email;
-        *userId = sessionInfo.userId;
-        *proxySessionId = sessionInfo.proxySessionId;
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::connected( std::string clientAddr )
-    {
-        auto itr = clientSessions.find( clientAddr );
-        if ( itr != clientSessions.end( ) )
-        { return Result::Arg; }
-        clientSessions[clientAddr] = 0;
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::disconnected( std::string clientAddr )
-    {
-        if ( !clientSessions.erase( clientAddr ) )
-            { return Result::Arg; }
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::hello(
-        std::string clientAddr,
-        uint64_t authToken,
-        int nodeId,
-        uint64_t * sessionId )
-    {
-        uint64_t clientSessionId = 0;
-        Result result = verifyConnection( clientAddr, &clientSessionId );
-        if ( result != Result::Ok )
-            { return result; }
-
-        result = verifyServerNetwork( ProxyServiceId, clientAddr );
-        if ( result != Result::Ok )
-            { return result; }
-
-        uint64_t userId;
-        std::string email;
-        result = grimauth( clientAddr, authToken, "grimethos.com", &userId, &email );
-        if ( result != Result::Ok )
-            { return result; }
-
-        uint64_t newSessionId = makeSessionId( );
-
-        clientSessions[clientAddr] = newSessionId;
-
-        SessionInfo & sessionInfo = sessions[newSessionId];
-        sessionInfo.extAddr = clientAddr;
-        sessionInfo.proxySessionId = clientSessionId;
-        sessionInfo.email = email;
-        sessionInfo.userId = userId;
-
-        ServerNode serverNode{ ProxyServiceId, nodeId };
-        serviceSessionMap[serverNode] = newSessionId;
-        sessionServiceMap[newSessionId] = serverNode;
-
-        *sessionId = newSessionId;
-
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::rello(
-        std::string clientAddr,
-        uint64_t sessionId )
-    {
-        std::string oldAddr;
-        Result result = reauth( clientAddr, sessionId, clientAddr, &oldAddr );
-        if ( result == Result::Ok )
-        {
-            if ( auto itr = clientSessions.find( oldAddr ); itr != clientSessions.end( ) )
-                { clientSessions[oldAddr] = 0; }
-            clientSessions[clientAddr] = sessionId;
-        }
-
-        return result;
-    }
-
-    Result SessionServer::Data::auth(
-        std::string clientAddr,
-        uint64_t authToken,
-        std::string extAddr,
-        uint64_t * sessionId )
-    {
-        uint64_t clientSessionId = 0;
-        Result result = verifyConnection( clientAddr, &clientSessionId );
-        if ( result != Result::Ok )
-            { return result; }
-
-        std::string_view clientServiceName;
-        int clientNodeId;
-        result = verifyServer( clientSessionId, &clientServiceName, &clientNodeId );
-        if ( result != Result::Ok )
-            { return result; }
-
-        if ( clientServiceName != "proxy.grimethos.com" )
-            { return Result::Access; }
-
-        uint64_t userId;
-        std::string email;
-        result = grimauth( extAddr, authToken, "grimethos.com", &userId, &email );
-        if ( result != Result::Ok )
-            { return result; }
-
-        uint64_t newSessionId = makeSessionId( );
-
-        SessionInfo & sessionInfo = sessions[newSessionId];
-        sessionInfo.extAddr = extAddr;
-        sessionInfo.proxySessionId = clientSessionId;
-        sessionInfo.email = email;
-        sessionInfo.userId = userId;
-
-        proxySessions[clientSessionId].insert( newSessionId );
-
-        *sessionId = newSessionId;
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::reauth(
-        std::string clientAddr,
-        uint64_t sessionId,
-        std::string extAddr,
-        std::string * oldExtAddr )
-    {
-        uint64_t clientSessionId = 0;
-        Result result = verifyConnection( clientAddr, &clientSessionId );
-        if ( result != Result::Ok )
-            { return result; }
-
-        bool isProxyServer = clientAddr == extAddr;
-        if ( isProxyServer )
-            { clientSessionId = sessionId; }
-
-        std::string_view clientServiceName;
-        int clientNodeId;
-        result = verifyServer( clientSessionId, &clientServiceName, &clientNodeId );
-        if ( result != Result::Ok )
-            { return result; }
-
-        std::string_view sessionExtAddr;
-        std::string_view email;
-        uint64_t userId = 0;
-        uint64_t proxySessionId = 0;
-        result = verifySession( sessionId, &sessionExtAddr, &email, &userId, &proxySessionId );
-        if ( result != Result::Ok )
-            { return result; }
-
-        auto oldAddr = cpp::Inet4::toTcpEndpoint( sessionExtAddr );
-        auto newAddr = cpp::Inet4::toTcpEndpoint( extAddr );
-        if ( oldAddr.address( ) != newAddr.address( ) )
-            { return Result::Access; }
-
-        SessionInfo & sessionInfo = sessions[sessionId];
-        *oldExtAddr = sessionInfo.extAddr;
-        uint64_t oldProxySessionId = sessionInfo.proxySessionId;
-        sessionInfo.extAddr = extAddr;
-
-        // if this is a client reauth (proxy server)
-        if ( isProxyServer )
-        {
-            proxySessions[oldProxySessionId].erase( sessionId );
-            proxySessions[clientSessionId].insert( sessionId );
-        }
-        else
-        {
-            sessionInfo.proxySessionId = clientSessionId;
-        }
-
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::authServerNode(
-        std::string clientAddr,
-        uint64_t sessionId,
-        std::string svcName, int nodeId )
-    {
-        uint64_t clientSessionId = 0;
-        Result result = verifyConnection( clientAddr, &clientSessionId );
-        if ( result != Result::Ok )
-        { return result; }
-
-        std::string_view clientServiceName;
-        int clientNodeId;
-        result = verifyServer( clientSessionId, &clientServiceName, &clientNodeId );
-        if ( result != Result::Ok )
-        { return result; }
-
-        std::string_view extAddr;
-        std::string_view email;
-        uint64_t userId = 0;
-        uint64_t proxySessionId = 0;
-        result = verifySession( sessionId, &extAddr, &email, &userId, &proxySessionId );
-        if ( result != Result::Ok )
-        { return result; }
-
-        if ( email != "monkeysmarts@gmail.com" )
-        { return Result::Access; }
-
-        result = verifyServerNetwork( svcName, std::string{ extAddr } );
-        if ( result != Result::Ok )
-        { return result; }
-
-        ServerNode serverNode{ svcName, nodeId };
-        serviceSessionMap[serverNode] = sessionId;
-        sessionServiceMap[sessionId] = serverNode;
-
-        return Result::Ok;
-    }
-
-    Result SessionServer::Data::openUdp(
-        uint64_t sessionId,
-        std::string intAddr,
-        std::string udpAddr )
-    {
-        return Result::Access;
-    }
-
-    Result SessionServer::Data::closeUdp( uint64_t sessionId )
-    {
-        return Result::Access;
-    }
-
-    Result SessionServer::Data::lookupUdp(
-        uint64_t sessionId,
-        std::string * extAddr,
-        std::string * intAddr,
-        std::string * udpAddr,
-        uint64_t * key )
-    {
-        return Result::Access;
-    }
-
-
-    namespace test
-    {
-        void testSessionServerData( )
-        {
-            const char * LOCAL_ADDR1 = "10.10.10.1:1";
-            const char * LOCAL_ADDR1_2 = "10.10.10.1:3";
-            const char * LOCAL_ADDR2 = "10.10.10.2:2";
-            const char * REMOTE_ADDR1 = "10.10.10.100:1";
-            const char * REMOTE_ADDR2 = "10.10.10.101:2";
-
-            SessionServer::Data data;
-            data.connected( LOCAL_ADDR1 );
-            data.connected( LOCAL_ADDR2 );
-
-            uint64_t proxySessionId[2];
-            if ( data.hello( LOCAL_ADDR1, 1, 0, &proxySessionId[0] ) != Result::Ok )
-                { throw std::exception{ "data.authClient( LOCAL_ADDR1 )" }; }
-            if ( data.hello( LOCAL_ADDR2, 2, 1, &proxySessionId[1] ) != Result::Ok )
-                { throw std::exception{ "data.authClient( LOCAL_ADDR2 )" }; }
-
-            data.connected( LOCAL_ADDR1_2 );
-            if ( data.rello( LOCAL_ADDR1_2, proxySessionId[0] ) != Result::Ok )
-                { throw std::exception{ "data.reauthClient( LOCAL_ADDR1_2 )" }; }
-
-            uint64_t galaxySessionId;
-            if ( data.auth( LOCAL_ADDR1_2, 1, REMOTE_ADDR1, &galaxySessionId ) != Result::Ok )
-                { throw std::exception{ "data.auth( LOCAL_ADDR1_2, 1, REMOTE_ADDR1 )" }; }
-            if ( data.authServerNode( LOCAL_ADDR1_2, galaxySessionId, "galaxy.backwater.grimethos.com", 0 ) != Result::Ok )
-                { throw std::exception{ "data.authServerNode( LOCAL_ADDR1_2, galaxySessionId )" }; }
-        }
-    }
-}
+module;
+
+#include <chrono>
+#include <cinttypes>
+#include <filesystem>
+#include <format>
+#include <set>
+#include <map>
+#include <functional>
+#include <system_error>
+#include <memory>
+#include <thread>
+#include <vector>
+
+export module grim.net.session_server;
+
+import cpp.random;
+import cpp.log;
+import cpp.asio.ip;
+import cpp.asio.tcp;
+import grim.arch.net;
+import grim.auth;
+import grim.net.auth_batch;
+import grim.net.auth_cache;
+import grim.net.message;
+import grim.net.route;
+import grim.net.schema;
+import grim.net.send_queue;
+import grim.net.session_api;
+import grim.net.session_link;
+import grim.net.session_log;
+import grim.net.session_table;
+import grim.net.stats;
+import grim.net.transport;
+
+export namespace grim::net
+{
+    //! The session service is split into shards (session servers), each owning the sessions it
+    //! created.  A session id carries the index of its owning shard in its top SessionShardBits.
+    constexpr uint32_t                      SessionShardBits = 8;
+    constexpr uint32_t                      MaxSessionShards = 1 << SessionShardBits;
+    constexpr uint8_t                       sessionShardOf( uint64_t sessionId )
+                                                { return (uint8_t)( sessionId >> ( 64 - SessionShardBits ) ); }
+    //! No session server is the last shard: ids in its range name groups of sessions, which a
+    //! proxy keeps for each session (see grim.net.group).  `n` is the sender's choice.
+    constexpr uint8_t                       GroupSessionShard = MaxSessionShards - 1;
+    constexpr bool                          isGroupId( uint64_t id )
+                                                { return sessionShardOf( id ) == GroupSessionShard; }
+    constexpr uint64_t                      makeGroupId( uint64_t n )
+                                                { return ( (uint64_t)GroupSessionShard << ( 64 - SessionShardBits ) ) | ( n & ( ~0ull >> SessionShardBits ) ); }
+
+    class SessionServer 
+        : public ISessionServer
+    {
+    public:
+        using                               MessageType = SessionMessageType;
+
+                                            SessionServer( );
+
+        void                                open(
+                                                cpp::AsyncContext & io,
+                                                StrArg listenAddress4,
+                                                StrArg listenAddress6,
+                                                StrArg email ) override;
+        //! listens on `listenAddress` without logging in, joining any peer shards with `authToken`
+        //! as if it had; for in-process ("loop:") tests
+        void                                openLocal( cpp::AsyncContext & io, StrArg listenAddress, StrArg email, auth::AuthToken authToken );
+        void                                close( ) override;
+        //! sessions are saved to `dataDir` and restored from it by open( ); unset, they are only
+        //! kept in memory
+        void                                setDataDir( std::filesystem::path dataDir );
+        //! makes this server shard `shardIndex` of the comma separated `shardAddrs` (which includes
+        //! this server), below GroupSessionShard.  Server nodes are replicated to every other shard.
+        void                                setShard( uint8_t shardIndex, StrArg shardAddrs );
+        //! verifies hello and auth tokens with `client`, collecting those which arrive within
+        //! `windowMillis` into one authBatch; unset, tokens are verified by Data's auth backend
+        void                                setAuthBatching( auth::IClient & client, int windowMillis = 2, size_t maxBatch = 256 );
+        //! adds this server's counters and latencies to `total` (see grim.net.stats)
+        void                                stats( NetStats * total ) const;
+
+        void                                onAuthing( AuthingFn ) override;
+        void                                onAuth( AuthFn ) override;
+        void                                onReady( ReadyFn ) override;
+        void                                onBackpressure( BackpressureFn ) override;
+        void                                setSendLimits( const SendLimits & limits ) override;
+
+        void                                auth(
+                                                int timeoutSeconds,
+                                                AuthFn ) override;
+        bool                                auth(
+                                                int timeoutSeconds,
+                                                StrOut email,
+                                                uint64_t * sessionId,
+                                                Result * result ) override;
+
+        void                                ready(
+                                                int timeoutSeconds,
+                                                ReadyFn ) override;
+        bool                                ready(
+                                                int timeoutSeconds,
+                                                Result * result ) override;
+
+        class                               Data;
+        class                               Client;
+
+    private:
+        void                                notifyAuthing( );
+        void                                notifyAuth( );
+        void                                notifyReady( );
+        // initialization
+        void                                doAuthLogin( );
+        void                                authLogin( grim::auth::Result result, grim::auth::AuthToken authToken );
+        void                                doAuthReady( );
+        void                                authReady( grim::auth::Result result );
+        void                                doListen( );
+        void                                doSnapshot( );
+        void                                doPeers( );
+        // tcp handlers
+        void                                connect( std::error_code acceptError, const std::string & addr );
+        void                                receive( const std::string & addr, std::string & recvBuffer );
+        void                                disconnect( const std::string & addr, std::error_code reason );
+        //! dropped if `handle` is stale (its connection closed while the request was being verified)
+        void                                reply( ConnectionHandle handle, const Message & request, Result result, const cpp::Memory & data = { } );
+        template<Schema T>
+        void                                reply( ConnectionHandle handle, const Message & request, Result result, const T & data );
+        void                                replicate( uint64_t sessionId );
+        //! calls `fn` once the token is verified (or cached), otherwise replies with the failure
+        void                                verify( ConnectionHandle handle, const Message & request, const std::string & extAddr, uint64_t authToken, std::function<void( )> fn );
+        void                                flushReplies( );
+        //! only valid while the connection is, i.e. inside a request handler
+        const std::string &                 addrOf( ConnectionHandle handle ) const;
+        // request handlers, see Detail::requests
+        void                                onConnect( StrArg ip ) override;
+        void                                onDisconnect( StrArg ip ) override;
+        void                                onRecv( ConnectionHandle connection, const Message & message, const cpp::Memory & data ) override;
+        void                                onHello( ConnectionHandle connection, const Message & message, const SessionHello & request );
+        void                                onRello( ConnectionHandle connection, const Message & message, const SessionRello & request );
+        void                                onAuth( ConnectionHandle connection, const Message & message, const SessionAuth & request );
+        void                                onReauth( ConnectionHandle connection, const Message & message, const SessionReauth & request );
+        void                                onAuthServer( ConnectionHandle connection, const Message & message, const SessionAuthServer & request );
+        void                                onLookupSession( ConnectionHandle connection, const Message & message, const SessionLookupSession & request );
+        void                                onLookupServer( ConnectionHandle connection, const Message & message, const SessionLookupServer & request );
+        //! a peer shard logs in as this one does, so a link whose token verifies as this server's
+        //! email is a shard's, and may replicate
+        void                                onJoinShard( ConnectionHandle connection, const Message & message, const SessionJoinShard & request );
+        void                                onReplicateServer( ConnectionHandle connection, const Message & message, const SessionReplicateServer & request );
+        void                                onOpenUdp( ConnectionHandle connection, const Message & message, const SessionOpenUdp & request );
+        void                                onCloseUdp( ConnectionHandle connection, const Message & message, const SessionCloseUdp & request );
+        void                                onLookupUdp( ConnectionHandle connection, const Message & message, const SessionLookupUdp & request );
+        void                                onStats( ConnectionHandle connection, const Message & message, const StatsRequest & request );
+
+    private:
+        struct                              Detail;
+        std::unique_ptr<Detail>             detail = std::make_unique<Detail>( );
+    };
+
+    //! Connection to every shard of the session service.  Requests about an existing session go to
+    //! the shard encoded in its id, new sessions are spread across shards, and server node lookups
+    //! go to any shard (server nodes are replicated).
+    class SessionServer::Client
+        : public ISessionApi
+    {
+    public:
+        Client( );
+
+        //! `shardAddrs` is the comma separated list of shard addresses, in shard index order
+        void                                open( cpp::AsyncContext & io, StrArg shardAddrs );
+        void                                close( );
+        //! bounds the requests waiting for each shard's link (see SessionLink), set before open( )
+        void                                setSendLimits( const SendLimits & limits );
+        void                                onBackpressure( BackpressureFn );
+
+        void                                ready( int timeoutSeconds, net::ReadyFn );
+
+        //! creates the proxy's session on one shard, then joins the rest with rello
+        void                                hello( auth::AuthToken authToken, uint8_t nodeId, OnHello );
+        //! joins every shard with an existing proxy session
+        void                                rello( uint64_t sessionId, OnRello );
+        void                                auth( std::string extAddr, uint64_t authToken, OnSessionResult ) override;
+        void                                reauth( std::string extAddr, uint64_t sessionId, OnSessionResult ) override;
+        void                                authServerNode( uint64_t sessionId, std::string svcName, int nodeId, OnSessionResult ) override;
+        void                                lookupServerNode( std::string svcName, int nodeId, OnSessionResult ) override;
+        void                                lookupSession( uint64_t sessionId, OnLookupSession ) override;
+        void                                openUdp( uint64_t sessionId, std::string intAddr, std::string udpAddr, OnOpenUdp ) override;
+        void                                closeUdp( uint64_t sessionId, OnSessionResult ) override;
+        void                                lookupUdp( uint64_t sessionId, OnLookupUdp ) override;
+
+    private:
+        SessionLink &                       shardOf( uint64_t sessionId );
+        SessionLink &                       nextShard( );
+        void                                relloShards( uint64_t sessionId, size_t ownerShard, OnRello );
+        void                                doRello( size_t shard, uint64_t sessionId, int retries, OnRello );
+
+    private:
+        struct                              Detail;
+        std::unique_ptr<Detail>             detail = std::make_unique<Detail>( );
+    };
+
+    class SessionServer::Data
+    {
+    public:
+        //! restores the sessions saved in `dataDir` (the snapshot, then the log), then logs every
+        //! change made from here on
+        Result                              open( const std::filesystem::path & dataDir );
+        //! writes every session to a new snapshot and empties the log
+        Result                              snapshot( );
+        //! writes the changes logged since the last flush
+        void                                flush( );
+
+        Result                              connected( std::string clientAddr );
+        Result                              disconnected( std::string clientAddr );
+        Result                              hello(
+                                                std::string clientAddr,
+                                                uint64_t authToken,
+                                                int nodeId,
+                                                uint64_t * sessionId );
+        Result                              rello(
+                                                std::string clientAddr,
+                                                uint64_t sessionId );
+
+        Result                              auth(
+                                                std::string clientAddr,
+                                                uint64_t authToken,
+                                                std::string extAddr,
+                                                uint64_t * sessionId );
+        Result                              reauth(
+                                                std::string clientAddr,
+                                                uint64_t sessionId,
+                                                std::string extAddr,
+                                                std::string * oldExtAddr );
+        Result                              authServerNode(
+                                                std::string clientAddr,
+                                                uint64_t sessionId,
+                                                std::string svcName, int nodeId );
+        //! Ok if `authToken` verifies as `email`, which a peer shard shares with this one
+        Result                              authShard(
+                                                std::string clientAddr,
+                                                uint64_t authToken,
+                                                const std::string & email );
+
+        //! only the proxy relaying `sessionId` may open or close its datagram endpoint, and only
+        //! proxies may look one up (the key authenticates the session's datagrams)
+        Result                              openUdp(
+                                                std::string clientAddr,
+                                                uint64_t sessionId,
+                                                std::string intAddr,
+                                                std::string udpAddr,
+                                                uint64_t * key );
+        Result                              closeUdp(
+                                                std::string clientAddr,
+                                                uint64_t sessionId );
+        Result                              lookupUdp(
+                                                std::string clientAddr,
+                                                uint64_t sessionId,
+                                                std::string * extAddr,
+                                                std::string * intAddr,
+                                                std::string * udpAddr,
+                                                uint64_t * key );
+
+        Result                              lookupSession(
+                                                uint64_t sessionId,
+                                                uint64_t * userId,
+                                                std::string * email );
+        Result                              lookupServerNode(
+                                                std::string svcName,
+                                                int nodeId,
+                                                uint64_t * sessionId );
+
+        //! session ids are allocated inside `shardIndex`
+        void                                setShard( uint8_t shardIndex );
+        struct ServerNodeInfo
+        {
+            uint64_t                        sessionId;
+            uint64_t                        userId;
+            std::string                     email;
+            std::string                     extAddr;
+            std::string                     service;
+            int                             nodeId;
+        };
+        //! a server node owned by this shard, as replicated to the others
+        Result                              getServerNode( uint64_t sessionId, ServerNodeInfo * info );
+        //! adds or updates a replica of a server node owned by another shard
+        Result                              putServerNode( const ServerNodeInfo & info );
+
+        //! verifies a token with the auth service; the default accepts the two test tokens (1 and 2)
+        using                               AuthBackend = std::function<Result(
+                                                const std::string & extAddr,
+                                                uint64_t authToken,
+                                                const std::string & svc,
+                                                uint64_t * userId,
+                                                std::string * email )>;
+        void                                setAuthBackend( AuthBackend backend );
+        //! verifications are cached, see AuthCache for limits and counters
+        AuthCache &                         authCache( );
+        void                                invalidateAuth( uint64_t authToken );
+        //! true if a verification of `authToken` from `extAddr` is cached
+        bool                                isAuthCached( const std::string & extAddr, uint64_t authToken );
+        //! caches a verification made outside of the auth backend (e.g. by a batch)
+        void                                putAuth( const std::string & extAddr, uint64_t authToken, Result result, uint64_t userId, const std::string & email );
+
+        //! bytes held by the session store (excluding the udp map)
+        size_t                              memoryUsage( ) const;
+    public:
+        struct SessionUdpInfo
+        {
+            std::string                     intAddr;
+            std::string                     udpAddr;
+            uint64_t                        key;
+        };
+        using                               SessionUdpMap = std::map<uint64_t, SessionUdpInfo>;
+    private:
+        //! a connected client whose hello/rello has not completed has no session
+        static constexpr uint32_t           NoSession = SessionTable::NoSlot - 1;
+
+        Result                              verifyConnection(
+                                                const std::string & clientAddr,
+                                                uint64_t * sessionId );
+        Result                              verifyServer(
+                                                uint64_t sessionId,
+                                                uint32_t * service,
+                                                int * nodeId );
+        Result                              verifySession(
+                                                uint64_t sessionId,
+                                                uint32_t * slot );
+        Result                              verifyServerNetwork(
+                                                std::string serviceName,
+                                                std::string addr );
+        Result                              verifyProxy(
+                                                const std::string & clientAddr,
+                                                uint64_t * proxySessionId );
+        Result                              grimauth(
+                                                const std::string & extAddr,
+                                                uint64_t authToken,
+                                                const std::string & svc,
+                                                uint64_t * userId,
+                                                std::string * email );
+        static Result                       testAuth(
+                                                const std::string & extAddr,
+                                                uint64_t authToken,
+                                                const std::string & svc,
+                                                uint64_t * userId,
+                                                std::string * email );
+        uint64_t                            makeSessionId( );
+        // changes shared by requests and replay, each is logged
+        uint32_t                            addSession(
+                                                uint64_t sessionId,
+                                                uint64_t userId,
+                                                uint64_t proxySessionId,
+                                                Endpoint extAddr,
+                                                std::string_view email );
+        void                                moveSession( uint32_t slot, Endpoint extAddr, uint64_t proxySessionId );
+        void                                setServerNode( uint32_t slot, std::string_view service, int nodeId );
+        void                                replay( const SessionLogRecord & record );
+        //! key of a (service, node) pair in serverNodes
+        static uint64_t                     serverNodeKey( uint32_t service, int nodeId );
+    private:
+        cpp::Random                         rng;
+        //! service names and emails
+        InternTable                         names;
+        EndpointTable                       endpoints;
+        SessionTable                        sessions;
+        //! connected client endpoint -> session slot (NoSession until hello/rello)
+        RouteTable                          clientSessions;
+        //! serverNodeKey( ) -> session slot
+        RouteTable                          serverNodes;
+        SessionUdpMap                       sessionUdp;
+        AuthBackend                         authBackend = testAuth;
+        AuthCache                           verifiedTokens;
+
+        std::filesystem::path               dataDir;
+        SessionLog                          sessionLog;
+        uint8_t                             shardIndex = 0;
+    };
+    namespace test
+    {
+        void                                testSessionServerData( );
+        void                                testSessionServerRestore( );
+        void                                testSessionServerShards( );
+        //! requests from a SessionServer::Client reach their handlers, over the loop transport
+        void                                testSessionServerClient( );
+        //! many times the high water mark of requests through a SessionServer::Client, which the
+        //! session server never acks
+        void                                testSessionServerClientLimits( );
+        //! only a link which joined with the service's own token may replicate to a shard
+        void                                testSessionServerJoinShard( );
+        //! drives hello/rello/auth/reauth/authServerNode with `sessionCount` live sessions and logs
+        //! ops/sec and bytes per session
+        void                                benchSessionServerData( size_t sessionCount = 1000000 );
+        //! auths `sessionCount` sessions spread over 1, 2, 4 and 8 shards, one thread per shard, and
+        //! logs the aggregate auths/sec
+        void                                benchSessionShards( size_t sessionCount = 1000000 );
+        //! repeated logins (reconnects and retried denied tokens) against a stub auth service which
+        //! takes `backendLatencyMicros` per call, with and without the auth cache
+        void                                benchSessionServerAuth( size_t loginCount = 20000, int backendLatencyMicros = 200 );
+    };
+}
+
+namespace grim::net
+{
+    const char * AuthServiceId = "grimethos.com";
+    const char * ProxyServiceId = "proxy.grimethos.com";
+    std::map<std::string, std::vector<std::string>> ServiceNetwork =
+    {
+        { ProxyServiceId, { } },
+    };
+
+    struct SessionServer::Client::Detail
+    {
+        cpp::AsyncContext                   io;
+        //! indexed by shard
+        std::vector<std::unique_ptr<SessionLink>> shards;
+        size_t                              nextShard = 0;
+        SendLimits                          sendLimits;
+        BackpressureFn                      onBackpressureHandler;
+    };
+
+    struct SessionServer::Detail
+    {
+        std::string                         email;
+        std::string                         bindAddress4;
+        std::string                         bindAddress6;
+        cpp::AsyncContext                   io;
+        TransportServer                     tcp;
+        grim::auth::Client                  grimauth;
+        grim::auth::AuthToken               authToken;
+
+        AuthingFn                           onAuthingHandler;
+        AuthFn                              onAuthHandler;
+        ReadyFn                             onReadyHandler;
+        ConnectFn                           onConnectHandler;
+        DisconnectFn                        onDisconnectHandler;
+        BackpressureFn                      onBackpressureHandler;
+        SendLimits                          sendLimits;
+
+        AuthFn                              authHandler;
+        ReadyFn                             readyHandler;
+        cpp::AsyncTimer                     handlerTimer;
+
+        uint64_t                            isAuthed : 1;
+        uint64_t                            isReady : 1;
+
+        struct Connection
+        {
+            std::string                     addr;
+            //! bumped each time the slot is reused, see ConnectionHandle
+            uint32_t                        generation = 0;
+            MessageReader                   reader;
+            MessageWriter                   writer;
+            //! proxies do not ack, so this only bounds the replies to one batch of requests
+            SendQueue                       sendQueue;
+            ConnectionStats                 stats;
+            //! joined as a peer shard, see onJoinShard( )
+            bool                            isShard = false;
+            bool                            isUsed = false;
+            bool                            isDisconnecting = false;
+        };
+        //! the transport names connections by address, request handlers by ConnectionHandle (an
+        //! index into connections)
+        std::map<std::string, uint32_t>     connectionIds;
+        std::vector<Connection>             connections;
+        std::vector<uint32_t>               freeConnections;
+        //! a handler for each MessageType
+        SchemaTable<ConnectionHandle>       requests;
+        std::string                         replyBuffer;
+        NetStats                            stats;
+        Data                                data;
+        std::filesystem::path               dataDir;
+        int                                 snapshotIntervalSeconds = 300;
+        cpp::AsyncTimer                     snapshotTimer;
+
+        uint8_t                             shardIndex = 0;
+        std::vector<std::string>            shardAddrs;
+        //! connections to the other shards, for replication
+        std::vector<std::unique_ptr<SessionLink>> peers;
+
+        auth::IClient *                     authClient = nullptr;
+        int                                 authBatchMillis = 2;
+        size_t                              authBatchMax = 256;
+        AuthBatcher                         authBatcher;
+        bool                                isReplyFlushPending = false;
+    };
+
+    SessionServer::SessionServer( ) :
+        detail( std::make_unique<Detail>() )
+    {
+        using namespace std::placeholders;
+        auto & requests = detail->requests;
+        requests.on<SessionHello>( std::bind( &SessionServer::onHello, this, _1, _2, _3 ) );
+        requests.on<SessionRello>( std::bind( &SessionServer::onRello, this, _1, _2, _3 ) );
+        requests.on<SessionAuth>( std::bind( &SessionServer::onAuth, this, _1, _2, _3 ) );
+        requests.on<SessionReauth>( std::bind( &SessionServer::onReauth, this, _1, _2, _3 ) );
+        requests.on<SessionAuthServer>( std::bind( &SessionServer::onAuthServer, this, _1, _2, _3 ) );
+        requests.on<SessionLookupSession>( std::bind( &SessionServer::onLookupSession, this, _1, _2, _3 ) );
+        requests.on<SessionLookupServer>( std::bind( &SessionServer::onLookupServer, this, _1, _2, _3 ) );
+        requests.on<SessionJoinShard>( std::bind( &SessionServer::onJoinShard, this, _1, _2, _3 ) );
+        requests.on<SessionReplicateServer>( std::bind( &SessionServer::onReplicateServer, this, _1, _2, _3 ) );
+        requests.on<SessionOpenUdp>( std::bind( &SessionServer::onOpenUdp, this, _1, _2, _3 ) );
+        requests.on<SessionCloseUdp>( std::bind( &SessionServer::onCloseUdp, this, _1, _2, _3 ) );
+        requests.on<SessionLookupUdp>( std::bind( &SessionServer::onLookupUdp, this, _1, _2, _3 ) );
+        requests.on<StatsRequest>( std::bind( &SessionServer::onStats, this, _1, _2, _3 ) );
+        requests.onInvalid( [this]( ConnectionHandle connection, const Message & message, const cpp::Memory & )
+            { reply( connection, message, Result::Arg ); } );
+    }
+
+    void SessionServer::open(
+            cpp::AsyncContext & io,
+            StrArg listenAddress4,
+            StrArg listenAddress6,
+            StrArg email )
+    {
+        detail->isAuthed = false;
+        detail->isReady = false;
+
+        detail->io = io;
+        detail->bindAddress4 = listenAddress4;
+        detail->bindAddress6 = listenAddress6;
+        detail->email = email;
+        detail->grimauth.setAsyncContext( io );
+
+        // restore before listening so proxies can rello as soon as they reconnect
+        if ( !detail->dataDir.empty( ) )
+        {
+            if ( detail->data.open( detail->dataDir ) != Result::Ok )
+                { cpp::Log::error( "open() : cannot restore sessions from '{}'", detail->dataDir.string( ) ); }
+            doSnapshot( );
+        }
+        doAuthLogin( );
+    }
+
+    void SessionServer::openLocal( cpp::AsyncContext & io, StrArg listenAddress, StrArg email, auth::AuthToken authToken )
+    {
+        detail->isAuthed = true;
+        detail->isReady = false;
+
+        detail->io = io;
+        detail->bindAddress4 = listenAddress;
+        detail->bindAddress6.clear( );
+        detail->email = email;
+        detail->authToken = authToken;
+        doListen( );
+    }
+
+    void SessionServer::close( )
+    {
+        detail->authBatcher.close( );
+        for ( auto & peer : detail->peers )
+            { peer->close( ); }
+        detail->snapshotTimer.cancel( );
+        detail->tcp.close( );
+        detail->data.flush( );
+    }
+
+    void SessionServer::setDataDir( std::filesystem::path dataDir )
+    {
+        detail->dataDir = std::move( dataDir );
+    }
+
+    void SessionServer::setShard( uint8_t shardIndex, StrArg shardAddrs )
+    {
+        detail->shardIndex = shardIndex;
+        detail->shardAddrs.clear( );
+        for ( auto & addr : shardAddrs.split( "," ) )
+            { detail->shardAddrs.push_back( addr ); }
+        detail->data.setShard( shardIndex );
+    }
+
+    void SessionServer::setAuthBatching( auth::IClient & client, int windowMillis, size_t maxBatch )
+    {
+        detail->authClient = &client;
+        detail->authBatchMillis = windowMillis;
+        detail->authBatchMax = maxBatch;
+    }
+
+    void SessionServer::stats( NetStats * total ) const
+    {
+        detail->stats.addTo( *total );
+    }
+
+    void SessionServer::doPeers( )
+    {
+        detail->peers.clear( );
+        for ( size_t i = 0; i < detail->shardAddrs.size( ); i++ )
+        {
+            if ( i == detail->shardIndex )
+                { continue; }
+            auto peer = std::make_unique<SessionLink>( );
+            peer->greet( SessionJoinShard{ detail->authToken.value } );
+            peer->open( detail->io, detail->shardAddrs[i] );
+            detail->peers.push_back( std::move( peer ) );
+        }
+    }
+
+    void SessionServer::doSnapshot( )
+    {
+        detail->snapshotTimer = detail->io.waitFor( cpp::Duration::ofSeconds( detail->snapshotIntervalSeconds ), [this]( )
+            {
+                if ( detail->data.snapshot( ) != Result::Ok )
+                    { cpp::Log::error( "doSnapshot() : cannot write snapshot to '{}'", detail->dataDir.string( ) ); }
+                doSnapshot( );
+            } );
+    }
+
+    void SessionServer::onAuthing( AuthingFn fn )
+    {
+        detail->onAuthingHandler = fn;
+    }
+
+    void SessionServer::onAuth( AuthFn fn )
+    {
+        detail->onAuthHandler = fn;
+    }
+
+    void SessionServer::onReady( ReadyFn fn )
+    {
+        detail->onReadyHandler = fn;
+    }
+
+    void SessionServer::onBackpressure( BackpressureFn fn )
+    {
+        detail->onBackpressureHandler = fn;
+    }
+
+    void SessionServer::setSendLimits( const SendLimits & limits )
+    {
+        detail->sendLimits = limits;
+    }
+
+    void SessionServer::auth( int timeoutSeconds, AuthFn fn )
+    {
+        // if isReady, post result immediately
+        if ( detail->isAuthed )
+            { detail->io.post( [this, fn]( ) { fn( detail->email, 0, Result::Ok ); } ); return; }
+
+        // start a timer that will return timeout if it elapses before the readyHandler is called
+        detail->authHandler = fn;
+        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( )
+            { detail->authHandler( detail->email, 0, Result::Timeout ); } );
+    }
+
+    bool SessionServer::auth(
+        int timeoutSeconds,
+        StrOut email,
+        uint64_t * sessionId,
+        Result * result )
+    {
+        *result = Result::Ok;
+        if ( !detail->isAuthed )
+        {
+            auto isAuthed = detail->io.createCondition<Result>( );
+            ready( timeoutSeconds, [&]( Result result )
+                { isAuthed.notify( result ); } );
+            *result = isAuthed.wait( );
+        }
+        *email = detail->email;
+        *sessionId = 0;
+
+        return *result == Result::Ok;
+    }
+
+    void SessionServer::ready( int timeoutSeconds, ReadyFn fn )
+    {
+        // if isReady, post result immediately
+        if ( detail->isReady )
+            { detail->io.post( [fn]( ) { fn( Result::Ok ); } ); return; }
+
+        // start a timer that will return timeout if it elapses before the readyHandler is called
+        detail->readyHandler = fn;
+        detail->handlerTimer = detail->io.waitFor( cpp::Duration::ofSeconds( timeoutSeconds ), [this]( ) 
+            { detail->readyHandler( Result::Timeout ); } );
+    }
+
+    bool SessionServer::ready( int timeoutSeconds, Result * result )
+    {
+        *result = Result::Ok;
+        if ( !detail->isReady )
+        {
+            auto isReady = detail->io.createCondition<Result>( );
+            ready( timeoutSeconds, [&]( Result result )
+                { isReady.notify( result ); } );
+            *result = isReady.wait( );
+        }
+        return *result == Result::Ok;
+    }
+
+    void SessionServer::onConnect( StrArg ip )
+    {
+
+    }
+
+    void SessionServer::onDisconnect( StrArg ip )
+    {
+
+    }
+
+    void SessionServer::onRecv( ConnectionHandle connection, const Message & message, const cpp::Memory & data )
+    {
+        // every MessageType has a handler in Detail::requests
+        reply( connection, message, Result::Arg );
+    }
+
+    void SessionServer::onHello( ConnectionHandle connection, const Message & message, const SessionHello & request )
+    {
+        // timed from the request to its reply, including any wait for the auth batch
+        auto start = LatencyHistogram::Clock::now( );
+        std::string addr = addrOf( connection );
+        verify( connection, message, addr, request.authToken, [this, connection, addr, message, request, start]( )
+            {
+                uint64_t sessionId = 0;
+                Result result = detail->data.hello( addr, request.authToken, request.nodeId, &sessionId );
+                if ( result == Result::Ok )
+                    { replicate( sessionId ); }
+                reply( connection, message, result, SessionIdReply{ sessionId } );
+                detail->stats.hello.record( LatencyHistogram::Clock::now( ) - start );
+            } );
+    }
+
+    void SessionServer::onRello( ConnectionHandle connection, const Message & message, const SessionRello & request )
+    {
+        auto start = LatencyHistogram::Clock::now( );
+        reply( connection, message, detail->data.rello( addrOf( connection ), request.sessionId ) );
+        detail->stats.rello.record( LatencyHistogram::Clock::now( ) - start );
+    }
+
+    void SessionServer::onAuth( ConnectionHandle connection, const Message & message, const SessionAuth & request )
+    {
+        auto start = LatencyHistogram::Clock::now( );
+        std::string addr = addrOf( connection );
+        verify( connection, message, request.extAddr, request.authToken, [this, connection, addr, message, request, start]( )
+            {
+                uint64_t sessionId = 0;
+                Result result = detail->data.auth( addr, request.authToken, request.extAddr, &sessionId );
+                reply( connection, message, result, SessionIdReply{ sessionId } );
+                detail->stats.auth.record( LatencyHistogram::Clock::now( ) - start );
+            } );
+    }
+
+    void SessionServer::onReauth( ConnectionHandle connection, const Message & message, const SessionReauth & request )
+    {
+        std::string oldExtAddr;
+        reply( connection, message, detail->data.reauth( addrOf( connection ), request.sessionId, request.extAddr, &oldExtAddr ) );
+    }
+
+    void SessionServer::onAuthServer( ConnectionHandle connection, const Message & message, const SessionAuthServer & request )
+    {
+        Result result = detail->data.authServerNode( addrOf( connection ), request.sessionId, request.svcName, request.nodeId );
+        if ( result == Result::Ok )
+            { replicate( request.sessionId ); }
+        reply( connection, message, result );
+    }
+
+    void SessionServer::onLookupSession( ConnectionHandle connection, const Message & message, const SessionLookupSession & request )
+    {
+        SessionLookupSessionReply data{ };
+        Result result = detail->data.lookupSession( request.sessionId, &data.userId, &data.email );
+        reply( connection, message, result, data );
+    }
+
+    void SessionServer::onLookupServer( ConnectionHandle connection, const Message & message, const SessionLookupServer & request )
+    {
+        uint64_t sessionId = 0;
+        Result result = detail->data.lookupServerNode( request.svcName, request.nodeId, &sessionId );
+        reply( connection, message, result, SessionIdReply{ sessionId } );
+    }
+
+    void SessionServer::onJoinShard( ConnectionHandle connection, const Message & message, const SessionJoinShard & request )
+    {
+        std::string addr = addrOf( connection );
+        verify( connection, message, addr, request.authToken, [this, connection, addr, message, request]( )
+            {
+                Result result = detail->data.authShard( addr, request.authToken, detail->email );
+                // the handle is checked by reply( ), the slot may have been reused meanwhile
+                auto & joined = detail->connections[connection.index];
+                if ( result == Result::Ok && joined.isUsed && joined.generation == connection.generation )
+                    { joined.isShard = true; }
+                reply( connection, message, result );
+            } );
+    }
+
+    void SessionServer::onReplicateServer( ConnectionHandle connection, const Message & message, const SessionReplicateServer & request )
+    {
+        // only shards replicate, and only over a link which joined as one
+        if ( !detail->connections[connection.index].isShard )
+            { reply( connection, message, Result::Access ); return; }
+
+        Data::ServerNodeInfo info{ request.sessionId, request.userId, request.email, request.extAddr, request.service, request.nodeId };
+        reply( connection, message, detail->data.putServerNode( info ) );
+    }
+
+    void SessionServer::onOpenUdp( ConnectionHandle connection, const Message & message, const SessionOpenUdp & request )
+    {
+        uint64_t key = 0;
+        Result result = detail->data.openUdp( addrOf( connection ), request.sessionId, request.intAddr, request.udpAddr, &key );
+        reply( connection, message, result, SessionOpenUdpReply{ key } );
+    }
+
+    void SessionServer::onCloseUdp( ConnectionHandle connection, const Message & message, const SessionCloseUdp & request )
+    {
+        reply( connection, message, detail->data.closeUdp( addrOf( connection ), request.sessionId ) );
+    }
+
+    void SessionServer::onLookupUdp( ConnectionHandle connection, const Message & message, const SessionLookupUdp & request )
+    {
+        SessionLookupUdpReply data{ };
+        Result result = detail->data.lookupUdp( addrOf( connection ), request.sessionId, &data.extAddr, &data.intAddr, &data.udpAddr, &data.key );
+        reply( connection, message, result, data );
+    }
+
+    void SessionServer::onStats( ConnectionHandle connection, const Message & message, const StatsRequest & request )
+    {
+        reply( connection, message, Result::Ok, StatsReply{ detail->stats.dump( ) + detail->connections[connection.index].stats.dump( ) } );
+    }
+
+    const std::string & SessionServer::addrOf( ConnectionHandle handle ) const
+    {
+        return detail->connections[handle.index].addr;
+    }
+
+    template<Schema T>
+    void SessionServer::reply( ConnectionHandle handle, const Message & request, Result result, const T & data )
+    {
+        encode( data, &detail->replyBuffer );
+        reply( handle, request, result, detail->replyBuffer );
+    }
+
+    void SessionServer::reply( ConnectionHandle handle, const Message & request, Result result, const cpp::Memory & data )
+    {
+        if ( !request.bind || handle.index >= detail->connections.size( ) )
+            { return; }
+        auto & connection = detail->connections[handle.index];
+        if ( !connection.isUsed || connection.generation != handle.generation || connection.isDisconnecting )
+            { return; }
+        const std::string & addr = connection.addr;
+        // a reply is never dropped, a peer which lets them pile up is disconnected
+        size_t frameSize = MessageHeaderSize + data.length( ) + paddingOf( data.length( ) );
+        if ( connection.sendQueue.admit( connection.writer.size( ), frameSize, false ) == SendQueue::Verdict::Disconnect )
+        {
+            cpp::Log::info( "reply() : addr='{}' msg='send queue full' queued={}", addr, connection.writer.size( ) );
+            connection.isDisconnecting = true;
+            connection.writer.clear( );
+            if ( connection.sendQueue.update( 0 ) && detail->onBackpressureHandler )
+                { detail->onBackpressureHandler( addr, true, 0 ); }
+            detail->io.post( [this, addr]( ) { detail->tcp.disconnect( addr, std::make_error_code( std::errc::no_buffer_space ) ); } );
+            return;
+        }
+        Message message{ };
+        message.len = ( data.length( ) + paddingOf( data.length( ) ) ) / MessageAlignment;
+        message.moniker = request.moniker;
+        message.bind = request.bind;
+        message.type = request.type;
+        message.result = (uint8_t)result;
+        message.toSessionId = request.fromSessionId;
+        // sent by receive( ) once the whole batch is handled
+        size_t offset = connection.writer.size( );
+        connection.writer.put( message, data );
+        detail->stats.countSent( message.type, connection.writer.size( ) - offset );
+        connection.stats.countSent( connection.writer.size( ) - offset );
+        if ( connection.sendQueue.update( connection.writer.size( ) ) && detail->onBackpressureHandler )
+            { detail->onBackpressureHandler( addr, connection.sendQueue.isBlocked( ), connection.writer.size( ) ); }
+    }
+
+    void SessionServer::verify( ConnectionHandle handle, const Message & request, const std::string & extAddr, uint64_t authToken, std::function<void( )> fn )
+    {
+        if ( !detail->authBatcher.isOpen( ) || detail->data.isAuthCached( extAddr, authToken ) )
+            { fn( ); return; }
+
+        std::string userIp{ extAddr.substr( 0, extAddr.find_last_of( ':' ) ) };
+        detail->authBatcher.auth( userIp, authToken, [=, this]( Result result, uint64_t userId, const std::string & email )
+            {
+                // a verdict is cached so the request finds it, anything else fails the request
+                if ( result == Result::Ok || result == Result::Access )
+                {
+                    detail->data.putAuth( extAddr, authToken, result, userId, email );
+                    fn( );
+                }
+                else
+                    { reply( handle, request, result ); }
+
+                // replies for the whole batch are sent together
+                if ( !detail->isReplyFlushPending )
+                {
+                    detail->isReplyFlushPending = true;
+                    detail->io.post( [this]( ) { flushReplies( ); } );
+                }
+            } );
+    }
+
+    void SessionServer::flushReplies( )
+    {
+        detail->isReplyFlushPending = false;
+        detail->data.flush( );
+        for ( auto & connection : detail->connections )
+        {
+            if ( !connection.isUsed || connection.writer.isEmpty( ) )
+                { continue; }
+            detail->tcp.send( connection.addr, connection.writer.getAll( ) );
+            connection.writer.clear( );
+            if ( connection.sendQueue.update( 0 ) && detail->onBackpressureHandler )
+                { detail->onBackpressureHandler( connection.addr, false, 0 ); }
+        }
+    }
+
+    void SessionServer::replicate( uint64_t sessionId )
+    {
+        Data::ServerNodeInfo info;
+        if ( detail->peers.empty( ) || detail->data.getServerNode( sessionId, &info ) != Result::Ok )
+            { return; }
+        SessionReplicateServer request{ info.sessionId, info.userId, info.email, info.extAddr, info.service, info.nodeId };
+        for ( auto & peer : detail->peers )
+            { peer->send( request, nullptr ); }
+    }
+
+    void SessionServer::notifyAuthing( )
+    {
+        if ( detail->onAuthingHandler ) 
+            { detail->onAuthingHandler( detail->email, "" ); }
+    }
+
+    void SessionServer::notifyAuth( )
+    {
+        detail->isAuthed = true;
+        detail->handlerTimer.cancel( );
+        if ( detail->onAuthHandler )
+            { detail->onAuthHandler( detail->email, 0, Result::Ok ); }
+        if ( detail->authHandler )
+            { detail->authHandler( detail->email, 0, Result::Ok ); }
+    }
+
+    void SessionServer::notifyReady( )
+    {
+        detail->isReady = true;
+        detail->handlerTimer.cancel( );
+        if ( detail->onReadyHandler )
+            { detail->onReadyHandler( Result::Ok ); }
+        if ( detail->readyHandler )
+            { detail->readyHandler( Result::Ok ); }
+    }
+
+    void SessionServer::doAuthLogin( )
+    {
+        using namespace std::placeholders;
+        int options = grim::auth::LoginOption::Default;
+        detail->grimauth.login(
+            grim::auth::UserEmail{ detail->email },
+            grim::auth::ServiceId{ "backwater.grimethos.com" },
+            options,
+            5,
+            std::bind(&SessionServer::authLogin, this, _1, _2));
+        notifyAuthing( );
+    }
+
+    void SessionServer::authLogin( grim::auth::Result result, grim::auth::AuthToken authToken )
+    {
+        using grim::auth::Result;
+
+        switch ( result )
+        {
+        case Result::Ok:
+            detail->authToken = authToken;
+            doAuthReady( );
+            break;
+        case Result::Pending:
+            // this shouldn't happen
+            break;
+        case Result::Denied:
+            cpp::Log::notice( "Authentication denied by {}", detail->email );
+            break;
+        case Result::Timeout:
+            // todo: is this correct?
+            doAuthLogin( );
+            break;
+        case Result::Retry:
+            detail->io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( ) { doAuthLogin( ); } );
+            break;
+        }
+    }
+
+    void SessionServer::doAuthReady( )
+    {
+        using namespace std::placeholders;
+
+        notifyAuth( );
+
+        int options = grim::auth::LoginOption::Default;
+        detail->grimauth.authInit(
+            grim::auth::AuthToken{ detail->authToken },
+            std::bind( &SessionServer::authReady, this, _1 ) );
+    }
+
+    void SessionServer::authReady( grim::auth::Result result )
+    {
+        if ( result != grim::auth::Result::Ok )
+        {
+            cpp::Log::error( "authReady() : result={}", std::to_underlying(result) );
+            detail->io.waitFor( cpp::Duration::ofSeconds( 60 ), [this]( ) { doAuthLogin( ); } );
+            return;
+        }
+        doListen( );
+    }
+
+    void SessionServer::doListen( )
+    {
+        using namespace std::placeholders;
+        detail->tcp.open(
+            detail->io,
+            detail->bindAddress4,
+            detail->bindAddress6,
+            std::bind( &SessionServer::connect, this, _1, _2 ),
+            std::bind( &SessionServer::receive, this, _1, _2 ),
+            std::bind( &SessionServer::disconnect, this, _1, _2 ) );
+        doPeers( );
+        if ( detail->authClient )
+            { detail->authBatcher.open( detail->io, *detail->authClient, detail->authToken, detail->authBatchMillis, detail->authBatchMax ); }
+        notifyReady( );
+    }
+
+    void SessionServer::connect( std::error_code acceptError, const std::string & addr )
+    {
+        if ( acceptError )
+        {
+            cpp::Log::error( "connect() : addr='{}' msg='{}'", addr, acceptError.message( ) );
+            return;
+        }
+        cpp::Log::info( "connect() : addr='{}'", addr );
+
+        uint32_t connectionId;
+        if ( !detail->freeConnections.empty( ) )
+        {
+            connectionId = detail->freeConnections.back( );
+            detail->freeConnections.pop_back( );
+        }
+        else
+        {
+            connectionId = (uint32_t)detail->connections.size( );
+            detail->connections.emplace_back( );
+        }
+        auto & connection = detail->connections[connectionId];
+        connection.addr = addr;
+        connection.generation++;
+        connection.reader.reset( );
+        connection.writer.clear( );
+        connection.sendQueue.reset( );
+        connection.sendQueue.setLimits( detail->sendLimits );
+        connection.stats.reset( );
+        connection.isShard = false;
+        connection.isUsed = true;
+        connection.isDisconnecting = false;
+        detail->connectionIds[addr] = connectionId;
+        detail->stats.connects.add( );
+        detail->data.connected( addr );
+    }
+
+    void SessionServer::receive( const std::string & addr, std::string & recvBuffer )
+    {
+        // the only lookup by address, each request is then dispatched by type
+        auto itr = detail->connectionIds.find( addr );
+        if ( itr == detail->connectionIds.end( ) )
+            { return; }
+        auto & connection = detail->connections[itr->second];
+        ConnectionHandle handle{ itr->second, connection.generation };
+        connection.reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+            {
+                detail->stats.countRecv( message.type, MessageHeaderSize + data.length( ) );
+                connection.stats.countRecv( MessageHeaderSize + data.length( ) );
+                if ( !detail->requests.dispatch( handle, message, data ) )
+                    { onRecv( handle, message, data ); }
+            } );
+        // one write for every change made by this batch of requests, before any reply is sent
+        detail->data.flush( );
+        if ( !connection.writer.isEmpty( ) )
+        {
+            detail->tcp.send( addr, connection.writer.getAll( ) );
+            connection.writer.clear( );
+            if ( connection.sendQueue.update( 0 ) && detail->onBackpressureHandler )
+                { detail->onBackpressureHandler( addr, false, 0 ); }
+        }
+    }
+
+    void SessionServer::disconnect( const std::string & addr, std::error_code reason )
+    {
+        cpp::Log::info( "disconnect() : addr='{}' msg='{}'", addr, reason.message( ) );
+        if ( auto itr = detail->connectionIds.find( addr ); itr != detail->connectionIds.end( ) )
+        {
+            auto & connection = detail->connections[itr->second];
+            connection.isUsed = false;
+            connection.writer.clear( );
+            detail->freeConnections.push_back( itr->second );
+            detail->connectionIds.erase( itr );
+            detail->stats.disconnects.add( );
+        }
+        detail->data.disconnected( addr );
+    }
+
+    SessionServer::Client::Client( )
+    {
+
+    }
+
+    void SessionServer::Client::open( cpp::AsyncContext & io, StrArg shardAddrs )
+    {
+        detail->io = io;
+        detail->shards.clear( );
+        for ( auto & addr : shardAddrs.split( "," ) )
+        {
+            auto shard = std::make_unique<SessionLink>( );
+            shard->setSendLimits( detail->sendLimits );
+            shard->onBackpressure( detail->onBackpressureHandler );
+            shard->open( io, addr );
+            detail->shards.push_back( std::move( shard ) );
+        }
+    }
+
+    void SessionServer::Client::close( )
+    {
+        for ( auto & shard : detail->shards )
+            { shard->close( ); }
+    }
+
+    void SessionServer::Client::setSendLimits( const SendLimits & limits )
+    {
+        detail->sendLimits = limits;
+    }
+
+    void SessionServer::Client::onBackpressure( BackpressureFn fn )
+    {
+        detail->onBackpressureHandler = fn;
+    }
+
+    void SessionServer::Client::ready( int timeoutSeconds, net::ReadyFn fn )
+    {
+        // ready once every shard is
+        auto pending = std::make_shared<size_t>( detail->shards.size( ) );
+        auto failure = std::make_shared<Result>( Result::Ok );
+        for ( auto & shard : detail->shards )
+        {
+            shard->ready( timeoutSeconds, [fn, pending, failure]( Result result )
+                {
+                    if ( result != Result::Ok )
+                        { *failure = result; }
+                    if ( !--*pending )
+                        { fn( *failure ); }
+                } );
+        }
+    }
+
+    SessionLink & SessionServer::Client::shardOf( uint64_t sessionId )
+    {
+        return *detail->shards[sessionShardOf( sessionId ) % detail->shards.size( )];
+    }
+
+    SessionLink & SessionServer::Client::nextShard( )
+    {
+        return *detail->shards[detail->nextShard++ % detail->shards.size( )];
+    }
+
+    void SessionServer::Client::hello( auth::AuthToken authToken, uint8_t nodeId, OnHello fn )
+    {
+        nextShard( ).send( SessionHello{ authToken.value, nodeId }, [this, fn]( const Message & msg, StrArg data )
+            {
+                Result result = (Result)msg.result;
+                SessionIdReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                if ( result != Result::Ok )
+                    { fn( result, "", 0 ); return; }
+
+                uint64_t sessionId = reply.sessionId;
+                relloShards( sessionId, sessionShardOf( sessionId ), [fn, sessionId]( Result result )
+                    { fn( result, "", sessionId ); } );
+            } );
+    }
+
+    void SessionServer::Client::rello( uint64_t sessionId, OnRello fn )
+    {
+        relloShards( sessionId, detail->shards.size( ), fn );
+    }
+
+    void SessionServer::Client::relloShards( uint64_t sessionId, size_t ownerShard, OnRello fn )
+    {
+        if ( detail->shards.size( ) <= 1 && ownerShard == 0 )
+            { fn( Result::Ok ); return; }
+
+        // the owner holds the session, every other shard holds a replica
+        auto pending = std::make_shared<size_t>( detail->shards.size( ) - ( ownerShard < detail->shards.size( ) ? 1 : 0 ) );
+        auto failure = std::make_shared<Result>( Result::Ok );
+        for ( size_t i = 0; i < detail->shards.size( ); i++ )
+        {
+            if ( i == ownerShard )
+                { continue; }
+            doRello( i, sessionId, 10, [fn, pending, failure]( Result result )
+                {
+                    if ( result != Result::Ok )
+                        { *failure = result; }
+                    if ( !--*pending )
+                        { fn( *failure ); }
+                } );
+        }
+    }
+
+    void SessionServer::Client::doRello( size_t shard, uint64_t sessionId, int retries, OnRello fn )
+    {
+        detail->shards[shard]->send( SessionRello{ sessionId }, [=, this]( const Message & msg, StrArg data )
+            {
+                Result result = (Result)msg.result;
+                // a new session may not have been replicated to this shard yet
+                if ( result == Result::Arg && retries )
+                {
+                    detail->io.waitFor( cpp::Duration::ofMillis( 100 ), [=, this]( )
+                        { doRello( shard, sessionId, retries - 1, fn ); } );
+                    return;
+                }
+                fn( result );
+            } );
+    }
+
+    void SessionServer::Client::auth( std::string extAddr, uint64_t authToken, OnSessionResult fn )
+    {
+        nextShard( ).send( SessionAuth{ std::move( extAddr ), authToken }, [fn]( const Message & msg, StrArg data )
+            {
+                Result result = (Result)msg.result;
+                SessionIdReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                fn( reply.sessionId, result );
+            } );
+    }
+
+    void SessionServer::Client::reauth( std::string extAddr, uint64_t sessionId, OnSessionResult fn )
+    {
+        shardOf( sessionId ).send( SessionReauth{ std::move( extAddr ), sessionId }, [fn, sessionId]( const Message & msg, StrArg data )
+            { fn( sessionId, (Result)msg.result ); } );
+    }
+
+    void SessionServer::Client::authServerNode( uint64_t sessionId, std::string svcName, int nodeId, OnSessionResult fn )
+    {
+        shardOf( sessionId ).send( SessionAuthServer{ sessionId, std::move( svcName ), nodeId }, [fn, sessionId]( const Message & msg, StrArg data )
+            { fn( sessionId, (Result)msg.result ); } );
+    }
+
+    void SessionServer::Client::lookupServerNode( std::string svcName, int nodeId, OnSessionResult fn )
+    {
+        nextShard( ).send( SessionLookupServer{ std::move( svcName ), nodeId }, [fn]( const Message & msg, StrArg data )
+            {
+                Result result = (Result)msg.result;
+                SessionIdReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                fn( reply.sessionId, result );
+            } );
+    }
+
+    void SessionServer::Client::lookupSession( uint64_t sessionId, OnLookupSession fn )
+    {
+        shardOf( sessionId ).send( SessionLookupSession{ sessionId }, [fn]( const Message & msg, StrArg data )
+            {
+                Result result = (Result)msg.result;
+                SessionLookupSessionReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                fn( reply.userId, reply.email, result );
+            } );
+    }
+
+    void SessionServer::Client::openUdp( uint64_t sessionId, std::string intAddr, std::string udpAddr, OnOpenUdp fn )
+    {
+        shardOf( sessionId ).send( SessionOpenUdp{ sessionId, std::move( intAddr ), std::move( udpAddr ) }, [fn]( const Message & msg, StrArg data )
+            {
+                Result result = (Result)msg.result;
+                SessionOpenUdpReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                fn( reply.key, result );
+            } );
+    }
+
+    void SessionServer::Client::closeUdp( uint64_t sessionId, OnSessionResult fn )
+    {
+        shardOf( sessionId ).send( SessionCloseUdp{ sessionId }, [fn, sessionId]( const Message & msg, StrArg data )
+            { fn( sessionId, (Result)msg.result ); } );
+    }
+
+    void SessionServer::Client::lookupUdp( uint64_t sessionId, OnLookupUdp fn )
+    {
+        shardOf( sessionId ).send( SessionLookupUdp{ sessionId }, [fn]( const Message & msg, StrArg data )
+            {
+                Result result = (Result)msg.result;
+                SessionLookupUdpReply reply{ };
+                if ( !decode( data, &reply ) )
+                    { result = Result::Unknown; }
+                fn( reply.extAddr, reply.intAddr, reply.udpAddr, reply.key, result );
+            } );
+    }
+
+
+    uint64_t SessionServer::Data::serverNodeKey( uint32_t service, int nodeId )
+    {
+        return ( (uint64_t)service << 32 ) | (uint32_t)nodeId;
+    }
+
+    size_t SessionServer::Data::memoryUsage( ) const
+    {
+        return names.memoryUsage( ) + endpoints.memoryUsage( ) + sessions.memoryUsage( )
+            + clientSessions.memoryUsage( ) + serverNodes.memoryUsage( );
+    }
+
+    void SessionServer::Data::setAuthBackend( AuthBackend backend )
+    {
+        authBackend = std::move( backend );
+        verifiedTokens.clear( );
+    }
+
+    AuthCache & SessionServer::Data::authCache( )
+    {
+        return verifiedTokens;
+    }
+
+    void SessionServer::Data::invalidateAuth( uint64_t authToken )
+    {
+        verifiedTokens.invalidate( authToken );
+    }
+
+    bool SessionServer::Data::isAuthCached( const std::string & extAddr, uint64_t authToken )
+    {
+        return verifiedTokens.contains( authToken, extAddr, AuthServiceId, AuthCache::Clock::now( ) );
+    }
+
+    void SessionServer::Data::putAuth( const std::string & extAddr, uint64_t authToken, Result result, uint64_t userId, const std::string & email )
+    {
+        verifiedTokens.insert( authToken, extAddr, AuthServiceId, AuthCache::Clock::now( ), result, userId, email );
+    }
+
+    Result SessionServer::Data::verifyConnection( const std::string & clientAddr, uint64_t * sessionId )
+    {
+        // verify clientAddr
+        uint32_t slot = clientSessions.find( endpoints.find( clientAddr ) );
+        if ( slot == RouteTable::NoRoute )
+            { return Result::Arg; }
+        *sessionId = ( slot == NoSession ) ? 0 : sessions.at( slot ).id;
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::verifyServer( uint64_t sessionId, uint32_t * service, int * nodeId )
+    {
+        uint32_t slot = sessions.find( sessionId );
+        if ( slot == SessionTable::NoSlot || !sessions.at( slot ).service )
+            { return Result::Arg; }
+        auto & session = sessions.at( slot );
+        *service = session.service;
+        *nodeId = session.nodeId;
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::verifyServerNetwork( std::string serviceName, std::string serverAddr )
+    {
+        auto addr = cpp::Inet4::toTcpEndpoint( serverAddr );
+        auto serverNetwork = cpp::Inet4::toAddress( addr.address( ).to_string( ) );
+
+        auto itr = ServiceNetwork.find( serviceName );
+        if ( itr == ServiceNetwork.end( ) )
+            { return Result::Ok; }
+
+        auto & validNetworks = itr->second;
+        bool isSafeNetwork = validNetworks.empty( );
+        for ( auto validNetwork : validNetworks )
+        {
+            auto network = cpp::Inet4::toAddress( validNetwork );
+            if ( serverNetwork.is_subnet_of( network ) )
+            { isSafeNetwork = true; break; }
+        }
+        if ( !isSafeNetwork )
+            { return Result::Access; }
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::verifyProxy( const std::string & clientAddr, uint64_t * proxySessionId )
+    {
+        Result result = verifyConnection( clientAddr, proxySessionId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint32_t service;
+        int nodeId;
+        result = verifyServer( *proxySessionId, &service, &nodeId );
+        if ( result != Result::Ok )
+            { return result; }
+        if ( names.get( service ) != ProxyServiceId )
+            { return Result::Access; }
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::grimauth(
+        const std::string & extAddr,
+        uint64_t authToken,
+        const std::string & svc,
+        uint64_t * userId,
+        std::string * email )
+    {
+        Result result;
+        auto now = AuthCache::Clock::now( );
+        if ( verifiedTokens.find( authToken, extAddr, svc, now, &result, userId, email ) )
+            { return result; }
+
+        result = authBackend( extAddr, authToken, svc, userId, email );
+        auto done = AuthCache::Clock::now( );
+        verifiedTokens.recordBackend( done - now );
+        verifiedTokens.insert( authToken, extAddr, svc, done, result, *userId, *email );
+        return result;
+    }
+
+    Result SessionServer::Data::testAuth(
+        const std::string & extAddr,
+        uint64_t authToken,
+        const std::string & svc,
+        uint64_t * userId,
+        std::string * email )
+    {
+        if ( authToken == 1 )
+        {
+            *userId = 1;
+            *email = "monkeysmarts@gmail.com";
+        }
+        else if ( authToken == 2 )
+        {
+            *userId = 2;
+            *email = "thomas.farthing@grimethos.com";
+        }
+        else
+        {
+            return Result::Access;
+        }
+        return Result::Ok;
+    }
+
+    uint64_t SessionServer::Data::makeSessionId( )
+    {
+        // the top bits name this shard, so any shard's client can route by id alone
+        uint64_t shardBits = (uint64_t)shardIndex << ( 64 - SessionShardBits );
+        uint64_t sessionId = 0;
+        while ( !sessionId || sessions.find( sessionId ) != SessionTable::NoSlot )
+        { sessionId = shardBits | ( rng.rand( ) >> SessionShardBits ); }
+        return sessionId;
+    }
+
+    Result SessionServer::Data::verifySession( uint64_t sessionId, uint32_t * slot )
+    {
+        *slot = sessions.find( sessionId );
+        if ( *slot == SessionTable::NoSlot )
+        { return Result::Arg; }
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::connected( std::string clientAddr )
+    {
+        if ( clientSessions.find( endpoints.find( clientAddr ) ) != RouteTable::NoRoute )
+        { return Result::Arg; }
+        clientSessions.insert( endpoints.pack( clientAddr ), NoSession );
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::disconnected( std::string clientAddr )
+    {
+        Endpoint endpoint = endpoints.find( clientAddr );
+        if ( !clientSessions.erase( endpoint ) )
+            { return Result::Arg; }
+        endpoints.release( endpoint );
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::hello(
+        std::string clientAddr,
+        uint64_t authToken,
+        int nodeId,
+        uint64_t * sessionId )
+    {
+        uint64_t clientSessionId = 0;
+        Result result = verifyConnection( clientAddr, &clientSessionId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        result = verifyServerNetwork( ProxyServiceId, clientAddr );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint64_t userId = 0;
+        std::string email;
+        result = grimauth( clientAddr, authToken, AuthServiceId, &userId, &email );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint64_t newSessionId = makeSessionId( );
+        uint32_t slot = addSession( newSessionId, userId, clientSessionId, endpoints.pack( clientAddr ), email );
+        setServerNode( slot, ProxyServiceId, nodeId );
+        clientSessions.insert( endpoints.find( clientAddr ), slot );
+
+        *sessionId = newSessionId;
+
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::rello(
+        std::string clientAddr,
+        uint64_t sessionId )
+    {
+        std::string oldAddr;
+        Result result = reauth( clientAddr, sessionId, clientAddr, &oldAddr );
+        if ( result == Result::Ok )
+        {
+            if ( Endpoint endpoint = endpoints.find( oldAddr ); clientSessions.find( endpoint ) != RouteTable::NoRoute )
+                { clientSessions.insert( endpoint, NoSession ); }
+            clientSessions.insert( endpoints.find( clientAddr ), sessions.find( sessionId ) );
+        }
+
+        return result;
+    }
+
+    Result SessionServer::Data::auth(
+        std::string clientAddr,
+        uint64_t authToken,
+        std::string extAddr,
+        uint64_t * sessionId )
+    {
+        uint64_t clientSessionId = 0;
+        Result result = verifyConnection( clientAddr, &clientSessionId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint32_t clientService;
+        int clientNodeId;
+        result = verifyServer( clientSessionId, &clientService, &clientNodeId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        if ( names.get( clientService ) != ProxyServiceId )
+            { return Result::Access; }
+
+        uint64_t userId = 0;
+        std::string email;
+        result = grimauth( extAddr, authToken, AuthServiceId, &userId, &email );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint64_t newSessionId = makeSessionId( );
+        addSession( newSessionId, userId, clientSessionId, endpoints.pack( extAddr ), email );
+
+        *sessionId = newSessionId;
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::reauth(
+        std::string clientAddr,
+        uint64_t sessionId,
+        std::string extAddr,
+        std::string * oldExtAddr )
+    {
+        uint64_t clientSessionId = 0;
+        Result result = verifyConnection( clientAddr, &clientSessionId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        bool isProxyServer = clientAddr == extAddr;
+        if ( isProxyServer )
+            { clientSessionId = sessionId; }
+
+        uint32_t clientService;
+        int clientNodeId;
+        result = verifyServer( clientSessionId, &clientService, &clientNodeId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint32_t slot;
+        result = verifySession( sessionId, &slot );
+        if ( result != Result::Ok )
+            { return result; }
+
+        auto & session = sessions.at( slot );
+        Endpoint newAddr = endpoints.pack( extAddr );
+        if ( !endpoints.isSameAddress( session.extAddr, newAddr ) )
+        {
+            endpoints.release( newAddr );
+            return Result::Access;
+        }
+
+        *oldExtAddr = endpoints.unpack( session.extAddr );
+        // a proxy keeps its session id across a rello, so the sessions it relays stay linked to it;
+        // a client session moves to the proxy it reconnected through
+        moveSession( slot, newAddr, isProxyServer ? 0 : clientSessionId );
+
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::authServerNode(
+        std::string clientAddr,
+        uint64_t sessionId,
+        std::string svcName, int nodeId )
+    {
+        uint64_t clientSessionId = 0;
+        Result result = verifyConnection( clientAddr, &clientSessionId );
+        if ( result != Result::Ok )
+        { return result; }
+
+        uint32_t clientService;
+        int clientNodeId;
+        result = verifyServer( clientSessionId, &clientService, &clientNodeId );
+        if ( result != Result::Ok )
+        { return result; }
+
+        uint32_t slot;
+        result = verifySession( sessionId, &slot );
+        if ( result != Result::Ok )
+        { return result; }
+
+        auto & session = sessions.at( slot );
+        if ( names.get( session.email ) != "monkeysmarts@gmail.com" )
+        { return Result::Access; }
+
+        result = verifyServerNetwork( svcName, endpoints.unpack( session.extAddr ) );
+        if ( result != Result::Ok )
+        { return result; }
+
+        setServerNode( slot, svcName, nodeId );
+
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::authShard(
+        std::string clientAddr,
+        uint64_t authToken,
+        const std::string & email )
+    {
+        uint64_t userId = 0;
+        std::string tokenEmail;
+        Result result = grimauth( clientAddr, authToken, AuthServiceId, &userId, &tokenEmail );
+        if ( result != Result::Ok )
+            { return result; }
+        if ( tokenEmail != email )
+            { return Result::Access; }
+        return Result::Ok;
+    }
+
+    uint32_t SessionServer::Data::addSession(
+        uint64_t sessionId,
+        uint64_t userId,
+        uint64_t proxySessionId,
+        Endpoint extAddr,
+        std::string_view email )
+    {
+        uint32_t slot = sessions.add( sessionId );
+        auto & session = sessions.at( slot );
+        session.extAddr = extAddr;
+        session.proxySessionId = proxySessionId;
+        session.email = names.intern( email );
+        session.userId = userId;
+        if ( uint32_t proxySlot = sessions.find( proxySessionId ); proxySlot != SessionTable::NoSlot )
+            { sessions.link( proxySlot, slot ); }
+
+        sessionLog.append( SessionLogRecord{
+            .kind = SessionLogRecord::Kind::Create,
+            .sessionId = sessionId,
+            .userId = userId,
+            .proxySessionId = proxySessionId,
+            .extAddr = endpoints.unpack( extAddr ),
+            .email = std::string{ email } } );
+        return slot;
+    }
+
+    void SessionServer::Data::moveSession( uint32_t slot, Endpoint extAddr, uint64_t proxySessionId )
+    {
+        auto & session = sessions.at( slot );
+        endpoints.release( session.extAddr );
+        session.extAddr = extAddr;
+        if ( proxySessionId )
+        {
+            sessions.unlink( slot );
+            session.proxySessionId = proxySessionId;
+            if ( uint32_t proxySlot = sessions.find( proxySessionId ); proxySlot != SessionTable::NoSlot )
+                { sessions.link( proxySlot, slot ); }
+        }
+
+        sessionLog.append( SessionLogRecord{
+            .kind = SessionLogRecord::Kind::Reauth,
+            .sessionId = session.id,
+            .proxySessionId = proxySessionId,
+            .extAddr = endpoints.unpack( extAddr ) } );
+    }
+
+    void SessionServer::Data::setServerNode( uint32_t slot, std::string_view service, int nodeId )
+    {
+        auto & session = sessions.at( slot );
+        uint32_t serviceId = names.intern( service );
+        names.release( session.service );
+        session.service = serviceId;
+        session.nodeId = nodeId;
+        serverNodes.insert( serverNodeKey( serviceId, nodeId ), slot );
+
+        sessionLog.append( SessionLogRecord{
+            .kind = SessionLogRecord::Kind::ServerNode,
+            .sessionId = session.id,
+            .service = std::string{ service },
+            .nodeId = nodeId } );
+    }
+
+    void SessionServer::Data::replay( const SessionLogRecord & record )
+    {
+        uint32_t slot = sessions.find( record.sessionId );
+        switch ( record.kind )
+        {
+        case SessionLogRecord::Kind::Create:
+            // the log may overlap the snapshot if a crash came between writing one and emptying the other
+            if ( slot == SessionTable::NoSlot )
+                { addSession( record.sessionId, record.userId, record.proxySessionId, endpoints.pack( record.extAddr ), record.email ); }
+            break;
+        case SessionLogRecord::Kind::Reauth:
+            if ( slot != SessionTable::NoSlot )
+                { moveSession( slot, endpoints.pack( record.extAddr ), record.proxySessionId ); }
+            break;
+        case SessionLogRecord::Kind::ServerNode:
+            if ( slot != SessionTable::NoSlot )
+                { setServerNode( slot, record.service, record.nodeId ); }
+            break;
+        }
+    }
+
+    Result SessionServer::Data::open( const std::filesystem::path & dataDir )
+    {
+        this->dataDir = dataDir;
+        std::error_code error;
+        std::filesystem::create_directories( dataDir, error );
+        if ( error )
+            { return Result::Arg; }
+
+        SessionSnapshot snapshot;
+        if ( snapshot.load( dataDir / "sessions.snapshot" ) == Result::Ok )
+        {
+            auto & records = snapshot.records( );
+            sessions.reserve( records.size( ) );
+            for ( auto & record : records )
+            {
+                uint32_t slot = addSession( record.sessionId, record.userId, 0, endpoints.pack( snapshot.string( record.extAddr ) ), snapshot.string( record.email ) );
+                sessions.at( slot ).proxySessionId = record.proxySessionId;
+                if ( record.service )
+                    { setServerNode( slot, snapshot.string( record.service ), record.nodeId ); }
+            }
+            // proxies may be restored after the sessions they relay
+            for ( auto & record : records )
+            {
+                uint32_t proxySlot = sessions.find( record.proxySessionId );
+                if ( proxySlot != SessionTable::NoSlot )
+                    { sessions.link( proxySlot, sessions.find( record.sessionId ) ); }
+            }
+        }
+
+        // the log is not open yet, so restoring appends nothing
+        return sessionLog.open( dataDir / "sessions.log", [this]( const SessionLogRecord & record ) { replay( record ); } );
+    }
+
+    Result SessionServer::Data::snapshot( )
+    {
+        if ( !sessionLog.isOpen( ) )
+            { return Result::Arg; }
+
+        SessionSnapshot snapshot;
+        sessions.forEach( [&]( const SessionRecord & session )
+            {
+                snapshot.addRecord( SessionSnapshot::Record{
+                    .sessionId = session.id,
+                    .userId = session.userId,
+                    .proxySessionId = session.proxySessionId,
+                    .extAddr = snapshot.addString( endpoints.unpack( session.extAddr ) ),
+                    .email = snapshot.addString( names.get( session.email ) ),
+                    .service = snapshot.addString( names.get( session.service ) ),
+                    .nodeId = session.nodeId } );
+            } );
+
+        sessionLog.flush( );
+        Result result = snapshot.save( dataDir / "sessions.snapshot" );
+        if ( result == Result::Ok )
+            { sessionLog.truncate( ); }
+        return result;
+    }
+
+    void SessionServer::Data::flush( )
+    {
+        sessionLog.flush( );
+    }
+
+    Result SessionServer::Data::lookupSession(
+        uint64_t sessionId,
+        uint64_t * userId,
+        std::string * email )
+    {
+        uint32_t slot;
+        Result result = verifySession( sessionId, &slot );
+        if ( result != Result::Ok )
+            { return result; }
+        auto & session = sessions.at( slot );
+        *userId = session.userId;
+        *email = names.get( session.email );
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::lookupServerNode(
+        std::string svcName,
+        int nodeId,
+        uint64_t * sessionId )
+    {
+        uint32_t service = names.find( svcName );
+        if ( !service )
+            { return Result::Arg; }
+        uint32_t slot = serverNodes.find( serverNodeKey( service, nodeId ) );
+        if ( slot == RouteTable::NoRoute )
+            { return Result::Arg; }
+        // a slot may since have been authed as another node
+        auto & session = sessions.at( slot );
+        if ( session.service != service || session.nodeId != nodeId )
+            { return Result::Arg; }
+        *sessionId = session.id;
+        return Result::Ok;
+    }
+
+    void SessionServer::Data::setShard( uint8_t shardIndex )
+    {
+        this->shardIndex = shardIndex;
+    }
+
+    Result SessionServer::Data::getServerNode( uint64_t sessionId, ServerNodeInfo * info )
+    {
+        uint32_t slot = sessions.find( sessionId );
+        if ( slot == SessionTable::NoSlot || !sessions.at( slot ).service )
+            { return Result::Arg; }
+        auto & session = sessions.at( slot );
+        info->sessionId = session.id;
+        info->userId = session.userId;
+        info->email = names.get( session.email );
+        info->extAddr = endpoints.unpack( session.extAddr );
+        info->service = names.get( session.service );
+        info->nodeId = session.nodeId;
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::putServerNode( const ServerNodeInfo & info )
+    {
+        // this shard is the source of truth for its own sessions
+        if ( !info.sessionId || sessionShardOf( info.sessionId ) == shardIndex || info.service.empty( ) )
+            { return Result::Arg; }
+
+        uint32_t slot = sessions.find( info.sessionId );
+        if ( slot == SessionTable::NoSlot )
+            { slot = addSession( info.sessionId, info.userId, 0, endpoints.pack( info.extAddr ), info.email ); }
+        else
+            { moveSession( slot, endpoints.pack( info.extAddr ), 0 ); }
+        setServerNode( slot, info.service, info.nodeId );
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::openUdp(
+        std::string clientAddr,
+        uint64_t sessionId,
+        std::string intAddr,
+        std::string udpAddr,
+        uint64_t * key )
+    {
+        uint64_t proxySessionId = 0;
+        Result result = verifyProxy( clientAddr, &proxySessionId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint32_t slot;
+        result = verifySession( sessionId, &slot );
+        if ( result != Result::Ok )
+            { return result; }
+        if ( sessions.at( slot ).proxySessionId != proxySessionId )
+            { return Result::Access; }
+
+        // a new key on every open, so datagrams signed for an earlier endpoint are rejected
+        uint64_t newKey = 0;
+        while ( !newKey )
+            { newKey = rng.rand( ); }
+        sessionUdp[sessionId] = SessionUdpInfo{ std::move( intAddr ), std::move( udpAddr ), newKey };
+        *key = newKey;
+        return Result::Ok;
+    }
+
+    Result SessionServer::Data::closeUdp(
+        std::string clientAddr,
+        uint64_t sessionId )
+    {
+        uint64_t proxySessionId = 0;
+        Result result = verifyProxy( clientAddr, &proxySessionId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint32_t slot;
+        result = verifySession( sessionId, &slot );
+        if ( result != Result::Ok )
+            { return result; }
+        if ( sessions.at( slot ).proxySessionId != proxySessionId )
+            { return Result::Access; }
+
+        return sessionUdp.erase( sessionId ) ? Result::Ok : Result::Arg;
+    }
+
+    Result SessionServer::Data::lookupUdp(
+        std::string clientAddr,
+        uint64_t sessionId,
+        std::string * extAddr,
+        std::string * intAddr,
+        std::string * udpAddr,
+        uint64_t * key )
+    {
+        uint64_t proxySessionId = 0;
+        Result result = verifyProxy( clientAddr, &proxySessionId );
+        if ( result != Result::Ok )
+            { return result; }
+
+        uint32_t slot;
+        result = verifySession( sessionId, &slot );
+        if ( result != Result::Ok )
+            { return result; }
+        auto itr = sessionUdp.find( sessionId );
+        if ( itr == sessionUdp.end( ) )
+            { return Result::Arg; }
+
+        *extAddr = endpoints.unpack( sessions.at( slot ).extAddr );
+        *intAddr = itr->second.intAddr;
+        *udpAddr = itr->second.udpAddr;
+        *key = itr->second.key;
+        return Result::Ok;
+    }
+
+
+    namespace test
+    {
+        void testSessionServerData( )
+        {
+            const char * LOCAL_ADDR1 = "10.10.10.1:1";
+            const char * LOCAL_ADDR1_2 = "10.10.10.1:3";
+            const char * LOCAL_ADDR2 = "10.10.10.2:2";
+            const char * REMOTE_ADDR1 = "10.10.10.100:1";
+            const char * REMOTE_ADDR2 = "10.10.10.101:2";
+
+            SessionServer::Data data;
+            data.connected( LOCAL_ADDR1 );
+            data.connected( LOCAL_ADDR2 );
+
+            uint64_t proxySessionId[2];
+            if ( data.hello( LOCAL_ADDR1, 1, 0, &proxySessionId[0] ) != Result::Ok )
+                { throw std::exception{ "data.authClient( LOCAL_ADDR1 )" }; }
+            if ( data.hello( LOCAL_ADDR2, 2, 1, &proxySessionId[1] ) != Result::Ok )
+                { throw std::exception{ "data.authClient( LOCAL_ADDR2 )" }; }
+
+            data.connected( LOCAL_ADDR1_2 );
+            if ( data.rello( LOCAL_ADDR1_2, proxySessionId[0] ) != Result::Ok )
+                { throw std::exception{ "data.reauthClient( LOCAL_ADDR1_2 )" }; }
+
+            uint64_t galaxySessionId;
+            if ( data.auth( LOCAL_ADDR1_2, 1, REMOTE_ADDR1, &galaxySessionId ) != Result::Ok )
+                { throw std::exception{ "data.auth( LOCAL_ADDR1_2, 1, REMOTE_ADDR1 )" }; }
+            if ( data.authServerNode( LOCAL_ADDR1_2, galaxySessionId, "galaxy.backwater.grimethos.com", 0 ) != Result::Ok )
+                { throw std::exception{ "data.authServerNode( LOCAL_ADDR1_2, galaxySessionId )" }; }
+
+            // only the relaying proxy opens the session's datagram endpoint
+            uint64_t key = 0;
+            if ( data.openUdp( LOCAL_ADDR2, galaxySessionId, "192.168.0.2:5000", "10.10.10.1:4000", &key ) != Result::Access )
+                { throw std::exception{ "data.openUdp( other proxy )" }; }
+            if ( data.openUdp( LOCAL_ADDR1_2, galaxySessionId, "192.168.0.2:5000", "10.10.10.1:4000", &key ) != Result::Ok || !key )
+                { throw std::exception{ "data.openUdp( LOCAL_ADDR1_2, galaxySessionId )" }; }
+            std::string extAddr, intAddr, udpAddr;
+            uint64_t foundKey = 0;
+            if ( data.lookupUdp( LOCAL_ADDR2, galaxySessionId, &extAddr, &intAddr, &udpAddr, &foundKey ) != Result::Ok
+                || extAddr != REMOTE_ADDR1 || intAddr != "192.168.0.2:5000" || udpAddr != "10.10.10.1:4000" || foundKey != key )
+                { throw std::exception{ "data.lookupUdp( galaxySessionId )" }; }
+            if ( data.closeUdp( LOCAL_ADDR1_2, galaxySessionId ) != Result::Ok
+                || data.lookupUdp( LOCAL_ADDR2, galaxySessionId, &extAddr, &intAddr, &udpAddr, &foundKey ) != Result::Arg )
+                { throw std::exception{ "data.closeUdp( galaxySessionId )" }; }
+        }
+
+        void testSessionServerRestore( )
+        {
+            const char * LOCAL_ADDR1 = "10.10.10.1:1";
+            const char * LOCAL_ADDR1_2 = "10.10.10.1:3";
+            const char * REMOTE_ADDR1 = "10.10.10.100:1";
+            const char * REMOTE_ADDR1_2 = "10.10.10.100:2";
+            auto dataDir = std::filesystem::temp_directory_path( ) / "grimnet-test-session-restore";
+            std::filesystem::remove_all( dataDir );
+
+            uint64_t proxySessionId;
+            uint64_t sessionId[2];
+            {
+                SessionServer::Data data;
+                if ( data.open( dataDir ) != Result::Ok )
+                    { throw std::exception{ "data.open( )" }; }
+                data.connected( LOCAL_ADDR1 );
+                data.hello( LOCAL_ADDR1, 1, 0, &proxySessionId );
+                data.auth( LOCAL_ADDR1, 1, REMOTE_ADDR1, &sessionId[0] );
+                // one session in the snapshot, one only in the log
+                if ( data.snapshot( ) != Result::Ok )
+                    { throw std::exception{ "data.snapshot( )" }; }
+                data.auth( LOCAL_ADDR1, 1, REMOTE_ADDR1_2, &sessionId[1] );
+                data.authServerNode( LOCAL_ADDR1, sessionId[1], "galaxy.backwater.grimethos.com", 0 );
+                data.flush( );
+            }
+
+            SessionServer::Data data;
+            if ( data.open( dataDir ) != Result::Ok )
+                { throw std::exception{ "data.open( restore )" }; }
+            data.connected( LOCAL_ADDR1_2 );
+            if ( data.rello( LOCAL_ADDR1_2, proxySessionId ) != Result::Ok )
+                { throw std::exception{ "data.rello( restored proxy )" }; }
+            std::string oldExtAddr;
+            if ( data.reauth( LOCAL_ADDR1_2, sessionId[1], REMOTE_ADDR1, &oldExtAddr ) != Result::Ok || oldExtAddr != REMOTE_ADDR1_2 )
+                { throw std::exception{ "data.reauth( logged session )" }; }
+            if ( data.authServerNode( LOCAL_ADDR1_2, sessionId[0], "galaxy.backwater.grimethos.com", 1 ) != Result::Ok )
+                { throw std::exception{ "data.authServerNode( snapshot session )" }; }
+        }
+
+        void testSessionServerShards( )
+        {
+            const char * LOCAL_ADDR1 = "10.10.10.1:1";
+            const char * REMOTE_ADDR1 = "10.10.10.100:1";
+
+            SessionServer::Data shards[2];
+            shards[0].setShard( 0 );
+            shards[1].setShard( 1 );
+
+            // the proxy says hello to shard 1, which replicates it to shard 0
+            uint64_t proxySessionId;
+            shards[1].connected( LOCAL_ADDR1 );
+            if ( shards[1].hello( LOCAL_ADDR1, 1, 0, &proxySessionId ) != Result::Ok || sessionShardOf( proxySessionId ) != 1 )
+                { throw std::exception{ "shards[1].hello( )" }; }
+            SessionServer::Data::ServerNodeInfo info;
+            if ( shards[1].getServerNode( proxySessionId, &info ) != Result::Ok )
+                { throw std::exception{ "shards[1].getServerNode( )" }; }
+            if ( shards[1].putServerNode( info ) != Result::Arg )
+                { throw std::exception{ "shards[1].putServerNode( own session )" }; }
+            if ( shards[0].putServerNode( info ) != Result::Ok )
+                { throw std::exception{ "shards[0].putServerNode( )" }; }
+
+            // ...so it can rello there and auth sessions which shard 0 owns
+            shards[0].connected( LOCAL_ADDR1 );
+            if ( shards[0].rello( LOCAL_ADDR1, proxySessionId ) != Result::Ok )
+                { throw std::exception{ "shards[0].rello( replica )" }; }
+            uint64_t sessionId;
+            if ( shards[0].auth( LOCAL_ADDR1, 1, REMOTE_ADDR1, &sessionId ) != Result::Ok || sessionShardOf( sessionId ) != 0 )
+                { throw std::exception{ "shards[0].auth( )" }; }
+            uint64_t foundId;
+            if ( shards[0].lookupServerNode( ProxyServiceId, 0, &foundId ) != Result::Ok || foundId != proxySessionId )
+                { throw std::exception{ "shards[0].lookupServerNode( replica )" }; }
+            uint64_t userId;
+            std::string email;
+            if ( shards[1].lookupSession( sessionId, &userId, &email ) != Result::Arg )
+                { throw std::exception{ "shards[1].lookupSession( other shard )" }; }
+        }
+
+        void testSessionServerClient( )
+        {
+            cpp::AsyncContext io;
+            SessionServer server;
+            server.openLocal( io, "loop:sessions:1", "test@grimethos.com", auth::AuthToken{ 1 } );
+            SessionServer::Client client;
+            client.open( io, "loop:sessions:1" );
+
+            // no session yet, so the server's own reply
+            Result lookupResult = Result::Unknown;
+            std::string lookupEmail = "unset";
+            client.lookupSession( 0x42, [&]( uint64_t, std::string email, Result result )
+                {
+                    lookupResult = result;
+                    lookupEmail = email;
+                    client.close( );
+                    server.close( );
+                } );
+            io.run( );
+
+            if ( lookupResult != Result::Arg || !lookupEmail.empty( ) )
+                { throw std::exception{ "client.lookupSession( )" }; }
+        }
+
+        void testSessionServerClientLimits( )
+        {
+            cpp::AsyncContext io;
+            SessionServer server;
+            server.openLocal( io, "loop:limits:1", "test@grimethos.com", auth::AuthToken{ 1 } );
+            SessionServer::Client client;
+            SendLimits limits;
+            limits.highWater = 4096;
+            limits.lowWater = 1024;
+            client.setSendLimits( limits );
+            client.open( io, "loop:limits:1" );
+
+            // a wave at a time, each under the high water mark and all of them many times over it
+            const size_t WaveCount = 64;
+            const size_t WaveSize = 32;
+            size_t replyCount = 0;
+            size_t failureCount = 0;
+            std::function<void( size_t )> sendWave = [&]( size_t wave )
+                {
+                    auto pending = std::make_shared<size_t>( WaveSize );
+                    for ( size_t i = 0; i < WaveSize; i++ )
+                    {
+                        client.lookupSession( 0x42, [&, wave, pending]( uint64_t, std::string, Result result )
+                            {
+                                replyCount++;
+                                if ( result != Result::Arg )
+                                    { failureCount++; }
+                                if ( --*pending )
+                                    { return; }
+                                if ( wave + 1 < WaveCount )
+                                    { sendWave( wave + 1 ); return; }
+                                client.close( );
+                                server.close( );
+                            } );
+                    }
+                };
+            sendWave( 0 );
+            io.run( );
+
+            if ( replyCount != WaveCount * WaveSize || failureCount )
+                { throw std::exception{ "client.send( past high water )" }; }
+        }
+
+        void testSessionServerJoinShard( )
+        {
+            cpp::AsyncContext io;
+            SessionServer server;
+            // test token 1 is this email, token 2 another's
+            server.openLocal( io, "loop:join:1", "monkeysmarts@gmail.com", auth::AuthToken{ 1 } );
+            // a server node owned by shard 1
+            SessionReplicateServer replica{ ( 1ull << ( 64 - SessionShardBits ) ) | 7, 1, "monkeysmarts@gmail.com", "10.10.10.1:1", ProxyServiceId, 0 };
+
+            SessionLink stranger;
+            SessionLink impostor;
+            SessionLink peer;
+            impostor.greet( SessionJoinShard{ 2 } );
+            peer.greet( SessionJoinShard{ 1 } );
+            Result results[3] = { Result::Unknown, Result::Unknown, Result::Unknown };
+            size_t pending = 3;
+            auto send = [&]( SessionLink & link, Result * result )
+                {
+                    link.open( io, "loop:join:1" );
+                    link.send( replica, [&, result]( const Message & msg, StrArg )
+                        {
+                            *result = (Result)msg.result;
+                            if ( --pending )
+                                { return; }
+                            stranger.close( );
+                            impostor.close( );
+                            peer.close( );
+                            server.close( );
+                        } );
+                };
+            send( stranger, &results[0] );
+            send( impostor, &results[1] );
+            send( peer, &results[2] );
+            io.run( );
+
+            if ( results[0] != Result::Access )
+                { throw std::exception{ "server.replicate( not joined )" }; }
+            // refused at the join, so it never reached the server
+            if ( results[1] != Result::Retry )
+                { throw std::exception{ "server.replicate( other token )" }; }
+            if ( results[2] != Result::Ok )
+                { throw std::exception{ "server.replicate( shard )" }; }
+        }
+
+        void benchSessionServerData( size_t sessionCount )
+        {
+            const size_t ProxyCount = 64;
+            const size_t RelloCount = 100000;
+            const size_t ServerNodeCount = 10000;
+
+            // addresses are formatted up front so only Data is measured
+            std::vector<std::string> proxyAddrs[2];
+            std::vector<std::string> extAddrs[2];
+            for ( size_t i = 0; i < ProxyCount; i++ )
+            {
+                proxyAddrs[0].push_back( std::format( "10.0.{}.{}:1000", i / 256, i % 256 ) );
+                proxyAddrs[1].push_back( std::format( "10.0.{}.{}:1001", i / 256, i % 256 ) );
+            }
+            for ( size_t i = 0; i < sessionCount; i++ )
+            {
+                std::string ip = std::format( "20.{}.{}.{}", ( i >> 16 ) & 0xff, ( i >> 8 ) & 0xff, i & 0xff );
+                extAddrs[0].push_back( ip + ":2000" );
+                extAddrs[1].push_back( ip + ":2001" );
+            }
+
+            SessionServer::Data data;
+            auto run = [&]( const char * name, size_t count, auto fn )
+                {
+                    auto start = std::chrono::steady_clock::now( );
+                    for ( size_t i = 0; i < count; i++ )
+                    {
+                        if ( fn( i ) != Result::Ok )
+                            { throw std::exception{ name }; }
+                    }
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now( ) - start;
+                    cpp::Log::info( "{} : {} ops, {:.0f} ops/sec", name, count, count / elapsed.count( ) );
+                };
+
+            std::vector<uint64_t> proxySessionIds( ProxyCount );
+            std::vector<uint64_t> sessionIds( sessionCount );
+            for ( size_t i = 0; i < ProxyCount; i++ )
+            {
+                data.connected( proxyAddrs[0][i] );
+                data.connected( proxyAddrs[1][i] );
+            }
+
+            run( "hello", ProxyCount, [&]( size_t i )
+                { return data.hello( proxyAddrs[0][i], 1, (int)i, &proxySessionIds[i] ); } );
+            run( "auth", sessionCount, [&]( size_t i )
+                { return data.auth( proxyAddrs[0][i % ProxyCount], 1 + i % 2, extAddrs[0][i], &sessionIds[i] ); } );
+            // every session moves to another proxy and port
+            run( "reauth", sessionCount, [&]( size_t i )
+                {
+                    std::string oldExtAddr;
+                    return data.reauth( proxyAddrs[0][( i + 1 ) % ProxyCount], sessionIds[i], extAddrs[1][i], &oldExtAddr );
+                } );
+            // proxies alternate between their two connections
+            std::vector<size_t> proxyConnection( ProxyCount, 0 );
+            run( "rello", RelloCount, [&]( size_t i )
+                {
+                    size_t proxy = i % ProxyCount;
+                    proxyConnection[proxy] ^= 1;
+                    return data.rello( proxyAddrs[proxyConnection[proxy]][proxy], proxySessionIds[proxy] );
+                } );
+            // sessions authed with token 1 (even) may auth as server nodes
+            run( "authServerNode", ServerNodeCount, [&]( size_t i )
+                {
+                    size_t proxy = i % ProxyCount;
+                    return data.authServerNode( proxyAddrs[proxyConnection[proxy]][proxy], sessionIds[( i * 2 ) % sessionCount], "galaxy.backwater.grimethos.com", (int)i );
+                } );
+
+            cpp::Log::info( "sessions : {}, {} bytes/session", sessionCount, data.memoryUsage( ) / sessionCount );
+        }
+
+        void benchSessionShards( size_t sessionCount )
+        {
+            const size_t ProxyCount = 16;
+
+            std::vector<std::string> proxyAddrs;
+            std::vector<std::string> extAddrs;
+            for ( size_t i = 0; i < ProxyCount; i++ )
+                { proxyAddrs.push_back( std::format( "10.0.0.{}:1000", i ) ); }
+            for ( size_t i = 0; i < sessionCount; i++ )
+                { extAddrs.push_back( std::format( "20.{}.{}.{}:2000", ( i >> 16 ) & 0xff, ( i >> 8 ) & 0xff, i & 0xff ) ); }
+
+            for ( size_t shardCount : { 1, 2, 4, 8 } )
+            {
+                // each shard is a separate server, so the shards share nothing
+                std::vector<SessionServer::Data> shards( shardCount );
+                std::vector<uint64_t> proxySessionIds( ProxyCount );
+                for ( size_t shard = 0; shard < shardCount; shard++ )
+                {
+                    shards[shard].setShard( (uint8_t)shard );
+                    for ( size_t i = 0; i < ProxyCount; i++ )
+                    {
+                        shards[shard].connected( proxyAddrs[i] );
+                        shards[shard].hello( proxyAddrs[i], 1, (int)i, &proxySessionIds[i] );
+                    }
+                }
+
+                std::vector<size_t> failures( shardCount );
+                auto start = std::chrono::steady_clock::now( );
+                std::vector<std::thread> threads;
+                for ( size_t shard = 0; shard < shardCount; shard++ )
+                {
+                    threads.emplace_back( [&, shard]( )
+                        {
+                            auto & data = shards[shard];
+                            for ( size_t i = shard; i < sessionCount; i += shardCount )
+                            {
+                                uint64_t sessionId;
+                                if ( data.auth( proxyAddrs[i % ProxyCount], 1 + i % 2, extAddrs[i], &sessionId ) != Result::Ok
+                                    || sessionShardOf( sessionId ) != shard )
+                                    { failures[shard]++; }
+                            }
+                        } );
+                }
+                for ( auto & thread : threads )
+                    { thread.join( ); }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now( ) - start;
+
+                size_t failed = 0;
+                for ( auto count : failures )
+                    { failed += count; }
+                cpp::Log::info( "shards : {}, {} auths, {:.0f} auths/sec, {} failed", shardCount, sessionCount, sessionCount / elapsed.count( ), failed );
+            }
+        }
+
+        void benchSessionServerAuth( size_t loginCount, int backendLatencyMicros )
+        {
+            const size_t ProxyCount = 16;
+            const size_t UserCount = 1000;
+
+            std::vector<std::string> proxyAddrs;
+            std::vector<std::string> extAddrs;
+            for ( size_t i = 0; i < ProxyCount; i++ )
+                { proxyAddrs.push_back( std::format( "10.0.0.{}:1000", i ) ); }
+            // each login is a reconnect from a new port
+            for ( size_t i = 0; i < loginCount; i++ )
+                { extAddrs.push_back( std::format( "20.0.{}.{}:{}", ( i % UserCount ) / 256, ( i % UserCount ) % 256, 2000 + i / UserCount ) ); }
+
+            // one token in ten is denied, and its user keeps retrying
+            auto backend = [backendLatencyMicros]( const std::string & extAddr, uint64_t authToken, const std::string & svc, uint64_t * userId, std::string * email )
+                {
+                    // spin, a sleep is far coarser than the latency of one call
+                    auto until = std::chrono::steady_clock::now( ) + std::chrono::microseconds( backendLatencyMicros );
+                    while ( std::chrono::steady_clock::now( ) < until )
+                        { }
+                    if ( authToken % 10 == 0 )
+                        { return Result::Access; }
+                    *userId = authToken;
+                    *email = std::format( "user{}@grimethos.com", authToken );
+                    return Result::Ok;
+                };
+
+            for ( bool isCached : { false, true } )
+            {
+                SessionServer::Data data;
+                data.setAuthBackend( backend );
+                if ( !isCached )
+                    { data.authCache( ).setLimits( 1, { }, { } ); }
+
+                std::vector<uint64_t> proxySessionIds( ProxyCount );
+                for ( size_t i = 0; i < ProxyCount; i++ )
+                {
+                    data.connected( proxyAddrs[i] );
+                    data.hello( proxyAddrs[i], 1, (int)i, &proxySessionIds[i] );
+                }
+
+                size_t denied = 0;
+                auto start = std::chrono::steady_clock::now( );
+                for ( size_t i = 0; i < loginCount; i++ )
+                {
+                    uint64_t sessionId;
+                    if ( data.auth( proxyAddrs[i % ProxyCount], 1 + i % UserCount, extAddrs[i], &sessionId ) != Result::Ok )
+                        { denied++; }
+                }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now( ) - start;
+
+                auto & stats = data.authCache( ).stats( );
+                cpp::Log::info( "auth ({}) : {} logins ({} denied), {:.0f} logins/sec, hit rate {:.3f}, {} backend calls, {:.0f}us mean, {}us max",
+                    isCached ? "cached" : "uncached", loginCount, denied, loginCount / elapsed.count( ),
+                    stats.hitRate( ), stats.backendCalls, stats.meanBackendMicros( ), stats.maxBackendMicros );
+            }
+        }
+    }
+}
@@ -0,0 +1,350 @@
+module;
+
+#include <charconv>
+#include <cinttypes>
+#include <deque>
+#include <format>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+export module grim.net.session_table;
+
+import grim.net.route;
+
+export namespace grim::net
+{
+    //! Strings stored once and referred to by a dense id.  Each intern() takes a reference which is
+    //! returned with release(); ids of released strings are reused.  Id 0 is the empty string.
+    class InternTable
+    {
+    public:
+        uint32_t                            intern( std::string_view value );
+        //! returns the id of an interned string without taking a reference, otherwise 0
+        uint32_t                            find( std::string_view value ) const;
+        void                                release( uint32_t id );
+        std::string_view                    get( uint32_t id ) const;
+
+        size_t                              size( ) const;
+        size_t                              memoryUsage( ) const;
+    private:
+        struct Entry
+        {
+            std::string                     value;
+            uint32_t                        refs = 0;
+        };
+        // a deque never moves its elements, so the map can key on views of them
+        std::deque<Entry>                   m_entries = std::deque<Entry>( 1 );
+        std::unordered_map<std::string_view, uint32_t> m_ids;
+        std::vector<uint32_t>               m_free;
+    };
+
+    //! An "ip:port" endpoint packed into 64 bits.  IPv4 endpoints are packed as address << 16 | port;
+    //! any other endpoint is interned and packed as bit 63 | intern id.  0 is no endpoint.
+    using                                   Endpoint = uint64_t;
+
+    class EndpointTable
+    {
+    public:
+        //! packs `addr`, taking a reference if it has to be interned
+        Endpoint                            pack( std::string_view addr );
+        //! packs `addr` without interning it, returns 0 if it is not known
+        Endpoint                            find( std::string_view addr ) const;
+        void                                release( Endpoint endpoint );
+        std::string                         unpack( Endpoint endpoint ) const;
+        //! true if both endpoints have the same address (ignoring the port)
+        bool                                isSameAddress( Endpoint x, Endpoint y ) const;
+
+        size_t                              memoryUsage( ) const;
+    private:
+        static constexpr Endpoint           InternBit = 1ull << 63;
+        InternTable                         m_names;
+    };
+
+    //! A session as stored by SessionServer::Data.  Strings are interned and addresses are packed
+    //! so records are fixed size and live in one array.
+    struct SessionRecord
+    {
+        uint64_t                            id = 0;
+        uint64_t                            userId = 0;
+        uint64_t                            proxySessionId = 0;
+        Endpoint                            extAddr = 0;
+        uint32_t                            email = 0;
+        //! set once the session is authed as a server node
+        uint32_t                            service = 0;
+        int                                 nodeId = 0;
+        // sessions relayed by a proxy form a list headed by the proxy's record
+        uint32_t                            proxyHead = RouteTable::NoRoute;
+        uint32_t                            proxyPrev = RouteTable::NoRoute;
+        uint32_t                            proxyNext = RouteTable::NoRoute;
+    };
+
+    //! Slab of session records indexed by session id.  A slot stays valid until the session is
+    //! removed, so other indexes refer to sessions by slot.
+    class SessionTable
+    {
+    public:
+        static constexpr uint32_t           NoSlot = RouteTable::NoRoute;
+
+        void                                reserve( size_t count );
+        uint32_t                            add( uint64_t sessionId );
+        uint32_t                            find( uint64_t sessionId ) const;
+        SessionRecord &                     at( uint32_t slot );
+        void                                remove( uint32_t slot );
+        //! adds `slot` to the sessions relayed by `proxySlot`
+        void                                link( uint32_t proxySlot, uint32_t slot );
+        void                                unlink( uint32_t slot );
+        void                                forEach( const std::function<void( const SessionRecord & record )> & fn ) const;
+
+        size_t                              size( ) const;
+        size_t                              memoryUsage( ) const;
+    private:
+        std::vector<SessionRecord>          m_records;
+        std::vector<uint32_t>               m_free;
+        RouteTable                          m_index;
+    };
+}
+
+namespace grim::net
+{
+    uint32_t InternTable::intern( std::string_view value )
+    {
+        if ( value.empty( ) )
+            { return 0; }
+        if ( auto itr = m_ids.find( value ); itr != m_ids.end( ) )
+        {
+            m_entries[itr->second].refs++;
+            return itr->second;
+        }
+
+        uint32_t id;
+        if ( !m_free.empty( ) )
+        {
+            id = m_free.back( );
+            m_free.pop_back( );
+        }
+        else
+        {
+            id = (uint32_t)m_entries.size( );
+            m_entries.emplace_back( );
+        }
+        auto & entry = m_entries[id];
+        entry.value = value;
+        entry.refs = 1;
+        m_ids[entry.value] = id;
+        return id;
+    }
+
+    uint32_t InternTable::find( std::string_view value ) const
+    {
+        auto itr = m_ids.find( value );
+        return itr == m_ids.end( ) ? 0 : itr->second;
+    }
+
+    void InternTable::release( uint32_t id )
+    {
+        if ( !id || id >= m_entries.size( ) || !m_entries[id].refs )
+            { return; }
+        auto & entry = m_entries[id];
+        if ( --entry.refs )
+            { return; }
+        m_ids.erase( entry.value );
+        entry.value.clear( );
+        m_free.push_back( id );
+    }
+
+    std::string_view InternTable::get( uint32_t id ) const
+    {
+        if ( id >= m_entries.size( ) )
+            { return { }; }
+        return m_entries[id].value;
+    }
+
+    size_t InternTable::size( ) const
+    {
+        return m_ids.size( );
+    }
+
+    size_t InternTable::memoryUsage( ) const
+    {
+        size_t bytes = m_entries.size( ) * sizeof( Entry ) + m_free.capacity( ) * sizeof( uint32_t );
+        // node based, estimated as one node plus one bucket pointer per entry
+        bytes += m_ids.size( ) * ( sizeof( std::string_view ) + sizeof( uint32_t ) + 2 * sizeof( void * ) );
+        bytes += m_ids.bucket_count( ) * sizeof( void * );
+        for ( auto & entry : m_entries )
+        {
+            if ( entry.value.capacity( ) > std::string{ }.capacity( ) )
+                { bytes += entry.value.capacity( ) + 1; }
+        }
+        return bytes;
+    }
+
+    bool parseIpv4( std::string_view addr, Endpoint * endpoint )
+    {
+        const char * pos = addr.data( );
+        const char * end = pos + addr.size( );
+        Endpoint value = 0;
+        for ( int i = 0; i < 5; i++ )
+        {
+            unsigned part = 0;
+            auto [next, ec] = std::from_chars( pos, end, part );
+            if ( ec != std::errc{ } || part > ( i < 4 ? 0xffu : 0xffffu ) )
+                { return false; }
+            value = ( value << ( i < 4 ? 8 : 16 ) ) | part;
+            pos = next;
+            if ( i == 4 )
+                { break; }
+            if ( pos == end || *pos != ( i < 3 ? '.' : ':' ) )
+                { return false; }
+            pos++;
+        }
+        // 0.0.0.0:0 would collide with "no endpoint"
+        if ( pos != end || !value )
+            { return false; }
+        *endpoint = value;
+        return true;
+    }
+
+    Endpoint EndpointTable::pack( std::string_view addr )
+    {
+        Endpoint endpoint;
+        if ( parseIpv4( addr, &endpoint ) )
+            { return endpoint; }
+        uint32_t id = m_names.intern( addr );
+        return id ? InternBit | id : 0;
+    }
+
+    Endpoint EndpointTable::find( std::string_view addr ) const
+    {
+        Endpoint endpoint;
+        if ( parseIpv4( addr, &endpoint ) )
+            { return endpoint; }
+        uint32_t id = m_names.find( addr );
+        return id ? InternBit | id : 0;
+    }
+
+    void EndpointTable::release( Endpoint endpoint )
+    {
+        if ( endpoint & InternBit )
+            { m_names.release( (uint32_t)endpoint ); }
+    }
+
+    std::string EndpointTable::unpack( Endpoint endpoint ) const
+    {
+        if ( !endpoint )
+            { return { }; }
+        if ( endpoint & InternBit )
+            { return std::string{ m_names.get( (uint32_t)endpoint ) }; }
+        return std::format( "{}.{}.{}.{}:{}",
+            ( endpoint >> 40 ) & 0xff, ( endpoint >> 32 ) & 0xff, ( endpoint >> 24 ) & 0xff, ( endpoint >> 16 ) & 0xff,
+            endpoint & 0xffff );
+    }
+
+    bool EndpointTable::isSameAddress( Endpoint x, Endpoint y ) const
+    {
+        if ( !( x & InternBit ) && !( y & InternBit ) )
+            { return ( x >> 16 ) == ( y >> 16 ); }
+        auto addressOf = []( std::string_view addr ) { return addr.substr( 0, addr.find_last_of( ':' ) ); };
+        std::string xAddr = unpack( x );
+        std::string yAddr = unpack( y );
+        return addressOf( xAddr ) == addressOf( yAddr );
+    }
+
+    size_t EndpointTable::memoryUsage( ) const
+    {
+        return m_names.memoryUsage( );
+    }
+
+    void SessionTable::reserve( size_t count )
+    {
+        m_records.reserve( count );
+        m_index.reserve( count );
+    }
+
+    uint32_t SessionTable::add( uint64_t sessionId )
+    {
+        uint32_t slot;
+        if ( !m_free.empty( ) )
+        {
+            slot = m_free.back( );
+            m_free.pop_back( );
+        }
+        else
+        {
+            slot = (uint32_t)m_records.size( );
+            m_records.emplace_back( );
+        }
+        m_records[slot] = SessionRecord{ .id = sessionId };
+        m_index.insert( sessionId, slot );
+        return slot;
+    }
+
+    uint32_t SessionTable::find( uint64_t sessionId ) const
+    {
+        return m_index.find( sessionId );
+    }
+
+    SessionRecord & SessionTable::at( uint32_t slot )
+    {
+        return m_records[slot];
+    }
+
+    void SessionTable::remove( uint32_t slot )
+    {
+        unlink( slot );
+        // sessions still relayed by this one are left unlinked
+        for ( uint32_t next = m_records[slot].proxyHead; next != NoSlot; )
+        {
+            auto & record = m_records[next];
+            next = record.proxyNext;
+            record.proxyPrev = record.proxyNext = NoSlot;
+        }
+        m_index.erase( m_records[slot].id );
+        m_records[slot] = SessionRecord{ };
+        m_free.push_back( slot );
+    }
+
+    void SessionTable::link( uint32_t proxySlot, uint32_t slot )
+    {
+        auto & proxy = m_records[proxySlot];
+        auto & record = m_records[slot];
+        record.proxyPrev = NoSlot;
+        record.proxyNext = proxy.proxyHead;
+        if ( proxy.proxyHead != NoSlot )
+            { m_records[proxy.proxyHead].proxyPrev = slot; }
+        proxy.proxyHead = slot;
+    }
+
+    void SessionTable::unlink( uint32_t slot )
+    {
+        auto & record = m_records[slot];
+        if ( record.proxyPrev != NoSlot )
+            { m_records[record.proxyPrev].proxyNext = record.proxyNext; }
+        else if ( uint32_t proxySlot = find( record.proxySessionId ); proxySlot != NoSlot && m_records[proxySlot].proxyHead == slot )
+            { m_records[proxySlot].proxyHead = record.proxyNext; }
+        if ( record.proxyNext != NoSlot )
+            { m_records[record.proxyNext].proxyPrev = record.proxyPrev; }
+        record.proxyPrev = record.proxyNext = NoSlot;
+    }
+
+    void SessionTable::forEach( const std::function<void( const SessionRecord & record )> & fn ) const
+    {
+        for ( auto & record : m_records )
+        {
+            if ( record.id )
+                { fn( record ); }
+        }
+    }
+
+    size_t SessionTable::size( ) const
+    {
+        return m_index.size( );
+    }
+
+    size_t SessionTable::memoryUsage( ) const
+    {
+        return m_records.capacity( ) * sizeof( SessionRecord ) + m_free.capacity( ) * sizeof( uint32_t ) + m_index.memoryUsage( );
+    }
+}
@@ -0,0 +1,528 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+
+#if defined( _WIN32 )
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+export module grim.net.shm;
+
+import cpp.asio;
+import cpp.memory;
+
+export namespace grim::net
+{
+    //! One direction of a shared memory connection: a single producer, single consumer byte ring.
+    //! Like a tcp stream it carries bytes rather than frames, the reader's MessageReader finds the
+    //! frame boundaries.  head and tail only ever grow, and sit on their own cache lines.
+    class ShmRing
+    {
+    public:
+        struct Control
+        {
+            alignas( 64 ) std::atomic<uint64_t> head;
+            alignas( 64 ) std::atomic<uint64_t> tail;
+        };
+        static_assert( std::atomic<uint64_t>::is_always_lock_free );
+
+        //! `capacity` must be a power of 2
+        void                                attach( Control * control, char * data, size_t capacity );
+        //! copies as much of `data` as fits, and returns how much that was
+        size_t                              write( const char * data, size_t size );
+        //! appends everything readable to `out`, and returns how much that was
+        size_t                              read( std::string & out );
+        size_t                              readable( ) const;
+    private:
+        Control *                           m_control = nullptr;
+        char *                              m_data = nullptr;
+        size_t                              m_capacity = 0;
+    };
+
+    //! A named shared memory mapping, created by one process and opened by another on the same host.
+    class ShmSegment
+    {
+    public:
+                                            ShmSegment( ) = default;
+                                            ~ShmSegment( );
+                                            ShmSegment( const ShmSegment & ) = delete;
+        ShmSegment &                        operator=( const ShmSegment & ) = delete;
+
+        //! a new, zero filled segment
+        bool                                create( const std::string & name, size_t size );
+        bool                                open( const std::string & name );
+        void                                close( );
+        //! removes the name once the other side has the segment open (a windows mapping lasts
+        //! until its last handle is closed, so this only matters elsewhere)
+        void                                unlink( );
+
+        char *                              data( ) const;
+        size_t                              size( ) const;
+    private:
+        std::string                         m_name;
+        char *                              m_data = nullptr;
+        size_t                              m_size = 0;
+#if defined( _WIN32 )
+        HANDLE                              m_mapping = nullptr;
+#endif
+    };
+
+    //! Both directions of a connection between two processes on one host, in one ShmSegment.  The
+    //! inbound ring is polled on the owner's io context: at once while there is traffic, and
+    //! every PollMillis once it is idle.  Whatever does not fit in the outbound ring waits in a
+    //! backlog until the peer catches up.
+    class ShmChannel
+    {
+    public:
+        using                               RecvFn = std::function<void( std::string & recvBuffer )>;
+        static constexpr size_t             DefaultCapacity = 1 << 20;
+        static constexpr int                PollMillis = 1;
+
+                                            ShmChannel( );
+                                            ~ShmChannel( );
+
+        //! the connecting side
+        bool                                create( size_t capacity = DefaultCapacity );
+        //! the accepting side
+        bool                                open( const std::string & name );
+        void                                start( cpp::AsyncContext & io, RecvFn );
+        void                                send( const cpp::Memory & data );
+        void                                close( );
+        void                                unlink( );
+
+        const std::string &                 name( ) const;
+        struct                              State;
+    private:
+        std::shared_ptr<State>              m_state;
+    };
+
+    //! a connection to an address on this host asks to move to shared memory before anything else
+    //! is sent: the request is ShmMagic, a uint32_t length and the segment's name, the reply is
+    //! ShmMagic and a uint32_t (1 if the segment was opened)
+    enum class                              ShmPreamble { Partial, None, Found };
+    std::string                             encodeShmRequest( const std::string & name );
+    std::string                             encodeShmReply( bool isAccepted );
+    //! a found preamble is erased from `recvBuffer`
+    ShmPreamble                             decodeShmRequest( std::string & recvBuffer, std::string * name );
+    ShmPreamble                             decodeShmReply( std::string & recvBuffer, bool * isAccepted );
+    bool                                    isLocalAddress( const std::string & addr );
+
+    namespace test
+    {
+        void                                testShmRing( );
+    };
+}
+
+namespace grim::net
+{
+    constexpr char                          ShmMagic[8] = { 'G', 'R', 'I', 'M', 'S', 'H', 'M', '1' };
+    constexpr size_t                        ShmPreambleSize = sizeof( ShmMagic ) + sizeof( uint32_t );
+    constexpr size_t                        ShmMaxName = 128;
+
+    //! the segment: header, the control blocks of both rings, then both rings' data.  Ring 0 is
+    //! written by the connecting side.
+    struct ShmHeader
+    {
+        char                                magic[8];
+        uint64_t                            capacity;
+        alignas( 64 ) ShmRing::Control      rings[2];
+    };
+
+    void ShmRing::attach( Control * control, char * data, size_t capacity )
+    {
+        m_control = control;
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+    size_t ShmRing::write( const char * data, size_t size )
+    {
+        uint64_t head = m_control->head.load( std::memory_order_relaxed );
+        uint64_t tail = m_control->tail.load( std::memory_order_acquire );
+        size = std::min<size_t>( size, m_capacity - (size_t)( head - tail ) );
+        if ( !size )
+            { return 0; }
+        size_t offset = (size_t)( head & ( m_capacity - 1 ) );
+        size_t first = std::min( size, m_capacity - offset );
+        std::memcpy( m_data + offset, data, first );
+        std::memcpy( m_data, data + first, size - first );
+        m_control->head.store( head + size, std::memory_order_release );
+        return size;
+    }
+
+    size_t ShmRing::read( std::string & out )
+    {
+        uint64_t tail = m_control->tail.load( std::memory_order_relaxed );
+        uint64_t head = m_control->head.load( std::memory_order_acquire );
+        size_t size = (size_t)( head - tail );
+        if ( !size )
+            { return 0; }
+        size_t offset = (size_t)( tail & ( m_capacity - 1 ) );
+        size_t first = std::min( size, m_capacity - offset );
+        out.append( m_data + offset, first );
+        out.append( m_data, size - first );
+        m_control->tail.store( head, std::memory_order_release );
+        return size;
+    }
+
+    size_t ShmRing::readable( ) const
+    {
+        return (size_t)( m_control->head.load( std::memory_order_acquire ) - m_control->tail.load( std::memory_order_relaxed ) );
+    }
+
+    ShmSegment::~ShmSegment( )
+    {
+        close( );
+    }
+
+#if defined( _WIN32 )
+    bool ShmSegment::create( const std::string & name, size_t size )
+    {
+        close( );
+        std::string path = "Local\\" + name;
+        m_mapping = CreateFileMappingA( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)( (uint64_t)size >> 32 ), (DWORD)size, path.c_str( ) );
+        if ( !m_mapping || GetLastError( ) == ERROR_ALREADY_EXISTS )
+            { close( ); return false; }
+        m_data = (char *)MapViewOfFile( m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size );
+        if ( !m_data )
+            { close( ); return false; }
+        m_name = name;
+        m_size = size;
+        return true;
+    }
+
+    bool ShmSegment::open( const std::string & name )
+    {
+        close( );
+        std::string path = "Local\\" + name;
+        m_mapping = OpenFileMappingA( FILE_MAP_ALL_ACCESS, FALSE, path.c_str( ) );
+        if ( !m_mapping )
+            { return false; }
+        m_data = (char *)MapViewOfFile( m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0 );
+        MEMORY_BASIC_INFORMATION info{ };
+        if ( !m_data || !VirtualQuery( m_data, &info, sizeof( info ) ) )
+            { close( ); return false; }
+        m_name = name;
+        m_size = info.RegionSize;
+        return true;
+    }
+
+    void ShmSegment::close( )
+    {
+        if ( m_data )
+            { UnmapViewOfFile( m_data ); }
+        if ( m_mapping )
+            { CloseHandle( m_mapping ); }
+        m_data = nullptr;
+        m_mapping = nullptr;
+        m_size = 0;
+        m_name.clear( );
+    }
+
+    void ShmSegment::unlink( )
+    {
+    }
+#else
+    bool ShmSegment::create( const std::string & name, size_t size )
+    {
+        close( );
+        std::string path = "/" + name;
+        int fd = shm_open( path.c_str( ), O_CREAT | O_EXCL | O_RDWR, 0600 );
+        if ( fd < 0 )
+            { return false; }
+        void * data = ftruncate( fd, (off_t)size ) == 0 ? mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+        ::close( fd );
+        if ( data == MAP_FAILED )
+        {
+            shm_unlink( path.c_str( ) );
+            return false;
+        }
+        m_name = name;
+        m_data = (char *)data;
+        m_size = size;
+        return true;
+    }
+
+    bool ShmSegment::open( const std::string & name )
+    {
+        close( );
+        std::string path = "/" + name;
+        int fd = shm_open( path.c_str( ), O_RDWR, 0600 );
+        if ( fd < 0 )
+            { return false; }
+        struct stat info{ };
+        void * data = fstat( fd, &info ) == 0 ? mmap( nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+        ::close( fd );
+        if ( data == MAP_FAILED )
+            { return false; }
+        m_name = name;
+        m_data = (char *)data;
+        m_size = (size_t)info.st_size;
+        return true;
+    }
+
+    void ShmSegment::close( )
+    {
+        if ( m_data )
+            { munmap( m_data, m_size ); }
+        m_data = nullptr;
+        m_size = 0;
+        m_name.clear( );
+    }
+
+    void ShmSegment::unlink( )
+    {
+        if ( !m_name.empty( ) )
+            { shm_unlink( ( "/" + m_name ).c_str( ) ); }
+    }
+#endif
+
+    char * ShmSegment::data( ) const
+    {
+        return m_data;
+    }
+
+    size_t ShmSegment::size( ) const
+    {
+        return m_size;
+    }
+
+    //! shared with the poll loop, which may outlive the channel by one poll
+    struct ShmChannel::State
+    {
+        ShmSegment                          segment;
+        std::string                         name;
+        ShmRing                             inbound;
+        ShmRing                             outbound;
+        std::string                         backlog;
+        std::string                         recvBuffer;
+        cpp::AsyncContext                   io;
+        RecvFn                              onRecv;
+        bool                                isOpen = false;
+    };
+
+    void shmPoll( const std::shared_ptr<ShmChannel::State> & state )
+    {
+        if ( !state->isOpen )
+            { return; }
+        size_t progress = 0;
+        if ( !state->backlog.empty( ) )
+        {
+            size_t written = state->outbound.write( state->backlog.data( ), state->backlog.size( ) );
+            state->backlog.erase( 0, written );
+            progress += written;
+        }
+        if ( size_t read = state->inbound.read( state->recvBuffer ) )
+        {
+            progress += read;
+            state->onRecv( state->recvBuffer );
+        }
+        // busy while there is traffic, then back to a timer
+        if ( !state->isOpen )
+            { return; }
+        if ( progress )
+            { state->io.post( [state]( ) { shmPoll( state ); } ); }
+        else
+            { state->io.waitFor( cpp::Duration::ofMillis( ShmChannel::PollMillis ), [state]( ) { shmPoll( state ); } ); }
+    }
+
+    std::string makeShmName( )
+    {
+        static std::atomic<uint32_t> nextId = 0;
+#if defined( _WIN32 )
+        uint64_t pid = GetCurrentProcessId( );
+#else
+        uint64_t pid = (uint64_t)getpid( );
+#endif
+        return "grim-shm-" + std::to_string( pid ) + "-" + std::to_string( ++nextId );
+    }
+
+    ShmChannel::ShmChannel( ) :
+        m_state( std::make_shared<State>( ) )
+    {
+    }
+
+    ShmChannel::~ShmChannel( )
+    {
+        close( );
+    }
+
+    bool ShmChannel::create( size_t capacity )
+    {
+        std::string name = makeShmName( );
+        if ( !m_state->segment.create( name, sizeof( ShmHeader ) + 2 * capacity ) )
+            { return false; }
+        auto * header = (ShmHeader *)m_state->segment.data( );
+        header->capacity = capacity;
+        std::memcpy( header->magic, ShmMagic, sizeof( ShmMagic ) );
+        char * data = m_state->segment.data( ) + sizeof( ShmHeader );
+        m_state->outbound.attach( &header->rings[0], data, capacity );
+        m_state->inbound.attach( &header->rings[1], data + capacity, capacity );
+        m_state->name = std::move( name );
+        return true;
+    }
+
+    bool ShmChannel::open( const std::string & name )
+    {
+        auto & segment = m_state->segment;
+        if ( !segment.open( name ) )
+            { return false; }
+        // a segment is only trusted as far as its header fits what was mapped
+        auto * header = (ShmHeader *)segment.data( );
+        uint64_t capacity = segment.size( ) >= sizeof( ShmHeader ) ? header->capacity : 0;
+        if ( std::memcmp( header->magic, ShmMagic, sizeof( ShmMagic ) ) || !capacity || ( capacity & ( capacity - 1 ) ) || sizeof( ShmHeader ) + 2 * capacity > segment.size( ) )
+        {
+            segment.close( );
+            return false;
+        }
+        char * data = segment.data( ) + sizeof( ShmHeader );
+        m_state->inbound.attach( &header->rings[0], data, (size_t)capacity );
+        m_state->outbound.attach( &header->rings[1], data + capacity, (size_t)capacity );
+        m_state->name = name;
+        return true;
+    }
+
+    void ShmChannel::start( cpp::AsyncContext & io, RecvFn onRecv )
+    {
+        m_state->io = io;
+        m_state->onRecv = std::move( onRecv );
+        m_state->isOpen = true;
+        io.post( [state = m_state]( ) { shmPoll( state ); } );
+    }
+
+    void ShmChannel::send( const cpp::Memory & data )
+    {
+        auto & state = *m_state;
+        // nothing overtakes the backlog
+        size_t written = state.backlog.empty( ) ? state.outbound.write( data.data( ), data.length( ) ) : 0;
+        if ( written < data.length( ) )
+            { state.backlog.append( data.data( ) + written, data.length( ) - written ); }
+    }
+
+    void ShmChannel::close( )
+    {
+        // the mapping stays until the last poll lets go of the state, which may be from inside onRecv
+        m_state->isOpen = false;
+    }
+
+    void ShmChannel::unlink( )
+    {
+        m_state->segment.unlink( );
+    }
+
+    const std::string & ShmChannel::name( ) const
+    {
+        return m_state->name;
+    }
+
+    std::string encodeShmPreamble( const std::string & data )
+    {
+        std::string out{ ShmMagic, sizeof( ShmMagic ) };
+        uint32_t length = (uint32_t)data.size( );
+        for ( int shift = 24; shift >= 0; shift -= 8 )
+            { out.push_back( (char)( ( length >> shift ) & 0xff ) ); }
+        return out + data;
+    }
+
+    ShmPreamble decodeShmPreamble( std::string & recvBuffer, size_t maxData, std::string * data )
+    {
+        size_t prefix = std::min( recvBuffer.size( ), sizeof( ShmMagic ) );
+        if ( std::memcmp( recvBuffer.data( ), ShmMagic, prefix ) )
+            { return ShmPreamble::None; }
+        if ( recvBuffer.size( ) < ShmPreambleSize )
+            { return ShmPreamble::Partial; }
+        uint32_t length = 0;
+        for ( size_t i = sizeof( ShmMagic ); i < ShmPreambleSize; i++ )
+            { length = ( length << 8 ) | (uint8_t)recvBuffer[i]; }
+        if ( length > maxData )
+            { return ShmPreamble::None; }
+        if ( recvBuffer.size( ) < ShmPreambleSize + length )
+            { return ShmPreamble::Partial; }
+        *data = recvBuffer.substr( ShmPreambleSize, length );
+        recvBuffer.erase( 0, ShmPreambleSize + length );
+        return ShmPreamble::Found;
+    }
+
+    std::string encodeShmRequest( const std::string & name )
+    {
+        return encodeShmPreamble( name );
+    }
+
+    std::string encodeShmReply( bool isAccepted )
+    {
+        return encodeShmPreamble( isAccepted ? "1" : "0" );
+    }
+
+    ShmPreamble decodeShmRequest( std::string & recvBuffer, std::string * name )
+    {
+        return decodeShmPreamble( recvBuffer, ShmMaxName, name );
+    }
+
+    ShmPreamble decodeShmReply( std::string & recvBuffer, bool * isAccepted )
+    {
+        std::string reply;
+        ShmPreamble preamble = decodeShmPreamble( recvBuffer, 1, &reply );
+        *isAccepted = preamble == ShmPreamble::Found && reply == "1";
+        return preamble;
+    }
+
+    bool isLocalAddress( const std::string & addr )
+    {
+        return addr.starts_with( "127." ) || addr.starts_with( "[::1]" ) || addr.starts_with( "localhost:" );
+    }
+
+    namespace test
+    {
+        void testShmRing( )
+        {
+            // plain memory behaves as the mapping would within one process
+            const size_t Capacity = 16;
+            ShmRing::Control control{ };
+            char data[Capacity];
+            ShmRing writer;
+            ShmRing reader;
+            writer.attach( &control, data, Capacity );
+            reader.attach( &control, data, Capacity );
+
+            std::string out;
+            if ( writer.write( "0123456789", 10 ) != 10 || reader.readable( ) != 10 )
+                { throw std::exception{ "ring.write( )" }; }
+            if ( reader.read( out ) != 10 || out != "0123456789" )
+                { throw std::exception{ "ring.read( )" }; }
+            // wraps around the end, and only what fits is written
+            if ( writer.write( "abcdefghijklmnopqrst", 20 ) != 16 )
+                { throw std::exception{ "ring.write( full )" }; }
+            out.clear( );
+            if ( reader.read( out ) != 16 || out != "abcdefghijklmnop" || reader.readable( ) )
+                { throw std::exception{ "ring.read( wrapped )" }; }
+
+            std::string recvBuffer = encodeShmRequest( "grim-shm-1-1" );
+            std::string name;
+            std::string partial = recvBuffer.substr( 0, 10 );
+            if ( decodeShmRequest( partial, &name ) != ShmPreamble::Partial )
+                { throw std::exception{ "decodeShmRequest( partial )" }; }
+            recvBuffer += "frame";
+            if ( decodeShmRequest( recvBuffer, &name ) != ShmPreamble::Found || name != "grim-shm-1-1" || recvBuffer != "frame" )
+                { throw std::exception{ "decodeShmRequest( )" }; }
+            if ( decodeShmRequest( recvBuffer, &name ) != ShmPreamble::None )
+                { throw std::exception{ "decodeShmRequest( none )" }; }
+            bool isAccepted = false;
+            std::string reply = encodeShmReply( true );
+            if ( decodeShmReply( reply, &isAccepted ) != ShmPreamble::Found || !isAccepted )
+                { throw std::exception{ "decodeShmReply( )" }; }
+        }
+    }
+}
@@ -0,0 +1,471 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <exception>
+#include <format>
+#include <string>
+#include <tuple>
+
+export module grim.net.stats;
+
+import cpp.log;
+import cpp.memory;
+import grim.arch.net;
+import grim.net.message;
+import grim.net.schema;
+
+export namespace grim::net
+{
+    //! A count with one writer (the io context or shard which owns it) which any thread may read
+    //! without a lock.  The writer adds with a plain load and store, so counting costs no more than
+    //! an ordinary increment; a reader sees each count on its own, not a consistent set.
+    class StatCounter
+    {
+    public:
+        void                                add( uint64_t n = 1 )
+                                                { m_value.store( m_value.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed ); }
+        void                                raise( uint64_t value )
+                                                { if ( value > get( ) ) { m_value.store( value, std::memory_order_relaxed ); } }
+        uint64_t                            get( ) const
+                                                { return m_value.load( std::memory_order_relaxed ); }
+        void                                reset( )
+                                                { m_value.store( 0, std::memory_order_relaxed ); }
+    private:
+        std::atomic<uint64_t>               m_value = 0;
+    };
+
+    //! Latencies in nanoseconds, counted in log-linear buckets as an HDR histogram does: each power
+    //! of two is split into SubBucketCount buckets, so a percentile is within 1 / SubBucketCount of
+    //! the true value whatever its magnitude.  Recording is a bit scan and a counter add.
+    class LatencyHistogram
+    {
+    public:
+        using                               Clock = std::chrono::steady_clock;
+        static constexpr uint32_t           SubBucketBits = 5;
+        static constexpr uint32_t           SubBucketCount = 1 << SubBucketBits;
+        //! latencies from 2^MaxExponent ns (about 18 minutes) up share the last bucket
+        static constexpr uint32_t           MaxExponent = 40;
+        static constexpr size_t             BucketCount = SubBucketCount * ( MaxExponent - SubBucketBits + 2 );
+
+        void                                record( uint64_t nanos );
+        void                                record( Clock::duration elapsed );
+        uint64_t                            count( ) const;
+        uint64_t                            max( ) const;
+        //! 0 if nothing was recorded
+        uint64_t                            mean( ) const;
+        //! the latency which `fraction` of those recorded are at or below (0.99 for the p99)
+        uint64_t                            percentile( double fraction ) const;
+        //! adds these counts to `total`, which belongs to the caller
+        void                                addTo( LatencyHistogram & total ) const;
+        void                                reset( );
+
+        static size_t                       bucketOf( uint64_t nanos );
+        //! the highest latency counted in `bucket`
+        static uint64_t                     highestOf( size_t bucket );
+    private:
+        std::array<StatCounter, BucketCount> m_buckets;
+        StatCounter                         m_count;
+        StatCounter                         m_sum;
+        StatCounter                         m_max;
+    };
+
+    //! Counters for one connection, kept by the server alongside it.
+    struct ConnectionStats
+    {
+        StatCounter                         messagesSent;
+        StatCounter                         messagesRecv;
+        StatCounter                         bytesSent;
+        StatCounter                         bytesRecv;
+
+        void                                countSent( size_t frameSize )
+                                                { messagesSent.add( ); bytesSent.add( frameSize ); }
+        void                                countRecv( size_t frameSize )
+                                                { messagesRecv.add( ); bytesRecv.add( frameSize ); }
+        void                                reset( );
+        std::string                         dump( ) const;
+    };
+
+    //! Counters and latencies for one io context: a client, a session server, or a proxy shard (a
+    //! proxy adds its shards together).  Frames are counted by message type as they are queued and
+    //! received, and a client times each request from send to the reply resolving its bind.
+    struct NetStats
+    {
+        StatCounter                         connects;
+        //! connects which rello an existing session, and proxy resumes
+        StatCounter                         reconnects;
+        StatCounter                         disconnects;
+        //! TLS handshakes completed by a server (see grim.net.tls), and those which resumed a session
+        StatCounter                         handshakes;
+        StatCounter                         resumedHandshakes;
+        StatCounter                         bytesSent;
+        StatCounter                         bytesRecv;
+        std::array<StatCounter, 256>        sentByType;
+        std::array<StatCounter, 256>        recvByType;
+        //! request to reply, measured at bind resolution
+        LatencyHistogram                    bindRtt;
+        LatencyHistogram                    hello;
+        LatencyHistogram                    rello;
+        LatencyHistogram                    auth;
+
+        void                                countSent( uint8_t type, size_t frameSize )
+                                                { sentByType[type].add( ); bytesSent.add( frameSize ); }
+        void                                countRecv( uint8_t type, size_t frameSize )
+                                                { recvByType[type].add( ); bytesRecv.add( frameSize ); }
+        uint64_t                            messagesSent( ) const;
+        uint64_t                            messagesRecv( ) const;
+        void                                addTo( NetStats & total ) const;
+        void                                reset( );
+        //! one line per group, latencies in microseconds; types nothing was counted for are left out
+        std::string                         dump( ) const;
+    };
+
+    //! Reserved in every server's message types: a StatsRequest sent with toSessionId 0 is answered
+    //! by the server itself, with its NetStats::dump( ) and the requesting connection's counters.
+    constexpr uint8_t                       StatsMessageType = 0xff;
+
+    struct StatsRequest
+    {
+        static constexpr uint8_t            Type = StatsMessageType;
+        static constexpr auto               Fields = std::tuple{ };
+    };
+
+    struct StatsReply
+    {
+        static constexpr uint8_t            Type = StatsMessageType;
+        std::string                         text;
+        static constexpr auto               Fields = std::tuple{ &StatsReply::text };
+    };
+
+    namespace test
+    {
+        void                                testStats( );
+        //! the cost of counting each frame received (per type and per connection) and of timing
+        //! one request in eight, against reading and dispatching the same frames
+        void                                benchStats( size_t messageCount = 10000000 );
+    };
+}
+
+namespace grim::net
+{
+    size_t LatencyHistogram::bucketOf( uint64_t nanos )
+    {
+        if ( nanos < SubBucketCount )
+            { return (size_t)nanos; }
+        uint32_t exponent = (uint32_t)std::bit_width( nanos ) - 1;
+        if ( exponent > MaxExponent )
+            { return BucketCount - 1; }
+        uint32_t shift = exponent - SubBucketBits;
+        return SubBucketCount * ( shift + 1 ) + (size_t)( ( nanos >> shift ) - SubBucketCount );
+    }
+
+    uint64_t LatencyHistogram::highestOf( size_t bucket )
+    {
+        size_t row = bucket / SubBucketCount;
+        if ( !row )
+            { return bucket; }
+        uint32_t shift = (uint32_t)row - 1;
+        uint64_t lowest = (uint64_t)( SubBucketCount + bucket % SubBucketCount ) << shift;
+        return lowest + ( (uint64_t)1 << shift ) - 1;
+    }
+
+    void LatencyHistogram::record( uint64_t nanos )
+    {
+        m_buckets[bucketOf( nanos )].add( );
+        m_count.add( );
+        m_sum.add( nanos );
+        m_max.raise( nanos );
+    }
+
+    void LatencyHistogram::record( Clock::duration elapsed )
+    {
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed ).count( );
+        record( (uint64_t)std::max<int64_t>( nanos, 0 ) );
+    }
+
+    uint64_t LatencyHistogram::count( ) const
+    {
+        return m_count.get( );
+    }
+
+    uint64_t LatencyHistogram::max( ) const
+    {
+        return m_max.get( );
+    }
+
+    uint64_t LatencyHistogram::mean( ) const
+    {
+        uint64_t count = m_count.get( );
+        return count ? m_sum.get( ) / count : 0;
+    }
+
+    uint64_t LatencyHistogram::percentile( double fraction ) const
+    {
+        // the buckets may be counted into while they are read, so the total is their own sum
+        uint64_t total = 0;
+        for ( auto & bucket : m_buckets )
+            { total += bucket.get( ); }
+        if ( !total )
+            { return 0; }
+        uint64_t target = std::max<uint64_t>( 1, (uint64_t)std::ceil( fraction * (double)total ) );
+        uint64_t seen = 0;
+        for ( size_t i = 0; i < BucketCount; i++ )
+        {
+            seen += m_buckets[i].get( );
+            if ( seen >= target )
+                { return std::min( highestOf( i ), max( ) ); }
+        }
+        return max( );
+    }
+
+    void LatencyHistogram::addTo( LatencyHistogram & total ) const
+    {
+        for ( size_t i = 0; i < BucketCount; i++ )
+        {
+            if ( uint64_t n = m_buckets[i].get( ) )
+                { total.m_buckets[i].add( n ); }
+        }
+        total.m_count.add( m_count.get( ) );
+        total.m_sum.add( m_sum.get( ) );
+        total.m_max.raise( m_max.get( ) );
+    }
+
+    void LatencyHistogram::reset( )
+    {
+        for ( auto & bucket : m_buckets )
+            { bucket.reset( ); }
+        m_count.reset( );
+        m_sum.reset( );
+        m_max.reset( );
+    }
+
+    void ConnectionStats::reset( )
+    {
+        messagesSent.reset( );
+        messagesRecv.reset( );
+        bytesSent.reset( );
+        bytesRecv.reset( );
+    }
+
+    std::string ConnectionStats::dump( ) const
+    {
+        return std::format( "connection : sent={} ({} bytes) recv={} ({} bytes)\n",
+            messagesSent.get( ), bytesSent.get( ), messagesRecv.get( ), bytesRecv.get( ) );
+    }
+
+    uint64_t NetStats::messagesSent( ) const
+    {
+        uint64_t total = 0;
+        for ( auto & counter : sentByType )
+            { total += counter.get( ); }
+        return total;
+    }
+
+    uint64_t NetStats::messagesRecv( ) const
+    {
+        uint64_t total = 0;
+        for ( auto & counter : recvByType )
+            { total += counter.get( ); }
+        return total;
+    }
+
+    void NetStats::addTo( NetStats & total ) const
+    {
+        total.connects.add( connects.get( ) );
+        total.reconnects.add( reconnects.get( ) );
+        total.disconnects.add( disconnects.get( ) );
+        total.handshakes.add( handshakes.get( ) );
+        total.resumedHandshakes.add( resumedHandshakes.get( ) );
+        total.bytesSent.add( bytesSent.get( ) );
+        total.bytesRecv.add( bytesRecv.get( ) );
+        for ( size_t i = 0; i < sentByType.size( ); i++ )
+        {
+            total.sentByType[i].add( sentByType[i].get( ) );
+            total.recvByType[i].add( recvByType[i].get( ) );
+        }
+        bindRtt.addTo( total.bindRtt );
+        hello.addTo( total.hello );
+        rello.addTo( total.rello );
+        auth.addTo( total.auth );
+    }
+
+    void NetStats::reset( )
+    {
+        connects.reset( );
+        reconnects.reset( );
+        disconnects.reset( );
+        handshakes.reset( );
+        resumedHandshakes.reset( );
+        bytesSent.reset( );
+        bytesRecv.reset( );
+        for ( size_t i = 0; i < sentByType.size( ); i++ )
+        {
+            sentByType[i].reset( );
+            recvByType[i].reset( );
+        }
+        bindRtt.reset( );
+        hello.reset( );
+        rello.reset( );
+        auth.reset( );
+    }
+
+    std::string NetStats::dump( ) const
+    {
+        auto byType = []( const std::array<StatCounter, 256> & counters )
+            {
+                std::string text;
+                for ( size_t i = 0; i < counters.size( ); i++ )
+                {
+                    if ( uint64_t n = counters[i].get( ) )
+                        { text += std::format( " {}={}", i, n ); }
+                }
+                return text;
+            };
+        auto latency = []( const char * name, const LatencyHistogram & histogram )
+            {
+                return std::format( "{} : count={} mean={:.1f} p50={:.1f} p99={:.1f} p999={:.1f} max={:.1f}\n",
+                    name, histogram.count( ), histogram.mean( ) / 1000.0, histogram.percentile( 0.5 ) / 1000.0,
+                    histogram.percentile( 0.99 ) / 1000.0, histogram.percentile( 0.999 ) / 1000.0, histogram.max( ) / 1000.0 );
+            };
+
+        std::string text;
+        text += std::format( "connections : connects={} reconnects={} disconnects={}\n", connects.get( ), reconnects.get( ), disconnects.get( ) );
+        if ( handshakes.get( ) )
+            { text += std::format( "tls : handshakes={} resumed={}\n", handshakes.get( ), resumedHandshakes.get( ) ); }
+        text += std::format( "sent : messages={} bytes={} types:{}\n", messagesSent( ), bytesSent.get( ), byType( sentByType ) );
+        text += std::format( "recv : messages={} bytes={} types:{}\n", messagesRecv( ), bytesRecv.get( ), byType( recvByType ) );
+        text += latency( "bindRtt", bindRtt );
+        text += latency( "hello", hello );
+        text += latency( "rello", rello );
+        text += latency( "auth", auth );
+        return text;
+    }
+
+    namespace test
+    {
+        void testStats( )
+        {
+            // every latency lands in a bucket which holds it, and the buckets are in order
+            uint64_t samples[] = { 0, 1, 31, 32, 33, 63, 64, 65, 1000, 123456, 999999999, (uint64_t)1 << 40 };
+            size_t lastBucket = 0;
+            for ( uint64_t nanos : samples )
+            {
+                size_t bucket = LatencyHistogram::bucketOf( nanos );
+                if ( bucket >= LatencyHistogram::BucketCount || bucket < lastBucket )
+                    { throw std::exception{ "LatencyHistogram::bucketOf( )" }; }
+                if ( LatencyHistogram::highestOf( bucket ) < nanos || ( bucket && LatencyHistogram::highestOf( bucket - 1 ) >= nanos ) )
+                    { throw std::exception{ "LatencyHistogram::highestOf( )" }; }
+                lastBucket = bucket;
+            }
+            if ( LatencyHistogram::bucketOf( ~(uint64_t)0 ) != LatencyHistogram::BucketCount - 1 )
+                { throw std::exception{ "LatencyHistogram::bucketOf( max )" }; }
+
+            // percentiles of 1..100000us are within 1/32 of the true value
+            LatencyHistogram histogram;
+            for ( uint64_t i = 1; i <= 100000; i++ )
+                { histogram.record( i * 1000 ); }
+            auto isNear = []( uint64_t value, double expected )
+                { return std::abs( (double)value - expected ) <= expected / LatencyHistogram::SubBucketCount; };
+            if ( histogram.count( ) != 100000 || histogram.max( ) != 100000000 || !isNear( histogram.mean( ), 50000500.0 ) )
+                { throw std::exception{ "LatencyHistogram::record( )" }; }
+            if ( !isNear( histogram.percentile( 0.5 ), 50000000.0 ) || !isNear( histogram.percentile( 0.99 ), 99000000.0 )
+                || !isNear( histogram.percentile( 0.999 ), 99900000.0 ) || histogram.percentile( 1.0 ) != 100000000 )
+                { throw std::exception{ "LatencyHistogram::percentile( )" }; }
+
+            // shards add up
+            NetStats shard0;
+            NetStats shard1;
+            shard0.countSent( 3, 64 );
+            shard0.countRecv( 3, 32 );
+            shard1.countSent( 3, 64 );
+            shard1.countSent( 200, 16 );
+            shard1.bindRtt.record( 5000 );
+            shard0.connects.add( );
+            NetStats total;
+            shard0.addTo( total );
+            shard1.addTo( total );
+            if ( total.messagesSent( ) != 3 || total.bytesSent.get( ) != 144 || total.sentByType[3].get( ) != 2
+                || total.messagesRecv( ) != 1 || total.connects.get( ) != 1 || total.bindRtt.count( ) != 1 )
+                { throw std::exception{ "NetStats::addTo( )" }; }
+            std::string text = total.dump( );
+            if ( text.find( "types: 3=2 200=1" ) == std::string::npos || text.find( "bindRtt : count=1" ) == std::string::npos )
+                { throw std::exception{ "NetStats::dump( )" }; }
+            total.reset( );
+            if ( total.messagesSent( ) || total.bindRtt.count( ) )
+                { throw std::exception{ "NetStats::reset( )" }; }
+
+            StatsReply reply{ text };
+            std::string encoded;
+            encode( reply, &encoded );
+            StatsReply decoded{ };
+            if ( !decode( cpp::Memory{ encoded }, &decoded ) || decoded.text != text )
+                { throw std::exception{ "StatsReply" }; }
+        }
+
+        void benchStats( size_t messageCount )
+        {
+            using Clock = std::chrono::steady_clock;
+            const size_t FrameCount = 256;
+
+            // small frames make the per-frame cost of counting as large a share as it can be
+            MessageWriter writer;
+            std::string payload( 40, 'x' );
+            for ( size_t i = 0; i < FrameCount; i++ )
+            {
+                Message message{ };
+                message.len = payload.size( ) / MessageAlignment;
+                message.bind = ( i % 8 ) ? 0 : 1;
+                message.type = (uint8_t)( i % 16 );
+                message.toSessionId = 2;
+                writer.put( message, payload );
+            }
+            std::string frames{ writer.getAll( ) };
+            size_t roundCount = std::max<size_t>( messageCount / FrameCount, 1 );
+
+            uint64_t sum = 0;
+            SchemaTable<> table;
+            for ( uint8_t type = 0; type < 16; type++ )
+                { table.on( type, [&sum]( const Message & message, const cpp::Memory & data ) { sum += message.type + data.length( ); } ); }
+
+            auto run = [&]( NetStats * stats, ConnectionStats * connection )
+                {
+                    MessageReader reader;
+                    std::string recvBuffer;
+                    auto start = Clock::now( );
+                    for ( size_t round = 0; round < roundCount; round++ )
+                    {
+                        recvBuffer = frames;
+                        reader.read( recvBuffer, [&]( const Message & message, const cpp::Memory & data )
+                            {
+                                if ( stats )
+                                {
+                                    size_t frameSize = MessageHeaderSize + data.length( );
+                                    stats->countRecv( message.type, frameSize );
+                                    connection->countRecv( frameSize );
+                                    // a bound request is timed from its send to its reply
+                                    if ( message.bind )
+                                    {
+                                        auto sent = Clock::now( );
+                                        stats->bindRtt.record( Clock::now( ) - sent );
+                                    }
+                                }
+                                table.dispatch( message, data );
+                            } );
+                    }
+                    return std::chrono::duration<double, std::nano>( Clock::now( ) - start ).count( ) / ( roundCount * FrameCount );
+                };
+
+            NetStats stats;
+            ConnectionStats connection;
+            double plain = run( nullptr, nullptr );
+            double counted = run( &stats, &connection );
+            cpp::Log::info( "stats : {} frames, read and dispatch {:.1f} ns/frame, with stats {:.1f} ns/frame ({:+.1f}%), {} bind latencies (sum {})",
+                roundCount * FrameCount, plain, counted, ( counted - plain ) * 100 / plain, stats.bindRtt.count( ), sum );
+        }
+    }
+}
@@ -0,0 +1,244 @@
+module;
+
+#include <algorithm>
+#include <cinttypes>
+#include <compare>
+#include <exception>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+export module grim.net.stream;
+
+import cpp.buffer;
+import cpp.memory;
+import grim.arch.net;
+import grim.net.message;
+
+export namespace grim::net
+{
+    //! A stream is a request sent as a sequence of parts which share one bind:
+    //!     * an open part (Result::More) carrying the total length as a uint64_t
+    //!     * data parts of StreamPartSize bytes (Result::More), the last one sent with Result::Ok
+    //! The receiver grants credits by replying with Result::More and a uint32_t credit count.  The
+    //! sender keeps at most `credits` data parts outstanding, starting with StreamWindow.  The
+    //! receiver's final reply (any result other than More) completes the stream.
+    constexpr size_t                        StreamPartSize = 64 * 1024;
+    constexpr uint32_t                      StreamWindow = 8;
+
+    static_assert( StreamPartSize % MessageAlignment == 0 );
+    static_assert( StreamPartSize < MaxMessageDataSize );
+
+    //! the data of a credit reply, and its count (0 if it is malformed)
+    std::string                             encodeStreamCredits( uint32_t credits );
+    uint32_t                                decodeStreamCredits( const cpp::Memory & data );
+
+    //! Receive side of the streams arriving on one connection, told apart by sender, bind and
+    //! moniker.  Each is reassembled into a buffer allocated once from its open part's length, and
+    //! handed out whole with the header of its last part.  Credits are granted StreamWindow / 2
+    //! parts at a time, so the sender never waits on a full window.  A stream longer than
+    //! MaxStreamSize is refused with Result::Arg and the rest of its parts dropped.
+    class StreamReader
+    {
+    public:
+        static constexpr size_t             MaxStreamSize = 64 << 20;
+
+        using                               ReplyFn = std::function<void( const Message & request, Result result, const cpp::Memory & data )>;
+        using                               StreamFn = std::function<void( const Message & message, const cpp::Memory & data )>;
+
+        //! false if `message` (a request from another session) is not part of a stream; otherwise
+        //! it is taken, `reply` sends credits (or the refusal) and `fn` gets the whole stream
+        bool                                read( const Message & message, const cpp::Memory & data, uint64_t nowMillis, const ReplyFn & reply, const StreamFn & fn );
+        //! drops the streams which have had no part since `beforeMillis`, e.g. their sender's session ended
+        void                                expire( uint64_t beforeMillis );
+        void                                clear( );
+        size_t                              size( ) const;
+    private:
+        struct Key
+        {
+            uint64_t                        fromSessionId;
+            uint16_t                        bind;
+            uint16_t                        moniker;
+            auto                            operator<=>( const Key & ) const = default;
+        };
+        struct Stream
+        {
+            std::string                     data;
+            size_t                          size = 0;
+            uint64_t                        lastMillis = 0;
+            uint32_t                        credits = 0;
+            bool                            isRefused = false;
+        };
+
+        std::map<Key, Stream>               m_streams;
+    };
+
+    namespace test
+    {
+        void                                testStreamReader( );
+    };
+}
+
+namespace grim::net
+{
+    std::string encodeStreamCredits( uint32_t credits )
+    {
+        auto reply = cpp::StringBuffer::writeTo( 8 );
+        reply.putBinary( credits, ByteOrder );
+        return reply.getAll( );
+    }
+
+    uint32_t decodeStreamCredits( const cpp::Memory & data )
+    {
+        uint32_t credits = 0;
+        try
+        {
+            cpp::DataBuffer reply{ data };
+            reply.getBinary( credits, ByteOrder );
+        }
+        catch ( std::exception & ) { return 0; }
+        return credits;
+    }
+
+    bool StreamReader::read( const Message & message, const cpp::Memory & data, uint64_t nowMillis, const ReplyFn & reply, const StreamFn & fn )
+    {
+        if ( !message.bind )
+            { return false; }
+        Key key{ message.fromSessionId, (uint16_t)message.bind, (uint16_t)message.moniker };
+        auto itr = m_streams.find( key );
+        if ( itr == m_streams.end( ) )
+        {
+            // anything but an open part is an ordinary request
+            uint64_t size = 0;
+            if ( message.result != (uint8_t)Result::More || data.length( ) != 8 )
+                { return false; }
+            try
+            {
+                cpp::DataBuffer part{ data };
+                part.getBinary( size, ByteOrder );
+            }
+            catch ( std::exception & ) { return false; }
+
+            auto & stream = m_streams[key];
+            stream.lastMillis = nowMillis;
+            if ( size > MaxStreamSize )
+            {
+                stream.isRefused = true;
+                reply( message, Result::Arg, cpp::Memory{ } );
+                return true;
+            }
+            stream.size = (size_t)size;
+            stream.data.reserve( stream.size );
+            return true;
+        }
+
+        auto & stream = itr->second;
+        stream.lastMillis = nowMillis;
+        bool isLast = message.result != (uint8_t)Result::More;
+        if ( stream.isRefused )
+        {
+            if ( isLast )
+                { m_streams.erase( itr ); }
+            return true;
+        }
+        // data views include the frame padding, which is trimmed using the total length
+        stream.data.append( data.data( ), std::min( data.length( ), stream.size - stream.data.size( ) ) );
+        if ( !isLast )
+        {
+            if ( ++stream.credits >= StreamWindow / 2 )
+            {
+                std::string credits = encodeStreamCredits( std::exchange( stream.credits, 0 ) );
+                reply( message, Result::More, credits );
+            }
+            return true;
+        }
+        std::string whole = std::move( stream.data );
+        bool isComplete = whole.size( ) == stream.size && message.result == (uint8_t)Result::Ok;
+        m_streams.erase( itr );
+        if ( isComplete )
+            { fn( message, whole ); }
+        else
+            { reply( message, Result::Arg, cpp::Memory{ } ); }
+        return true;
+    }
+
+    void StreamReader::expire( uint64_t beforeMillis )
+    {
+        std::erase_if( m_streams, [beforeMillis]( const auto & entry ) { return entry.second.lastMillis < beforeMillis; } );
+    }
+
+    void StreamReader::clear( )
+    {
+        m_streams.clear( );
+    }
+
+    size_t StreamReader::size( ) const
+    {
+        return m_streams.size( );
+    }
+
+    namespace test
+    {
+        void testStreamReader( )
+        {
+            StreamReader reader;
+            std::vector<std::pair<Result, uint32_t>> replies;
+            std::string whole;
+            auto reply = [&]( const Message &, Result result, const cpp::Memory & data )
+                { replies.emplace_back( result, result == Result::More ? decodeStreamCredits( data ) : 0 ); };
+            auto done = [&]( const Message &, const cpp::Memory & data )
+                { whole.assign( data.data( ), data.length( ) ); };
+            auto open = []( uint64_t size )
+                {
+                    auto part = cpp::StringBuffer::writeTo( 8 );
+                    part.putBinary( size, ByteOrder );
+                    return part.getAll( );
+                };
+
+            Message message{ };
+            message.bind = 3;
+            message.moniker = 9;
+            message.fromSessionId = 0x11;
+            // an ordinary bound request is left alone
+            if ( reader.read( message, std::string{ "request" }, 0, reply, done ) || reader.size( ) )
+                { throw std::exception{ "reader.read( request )" }; }
+
+            // StreamWindow parts of 8 bytes and a padded last one
+            std::string expected;
+            for ( uint32_t i = 0; i <= StreamWindow; i++ )
+                { expected += std::string( 8, (char)( 'a' + i ) ); }
+            expected += "xyz";
+            message.result = (uint8_t)Result::More;
+            if ( !reader.read( message, open( expected.size( ) ), 0, reply, done ) || reader.size( ) != 1 )
+                { throw std::exception{ "reader.read( open )" }; }
+            for ( uint32_t i = 0; i <= StreamWindow; i++ )
+                { reader.read( message, cpp::Memory{ expected }.substr( i * 8, 8 ), 0, reply, done ); }
+            message.result = (uint8_t)Result::Ok;
+            reader.read( message, std::string{ "xyz" } + std::string( 5, '\0' ), 0, reply, done );
+            if ( whole != expected || reader.size( ) )
+                { throw std::exception{ "reader.read( whole )" }; }
+            if ( replies.size( ) != 2 || replies[0] != std::pair{ Result::More, StreamWindow / 2 } || replies[1] != std::pair{ Result::More, StreamWindow / 2 } )
+                { throw std::exception{ "reader.read( credits )" }; }
+
+            // too long: refused, and the parts which follow are dropped up to the last one
+            replies.clear( );
+            whole.clear( );
+            message.result = (uint8_t)Result::More;
+            reader.read( message, open( StreamReader::MaxStreamSize + 1 ), 0, reply, done );
+            if ( replies.size( ) != 1 || replies[0].first != Result::Arg )
+                { throw std::exception{ "reader.read( refused )" }; }
+            reader.read( message, std::string{ "12345678" }, 0, reply, done );
+            message.result = (uint8_t)Result::Ok;
+            if ( !reader.read( message, std::string{ "12345678" }, 0, reply, done ) || !whole.empty( ) || reader.size( ) )
+                { throw std::exception{ "reader.read( refused parts )" }; }
+
+            message.result = (uint8_t)Result::More;
+            reader.read( message, open( 64 ), 10, reply, done );
+            reader.expire( 11 );
+            if ( reader.size( ) )
+                { throw std::exception{ "reader.expire( )" }; }
+        }
+    }
+}
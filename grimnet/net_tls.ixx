@@ -0,0 +1,1019 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined( _WIN32 )
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <sddl.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+export module grim.net.tls;
+
+import cpp.log;
+import grim.arch.net;
+
+export namespace grim::net
+{
+    //! The keys a proxy encrypts session tickets with (RFC 5077, and TLS 1.3's stateless tickets):
+    //! a client resumes by presenting its ticket, which any proxy holding the key decrypts, so the
+    //! proxy keeps no state for it.  A new key encrypts tickets every `rotateSeconds`, and each key
+    //! still decrypts for `lifetimeSeconds` after it is replaced, as long as the tickets it issued.
+    //! Proxies given the same file share their keys, so a ticket from a proxy which restarts (or
+    //! any other) still resumes; the file is a secret, as the certificate's key is.
+    class TicketKeys
+    {
+    public:
+        struct Key
+        {
+            std::array<uint8_t, 16>         name;
+            std::array<uint8_t, 32>         aesKey;
+            std::array<uint8_t, 32>         hmacKey;
+            //! unix seconds
+            int64_t                         created = 0;
+        };
+
+        void                                setRotation( int rotateSeconds, int lifetimeSeconds );
+        //! reads the keys shared through `path`, and writes them back with a new key if they are due
+        Result                              open( const std::filesystem::path & path, int64_t now );
+
+        //! the key to encrypt a ticket with at `now`; rotates first if the current key is due
+        bool                                encryptKey( int64_t now, Key * key );
+        //! the key a ticket names, if it has not expired; `isCurrent` is false for a replaced key,
+        //! so the ticket is renewed
+        bool                                decryptKey( const uint8_t * name, int64_t now, Key * key, bool * isCurrent );
+        size_t                              size( ) const;
+    private:
+        void                                rotate( int64_t now );
+        //! true if any of `keys` was new
+        bool                                merge( const std::vector<Key> & keys );
+        void                                expire( int64_t now );
+        //! writes the keys to the file, keeping any another proxy wrote meanwhile
+        Result                              save( int64_t now );
+        static Result                       read( const std::filesystem::path & path, std::vector<Key> * keys );
+        //! creates `path`, which must not exist, readable by its owner only
+        static Result                       write( const std::filesystem::path & path, const std::vector<Key> & keys );
+
+        mutable std::mutex                  m_mutex;
+        //! newest first
+        std::vector<Key>                    m_keys;
+        int                                 m_rotateSeconds = 3600;
+        int                                 m_lifetimeSeconds = 7200;
+        std::filesystem::path               m_path;
+        //! a ticket naming an unknown key reloads the file, at most once a second
+        int64_t                             m_lastRead = 0;
+    };
+
+    struct TlsServerConfig
+    {
+        //! PEM: the certificate, then the chain to the CA
+        std::string                         certFile;
+        std::string                         keyFile;
+        //! see TicketKeys; empty keeps the keys in memory, and tickets resume on this proxy only
+        //! until it restarts
+        std::string                         ticketKeyFile;
+        int                                 ticketRotateSeconds = 3600;
+        //! of tickets and of the session id cache
+        int                                 sessionLifetimeSeconds = 7200;
+        //! sessions kept for clients which resume by session id rather than ticket
+        size_t                              sessionCacheSize = 100000;
+    };
+
+    //! TLS termination for a server: the certificate, ticket keys, and a session id cache shared
+    //! by every connection made with it (all the shards of a proxy use one).  A resumed handshake
+    //! skips the certificate and its signature, which dominate a full handshake's cost.
+    class TlsServerContext
+    {
+    public:
+                                            TlsServerContext( ) = default;
+                                            TlsServerContext( const TlsServerContext & ) = delete;
+        TlsServerContext &                  operator=( const TlsServerContext & ) = delete;
+                                            ~TlsServerContext( );
+
+        Result                              open( const TlsServerConfig & config );
+        //! the certificate chain and key as PEM text, rather than files
+        Result                              openPem( const TlsServerConfig & config, const std::string & certPem, const std::string & keyPem );
+        void                                close( );
+        bool                                isOpen( ) const
+                                                { return m_ctx != nullptr; }
+    private:
+        friend class                        TlsChannel;
+        static int                          ticketKey( SSL * ssl, unsigned char * name, unsigned char * iv, EVP_CIPHER_CTX * cipher, EVP_MAC_CTX * mac, int isEncrypt );
+
+        SSL_CTX *                           m_ctx = nullptr;
+        TicketKeys                          m_keys;
+    };
+
+    //! TLS for clients: the CAs a server's certificate is checked against, and the session last
+    //! made with each server, which the next connection to it offers to resume.  One context may
+    //! be shared by any number of connections, on any thread.
+    class TlsClientContext
+    {
+    public:
+                                            TlsClientContext( ) = default;
+                                            TlsClientContext( const TlsClientContext & ) = delete;
+        TlsClientContext &                  operator=( const TlsClientContext & ) = delete;
+                                            ~TlsClientContext( );
+
+        //! an empty `caFilename` uses the system's CAs
+        Result                              open( const std::string & caFilename );
+        //! the CA certificates as PEM text, rather than a file
+        Result                              openPem( const std::string & caPem );
+        void                                close( );
+        bool                                isOpen( ) const
+                                                { return m_ctx != nullptr; }
+        //! drops the session kept for `peer`, so the next connection to it is a full handshake
+        void                                forget( const std::string & peer );
+        size_t                              sessionCount( ) const;
+    private:
+        friend class                        TlsChannel;
+        Result                              create( );
+        void                                resume( const std::string & peer, SSL * ssl );
+        static int                          newSession( SSL * ssl, SSL_SESSION * session );
+
+        SSL_CTX *                           m_ctx = nullptr;
+        mutable std::mutex                  m_mutex;
+        std::map<std::string, SSL_SESSION *> m_sessions;
+    };
+
+    //! One connection's TLS, over memory rather than a socket: the bytes received go in through
+    //! recv( ), which hands back what they decrypt to, and whatever TLS sends in return (handshake
+    //! records, alerts, data from send( )) is appended to `out` for the caller to write.  Data sent
+    //! before the handshake completes is held until then.
+    class TlsChannel
+    {
+    public:
+                                            TlsChannel( ) = default;
+                                            TlsChannel( const TlsChannel & ) = delete;
+        TlsChannel &                        operator=( const TlsChannel & ) = delete;
+                                            ~TlsChannel( );
+
+        bool                                accept( TlsServerContext & tls );
+        //! starts the handshake with `peer` (the address connected to, which keys the session kept
+        //! by `tls`); the certificate must name the host in `nameAddr`, or in `peer` if it is empty
+        bool                                connect( TlsClientContext & tls, const std::string & peer, const std::string & nameAddr, std::string & out );
+        //! false once the connection is to be dropped: a failed handshake, a bad record, or the
+        //! peer closed it
+        bool                                recv( const char * data, size_t size, std::string & plain, std::string & out );
+        bool                                send( const char * data, size_t size, std::string & out );
+        void                                reset( );
+
+        bool                                isOpen( ) const
+                                                { return m_isOpen; }
+        bool                                isResumed( ) const;
+    private:
+        friend class                        TlsClientContext;
+        bool                                advance( std::string & out );
+        void                                drain( std::string & out );
+
+        SSL *                               m_ssl = nullptr;
+        bool                                m_isOpen = false;
+        std::string                         m_peer;
+        std::string                         m_pending;
+    };
+
+    namespace test
+    {
+        void                                testTlsResume( );
+        //! handshakes per second on one core, as the proxy sees them, for `clientCount` clients
+        //! connecting at once: full handshakes to a new proxy, then all of them again resuming
+        //! after it restarts
+        void                                benchTlsResume( size_t clientCount = 50000 );
+    };
+}
+
+namespace grim::net
+{
+    namespace
+    {
+        int64_t unixSeconds( )
+        {
+            return std::chrono::duration_cast<std::chrono::seconds>( std::chrono::system_clock::now( ).time_since_epoch( ) ).count( );
+        }
+
+        //! "host:port" or "[v6]:port"
+        std::string hostOf( const std::string & addr )
+        {
+            if ( addr.starts_with( '[' ) )
+                { return addr.substr( 1, addr.find( ']' ) - 1 ); }
+            return addr.substr( 0, addr.find_last_of( ':' ) );
+        }
+
+        constexpr uint32_t                  TicketFileMagic = 0x314b5447; // "GTK1"
+        constexpr size_t                    TicketRecordSize = 16 + 32 + 32 + 8;
+    }
+
+    void TicketKeys::setRotation( int rotateSeconds, int lifetimeSeconds )
+    {
+        std::lock_guard lock{ m_mutex };
+        m_rotateSeconds = std::max( rotateSeconds, 1 );
+        m_lifetimeSeconds = std::max( lifetimeSeconds, 0 );
+    }
+
+    Result TicketKeys::open( const std::filesystem::path & path, int64_t now )
+    {
+        std::lock_guard lock{ m_mutex };
+        m_path = path;
+        std::vector<Key> keys;
+        std::error_code error;
+        if ( std::filesystem::exists( path, error ) && read( path, &keys ) != Result::Ok )
+            { return Result::Arg; }
+        merge( keys );
+        m_lastRead = now;
+        rotate( now );
+        return m_keys.empty( ) ? Result::Unknown : Result::Ok;
+    }
+
+    bool TicketKeys::encryptKey( int64_t now, Key * key )
+    {
+        std::lock_guard lock{ m_mutex };
+        if ( m_keys.empty( ) || m_keys.front( ).created + m_rotateSeconds <= now )
+            { rotate( now ); }
+        if ( m_keys.empty( ) )
+            { return false; }
+        *key = m_keys.front( );
+        return true;
+    }
+
+    bool TicketKeys::decryptKey( const uint8_t * name, int64_t now, Key * key, bool * isCurrent )
+    {
+        std::lock_guard lock{ m_mutex };
+        auto find = [&]( )
+            {
+                return std::find_if( m_keys.begin( ), m_keys.end( ), [&]( const Key & key )
+                    { return std::memcmp( key.name.data( ), name, key.name.size( ) ) == 0; } );
+            };
+        auto itr = find( );
+        // another proxy may have rotated to a key not read here yet
+        if ( itr == m_keys.end( ) && !m_path.empty( ) && now > m_lastRead )
+        {
+            std::vector<Key> keys;
+            if ( read( m_path, &keys ) == Result::Ok )
+                { merge( keys ); }
+            m_lastRead = now;
+            itr = find( );
+        }
+        if ( itr == m_keys.end( ) || itr->created + m_rotateSeconds + m_lifetimeSeconds <= now )
+            { return false; }
+        *key = *itr;
+        *isCurrent = itr == m_keys.begin( );
+        return true;
+    }
+
+    size_t TicketKeys::size( ) const
+    {
+        std::lock_guard lock{ m_mutex };
+        return m_keys.size( );
+    }
+
+    void TicketKeys::rotate( int64_t now )
+    {
+        // another proxy sharing the file may have rotated already
+        if ( !m_path.empty( ) )
+        {
+            std::vector<Key> keys;
+            if ( read( m_path, &keys ) == Result::Ok )
+                { merge( keys ); }
+            m_lastRead = now;
+        }
+        if ( m_keys.empty( ) || m_keys.front( ).created + m_rotateSeconds <= now )
+        {
+            Key key;
+            key.created = now;
+            if ( RAND_bytes( key.name.data( ), (int)key.name.size( ) ) != 1
+                || RAND_bytes( key.aesKey.data( ), (int)key.aesKey.size( ) ) != 1
+                || RAND_bytes( key.hmacKey.data( ), (int)key.hmacKey.size( ) ) != 1 )
+                { cpp::Log::error( "TicketKeys::rotate() : RAND_bytes failed" ); return; }
+            m_keys.insert( m_keys.begin( ), key );
+            expire( now );
+            if ( !m_path.empty( ) && save( now ) != Result::Ok )
+                { cpp::Log::error( "TicketKeys::rotate() : could not write '{}'", m_path.string( ) ); }
+            return;
+        }
+        expire( now );
+    }
+
+    bool TicketKeys::merge( const std::vector<Key> & keys )
+    {
+        bool isChanged = false;
+        for ( auto & key : keys )
+        {
+            bool isKnown = std::any_of( m_keys.begin( ), m_keys.end( ), [&]( const Key & known )
+                { return known.name == key.name; } );
+            if ( !isKnown )
+                { m_keys.push_back( key ); isChanged = true; }
+        }
+        std::stable_sort( m_keys.begin( ), m_keys.end( ), []( const Key & a, const Key & b )
+            { return a.created > b.created; } );
+        return isChanged;
+    }
+
+    void TicketKeys::expire( int64_t now )
+    {
+        // the current key stays, however old, so there is always one to encrypt with
+        while ( m_keys.size( ) > 1 && m_keys.back( ).created + m_rotateSeconds + m_lifetimeSeconds <= now )
+            { m_keys.pop_back( ); }
+    }
+
+    Result TicketKeys::read( const std::filesystem::path & path, std::vector<Key> * keys )
+    {
+        std::ifstream file{ path, std::ios::binary | std::ios::ate };
+        if ( !file )
+            { return Result::Arg; }
+        std::string data( (size_t)file.tellg( ), '\0' );
+        file.seekg( 0 );
+        file.read( data.data( ), data.size( ) );
+        auto getU64 = [&]( size_t offset )
+            {
+                uint64_t value = 0;
+                for ( size_t i = 0; i < 8; i++ )
+                    { value |= (uint64_t)(uint8_t)data[offset + i] << ( 8 * i ); }
+                return value;
+            };
+        if ( data.size( ) < 8 || (uint32_t)getU64( 0 ) != TicketFileMagic )
+            { return Result::Arg; }
+        size_t count = (size_t)( getU64( 0 ) >> 32 );
+        if ( data.size( ) != 8 + count * TicketRecordSize )
+            { return Result::Arg; }
+        keys->clear( );
+        for ( size_t i = 0; i < count; i++ )
+        {
+            const char * record = data.data( ) + 8 + i * TicketRecordSize;
+            auto & key = keys->emplace_back( );
+            std::memcpy( key.name.data( ), record, 16 );
+            std::memcpy( key.aesKey.data( ), record + 16, 32 );
+            std::memcpy( key.hmacKey.data( ), record + 48, 32 );
+            key.created = (int64_t)getU64( 8 + i * TicketRecordSize + 80 );
+        }
+        return Result::Ok;
+    }
+
+    Result TicketKeys::save( int64_t now )
+    {
+        // renamed into place, so another proxy never reads half a file; the temporary is this
+        // writer's own, so proxies rotating at once do not write into each other's
+        std::array<uint8_t, 8> nonce;
+        if ( RAND_bytes( nonce.data( ), (int)nonce.size( ) ) != 1 )
+            { return Result::Unknown; }
+        std::string suffix = ".";
+        for ( uint8_t byte : nonce )
+        {
+            suffix.push_back( "0123456789abcdef"[byte >> 4] );
+            suffix.push_back( "0123456789abcdef"[byte & 0xf] );
+        }
+        auto tmpPath = m_path;
+        tmpPath += suffix + ".tmp";
+
+        std::error_code error;
+        Result result = write( tmpPath, m_keys );
+        // a key another proxy renamed into place since this one read the file is kept, rather
+        // than replaced by this one's file
+        std::vector<Key> keys;
+        if ( result == Result::Ok && read( m_path, &keys ) == Result::Ok && merge( keys ) )
+        {
+            expire( now );
+            std::filesystem::remove( tmpPath, error );
+            result = write( tmpPath, m_keys );
+        }
+        if ( result == Result::Ok )
+            { std::filesystem::rename( tmpPath, m_path, error ); }
+        if ( result != Result::Ok || error )
+        {
+            std::filesystem::remove( tmpPath, error );
+            return Result::Unknown;
+        }
+        return Result::Ok;
+    }
+
+    Result TicketKeys::write( const std::filesystem::path & path, const std::vector<Key> & keys )
+    {
+        std::string data;
+        auto putU64 = [&]( uint64_t value )
+            {
+                for ( size_t i = 0; i < 8; i++ )
+                    { data.push_back( (char)( value >> ( 8 * i ) ) ); }
+            };
+        putU64( TicketFileMagic | (uint64_t)keys.size( ) << 32 );
+        for ( auto & key : keys )
+        {
+            data.append( (const char *)key.name.data( ), key.name.size( ) );
+            data.append( (const char *)key.aesKey.data( ), key.aesKey.size( ) );
+            data.append( (const char *)key.hmacKey.data( ), key.hmacKey.size( ) );
+            putU64( (uint64_t)key.created );
+        }
+
+        // created with the owner's access only, rather than changed after, so the keys are never
+        // readable by anyone else (the rename keeps it so)
+#if defined( _WIN32 )
+        PSECURITY_DESCRIPTOR descriptor = nullptr;
+        if ( !ConvertStringSecurityDescriptorToSecurityDescriptorW( L"D:P(A;;FA;;;OW)", SDDL_REVISION_1, &descriptor, nullptr ) )
+            { return Result::Unknown; }
+        SECURITY_ATTRIBUTES attributes{ sizeof( attributes ), descriptor, FALSE };
+        HANDLE file = CreateFileW( path.c_str( ), GENERIC_WRITE, 0, &attributes, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr );
+        LocalFree( descriptor );
+        if ( file == INVALID_HANDLE_VALUE )
+            { return Result::Unknown; }
+        DWORD written = 0;
+        bool isOk = WriteFile( file, data.data( ), (DWORD)data.size( ), &written, nullptr ) && written == data.size( );
+        isOk = FlushFileBuffers( file ) && isOk;
+        CloseHandle( file );
+#else
+        int file = ::open( path.c_str( ), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+        if ( file < 0 )
+            { return Result::Unknown; }
+        size_t offset = 0;
+        while ( offset < data.size( ) )
+        {
+            ssize_t written = ::write( file, data.data( ) + offset, data.size( ) - offset );
+            if ( written < 0 && errno == EINTR )
+                { continue; }
+            if ( written <= 0 )
+                { break; }
+            offset += (size_t)written;
+        }
+        bool isOk = offset == data.size( ) && ::fsync( file ) == 0;
+        ::close( file );
+#endif
+        return isOk ? Result::Ok : Result::Unknown;
+    }
+
+
+    TlsServerContext::~TlsServerContext( )
+    {
+        close( );
+    }
+
+    Result TlsServerContext::open( const TlsServerConfig & config )
+    {
+        auto readAll = []( const std::string & filename, std::string * text )
+            {
+                std::ifstream file{ filename, std::ios::binary };
+                text->assign( std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{ } );
+                return file.good( ) || file.eof( );
+            };
+        std::string certPem;
+        std::string keyPem;
+        if ( !readAll( config.certFile, &certPem ) || !readAll( config.keyFile, &keyPem ) )
+            { cpp::Log::error( "TlsServerContext::open() : could not read '{}' or '{}'", config.certFile, config.keyFile ); return Result::Arg; }
+        return openPem( config, certPem, keyPem );
+    }
+
+    Result TlsServerContext::openPem( const TlsServerConfig & config, const std::string & certPem, const std::string & keyPem )
+    {
+        close( );
+        m_ctx = SSL_CTX_new( TLS_server_method( ) );
+        if ( !m_ctx )
+            { return Result::Unknown; }
+        SSL_CTX_set_min_proto_version( m_ctx, TLS1_2_VERSION );
+
+        bool isLoaded = false;
+        if ( BIO * bio = BIO_new_mem_buf( certPem.data( ), (int)certPem.size( ) ) )
+        {
+            if ( X509 * cert = PEM_read_bio_X509( bio, nullptr, nullptr, nullptr ) )
+            {
+                isLoaded = SSL_CTX_use_certificate( m_ctx, cert ) == 1;
+                X509_free( cert );
+                while ( X509 * chain = PEM_read_bio_X509( bio, nullptr, nullptr, nullptr ) )
+                    { SSL_CTX_add0_chain_cert( m_ctx, chain ); }
+            }
+            BIO_free( bio );
+        }
+        if ( BIO * bio = BIO_new_mem_buf( keyPem.data( ), (int)keyPem.size( ) ) )
+        {
+            EVP_PKEY * key = PEM_read_bio_PrivateKey( bio, nullptr, nullptr, nullptr );
+            isLoaded = isLoaded && key && SSL_CTX_use_PrivateKey( m_ctx, key ) == 1 && SSL_CTX_check_private_key( m_ctx ) == 1;
+            EVP_PKEY_free( key );
+            BIO_free( bio );
+        }
+        if ( !isLoaded )
+            { cpp::Log::error( "TlsServerContext::open() : certificate or key not loaded" ); close( ); return Result::Arg; }
+
+        // the session id cache, for clients which do not resume by ticket
+        static const unsigned char SessionContext[] = "grim.net";
+        SSL_CTX_set_session_id_context( m_ctx, SessionContext, sizeof( SessionContext ) - 1 );
+        SSL_CTX_set_session_cache_mode( m_ctx, SSL_SESS_CACHE_SERVER );
+        SSL_CTX_sess_set_cache_size( m_ctx, (long)config.sessionCacheSize );
+        SSL_CTX_set_timeout( m_ctx, config.sessionLifetimeSeconds );
+        // a client keeps only the newest ticket, so a second would be wasted
+        SSL_CTX_set_num_tickets( m_ctx, 1 );
+
+        m_keys.setRotation( config.ticketRotateSeconds, config.sessionLifetimeSeconds );
+        if ( !config.ticketKeyFile.empty( ) && m_keys.open( config.ticketKeyFile, unixSeconds( ) ) != Result::Ok )
+            { cpp::Log::error( "TlsServerContext::open() : ticket keys not loaded from '{}'", config.ticketKeyFile ); close( ); return Result::Arg; }
+        SSL_CTX_set_app_data( m_ctx, this );
+        SSL_CTX_set_tlsext_ticket_key_evp_cb( m_ctx, &TlsServerContext::ticketKey );
+        return Result::Ok;
+    }
+
+    void TlsServerContext::close( )
+    {
+        if ( m_ctx )
+            { SSL_CTX_free( m_ctx ); }
+        m_ctx = nullptr;
+    }
+
+    int TlsServerContext::ticketKey( SSL * ssl, unsigned char * name, unsigned char * iv, EVP_CIPHER_CTX * cipher, EVP_MAC_CTX * mac, int isEncrypt )
+    {
+        auto * self = (TlsServerContext *)SSL_CTX_get_app_data( SSL_get_SSL_CTX( ssl ) );
+        int64_t now = unixSeconds( );
+        TicketKeys::Key key;
+        bool isCurrent = true;
+        if ( isEncrypt )
+        {
+            if ( !self->m_keys.encryptKey( now, &key ) || RAND_bytes( iv, EVP_MAX_IV_LENGTH ) != 1 )
+                { return -1; }
+            std::memcpy( name, key.name.data( ), key.name.size( ) );
+            if ( EVP_EncryptInit_ex( cipher, EVP_aes_256_cbc( ), nullptr, key.aesKey.data( ), iv ) != 1 )
+                { return -1; }
+        }
+        else
+        {
+            // an unknown or expired key is not an error: the handshake is a full one
+            if ( !self->m_keys.decryptKey( name, now, &key, &isCurrent ) )
+                { return 0; }
+            if ( EVP_DecryptInit_ex( cipher, EVP_aes_256_cbc( ), nullptr, key.aesKey.data( ), iv ) != 1 )
+                { return -1; }
+        }
+        char digest[] = "SHA256";
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_octet_string( OSSL_MAC_PARAM_KEY, key.hmacKey.data( ), key.hmacKey.size( ) ),
+            OSSL_PARAM_construct_utf8_string( OSSL_MAC_PARAM_DIGEST, digest, 0 ),
+            OSSL_PARAM_construct_end( ) };
+        if ( EVP_MAC_CTX_set_params( mac, params ) != 1 )
+            { return -1; }
+        // 2 asks for a new ticket, under the current key.  A TLS 1.3 client uses each ticket once,
+        // so it always gets a new one, or its next reconnect would be a full handshake.
+        return isCurrent && SSL_version( ssl ) != TLS1_3_VERSION ? 1 : 2;
+    }
+
+
+    TlsClientContext::~TlsClientContext( )
+    {
+        close( );
+    }
+
+    Result TlsClientContext::create( )
+    {
+        close( );
+        m_ctx = SSL_CTX_new( TLS_client_method( ) );
+        if ( !m_ctx )
+            { return Result::Unknown; }
+        SSL_CTX_set_min_proto_version( m_ctx, TLS1_2_VERSION );
+        SSL_CTX_set_verify( m_ctx, SSL_VERIFY_PEER, nullptr );
+        // sessions are kept here by peer, not in openssl's cache
+        SSL_CTX_set_session_cache_mode( m_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+        SSL_CTX_sess_set_new_cb( m_ctx, &TlsClientContext::newSession );
+        SSL_CTX_set_app_data( m_ctx, this );
+        return Result::Ok;
+    }
+
+    Result TlsClientContext::open( const std::string & caFilename )
+    {
+        if ( create( ) != Result::Ok )
+            { return Result::Unknown; }
+        int isLoaded = caFilename.empty( )
+            ? SSL_CTX_set_default_verify_paths( m_ctx )
+            : SSL_CTX_load_verify_locations( m_ctx, caFilename.c_str( ), nullptr );
+        if ( isLoaded != 1 )
+            { cpp::Log::error( "TlsClientContext::open() : CAs not loaded from '{}'", caFilename ); close( ); return Result::Arg; }
+        return Result::Ok;
+    }
+
+    Result TlsClientContext::openPem( const std::string & caPem )
+    {
+        if ( create( ) != Result::Ok )
+            { return Result::Unknown; }
+        size_t count = 0;
+        if ( BIO * bio = BIO_new_mem_buf( caPem.data( ), (int)caPem.size( ) ) )
+        {
+            while ( X509 * cert = PEM_read_bio_X509( bio, nullptr, nullptr, nullptr ) )
+            {
+                count += X509_STORE_add_cert( SSL_CTX_get_cert_store( m_ctx ), cert ) == 1;
+                X509_free( cert );
+            }
+            BIO_free( bio );
+        }
+        if ( !count )
+            { close( ); return Result::Arg; }
+        return Result::Ok;
+    }
+
+    void TlsClientContext::close( )
+    {
+        std::lock_guard lock{ m_mutex };
+        for ( auto & [peer, session] : m_sessions )
+            { SSL_SESSION_free( session ); }
+        m_sessions.clear( );
+        if ( m_ctx )
+            { SSL_CTX_free( m_ctx ); }
+        m_ctx = nullptr;
+    }
+
+    void TlsClientContext::forget( const std::string & peer )
+    {
+        std::lock_guard lock{ m_mutex };
+        if ( auto itr = m_sessions.find( peer ); itr != m_sessions.end( ) )
+        {
+            SSL_SESSION_free( itr->second );
+            m_sessions.erase( itr );
+        }
+    }
+
+    size_t TlsClientContext::sessionCount( ) const
+    {
+        std::lock_guard lock{ m_mutex };
+        return m_sessions.size( );
+    }
+
+    void TlsClientContext::resume( const std::string & peer, SSL * ssl )
+    {
+        std::lock_guard lock{ m_mutex };
+        if ( auto itr = m_sessions.find( peer ); itr != m_sessions.end( ) && SSL_SESSION_is_resumable( itr->second ) )
+            { SSL_set_session( ssl, itr->second ); }
+    }
+
+    int TlsClientContext::newSession( SSL * ssl, SSL_SESSION * session )
+    {
+        auto * self = (TlsClientContext *)SSL_CTX_get_app_data( SSL_get_SSL_CTX( ssl ) );
+        auto * channel = (TlsChannel *)SSL_get_app_data( ssl );
+        if ( !channel || channel->m_peer.empty( ) )
+            { return 0; }
+        // the newest replaces the last; 1 keeps the reference openssl passed
+        std::lock_guard lock{ self->m_mutex };
+        auto & kept = self->m_sessions[channel->m_peer];
+        if ( kept )
+            { SSL_SESSION_free( kept ); }
+        kept = session;
+        return 1;
+    }
+
+
+    TlsChannel::~TlsChannel( )
+    {
+        reset( );
+    }
+
+    void TlsChannel::reset( )
+    {
+        // a connection dropped without a close_notify (a proxy restarting, say) would otherwise
+        // take its session with it, which is the very case resumption is for
+        if ( m_ssl )
+        {
+            SSL_set_shutdown( m_ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN );
+            SSL_free( m_ssl );
+        }
+        m_ssl = nullptr;
+        m_isOpen = false;
+        m_peer.clear( );
+        m_pending.clear( );
+    }
+
+    bool TlsChannel::accept( TlsServerContext & tls )
+    {
+        reset( );
+        m_ssl = SSL_new( tls.m_ctx );
+        if ( !m_ssl )
+            { return false; }
+        // the ssl owns both bios
+        SSL_set_bio( m_ssl, BIO_new( BIO_s_mem( ) ), BIO_new( BIO_s_mem( ) ) );
+        SSL_set_app_data( m_ssl, this );
+        SSL_set_accept_state( m_ssl );
+        return true;
+    }
+
+    bool TlsChannel::connect( TlsClientContext & tls, const std::string & peer, const std::string & nameAddr, std::string & out )
+    {
+        reset( );
+        m_ssl = SSL_new( tls.m_ctx );
+        if ( !m_ssl )
+            { return false; }
+        SSL_set_bio( m_ssl, BIO_new( BIO_s_mem( ) ), BIO_new( BIO_s_mem( ) ) );
+        SSL_set_app_data( m_ssl, this );
+        SSL_set_connect_state( m_ssl );
+        m_peer = peer;
+
+        std::string name = hostOf( nameAddr.empty( ) ? peer : nameAddr );
+        // an address is checked against the certificate's ip names, a host name also goes in sni
+        if ( X509_VERIFY_PARAM_set1_ip_asc( SSL_get0_param( m_ssl ), name.c_str( ) ) != 1 )
+        {
+            SSL_set_tlsext_host_name( m_ssl, name.c_str( ) );
+            SSL_set1_host( m_ssl, name.c_str( ) );
+        }
+        tls.resume( peer, m_ssl );
+        return advance( out );
+    }
+
+    bool TlsChannel::recv( const char * data, size_t size, std::string & plain, std::string & out )
+    {
+        if ( !m_ssl )
+            { return false; }
+        if ( size && BIO_write( SSL_get_rbio( m_ssl ), data, (int)size ) != (int)size )
+            { return false; }
+        if ( !advance( out ) )
+            { return false; }
+        // also reads what comes after the handshake, such as the tickets a server sends
+        while ( m_isOpen )
+        {
+            constexpr size_t ReadSize = 16384;
+            size_t offset = plain.size( );
+            size_t readSize = 0;
+            plain.resize( offset + ReadSize );
+            int result = SSL_read_ex( m_ssl, plain.data( ) + offset, ReadSize, &readSize );
+            plain.resize( offset + readSize );
+            if ( result == 1 )
+                { continue; }
+            int error = SSL_get_error( m_ssl, result );
+            drain( out );
+            return error == SSL_ERROR_WANT_READ;
+        }
+        drain( out );
+        return true;
+    }
+
+    bool TlsChannel::send( const char * data, size_t size, std::string & out )
+    {
+        if ( !m_ssl )
+            { return false; }
+        if ( !m_isOpen )
+            { m_pending.append( data, size ); return true; }
+        size_t written = 0;
+        if ( size && SSL_write_ex( m_ssl, data, size, &written ) != 1 )
+            { return false; }
+        drain( out );
+        return true;
+    }
+
+    bool TlsChannel::isResumed( ) const
+    {
+        return m_ssl && SSL_session_reused( m_ssl ) == 1;
+    }
+
+    bool TlsChannel::advance( std::string & out )
+    {
+        if ( !m_isOpen )
+        {
+            int result = SSL_do_handshake( m_ssl );
+            if ( result != 1 )
+            {
+                // an alert may be waiting to go out
+                drain( out );
+                return SSL_get_error( m_ssl, result ) == SSL_ERROR_WANT_READ;
+            }
+            m_isOpen = true;
+            std::string pending = std::move( m_pending );
+            m_pending.clear( );
+            if ( !send( pending.data( ), pending.size( ), out ) )
+                { return false; }
+        }
+        drain( out );
+        return true;
+    }
+
+    void TlsChannel::drain( std::string & out )
+    {
+        BIO * bio = SSL_get_wbio( m_ssl );
+        size_t pending = BIO_ctrl_pending( bio );
+        if ( !pending )
+            { return; }
+        size_t offset = out.size( );
+        out.resize( offset + pending );
+        int readSize = BIO_read( bio, out.data( ) + offset, (int)pending );
+        out.resize( offset + (size_t)std::max( readSize, 0 ) );
+    }
+
+
+    namespace test
+    {
+        //! a self signed certificate for `name`, as PEM, with a P-256 key or an RSA 2048 one
+        void makeCertificate( const std::string & name, bool isRsa, std::string * certPem, std::string * keyPem )
+        {
+            EVP_PKEY * key = isRsa ? EVP_RSA_gen( 2048 ) : EVP_EC_gen( "P-256" );
+            X509 * cert = X509_new( );
+            if ( !key || !cert )
+                { throw std::exception{ "makeCertificate( )" }; }
+            X509_set_version( cert, 2 );
+            ASN1_INTEGER_set( X509_get_serialNumber( cert ), 1 );
+            X509_gmtime_adj( X509_getm_notBefore( cert ), -60 );
+            X509_gmtime_adj( X509_getm_notAfter( cert ), 60 * 60 * 24 );
+            X509_set_pubkey( cert, key );
+            X509_NAME * subject = X509_get_subject_name( cert );
+            X509_NAME_add_entry_by_txt( subject, "CN", MBSTRING_ASC, (const unsigned char *)name.c_str( ), -1, -1, 0 );
+            X509_set_issuer_name( cert, subject );
+            X509V3_CTX v3;
+            X509V3_set_ctx_nodb( &v3 );
+            X509V3_set_ctx( &v3, cert, cert, nullptr, nullptr, 0 );
+            std::string altName = "DNS:" + name;
+            for ( auto [nid, value] : { std::pair{ NID_subject_alt_name, altName.c_str( ) }, std::pair{ NID_basic_constraints, "critical,CA:TRUE" } } )
+            {
+                if ( X509_EXTENSION * extension = X509V3_EXT_conf_nid( nullptr, &v3, nid, value ) )
+                {
+                    X509_add_ext( cert, extension, -1 );
+                    X509_EXTENSION_free( extension );
+                }
+            }
+            if ( !X509_sign( cert, key, EVP_sha256( ) ) )
+                { throw std::exception{ "makeCertificate( sign )" }; }
+
+            auto toPem = []( auto write )
+                {
+                    BIO * bio = BIO_new( BIO_s_mem( ) );
+                    write( bio );
+                    char * data = nullptr;
+                    long size = BIO_get_mem_data( bio, &data );
+                    std::string pem{ data, (size_t)size };
+                    BIO_free( bio );
+                    return pem;
+                };
+            *certPem = toPem( [&]( BIO * bio ) { PEM_write_bio_X509( bio, cert ); } );
+            *keyPem = toPem( [&]( BIO * bio ) { PEM_write_bio_PrivateKey( bio, key, nullptr, nullptr, 0, nullptr, nullptr ); } );
+            X509_free( cert );
+            EVP_PKEY_free( key );
+        }
+
+        //! runs a handshake between two channels in memory, then one message each way; `elapsed`
+        //! adds the time spent in the server's side
+        using                               Clock = std::chrono::steady_clock;
+
+        bool handshake( TlsServerContext & server, TlsClientContext & client, const std::string & peer, Clock::duration * elapsed = nullptr )
+        {
+            TlsChannel proxy;
+            TlsChannel bot;
+            std::string toProxy;
+            std::string toBot;
+            std::string proxyPlain;
+            std::string botPlain;
+            if ( !proxy.accept( server ) || !bot.connect( client, peer, "", toProxy ) )
+                { throw std::exception{ "handshake( start )" }; }
+            bot.send( "ping", 4, toProxy );
+            for ( int round = 0; !toProxy.empty( ) || !toBot.empty( ); round++ )
+            {
+                if ( round > 16 )
+                    { throw std::exception{ "handshake( rounds )" }; }
+                auto start = Clock::now( );
+                bool isProxyOk = proxy.recv( toProxy.data( ), toProxy.size( ), proxyPlain, toBot );
+                if ( elapsed )
+                    { *elapsed += Clock::now( ) - start; }
+                toProxy.clear( );
+                if ( proxyPlain == "ping" )
+                    { proxy.send( "pong", 4, toBot ); proxyPlain.clear( ); }
+                if ( !isProxyOk || !bot.recv( toBot.data( ), toBot.size( ), botPlain, toProxy ) )
+                    { throw std::exception{ "handshake( recv )" }; }
+                toBot.clear( );
+            }
+            if ( !proxy.isOpen( ) || !bot.isOpen( ) || botPlain != "pong" || proxy.isResumed( ) != bot.isResumed( ) )
+                { throw std::exception{ "handshake( )" }; }
+            return proxy.isResumed( );
+        }
+
+        void testTlsResume( )
+        {
+            std::string certPem;
+            std::string keyPem;
+            makeCertificate( "localhost", false, &certPem, &keyPem );
+            auto keyFile = std::filesystem::temp_directory_path( ) / "grim-test-tickets.keys";
+            std::filesystem::remove( keyFile );
+            TlsServerConfig config;
+            config.ticketKeyFile = keyFile.string( );
+
+            TlsClientContext client;
+            auto server = std::make_unique<TlsServerContext>( );
+            if ( client.openPem( certPem ) != Result::Ok || server->openPem( config, certPem, keyPem ) != Result::Ok )
+                { throw std::exception{ "open( )" }; }
+            if ( handshake( *server, client, "localhost:1" ) || client.sessionCount( ) != 1 )
+                { throw std::exception{ "handshake( full )" }; }
+            if ( !handshake( *server, client, "localhost:1" ) )
+                { throw std::exception{ "handshake( resumed )" }; }
+            // a restarted proxy reads the same ticket keys
+            server = std::make_unique<TlsServerContext>( );
+            if ( server->openPem( config, certPem, keyPem ) != Result::Ok || !handshake( *server, client, "localhost:1" ) )
+                { throw std::exception{ "handshake( restarted )" }; }
+            // without them, its tickets are gone with it
+            config.ticketKeyFile.clear( );
+            server = std::make_unique<TlsServerContext>( );
+            if ( server->openPem( config, certPem, keyPem ) != Result::Ok || handshake( *server, client, "localhost:1" ) )
+                { throw std::exception{ "handshake( new keys )" }; }
+            client.forget( "localhost:1" );
+            if ( client.sessionCount( ) != 0 )
+                { throw std::exception{ "client.forget( )" }; }
+
+            // a certificate from another CA, or for another name, is refused
+            std::string otherCert;
+            std::string otherKey;
+            makeCertificate( "localhost", false, &otherCert, &otherKey );
+            TlsServerContext other;
+            other.openPem( config, otherCert, otherKey );
+            bool isRefused = false;
+            try { handshake( other, client, "localhost:1" ); }
+            catch ( std::exception & ) { isRefused = true; }
+            try { handshake( *server, client, "127.0.0.1:1" ); isRefused = false; }
+            catch ( std::exception & ) { }
+            if ( !isRefused )
+                { throw std::exception{ "handshake( refused )" }; }
+
+            // rotation: a replaced key decrypts (and renews) until its tickets expire
+            std::filesystem::remove( keyFile );
+            TicketKeys keys;
+            keys.setRotation( 60, 600 );
+            if ( keys.open( keyFile, 1000 ) != Result::Ok )
+                { throw std::exception{ "keys.open( )" }; }
+            TicketKeys::Key first;
+            TicketKeys::Key key;
+            bool isCurrent = false;
+            keys.encryptKey( 1000, &first );
+            if ( !keys.encryptKey( 1059, &key ) || key.name != first.name )
+                { throw std::exception{ "keys.encryptKey( )" }; }
+            if ( !keys.encryptKey( 1060, &key ) || key.name == first.name )
+                { throw std::exception{ "keys.encryptKey( rotated )" }; }
+            if ( !keys.decryptKey( first.name.data( ), 1659, &key, &isCurrent ) || isCurrent || key.aesKey != first.aesKey )
+                { throw std::exception{ "keys.decryptKey( )" }; }
+            if ( keys.decryptKey( first.name.data( ), 1660, &key, &isCurrent ) )
+                { throw std::exception{ "keys.decryptKey( expired )" }; }
+            // a second proxy sharing the file encrypts with the same key
+            TicketKeys shared;
+            shared.setRotation( 60, 600 );
+            TicketKeys::Key sharedKey;
+            if ( shared.open( keyFile, 1061 ) != Result::Ok || !shared.encryptKey( 1061, &sharedKey ) || sharedKey.name == first.name )
+                { throw std::exception{ "shared.open( )" }; }
+            keys.encryptKey( 1061, &key );
+            if ( sharedKey.name != key.name )
+                { throw std::exception{ "shared.encryptKey( )" }; }
+#if !defined( _WIN32 )
+            using std::filesystem::perms;
+            if ( ( std::filesystem::status( keyFile ).permissions( ) & ( perms::group_all | perms::others_all ) ) != perms::none )
+                { throw std::exception{ "keys.save( owner only )" }; }
+#endif
+            // each writer's temporary is renamed into place (or removed)
+            for ( auto & entry : std::filesystem::directory_iterator{ keyFile.parent_path( ) } )
+            {
+                auto name = entry.path( ).filename( ).string( );
+                if ( name.starts_with( keyFile.filename( ).string( ) + "." ) && name.ends_with( ".tmp" ) )
+                    { throw std::exception{ "keys.save( temporary )" }; }
+            }
+            std::filesystem::remove( keyFile );
+        }
+
+        void benchTlsResume( size_t clientCount )
+        {
+            auto keyFile = std::filesystem::temp_directory_path( ) / "grim-bench-tickets.keys";
+            TlsServerConfig config;
+            config.ticketKeyFile = keyFile.string( );
+            config.sessionCacheSize = clientCount;
+
+            // a full handshake's cost is mostly the certificate's signature, so both kinds are run
+            for ( bool isRsa : { false, true } )
+            {
+                std::string certPem;
+                std::string keyPem;
+                makeCertificate( "localhost", isRsa, &certPem, &keyPem );
+                std::filesystem::remove( keyFile );
+                // one context for every bot, each with its own session
+                TlsClientContext clients;
+                if ( clients.openPem( certPem ) != Result::Ok )
+                    { throw std::exception{ "benchTlsResume( )" }; }
+
+                auto storm = [&]( const char * name )
+                    {
+                        // each storm meets a proxy just (re)started, with nothing cached but the ticket keys
+                        TlsServerContext server;
+                        if ( server.openPem( config, certPem, keyPem ) != Result::Ok )
+                            { throw std::exception{ "benchTlsResume( open )" }; }
+                        Clock::duration elapsed{ };
+                        size_t resumed = 0;
+                        for ( size_t i = 0; i < clientCount; i++ )
+                            { resumed += handshake( server, clients, "localhost:" + std::to_string( i ), &elapsed ); }
+                        std::chrono::duration<double> seconds = elapsed;
+                        cpp::Log::info( "{} {} : {} handshakes, {} resumed, {:.2f} sec in the proxy, {:.0f} handshakes/sec/core",
+                            isRsa ? "rsa 2048" : "p-256", name, clientCount, resumed, seconds.count( ),
+                            seconds.count( ) > 0 ? clientCount / seconds.count( ) : 0.0 );
+                        return resumed;
+                    };
+                if ( storm( "full" ) != 0 || storm( "resumed" ) != clientCount )
+                    { throw std::exception{ "benchTlsResume( )" }; }
+            }
+            std::filesystem::remove( keyFile );
+        }
+    }
+}
@@ -0,0 +1,502 @@
+module;
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+export module grim.net.transport;
+
+import cpp.asio;
+import cpp.asio.tcp;
+import cpp.log;
+import cpp.memory;
+import grim.arch.net;
+import grim.net.loopback;
+import grim.net.message;
+import grim.net.shm;
+import grim.net.stats;
+import grim.net.tls;
+
+export namespace grim::net
+{
+    //! The listening side of a connection, over tcp or (for a "loop:" address, see LoopServer) in
+    //! process.  The servers use it in place of cpp::TcpServer, so the same code runs either way.
+    //! A tcp client on the same host may move its connection to shared memory (see ShmChannel);
+    //! the tcp connection stays open, and its disconnect still ends the connection.
+    class TransportServer
+    {
+    public:
+        using                               ConnectFn = LoopServer::ConnectFn;
+        using                               RecvFn = LoopServer::RecvFn;
+        using                               DisconnectFn = LoopServer::DisconnectFn;
+
+        //! before open( ): tcp connections are TLS (see grim.net.tls), or plain for nullptr; each
+        //! handshake is counted in `stats` if given.  A connection moved to shared memory leaves
+        //! TLS behind with the tcp connection, as it never leaves the host.
+        void                                setTls( TlsServerContext * tls, NetStats * stats );
+
+        //! a loop address is opened once, `listenAddress6` is only used for tcp
+        void                                open(
+                                                cpp::AsyncContext & io,
+                                                StrArg listenAddress4,
+                                                StrArg listenAddress6,
+                                                ConnectFn,
+                                                RecvFn,
+                                                DisconnectFn );
+        void                                close( );
+        void                                send( const std::string & addr, const cpp::Memory & data );
+        void                                disconnect( const std::string & addr, std::error_code reason );
+    private:
+        void                                receive( const std::string & addr, std::string & recvBuffer );
+
+        struct Peer
+        {
+            //! false until the first bytes show whether the client asked for shared memory
+            bool                            isKnown = false;
+            std::unique_ptr<ShmChannel>     shm;
+            std::unique_ptr<TlsChannel>     tls;
+            //! decrypted, and not yet taken by m_onRecv
+            std::string                     plain;
+        };
+        //! false if the connection is dropped
+        bool                                decrypt( const std::string & addr, Peer & peer, std::string & recvBuffer );
+        void                                sendTcp( const std::string & addr, Peer & peer, const cpp::Memory & data );
+
+        cpp::TcpServer                      m_tcp;
+        LoopServer                          m_loop;
+        bool                                m_isLoop = false;
+        cpp::AsyncContext                   m_io;
+        RecvFn                              m_onRecv;
+        std::map<std::string, Peer>         m_peers;
+        TlsServerContext *                  m_tls = nullptr;
+        NetStats *                          m_tlsStats = nullptr;
+        std::string                         m_tlsOut;
+    };
+
+    //! The connecting side of a connection, see TransportServer.  A tcp connection to this host
+    //! moves to shared memory before onConnect, unless that is turned off or the server refuses.
+    class TransportClient
+    {
+    public:
+        using                               ConnectFn = LoopClient::ConnectFn;
+        using                               RecvFn = LoopClient::RecvFn;
+        using                               DisconnectFn = LoopClient::DisconnectFn;
+
+        void                                setShm( bool isEnabled );
+        //! tcp connections made after are TLS, resuming the session `tls` kept from the last
+        //! connection to the same address; the certificate must name the host in `nameAddr` (the
+        //! address before it was resolved), or in the address connected to if it is empty.
+        //! nullptr for none, when the cpp::TcpClient's own is used with connect( )'s `caFilename`.
+        void                                setTls( TlsClientContext * tls, std::string nameAddr );
+
+        void                                connect(
+                                                cpp::AsyncContext & io,
+                                                StrArg addr,
+                                                ConnectFn,
+                                                RecvFn,
+                                                DisconnectFn,
+                                                const std::string & caFilename );
+        void                                send( const cpp::Memory & data );
+        void                                disconnect( );
+        //! true once connected over TLS with a resumed session
+        bool                                isResumed( ) const;
+    private:
+        //! once connected (and through the TLS handshake), asks for shared memory if it may
+        void                                didConnect( std::error_code error, ConnectFn onConnect );
+        void                                sendTcp( const cpp::Memory & data );
+
+        cpp::TcpClient                      m_tcp;
+        LoopClient                          m_loop;
+        bool                                m_isLoop = false;
+        bool                                m_isShmEnabled = true;
+        bool                                m_isUpgrade = false;
+        //! asked for, until the server's reply
+        std::unique_ptr<ShmChannel>         m_pendingShm;
+        std::unique_ptr<ShmChannel>         m_shm;
+        //! until the handshake or the server's reply to the shared memory request
+        ConnectFn                           m_onConnect;
+        TlsClientContext *                  m_tls = nullptr;
+        std::string                         m_tlsName;
+        std::unique_ptr<TlsChannel>         m_channel;
+        std::string                         m_plain;
+        std::string                         m_tlsOut;
+    };
+
+    namespace test
+    {
+        //! zone to view object updates, one way, over loopback tcp and then shared memory
+        void                                benchShm( size_t updateCount = 1000000 );
+    };
+}
+
+namespace grim::net
+{
+    void TransportServer::setTls( TlsServerContext * tls, NetStats * stats )
+    {
+        m_tls = tls;
+        m_tlsStats = stats;
+    }
+
+    void TransportServer::open(
+            cpp::AsyncContext & io,
+            StrArg listenAddress4,
+            StrArg listenAddress6,
+            ConnectFn onConnect,
+            RecvFn onRecv,
+            DisconnectFn onDisconnect )
+    {
+        m_isLoop = isLoopAddress( std::string_view{ listenAddress4.data( ), listenAddress4.length( ) } );
+        if ( m_isLoop )
+            { m_loop.open( io, listenAddress4, std::move( onConnect ), std::move( onRecv ), std::move( onDisconnect ) ); }
+        else
+        {
+            m_io = io;
+            m_onRecv = std::move( onRecv );
+            m_tcp.open( io, listenAddress4, listenAddress6,
+                [this, onConnect = std::move( onConnect )]( std::error_code acceptError, const std::string & addr )
+                {
+                    // the client speaks first, so the handshake starts with its first bytes
+                    if ( !acceptError && m_tls )
+                    {
+                        auto & peer = m_peers[addr];
+                        peer.tls = std::make_unique<TlsChannel>( );
+                        peer.tls->accept( *m_tls );
+                    }
+                    onConnect( acceptError, addr );
+                },
+                [this]( const std::string & addr, std::string & recvBuffer )
+                    { receive( addr, recvBuffer ); },
+                [this, onDisconnect = std::move( onDisconnect )]( const std::string & addr, std::error_code reason )
+                {
+                    m_peers.erase( addr );
+                    onDisconnect( addr, reason );
+                },
+                nullptr );
+        }
+    }
+
+    void TransportServer::receive( const std::string & addr, std::string & recvBuffer )
+    {
+        auto & peer = m_peers[addr];
+        std::string * buffer = &recvBuffer;
+        if ( peer.tls )
+        {
+            if ( !decrypt( addr, peer, recvBuffer ) )
+                { return; }
+            buffer = &peer.plain;
+        }
+        if ( !peer.isKnown )
+        {
+            std::string name;
+            switch ( decodeShmRequest( *buffer, &name ) )
+            {
+            case ShmPreamble::Partial:
+                return;
+            case ShmPreamble::Found:
+            {
+                // a client on another host names a segment which is not here, and stays on tcp
+                auto shm = std::make_unique<ShmChannel>( );
+                bool isOpen = shm->open( name );
+                sendTcp( addr, peer, encodeShmReply( isOpen ) );
+                if ( isOpen )
+                {
+                    shm->start( m_io, [this, addr]( std::string & shmBuffer )
+                        { m_onRecv( addr, shmBuffer ); } );
+                    peer.shm = std::move( shm );
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            peer.isKnown = true;
+            if ( buffer->empty( ) )
+                { return; }
+        }
+        m_onRecv( addr, *buffer );
+    }
+
+    bool TransportServer::decrypt( const std::string & addr, Peer & peer, std::string & recvBuffer )
+    {
+        bool wasOpen = peer.tls->isOpen( );
+        m_tlsOut.clear( );
+        bool isOk = peer.tls->recv( recvBuffer.data( ), recvBuffer.size( ), peer.plain, m_tlsOut );
+        recvBuffer.clear( );
+        if ( !m_tlsOut.empty( ) )
+            { m_tcp.send( addr, m_tlsOut ); }
+        if ( !isOk )
+        {
+            m_io.post( [this, addr]( ) { m_tcp.disconnect( addr, std::make_error_code( std::errc::protocol_error ) ); } );
+            return false;
+        }
+        if ( !wasOpen && peer.tls->isOpen( ) && m_tlsStats )
+        {
+            m_tlsStats->handshakes.add( );
+            if ( peer.tls->isResumed( ) )
+                { m_tlsStats->resumedHandshakes.add( ); }
+        }
+        return !peer.plain.empty( );
+    }
+
+    void TransportServer::sendTcp( const std::string & addr, Peer & peer, const cpp::Memory & data )
+    {
+        if ( !peer.tls )
+            { m_tcp.send( addr, data ); return; }
+        m_tlsOut.clear( );
+        if ( peer.tls->send( data.data( ), data.length( ), m_tlsOut ) && !m_tlsOut.empty( ) )
+            { m_tcp.send( addr, m_tlsOut ); }
+    }
+
+    void TransportServer::close( )
+    {
+        if ( m_isLoop )
+            { m_loop.close( ); }
+        else
+        {
+            m_peers.clear( );
+            m_tcp.close( );
+        }
+    }
+
+    void TransportServer::send( const std::string & addr, const cpp::Memory & data )
+    {
+        if ( m_isLoop )
+            { m_loop.send( addr, data ); return; }
+        auto itr = m_peers.find( addr );
+        if ( itr != m_peers.end( ) && itr->second.shm )
+            { itr->second.shm->send( data ); }
+        else if ( itr != m_peers.end( ) )
+            { sendTcp( addr, itr->second, data ); }
+        // with TLS every connection has a peer, so this one is gone
+        else if ( !m_tls )
+            { m_tcp.send( addr, data ); }
+    }
+
+    void TransportServer::disconnect( const std::string & addr, std::error_code reason )
+    {
+        if ( m_isLoop )
+            { m_loop.disconnect( addr, reason ); }
+        else
+            { m_tcp.disconnect( addr, reason ); }
+    }
+
+    void TransportClient::setShm( bool isEnabled )
+    {
+        m_isShmEnabled = isEnabled;
+    }
+
+    void TransportClient::setTls( TlsClientContext * tls, std::string nameAddr )
+    {
+        m_tls = tls;
+        m_tlsName = std::move( nameAddr );
+    }
+
+    void TransportClient::connect(
+            cpp::AsyncContext & io,
+            StrArg addr,
+            ConnectFn onConnect,
+            RecvFn onRecv,
+            DisconnectFn onDisconnect,
+            const std::string & caFilename )
+    {
+        m_isLoop = isLoopAddress( std::string_view{ addr.data( ), addr.length( ) } );
+        if ( m_isLoop )
+            { m_loop.connect( io, addr, std::move( onConnect ), std::move( onRecv ), std::move( onDisconnect ) ); }
+        else
+        {
+            m_pendingShm.reset( );
+            m_shm.reset( );
+            m_channel.reset( );
+            m_plain.clear( );
+            m_onConnect = nullptr;
+            std::string peer{ addr.data( ), addr.length( ) };
+            m_isUpgrade = m_isShmEnabled && isLocalAddress( peer );
+            m_tcp.connect( *io, addr,
+                [this, io, peer, onConnect = std::move( onConnect )]( std::error_code error ) mutable
+                {
+                    if ( error || !m_tls )
+                        { didConnect( error, onConnect ); return; }
+                    // onConnect waits for the handshake
+                    m_channel = std::make_unique<TlsChannel>( );
+                    m_onConnect = onConnect;
+                    m_tlsOut.clear( );
+                    bool isOk = m_channel->connect( *m_tls, peer, m_tlsName, m_tlsOut );
+                    if ( !m_tlsOut.empty( ) )
+                        { m_tcp.send( m_tlsOut ); }
+                    if ( !isOk )
+                        { io.post( [this]( ) { m_tcp.disconnect( ); } ); }
+                },
+                [this, io, onRecv]( std::string & recvBuffer ) mutable
+                {
+                    std::string * buffer = &recvBuffer;
+                    if ( m_channel )
+                    {
+                        bool wasOpen = m_channel->isOpen( );
+                        m_tlsOut.clear( );
+                        bool isOk = m_channel->recv( recvBuffer.data( ), recvBuffer.size( ), m_plain, m_tlsOut );
+                        recvBuffer.clear( );
+                        if ( !m_tlsOut.empty( ) )
+                            { m_tcp.send( m_tlsOut ); }
+                        if ( !isOk )
+                            { io.post( [this]( ) { m_tcp.disconnect( ); } ); return; }
+                        if ( !wasOpen && m_channel->isOpen( ) )
+                        {
+                            auto onConnect = std::move( m_onConnect );
+                            m_onConnect = nullptr;
+                            didConnect( std::error_code{ }, onConnect );
+                        }
+                        buffer = &m_plain;
+                        if ( buffer->empty( ) )
+                            { return; }
+                    }
+                    if ( m_pendingShm )
+                    {
+                        bool isAccepted = false;
+                        if ( decodeShmReply( *buffer, &isAccepted ) == ShmPreamble::Partial )
+                            { return; }
+                        auto shm = std::move( m_pendingShm );
+                        shm->unlink( );
+                        if ( isAccepted )
+                        {
+                            shm->start( io, onRecv );
+                            m_shm = std::move( shm );
+                        }
+                        auto onConnect = std::move( m_onConnect );
+                        onConnect( std::error_code{ } );
+                        if ( buffer->empty( ) )
+                            { return; }
+                    }
+                    onRecv( *buffer );
+                },
+                [this, onDisconnect = std::move( onDisconnect )]( std::error_code reason )
+                {
+                    if ( m_pendingShm )
+                        { m_pendingShm->unlink( ); }
+                    m_pendingShm.reset( );
+                    m_onConnect = nullptr;
+                    m_shm.reset( );
+                    m_channel.reset( );
+                    m_plain.clear( );
+                    onDisconnect( reason );
+                },
+                m_tls ? std::string{ } : caFilename );
+        }
+    }
+
+    void TransportClient::didConnect( std::error_code error, ConnectFn onConnect )
+    {
+        auto shm = std::make_unique<ShmChannel>( );
+        if ( error || !m_isUpgrade || !shm->create( ) )
+            { onConnect( error ); return; }
+        // onConnect waits for the reply, so nothing is sent over tcp after the request
+        sendTcp( encodeShmRequest( shm->name( ) ) );
+        m_pendingShm = std::move( shm );
+        m_onConnect = onConnect;
+    }
+
+    void TransportClient::send( const cpp::Memory & data )
+    {
+        if ( m_isLoop )
+            { m_loop.send( data ); }
+        else if ( m_shm )
+            { m_shm->send( data ); }
+        else
+            { sendTcp( data ); }
+    }
+
+    void TransportClient::sendTcp( const cpp::Memory & data )
+    {
+        if ( !m_channel )
+            { m_tcp.send( data ); return; }
+        m_tlsOut.clear( );
+        if ( m_channel->send( data.data( ), data.length( ), m_tlsOut ) && !m_tlsOut.empty( ) )
+            { m_tcp.send( m_tlsOut ); }
+    }
+
+    bool TransportClient::isResumed( ) const
+    {
+        return m_channel && m_channel->isResumed( );
+    }
+
+    void TransportClient::disconnect( )
+    {
+        if ( m_isLoop )
+            { m_loop.disconnect( ); }
+        else
+            { m_tcp.disconnect( ); }
+    }
+
+    namespace test
+    {
+        void benchShm( size_t updateCount )
+        {
+            using Clock = std::chrono::steady_clock;
+            // an updateObject: object ref, position, velocity and state
+            std::string payload( 48, 'x' );
+            Message update{ };
+            update.len = payload.size( ) / MessageAlignment;
+            update.bind = 1;
+            update.type = 7;
+            MessageWriter batch;
+            const size_t BatchSize = 256;
+            for ( size_t i = 0; i < BatchSize; i++ )
+                { batch.put( update, payload ); }
+
+            auto run = [&]( const char * addr, bool isShm )
+                {
+                    cpp::AsyncContext io;
+                    TransportServer view;
+                    TransportClient zone;
+                    MessageReader reader;
+                    size_t received = 0;
+                    size_t sent = 0;
+                    Clock::time_point start;
+                    std::function<void( )> sendBatch = [&]( )
+                        {
+                            zone.send( batch.getAll( ) );
+                            sent += BatchSize;
+                            if ( sent < updateCount )
+                                { io.post( sendBatch ); }
+                        };
+
+                    view.open( io, addr, "",
+                        []( std::error_code, const std::string & ) { },
+                        [&]( const std::string &, std::string & recvBuffer )
+                        {
+                            reader.read( recvBuffer, [&]( const Message &, const cpp::Memory & )
+                                { received++; } );
+                            if ( received >= updateCount )
+                                { zone.disconnect( ); view.close( ); }
+                        },
+                        []( const std::string &, std::error_code ) { } );
+                    zone.setShm( isShm );
+                    zone.connect( io, addr,
+                        [&]( std::error_code error )
+                        {
+                            if ( error )
+                                { view.close( ); return; }
+                            start = Clock::now( );
+                            sendBatch( );
+                        },
+                        []( std::string & ) { },
+                        []( std::error_code ) { }, "" );
+                    io.run( );
+                    std::chrono::duration<double> elapsed = Clock::now( ) - start;
+
+                    if ( received < updateCount )
+                        { throw std::exception{ "benchShm( )" }; }
+                    double perSecond = elapsed.count( ) > 0 ? received / elapsed.count( ) : 0.0;
+                    cpp::Log::info( "{} : {} updates in {:.2f} sec, {:.0f} updates/sec, {:.0f} MB/sec",
+                        isShm ? "shm" : "loopback tcp", received, elapsed.count( ), perSecond,
+                        perSecond * ( MessageHeaderSize + payload.size( ) ) / ( 1 << 20 ) );
+                };
+            run( "127.0.0.1:43301", false );
+            run( "127.0.0.1:43302", true );
+        }
+    }
+}
@@ -1,8 +1,8 @@
-module;
-
-export module grim.arch;
-
-export namespace grim::arch
-{
-
-}
+module;
+
+export module grim.arch;
+
+export namespace grim::arch
+{
+
+}
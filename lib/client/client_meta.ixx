@@ -1,8 +1,8 @@
-module;
-
-export module grim.client.meta;
-
-export namespace grim::client
-{
-
-}
+module;
+
+export module grim.client.meta;
+
+export namespace grim::client
+{
+
+}
@@ -1,8 +1,8 @@
-module;
-
-export module grim.server.meta;
-
-export namespace grim::server
-{
-
-}
+module;
+
+export module grim.server.meta;
+
+export namespace grim::server
+{
+
+}
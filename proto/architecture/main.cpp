@@ -1,14 +1,14 @@
-#include <cinttypes>
-#include <filesystem>
-
-import cpp.program;
-import cpp.asio;
-import grim.auth;
-import grim.net;
-
-int main(int argc, char ** argv)
-{
-    cpp::Program program;
-    cpp::AsyncContext io;
-
+#include <cinttypes>
+#include <filesystem>
+
+import cpp.program;
+import cpp.asio;
+import grim.auth;
+import grim.net;
+
+int main(int argc, char ** argv)
+{
+    cpp::Program program;
+    cpp::AsyncContext io;
+
 }
\ No newline at end of file
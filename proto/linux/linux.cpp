@@ -1,12 +1,12 @@
-﻿// linux.cpp : Defines the entry point for the application.
-//
-
-#include "linux.h"
-
-using namespace std;
-
-int main( )
-{
-	cout << "Hello CMake." << endl;
-	return 0;
-}
+﻿// linux.cpp : Defines the entry point for the application.
+//
+
+#include "linux.h"
+
+using namespace std;
+
+int main( )
+{
+	cout << "Hello CMake." << endl;
+	return 0;
+}
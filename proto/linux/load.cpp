@@ -0,0 +1,547 @@
+// grimnet-load: end to end load generator for grimnet.
+//
+// Starts a session server, N proxy servers and thousands of synthetic clients in one process, drives
+// a weighted mix of hello, rello, request/reply and fan-out traffic for a fixed time, then reports each
+// operation's throughput and p50/p99/p999 latency, followed by the clients', proxies' and session
+// server's NetStats.  With --storm-at, proxy 0 is closed part way through; its clients reconnect to
+// the other proxies and the time from each disconnect to ready again is reported as "recover".
+//
+//   grimnet-load --clients 5000 --proxies 4 --threads 8 --seconds 60 --rate 10
+//                --mix hello=1,rello=1,request=16,fanout=2 --fanout 16 --storm-at 20
+//
+// What each operation measures:
+//   hello      a client is closed and replaced by a new one; open( ) to ready
+//   rello      a client drops its connection (Client::reconnect); disconnect to ready
+//   request    a ProbeRequest answered by the client's proxy; send to reply
+//   fanout     one notification sent to --fanout random sessions on the sender's proxy (on any of its
+//              shards, proxies do not relay to each other); send to arrival, per receiver
+//   recover    an unplanned disconnect (the storm); disconnect to ready
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+import cpp.program;
+import cpp.asio;
+import grim.arch.auth;
+import grim.net;
+
+namespace
+{
+    using                                   Clock = std::chrono::steady_clock;
+
+    enum class                              Op : uint8_t { Hello, Rello, Request, Fanout, Recover };
+    constexpr size_t                        OpCount = 5;
+    constexpr const char *                  OpNames[OpCount] = { "hello", "rello", "request", "fanout", "recover" };
+    //! the operations picked by weight; recover only follows a disconnect
+    constexpr size_t                        MixCount = 4;
+
+    //! an application message type, clear of the proxy's and StatsMessageType
+    constexpr uint8_t                       FanoutType = 0x40;
+    //! the send time (steady clock nanoseconds) followed by padding
+    constexpr size_t                        FanoutSize = 64;
+    constexpr int                           TickMillis = 10;
+    //! after the run, for replies and fan-outs in flight to arrive before the report
+    constexpr int                           SettleMillis = 1000;
+
+    struct Options
+    {
+        std::string                         email = "monkeysmarts@gmail.com";
+        uint16_t                            sessionPort = 47000;
+        //! proxy N listens on proxyPort + N * shardCount (and its shard M on that port + M)
+        uint16_t                            proxyPort = 47100;
+        uint32_t                            proxyCount = 2;
+        uint32_t                            shardCount = 1;
+        size_t                              clientCount = 2000;
+        size_t                              threadCount = 4;
+        int                                 seconds = 30;
+        //! operations started per second, per client
+        double                              rate = 10;
+        //! relative weights of hello, rello, request and fanout
+        std::array<uint32_t, MixCount>      mix = { 1, 1, 16, 2 };
+        //! sessions each fan-out is sent to
+        uint32_t                            fanout = 16;
+        //! seconds into the run at which proxy 0 is closed; 0 for no storm
+        int                                 stormAt = 0;
+    };
+
+    bool parseMix( const std::string & text, Options * options )
+    {
+        options->mix.fill( 0 );
+        size_t offset = 0;
+        while ( offset < text.length( ) )
+        {
+            size_t end = text.find( ',', offset );
+            if ( end == std::string::npos )
+                { end = text.length( ); }
+            std::string item = text.substr( offset, end - offset );
+            size_t equals = item.find( '=' );
+            if ( equals == std::string::npos )
+                { return false; }
+            std::string name = item.substr( 0, equals );
+            size_t op = 0;
+            while ( op < MixCount && name != OpNames[op] )
+                { op++; }
+            if ( op == MixCount )
+                { return false; }
+            options->mix[op] = (uint32_t)std::stoul( item.substr( equals + 1 ) );
+            offset = end + 1;
+        }
+        return options->mix[0] + options->mix[1] + options->mix[2] + options->mix[3] > 0;
+    }
+
+    bool parseOptions( int argc, const char ** argv, Options * options )
+    {
+        for ( int i = 1; i + 1 < argc; i += 2 )
+        {
+            std::string name = argv[i];
+            std::string value = argv[i + 1];
+            if ( name == "--email" )
+                { options->email = value; }
+            else if ( name == "--session-port" )
+                { options->sessionPort = (uint16_t)std::stoul( value ); }
+            else if ( name == "--proxy-port" )
+                { options->proxyPort = (uint16_t)std::stoul( value ); }
+            else if ( name == "--proxies" )
+                { options->proxyCount = (uint32_t)std::stoul( value ); }
+            else if ( name == "--shards" )
+                { options->shardCount = (uint32_t)std::stoul( value ); }
+            else if ( name == "--clients" )
+                { options->clientCount = std::stoul( value ); }
+            else if ( name == "--threads" )
+                { options->threadCount = std::stoul( value ); }
+            else if ( name == "--seconds" )
+                { options->seconds = std::stoi( value ); }
+            else if ( name == "--rate" )
+                { options->rate = std::stod( value ); }
+            else if ( name == "--mix" )
+                { if ( !parseMix( value, options ) ) { return false; } }
+            else if ( name == "--fanout" )
+                { options->fanout = (uint32_t)std::stoul( value ); }
+            else if ( name == "--storm-at" )
+                { options->stormAt = std::stoi( value ); }
+            else
+                { return false; }
+        }
+        return ( argc % 2 ) == 1 && options->proxyCount > 0 && options->shardCount > 0
+            && options->clientCount > 0 && options->threadCount > 0 && options->seconds > 0;
+    }
+
+    struct Worker;
+
+    //! one synthetic client; only touched on its worker's thread
+    struct Bot
+    {
+        Worker *                            worker = nullptr;
+        size_t                              index = 0;
+        std::unique_ptr<grim::net::Client>  client;
+        bool                                isReady = false;
+        //! a hello, rello or recovery in flight, timed to the next ready
+        bool                                isPending = false;
+        Op                                  pendingOp = Op::Hello;
+        Clock::time_point                   pendingStart;
+    };
+
+    //! an io context and thread with its share of the clients
+    struct Worker
+    {
+        cpp::AsyncContext                   io;
+        std::thread                         thread;
+        std::vector<std::unique_ptr<Bot>>   bots;
+        //! written on this worker's thread only, read by the report (see grim.net.stats)
+        std::array<grim::net::LatencyHistogram, OpCount> latency;
+        std::array<grim::net::StatCounter, OpCount> done;
+        std::array<grim::net::StatCounter, OpCount> failed;
+        grim::net::StatCounter              fanoutSent;
+        //! operations not started since the client picked was not ready
+        grim::net::StatCounter              busy;
+        cpp::AsyncTimer                     tickTimer;
+        double                              due = 0;
+        std::mt19937_64                     random;
+        //! closed clients, kept until the run ends since their io may still be in flight
+        std::vector<std::unique_ptr<grim::net::Client>> retired;
+    };
+
+    class LoadGenerator
+    {
+    public:
+        explicit                            LoadGenerator( const Options & options );
+        bool                                open( cpp::AsyncContext & io );
+        void                                run( cpp::AsyncContext & io );
+    private:
+        void                                openBot( Bot & bot );
+        void                                didReady( Bot & bot, grim::net::Result result );
+        void                                didDisconnect( Bot & bot );
+        void                                didRecv( Bot & bot, const grim::net::Message & message, grim::net::StrArg data );
+        void                                tick( Worker & worker );
+        Op                                  pickOp( Worker & worker );
+        void                                start( Bot & bot, Op op );
+        void                                storm( );
+        void                                report( ) const;
+    private:
+        Options                             options;
+        std::string                         proxyAddrs;
+        grim::net::SessionServer            sessionServer;
+        std::vector<std::unique_ptr<grim::net::ProxyServer>> proxies;
+        std::vector<std::unique_ptr<Worker>> workers;
+        //! each client's session, for fan-out targets; 0 while it has none
+        std::vector<std::atomic<uint64_t>>  sessionIds;
+        //! each client's proxy, as fan-outs only go to sessions on the sender's
+        std::vector<std::atomic<uint32_t>>  proxyIndexes;
+        std::atomic<bool>                   isRunning = false;
+        Clock::time_point                   startTime;
+        Clock::time_point                   stopTime;
+    };
+
+    LoadGenerator::LoadGenerator( const Options & options )
+        : options( options ), sessionIds( options.clientCount ), proxyIndexes( options.clientCount )
+    {
+        // each proxy's first port; its probe reply tells a client which of its shards to use
+        for ( uint32_t i = 0; i < options.proxyCount; i++ )
+        {
+            if ( i )
+                { proxyAddrs += ","; }
+            proxyAddrs += std::format( "127.0.0.1:{}", options.proxyPort + i * options.shardCount );
+        }
+    }
+
+    bool LoadGenerator::open( cpp::AsyncContext & io )
+    {
+        grim::net::Result result;
+        std::string email;
+        uint64_t sessionId = 0;
+        sessionServer.open( io, std::format( "127.0.0.1:{}", options.sessionPort ), std::format( "[::1]:{}", options.sessionPort ), options.email );
+        if ( !sessionServer.auth( 5, &email, &sessionId, &result ) || !sessionServer.ready( 5, &result ) )
+        {
+            cpp::Log::error( "session server not ready, result={}", (int)result );
+            return false;
+        }
+        for ( uint32_t i = 0; i < options.proxyCount; i++ )
+        {
+            uint16_t port = (uint16_t)( options.proxyPort + i * options.shardCount );
+            auto & proxy = proxies.emplace_back( std::make_unique<grim::net::ProxyServer>( ) );
+            proxy->open( io, std::format( "127.0.0.1:{}", port ), std::format( "[::1]:{}", port ),
+                std::format( "[::1]:{}", options.sessionPort ), options.email, (uint8_t)i, options.shardCount );
+            if ( !proxy->auth( 5, &email, &sessionId, &result ) || !proxy->ready( 5, &result ) )
+            {
+                cpp::Log::error( "proxy {} not ready, result={}", i, (int)result );
+                return false;
+            }
+        }
+        cpp::Log::info( "{} proxies ready: {}", options.proxyCount, proxyAddrs );
+        return true;
+    }
+
+    void LoadGenerator::run( cpp::AsyncContext & io )
+    {
+        for ( size_t i = 0; i < options.threadCount; i++ )
+        {
+            auto & worker = workers.emplace_back( std::make_unique<Worker>( ) );
+            worker->random.seed( i + 1 );
+        }
+        for ( size_t i = 0; i < options.clientCount; i++ )
+        {
+            Worker & worker = *workers[i % workers.size( )];
+            auto & bot = worker.bots.emplace_back( std::make_unique<Bot>( ) );
+            bot->worker = &worker;
+            bot->index = i;
+        }
+
+        isRunning = true;
+        startTime = Clock::now( );
+        for ( auto & worker : workers )
+        {
+            Worker * w = worker.get( );
+            // every client's first hello is timed, so the run opens with a connect storm of its own
+            w->io.post( [this, w]( )
+                {
+                    for ( auto & bot : w->bots )
+                    {
+                        bot->isPending = true;
+                        bot->pendingOp = Op::Hello;
+                        bot->pendingStart = Clock::now( );
+                        openBot( *bot );
+                    }
+                    tick( *w );
+                } );
+            w->thread = std::thread{ [w]( ) { w->io.run( ); } };
+        }
+
+        cpp::AsyncTimer stormTimer;
+        if ( options.stormAt > 0 && options.stormAt < options.seconds )
+            { stormTimer = io.waitFor( cpp::Duration::ofSeconds( options.stormAt ), [this]( ) { storm( ); } ); }
+        cpp::AsyncTimer stopTimer = io.waitFor( cpp::Duration::ofSeconds( options.seconds ), [this, &io]( )
+            {
+                isRunning = false;
+                stopTime = Clock::now( );
+                io.waitFor( cpp::Duration::ofMillis( SettleMillis ), [this]( )
+                    {
+                        report( );
+                        // thousands of clients and their servers are not torn down one by one: the
+                        // run ends with the process
+                        std::quick_exit( 0 );
+                    } );
+            } );
+        io.run( );
+    }
+
+    void LoadGenerator::openBot( Bot & bot )
+    {
+        bot.client = std::make_unique<grim::net::Client>( );
+        grim::net::Client & client = *bot.client;
+        client.onConnect( [this, &bot]( grim::net::Result result, grim::net::StrArg addr, std::string reason )
+            {
+                // proxy N's shards listen on proxyPort + N * shardCount and up
+                std::string_view view{ addr.data( ), addr.length( ) };
+                size_t colon = view.find_last_of( ':' );
+                if ( result == grim::net::Result::Ok && colon != std::string_view::npos )
+                    { proxyIndexes[bot.index] = (uint32_t)( ( std::stoul( std::string{ view.substr( colon + 1 ) } ) - options.proxyPort ) / options.shardCount ); }
+            } );
+        client.onAuth( [this, &bot]( grim::net::Result result, grim::net::StrArg email, uint64_t sessionId )
+            {
+                if ( result == grim::net::Result::Ok )
+                    { sessionIds[bot.index] = sessionId; }
+            } );
+        client.onReady( [this, &bot]( grim::net::Result result )
+            { didReady( bot, result ); } );
+        client.onDisconnect( [this, &bot]( grim::net::Result result, grim::net::StrArg addr, std::string reason )
+            { didDisconnect( bot ); } );
+        client.onRecv( [this, &bot]( const grim::net::Message & message, grim::net::StrArg data )
+            { didRecv( bot, message, data ); } );
+        client.open( bot.worker->io, options.email, grim::auth::AuthToken{ 1 }, proxyAddrs );
+    }
+
+    void LoadGenerator::didReady( Bot & bot, grim::net::Result result )
+    {
+        Worker & worker = *bot.worker;
+        if ( result != grim::net::Result::Ok )
+        {
+            if ( bot.isPending )
+                { worker.failed[(size_t)bot.pendingOp].add( ); }
+            bot.isPending = false;
+            return;
+        }
+        bot.isReady = true;
+        if ( bot.isPending )
+        {
+            worker.latency[(size_t)bot.pendingOp].record( Clock::now( ) - bot.pendingStart );
+            worker.done[(size_t)bot.pendingOp].add( );
+            bot.isPending = false;
+        }
+    }
+
+    void LoadGenerator::didDisconnect( Bot & bot )
+    {
+        bot.isReady = false;
+        // a rello's own disconnect is already timed
+        if ( bot.isPending || !isRunning )
+            { return; }
+        bot.isPending = true;
+        bot.pendingOp = Op::Recover;
+        bot.pendingStart = Clock::now( );
+    }
+
+    void LoadGenerator::didRecv( Bot & bot, const grim::net::Message & message, grim::net::StrArg data )
+    {
+        if ( message.type != FanoutType || data.length( ) < sizeof( uint64_t ) )
+            { return; }
+        uint64_t sent;
+        std::memcpy( &sent, data.data( ), sizeof( sent ) );
+        uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now( ).time_since_epoch( ) ).count( );
+        Worker & worker = *bot.worker;
+        worker.latency[(size_t)Op::Fanout].record( now > sent ? now - sent : 0 );
+        worker.done[(size_t)Op::Fanout].add( );
+    }
+
+    void LoadGenerator::tick( Worker & worker )
+    {
+        if ( !isRunning )
+            { return; }
+        worker.due += worker.bots.size( ) * options.rate * TickMillis / 1000.0;
+        for ( ; worker.due >= 1; worker.due-- )
+        {
+            Bot & bot = *worker.bots[worker.random( ) % worker.bots.size( )];
+            if ( bot.isReady && !bot.isPending )
+                { start( bot, pickOp( worker ) ); }
+            else
+                { worker.busy.add( ); }
+        }
+        worker.tickTimer = worker.io.waitFor( cpp::Duration::ofMillis( TickMillis ), [this, &worker]( ) { tick( worker ); } );
+    }
+
+    Op LoadGenerator::pickOp( Worker & worker )
+    {
+        uint32_t total = 0;
+        for ( uint32_t weight : options.mix )
+            { total += weight; }
+        uint32_t pick = (uint32_t)( worker.random( ) % total );
+        size_t op = 0;
+        while ( pick >= options.mix[op] )
+            { pick -= options.mix[op++]; }
+        return (Op)op;
+    }
+
+    void LoadGenerator::start( Bot & bot, Op op )
+    {
+        Worker & worker = *bot.worker;
+        switch ( op )
+        {
+        case Op::Hello:
+            {
+                // a new session from a new client; the old one is closed quietly
+                grim::net::Client & client = *bot.client;
+                client.onAuth( { } );
+                client.onReady( { } );
+                client.onDisconnect( { } );
+                client.onRecv( { } );
+                client.close( );
+                worker.retired.push_back( std::move( bot.client ) );
+                sessionIds[bot.index] = 0;
+                bot.isReady = false;
+                bot.isPending = true;
+                bot.pendingOp = Op::Hello;
+                bot.pendingStart = Clock::now( );
+                openBot( bot );
+                break;
+            }
+        case Op::Rello:
+            bot.isReady = false;
+            bot.isPending = true;
+            bot.pendingOp = Op::Rello;
+            bot.pendingStart = Clock::now( );
+            bot.client->reconnect( );
+            break;
+        case Op::Request:
+            {
+                auto sent = Clock::now( );
+                bot.client->send( 0, grim::net::ProbeRequest{ }, [&worker, sent]( const grim::net::Message & message, grim::net::StrArg data )
+                    {
+                        if ( message.result != (uint8_t)grim::net::Result::Ok )
+                            { worker.failed[(size_t)Op::Request].add( ); return; }
+                        worker.latency[(size_t)Op::Request].record( Clock::now( ) - sent );
+                        worker.done[(size_t)Op::Request].add( );
+                    } );
+                break;
+            }
+        case Op::Fanout:
+            {
+                std::string payload( FanoutSize, '\0' );
+                uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now( ).time_since_epoch( ) ).count( );
+                std::memcpy( payload.data( ), &now, sizeof( now ) );
+                uint32_t proxyIndex = proxyIndexes[bot.index];
+                for ( uint32_t i = 0; i < options.fanout; i++ )
+                {
+                    // a few tries for a session on the same proxy, with several proxies most are not
+                    uint64_t toSessionId = 0;
+                    for ( int tries = 0; tries < 8 && !toSessionId; tries++ )
+                    {
+                        size_t index = worker.random( ) % sessionIds.size( );
+                        if ( proxyIndexes[index] == proxyIndex )
+                            { toSessionId = sessionIds[index]; }
+                    }
+                    if ( !toSessionId )
+                        { continue; }
+                    bot.client->send( toSessionId, 0, 0, FanoutType, 0, payload );
+                    worker.fanoutSent.add( );
+                }
+                break;
+            }
+        case Op::Recover:
+            break;
+        }
+    }
+
+    void LoadGenerator::storm( )
+    {
+        cpp::Log::info( "storm: closing proxy 0 at {}s", options.stormAt );
+        proxies[0]->close( );
+    }
+
+    void LoadGenerator::report( ) const
+    {
+        double seconds = std::chrono::duration<double>( stopTime - startTime ).count( );
+        std::array<grim::net::LatencyHistogram, OpCount> latency;
+        std::array<uint64_t, OpCount> done{ };
+        std::array<uint64_t, OpCount> failed{ };
+        uint64_t fanoutSent = 0;
+        uint64_t busy = 0;
+        grim::net::NetStats clientStats;
+        for ( auto & worker : workers )
+        {
+            for ( size_t op = 0; op < OpCount; op++ )
+            {
+                worker->latency[op].addTo( latency[op] );
+                done[op] += worker->done[op].get( );
+                failed[op] += worker->failed[op].get( );
+            }
+            fanoutSent += worker->fanoutSent.get( );
+            busy += worker->busy.get( );
+            for ( auto & bot : worker->bots )
+                { bot->client->stats( ).addTo( clientStats ); }
+        }
+
+        cpp::Log::info( "grimnet-load: {} clients on {} threads, {} proxies x {} shards, {:.1f}s{}",
+            options.clientCount, options.threadCount, options.proxyCount, options.shardCount, seconds,
+            options.stormAt ? std::format( ", proxy 0 closed at {}s", options.stormAt ) : "" );
+        cpp::Log::info( "{:<10}{:>12}{:>10}{:>12}{:>10}{:>10}{:>10}{:>10}", "op", "done", "failed", "per sec", "p50 us", "p99 us", "p999 us", "max us" );
+        for ( size_t op = 0; op < OpCount; op++ )
+        {
+            const auto & histogram = latency[op];
+            cpp::Log::info( "{:<10}{:>12}{:>10}{:>12.0f}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}",
+                OpNames[op], done[op], failed[op], done[op] / seconds,
+                histogram.percentile( 0.50 ) / 1000.0, histogram.percentile( 0.99 ) / 1000.0,
+                histogram.percentile( 0.999 ) / 1000.0, histogram.max( ) / 1000.0 );
+        }
+        cpp::Log::info( "fanout: {} sent, {} arrived; {} operations skipped for a busy client", fanoutSent, done[(size_t)Op::Fanout], busy );
+
+        cpp::Log::info( "clients:\n{}", clientStats.dump( ) );
+        for ( size_t i = 0; i < proxies.size( ); i++ )
+        {
+            grim::net::NetStats proxyStats;
+            proxies[i]->stats( &proxyStats );
+            cpp::Log::info( "proxy {}:\n{}", i, proxyStats.dump( ) );
+        }
+        grim::net::NetStats sessionStats;
+        sessionServer.stats( &sessionStats );
+        cpp::Log::info( "session server:\n{}", sessionStats.dump( ) );
+    }
+}
+
+int main( int argc, const char ** argv )
+{
+    cpp::Program program;
+    cpp::Log::addConsoleHandler( );
+
+    Options options;
+    if ( !parseOptions( argc, argv, &options ) )
+    {
+        cpp::Log::error( "usage: grimnet-load [--clients N] [--proxies N] [--shards N] [--threads N] [--seconds N] [--rate N] "
+            "[--mix hello=W,rello=W,request=W,fanout=W] [--fanout N] [--storm-at N] [--email E] [--session-port P] [--proxy-port P]\n"
+            "a fan-out goes to sessions on the sender's proxy only, as proxies do not relay to each other" );
+        return 1;
+    }
+
+    try
+    {
+        cpp::AsyncContext io;
+        LoadGenerator load{ options };
+        if ( !load.open( io ) )
+            { return 1; }
+        load.run( io );
+    }
+    catch ( std::exception & e ) {
+        cpp::Log::error( e.what( ) );
+        return 1;
+    }
+    return 0;
+}
@@ -1,418 +1,552 @@
-import cpp.memory;
-import cpp.chrono;
-import cpp.program;
-import cpp.asio.udp;
-import cpp.asio.tcp;
-
-#include <iostream>
-#include <set>
-#include <map>
-#include <functional>
-#include <chrono>
-
-#include <Windows.h>
-
-enum class Message
-    { Unknown, Add, Connect, Disconnect };
-
-
-bool getMessage( std::string & buffer, Message & messageType, std::string & message )
-{
-    size_t pos = buffer.find( "\n\n" );
-    if ( pos == std::string::npos )
-        { return false; }
-
-    message = buffer.substr( 0, pos );
-    if ( message.starts_with( "add" ) )
-        { messageType = Message::Add; }
-    else if ( message.starts_with( "connect" ) )
-        { messageType = Message::Connect; }
-    else if ( message.starts_with( "disconnect" ) )
-        { messageType = Message::Disconnect; }
-    else
-        { messageType = Message::Unknown; }
-    buffer = buffer.substr( pos + 2 );
-
-    return true;
-}
-
-
-cpp::Memory addressIpOf( cpp::Memory addr )
-{
-    auto pos = addr.findLastOf( ":" );
-    return addr.substr( 0, pos );
-}
-
-
-cpp::Memory addressPortOf( cpp::Memory addr )
-{
-    auto pos = addr.findLastOf( ":" );
-    return addr.substr( pos + 1 );
-}
-
-using MessageHandler = std::function<void( Message, const std::string & )>;
-
-struct PeerDesc
-{
-    int id;
-    std::string name;
-    std::string extAddr;
-    std::string intAddr;
-    std::string p2pAddr;
-};
-
-
-struct PeerInfo
-{
-    int id;
-    cpp::Time frameTime;
-    uint32_t lastIndex;
-    uint32_t currentIndex;
-    std::set<uint32_t> lastFrame;
-    std::set<uint32_t> currentFrame;
-};
-
-
-class ControlConnection
-{
-public:
-    ControlConnection(
-        cpp::AsyncContext & io,
-        std::string addr,
-        std::string name,
-        std::string p2pAddr,
-        std::function<void( const PeerDesc & )> connectHandler,
-        std::function<void( int )> disconnectHandler );
-private:
-    void doConnect( );
-
-    void onConnect( std::error_code connectResult );
-    void onDisconnect( std::error_code reason );
-    void onRecv( std::string & recvBuffer );
-private:
-    cpp::TcpClient m_tcp;
-    cpp::AsyncTimer m_reconnectTimer;
-    cpp::AsyncContext & m_io;
-    std::string m_addr;
-    std::string m_name;
-    std::string m_p2pAddr;
-    std::map<Message, MessageHandler> m_handlers;
-    std::function<void( PeerDesc )> m_connectHandler;
-    std::function<void( int )> m_disconnectHandler;
-};
-
-
-class PeerConnection
-{
-public:
-    PeerConnection( cpp::AsyncContext & io );
-
-    std::string getBindAddress( ) const;
-
-    void add( PeerDesc peer );
-    void remove( int peerId );
-
-    PeerDesc * lookup( std::string address );
-
-private:
-    void onRecv( cpp::Memory from, cpp::Memory data );
-    
-    void doSend( );
-    void send( cpp::Memory data );
-
-    void updatePeerStatus( PeerInfo & peerInfo, uint32_t msgId );
-    void checkPeerStatus( PeerInfo & info );
-
-private:
-    cpp::AsyncContext & m_io;
-    cpp::UdpClient m_udp;
-    std::map<int, PeerDesc> m_peers;
-    std::map<int, PeerInfo> m_peerInfo;
-    std::map<std::string, int> m_peerLookup;
-
-    cpp::AsyncTimer m_sendTimer;
-    uint32_t m_sendNum = 0;
-};
-
-
-int main( int argc, const char ** argv )
-{
-    cpp::Program program;
-    cpp::Log::addConsoleHandler( );
-    cpp::Log::addDebuggerHandler( );
-
-    try
-    {
-        char computerName[64];
-        DWORD len = 64;
-        GetComputerNameExA( ComputerNameNetBIOS, computerName, &len );
-
-        std::string name = ( argc >= 2 ) ? argv[1] : computerName;
-        std::string addr = ( argc >= 3 ) ? argv[2] : "home.grimethos.com:54321";
-
-        cpp::AsyncContext io;
-
-        auto peerConnection = PeerConnection{ io };
-        auto p2pAddr = peerConnection.getBindAddress( );
-        cpp::Log::info( std::format( "udp: {}", p2pAddr ) );
-
-        auto controlConnection = ControlConnection{ io, addr, name, p2pAddr,
-            [&]( const PeerDesc & peerDesc ) 
-                { 
-                    peerConnection.add( peerDesc );
-                },
-            [&]( int peerId ) 
-                { 
-                    peerConnection.remove( peerId );
-                } };
-
-        io.run( );
-        return 0;
-    }
-    catch ( std::exception & e )
-    {
-        cpp::Log::error( "error: %s\n", e.what( ) );
-        return -1;
-    }
-
-}
-
-
-ControlConnection::ControlConnection(
-    cpp::AsyncContext & io,
-    std::string addr,
-    std::string name,
-    std::string p2pAddr,
-    std::function<void( const PeerDesc & )> onConnect,
-    std::function<void( int )> onDisconnect ) :
-    m_io( io ),
-    m_addr( addr ),
-    m_name( name ),
-    m_p2pAddr( p2pAddr ),
-    m_connectHandler( std::move( onConnect ) ),
-    m_disconnectHandler( std::move( onDisconnect ) )
-{
-    m_handlers[Message::Connect] = [=]( Message type, const std::string & data )
-    {
-        auto parts = cpp::Memory{ data }.split( " " );
-        if ( parts.size( ) == 6 )
-        {
-            PeerDesc peerInfo;
-            peerInfo.id = parts[1].asDecimal( );
-            peerInfo.name = parts[2];
-            peerInfo.intAddr = parts[3];
-            peerInfo.extAddr = parts[4];
-            peerInfo.p2pAddr = parts[5];
-            m_connectHandler( peerInfo );
-        }
-    };
-    m_handlers[Message::Disconnect] = [=]( Message type, const std::string & data )
-    {
-        auto parts = cpp::Memory{ data }.split( " " );
-        if ( parts.size( ) == 2 )
-        {
-            int peerId = parts[1].asDecimal( );
-            m_disconnectHandler( peerId );
-        }
-    };
-    doConnect( );
-}
-
-
-void ControlConnection::doConnect( )
-{
-    using namespace std::placeholders;
-
-    m_tcp.connect( m_io, m_addr,
-        std::bind( &ControlConnection::onConnect, this, _1 ),
-        std::bind( &ControlConnection::onRecv, this, _1 ),
-        std::bind( &ControlConnection::onDisconnect, this, _1 ) );
-}
-
-
-void ControlConnection::onConnect( std::error_code connectResult )
-{
-    cpp::Log::info( std::format( "onConnect() : {}\n",
-        connectResult.message( ) ) );
-    if ( !connectResult )
-    {
-        m_tcp.send( std::format( "add {} {} {}\n\n", m_name, m_tcp.localAddress( ), m_p2pAddr ) );
-    }
-    else
-    {
-        m_reconnectTimer = m_io.waitFor( cpp::Duration::ofSeconds( 1 ), std::bind( &ControlConnection::doConnect, this ) );
-    }
-}
-
-
-void ControlConnection::onDisconnect( std::error_code reason )
-{
-    cpp::Log::info( std::format( "onDisconnect() : {}\n",
-        reason.message( ) ) );
-}
-
-
-void ControlConnection::onRecv( std::string & recvBuffer )
-{
-    Message messageType;
-    std::string message;
-    while ( getMessage( recvBuffer, messageType, message ) )
-    {
-        //cpp::Log::info( message );
-        if ( auto itr = m_handlers.find( messageType ); itr != m_handlers.end( ) )
-            { itr->second( messageType, message ); }
-    }
-}
-
-
-PeerConnection::PeerConnection( cpp::AsyncContext & io )
-    : m_io(io )
-{
-    using namespace std::placeholders;
-    m_udp.bind( m_io, "", 
-        std::bind(&PeerConnection::onRecv, this, _1, _2),
-        []( std::error_code reason ) 
-        { 
-        } );
-
-    doSend( );
-}
-
-
-std::string PeerConnection::getBindAddress( ) const
-{
-    return m_udp.localAddress();
-}
-
-
-void PeerConnection::add( PeerDesc peer )
-{
-    m_peers[peer.id] = peer;
-    m_peerLookup[peer.p2pAddr] = peer.id;
-    
-    auto & info = m_peerInfo[peer.id];
-    info.id = peer.id;
-
-    cpp::Log::info( std::format( "connect to {} at {}\n",
-        peer.name,
-        peer.p2pAddr ) );
-}
-
-
-void PeerConnection::remove( int peerId )
-{
-    if ( auto itr = m_peers.find( peerId ); itr != m_peers.end( ) )
-    {
-        cpp::Log::info( std::format( "disconnect from {}\n",
-            itr->second.name ) );
-
-        m_peerInfo.erase( peerId );
-        m_peerLookup.erase( itr->second.p2pAddr );
-        m_peers.erase( peerId );
-    }
-}
-
-
-PeerDesc * PeerConnection::lookup( std::string address )
-{
-    auto itr = m_peerLookup.find( address );
-    if ( itr == m_peerLookup.end( ) )
-        { return nullptr; }
-    return &m_peers[itr->second];
-}
-
-
-void PeerConnection::doSend( )
-{
-    std::string msg;
-    msg += cpp::Memory::ofValue( m_sendNum++ );
-    msg += cpp::Memory::ofValue( uint32_t{1} );
-
-    send( msg );
-    m_sendTimer = m_io.waitFor( cpp::Duration::ofMillis( 20 ), std::bind( &PeerConnection::doSend, this ) );
-}
-
-
-void PeerConnection::send( cpp::Memory data )
-{
-    for ( auto & peer : m_peers )
-    {
-        auto & addr = peer.second.p2pAddr;
-        m_udp.send( addr, data );
-    }
-}
-
-
-void PeerConnection::updatePeerStatus( PeerInfo & info, uint32_t msgIndex )
-{
-    if ( msgIndex < info.currentIndex )
-    {
-        info.currentFrame.erase( msgIndex );
-        info.lastFrame.erase( msgIndex );
-    }
-    else
-    {
-        for ( uint32_t i = info.currentIndex; i < msgIndex; i++ )
-            { info.currentFrame.insert( i ); }
-        info.currentIndex = msgIndex + 1;
-    }
-
-    checkPeerStatus( info );
-}
-
-
-void PeerConnection::checkPeerStatus( PeerInfo & info )
-{
-    auto now = cpp::Time::now( );
-    if ( now > info.frameTime )
-    {
-        auto & addr = m_peers[info.id].p2pAddr;
-
-        std::string msg;
-        msg += cpp::Memory::ofValue( m_sendNum++ );
-        msg += cpp::Memory::ofValue( uint32_t{ 0 } );
-        msg += cpp::Memory::ofValue( info.currentIndex - info.lastIndex );
-        msg += cpp::Memory::ofValue( uint32_t{ (uint32_t)info.lastFrame.size( ) } );
-
-        m_udp.send( addr, msg );
-
-        info.lastFrame = std::move( info.currentFrame );
-        info.lastIndex = info.currentIndex;
-        info.frameTime += std::chrono::milliseconds( 1000 );
-    }
-}
-
-
-void PeerConnection::onRecv( cpp::Memory from, cpp::Memory data )
-{
-    PeerDesc * peerDesc = lookup( from );
-    if ( peerDesc )
-    {
-        auto & info = m_peerInfo[peerDesc->id];
-
-        uint32_t * msgData = (uint32_t *)data.data();
-
-        uint32_t msgIndex = msgData[0];
-        updatePeerStatus( info, msgIndex );
-
-        uint32_t msgType = msgData[1];
-        if ( msgType == 0 )
-        {
-            uint32_t total = msgData[2];
-            uint32_t lost = msgData[3];
-            double dropped = (total > 0) ? lost / total : 100.0;
-
-            //if ( dropped > 0.0 )
-            {
-                cpp::Log::info( std::format( "from {} : {}/{}%\n",
-                    peerDesc->name,
-                    total,
-                    dropped ) );
-            }
-        }
-        else if ( msgType == 1 )
-        {
-
-        }
-    }
-}
+import cpp.memory;
+import cpp.chrono;
+import cpp.program;
+import cpp.asio.udp;
+import cpp.asio.tcp;
+import cpp.asio.ip;
+import grim.net.datagram;
+
+#include <iostream>
+#include <set>
+#include <map>
+#include <functional>
+#include <chrono>
+
+#include <Windows.h>
+
+enum class Message
+    { Unknown, Add, Connect, Disconnect };
+
+
+bool getMessage( std::string & buffer, Message & messageType, std::string & message )
+{
+    size_t pos = buffer.find( "\n\n" );
+    if ( pos == std::string::npos )
+        { return false; }
+
+    message = buffer.substr( 0, pos );
+    if ( message.starts_with( "add" ) )
+        { messageType = Message::Add; }
+    else if ( message.starts_with( "connect" ) )
+        { messageType = Message::Connect; }
+    else if ( message.starts_with( "disconnect" ) )
+        { messageType = Message::Disconnect; }
+    else
+        { messageType = Message::Unknown; }
+    buffer = buffer.substr( pos + 2 );
+
+    return true;
+}
+
+
+cpp::Memory addressIpOf( cpp::Memory addr )
+{
+    auto pos = addr.findLastOf( ":" );
+    return addr.substr( 0, pos );
+}
+
+
+cpp::Memory addressPortOf( cpp::Memory addr )
+{
+    auto pos = addr.findLastOf( ":" );
+    return addr.substr( pos + 1 );
+}
+
+using MessageHandler = std::function<void( Message, const std::string & )>;
+
+struct PeerDesc
+{
+    int id;
+    std::string name;
+    std::string extAddr;
+    std::string intAddr;
+    std::string p2pAddr;
+};
+
+
+struct PeerInfo
+{
+    int id;
+    cpp::Time frameTime;
+    uint32_t lastIndex;
+    uint32_t currentIndex;
+    std::set<uint32_t> lastFrame;
+    std::set<uint32_t> currentFrame;
+    // falls back to the relay when nothing arrives directly for a while, and back again once it does
+    std::chrono::steady_clock::time_point lastDirect;
+    bool isRelayed = false;
+};
+
+
+class ControlConnection
+{
+public:
+    ControlConnection(
+        cpp::AsyncContext & io,
+        std::string addr,
+        std::string name,
+        std::string p2pAddr,
+        std::function<void( const PeerDesc & )> connectHandler,
+        std::function<void( int )> disconnectHandler,
+        std::function<void( int, const std::string &, uint64_t )> relayHandler );
+private:
+    void doConnect( );
+
+    void onConnect( std::error_code connectResult );
+    void onDisconnect( std::error_code reason );
+    void onRecv( std::string & recvBuffer );
+private:
+    cpp::TcpClient m_tcp;
+    cpp::AsyncTimer m_reconnectTimer;
+    cpp::AsyncContext & m_io;
+    std::string m_addr;
+    std::string m_name;
+    std::string m_p2pAddr;
+    std::map<Message, MessageHandler> m_handlers;
+    std::function<void( PeerDesc )> m_connectHandler;
+    std::function<void( int )> m_disconnectHandler;
+    std::function<void( int, const std::string &, uint64_t )> m_relayHandler;
+};
+
+
+class PeerConnection
+{
+public:
+    PeerConnection( cpp::AsyncContext & io );
+
+    std::string getBindAddress( ) const;
+
+    void add( PeerDesc peer );
+    void remove( int peerId );
+    void setRelay( int selfId, std::string relayAddr, uint64_t relayKey );
+
+    PeerDesc * lookup( std::string address );
+
+private:
+    void onRecv( cpp::Memory from, cpp::Memory data );
+    void onRecvRelay( cpp::Memory datagram );
+    void onPeerRecv( PeerDesc & peerDesc, cpp::Memory data );
+    
+    void doSend( );
+    void doCheck( );
+    void send( cpp::Memory data );
+    void sendTo( PeerInfo & info, cpp::Memory data );
+    void sendRelay( int peerId, cpp::Memory data );
+
+    void updatePeerStatus( PeerInfo & peerInfo, uint32_t msgId );
+    void checkPeerStatus( PeerInfo & info );
+
+private:
+    cpp::AsyncContext & m_io;
+    cpp::UdpClient m_udp;
+    std::map<int, PeerDesc> m_peers;
+    std::map<int, PeerInfo> m_peerInfo;
+    std::map<std::string, int> m_peerLookup;
+
+    cpp::AsyncTimer m_sendTimer;
+    uint32_t m_sendNum = 0;
+
+    cpp::AsyncTimer m_checkTimer;
+    int m_selfId = 0;
+    std::string m_relayAddr;
+    uint64_t m_relayKey = 0;
+    uint32_t m_relaySeq = 0;
+    grim::net::ReplayWindow m_relayReplay;
+    std::string m_relayBuffer;
+};
+
+
+int main( int argc, const char ** argv )
+{
+    cpp::Program program;
+    cpp::Log::addConsoleHandler( );
+    cpp::Log::addDebuggerHandler( );
+
+    try
+    {
+        char computerName[64];
+        DWORD len = 64;
+        GetComputerNameExA( ComputerNameNetBIOS, computerName, &len );
+
+        std::string name = ( argc >= 2 ) ? argv[1] : computerName;
+        std::string addr = ( argc >= 3 ) ? argv[2] : "home.grimethos.com:54321";
+
+        cpp::AsyncContext io;
+
+        auto peerConnection = PeerConnection{ io };
+        auto p2pAddr = peerConnection.getBindAddress( );
+        cpp::Log::info( std::format( "udp: {}", p2pAddr ) );
+
+        auto controlConnection = ControlConnection{ io, addr, name, p2pAddr,
+            [&]( const PeerDesc & peerDesc ) 
+                { 
+                    peerConnection.add( peerDesc );
+                },
+            [&]( int peerId ) 
+                { 
+                    peerConnection.remove( peerId );
+                },
+            [&]( int selfId, const std::string & relayAddr, uint64_t relayKey )
+                {
+                    peerConnection.setRelay( selfId, relayAddr, relayKey );
+                } };
+
+        io.run( );
+        return 0;
+    }
+    catch ( std::exception & e )
+    {
+        cpp::Log::error( "error: %s\n", e.what( ) );
+        return -1;
+    }
+
+}
+
+
+ControlConnection::ControlConnection(
+    cpp::AsyncContext & io,
+    std::string addr,
+    std::string name,
+    std::string p2pAddr,
+    std::function<void( const PeerDesc & )> onConnect,
+    std::function<void( int )> onDisconnect,
+    std::function<void( int, const std::string &, uint64_t )> onRelay ) :
+    m_io( io ),
+    m_addr( addr ),
+    m_name( name ),
+    m_p2pAddr( p2pAddr ),
+    m_connectHandler( std::move( onConnect ) ),
+    m_disconnectHandler( std::move( onDisconnect ) ),
+    m_relayHandler( std::move( onRelay ) )
+{
+    // add : ok id relayPort relayKey
+    m_handlers[Message::Add] = [=]( Message type, const std::string & data )
+    {
+        auto parts = cpp::Memory{ data }.split( " " );
+        if ( parts.size( ) == 6 && parts[2] == "ok" )
+        {
+            int selfId = parts[3].asDecimal( );
+            std::string relayAddr = cpp::TcpServer::resolve( cpp::TcpVersion::v4, addressIpOf( m_addr ) ) + ":" + std::string{ parts[4] };
+            uint64_t relayKey = std::stoull( std::string{ parts[5] } );
+            m_relayHandler( selfId, relayAddr, relayKey );
+        }
+    };
+    m_handlers[Message::Connect] = [=]( Message type, const std::string & data )
+    {
+        auto parts = cpp::Memory{ data }.split( " " );
+        if ( parts.size( ) == 6 )
+        {
+            PeerDesc peerInfo;
+            peerInfo.id = parts[1].asDecimal( );
+            peerInfo.name = parts[2];
+            peerInfo.intAddr = parts[3];
+            peerInfo.extAddr = parts[4];
+            peerInfo.p2pAddr = parts[5];
+            m_connectHandler( peerInfo );
+        }
+    };
+    m_handlers[Message::Disconnect] = [=]( Message type, const std::string & data )
+    {
+        auto parts = cpp::Memory{ data }.split( " " );
+        if ( parts.size( ) == 2 )
+        {
+            int peerId = parts[1].asDecimal( );
+            m_disconnectHandler( peerId );
+        }
+    };
+    doConnect( );
+}
+
+
+void ControlConnection::doConnect( )
+{
+    using namespace std::placeholders;
+
+    m_tcp.connect( m_io, m_addr,
+        std::bind( &ControlConnection::onConnect, this, _1 ),
+        std::bind( &ControlConnection::onRecv, this, _1 ),
+        std::bind( &ControlConnection::onDisconnect, this, _1 ) );
+}
+
+
+void ControlConnection::onConnect( std::error_code connectResult )
+{
+    cpp::Log::info( std::format( "onConnect() : {}\n",
+        connectResult.message( ) ) );
+    if ( !connectResult )
+    {
+        m_tcp.send( std::format( "add {} {} {}\n\n", m_name, m_tcp.localAddress( ), m_p2pAddr ) );
+    }
+    else
+    {
+        m_reconnectTimer = m_io.waitFor( cpp::Duration::ofSeconds( 1 ), std::bind( &ControlConnection::doConnect, this ) );
+    }
+}
+
+
+void ControlConnection::onDisconnect( std::error_code reason )
+{
+    cpp::Log::info( std::format( "onDisconnect() : {}\n",
+        reason.message( ) ) );
+}
+
+
+void ControlConnection::onRecv( std::string & recvBuffer )
+{
+    Message messageType;
+    std::string message;
+    while ( getMessage( recvBuffer, messageType, message ) )
+    {
+        //cpp::Log::info( message );
+        if ( auto itr = m_handlers.find( messageType ); itr != m_handlers.end( ) )
+            { itr->second( messageType, message ); }
+    }
+}
+
+
+PeerConnection::PeerConnection( cpp::AsyncContext & io )
+    : m_io(io )
+{
+    using namespace std::placeholders;
+    m_udp.bind( m_io, "", 
+        std::bind(&PeerConnection::onRecv, this, _1, _2),
+        []( std::error_code reason ) 
+        { 
+        } );
+
+    doSend( );
+    doCheck( );
+}
+
+
+std::string PeerConnection::getBindAddress( ) const
+{
+    return m_udp.localAddress();
+}
+
+
+void PeerConnection::add( PeerDesc peer )
+{
+    m_peers[peer.id] = peer;
+    m_peerLookup[peer.p2pAddr] = peer.id;
+    
+    auto & info = m_peerInfo[peer.id];
+    info.id = peer.id;
+    info.lastDirect = std::chrono::steady_clock::now( );
+    info.isRelayed = false;
+
+    cpp::Log::info( std::format( "connect to {} at {}\n",
+        peer.name,
+        peer.p2pAddr ) );
+}
+
+
+void PeerConnection::remove( int peerId )
+{
+    if ( auto itr = m_peers.find( peerId ); itr != m_peers.end( ) )
+    {
+        cpp::Log::info( std::format( "disconnect from {}\n",
+            itr->second.name ) );
+
+        m_peerInfo.erase( peerId );
+        m_peerLookup.erase( itr->second.p2pAddr );
+        m_peers.erase( peerId );
+    }
+}
+
+
+void PeerConnection::setRelay( int selfId, std::string relayAddr, uint64_t relayKey )
+{
+    m_selfId = selfId;
+    m_relayAddr = std::move( relayAddr );
+    m_relayKey = relayKey;
+    m_relaySeq = 0;
+    m_relayReplay.reset( );
+
+    // registers this endpoint with the relay
+    sendRelay( 0, { } );
+
+    cpp::Log::info( std::format( "relay at {} as {}\n",
+        m_relayAddr,
+        m_selfId ) );
+}
+
+
+PeerDesc * PeerConnection::lookup( std::string address )
+{
+    auto itr = m_peerLookup.find( address );
+    if ( itr == m_peerLookup.end( ) )
+        { return nullptr; }
+    return &m_peers[itr->second];
+}
+
+
+void PeerConnection::doSend( )
+{
+    std::string msg;
+    msg += cpp::Memory::ofValue( m_sendNum++ );
+    msg += cpp::Memory::ofValue( uint32_t{1} );
+
+    send( msg );
+    m_sendTimer = m_io.waitFor( cpp::Duration::ofMillis( 20 ), std::bind( &PeerConnection::doSend, this ) );
+}
+
+
+void PeerConnection::doCheck( )
+{
+    auto now = std::chrono::steady_clock::now( );
+    for ( auto & [peerId, info] : m_peerInfo )
+    {
+        if ( info.isRelayed )
+        {
+            // keeps punching, so the peer is promoted back as soon as a direct path opens
+            std::string msg;
+            msg += cpp::Memory::ofValue( m_sendNum++ );
+            msg += cpp::Memory::ofValue( uint32_t{ 1 } );
+            m_udp.send( m_peers[peerId].p2pAddr, msg );
+        }
+        else if ( !m_relayAddr.empty( ) && now - info.lastDirect > std::chrono::seconds( 3 ) )
+        {
+            info.isRelayed = true;
+            cpp::Log::info( std::format( "relay to {}\n",
+                m_peers[peerId].name ) );
+        }
+    }
+
+    // keeps the relay's view of this endpoint (and any NAT mapping on the way) alive
+    if ( !m_relayAddr.empty( ) )
+        { sendRelay( 0, { } ); }
+
+    m_checkTimer = m_io.waitFor( cpp::Duration::ofSeconds( 1 ), std::bind( &PeerConnection::doCheck, this ) );
+}
+
+
+void PeerConnection::send( cpp::Memory data )
+{
+    for ( auto & [peerId, info] : m_peerInfo )
+        { sendTo( info, data ); }
+}
+
+
+void PeerConnection::sendTo( PeerInfo & info, cpp::Memory data )
+{
+    if ( info.isRelayed )
+        { sendRelay( info.id, data ); }
+    else
+        { m_udp.send( m_peers[info.id].p2pAddr, data ); }
+}
+
+
+void PeerConnection::sendRelay( int peerId, cpp::Memory data )
+{
+    m_relayBuffer.clear( );
+    grim::net::encodeDatagram( m_relayBuffer, grim::net::DatagramHeader{ (uint64_t)peerId, (uint64_t)m_selfId, ++m_relaySeq }, m_relayKey, data );
+    m_udp.send( m_relayAddr, m_relayBuffer );
+}
+
+
+void PeerConnection::updatePeerStatus( PeerInfo & info, uint32_t msgIndex )
+{
+    if ( msgIndex < info.currentIndex )
+    {
+        info.currentFrame.erase( msgIndex );
+        info.lastFrame.erase( msgIndex );
+    }
+    else
+    {
+        for ( uint32_t i = info.currentIndex; i < msgIndex; i++ )
+            { info.currentFrame.insert( i ); }
+        info.currentIndex = msgIndex + 1;
+    }
+
+    checkPeerStatus( info );
+}
+
+
+void PeerConnection::checkPeerStatus( PeerInfo & info )
+{
+    auto now = cpp::Time::now( );
+    if ( now > info.frameTime )
+    {
+        std::string msg;
+        msg += cpp::Memory::ofValue( m_sendNum++ );
+        msg += cpp::Memory::ofValue( uint32_t{ 0 } );
+        msg += cpp::Memory::ofValue( info.currentIndex - info.lastIndex );
+        msg += cpp::Memory::ofValue( uint32_t{ (uint32_t)info.lastFrame.size( ) } );
+
+        sendTo( info, msg );
+
+        info.lastFrame = std::move( info.currentFrame );
+        info.lastIndex = info.currentIndex;
+        info.frameTime += std::chrono::milliseconds( 1000 );
+    }
+}
+
+
+void PeerConnection::onRecv( cpp::Memory from, cpp::Memory data )
+{
+    if ( !m_relayAddr.empty( ) && from == m_relayAddr )
+        { onRecvRelay( data ); return; }
+
+    PeerDesc * peerDesc = lookup( from );
+    if ( peerDesc )
+    {
+        auto & info = m_peerInfo[peerDesc->id];
+        info.lastDirect = std::chrono::steady_clock::now( );
+        if ( info.isRelayed )
+        {
+            info.isRelayed = false;
+            cpp::Log::info( std::format( "direct to {}\n",
+                peerDesc->name ) );
+        }
+        onPeerRecv( *peerDesc, data );
+    }
+}
+
+
+void PeerConnection::onRecvRelay( cpp::Memory datagram )
+{
+    grim::net::DatagramHeader header;
+    cpp::Memory data;
+    if ( !grim::net::decodeDatagram( datagram, &header, &data ) || header.toSessionId != (uint64_t)m_selfId )
+        { return; }
+    if ( !grim::net::verifyDatagram( datagram, m_relayKey ) || !m_relayReplay.accept( header.seq ) )
+        { return; }
+    if ( auto itr = m_peers.find( (int)header.fromSessionId ); itr != m_peers.end( ) )
+        { onPeerRecv( itr->second, data ); }
+}
+
+
+void PeerConnection::onPeerRecv( PeerDesc & peerDesc, cpp::Memory data )
+{
+    if ( data.length( ) < 2 * sizeof( uint32_t ) )
+        { return; }
+
+    auto & info = m_peerInfo[peerDesc.id];
+
+    uint32_t * msgData = (uint32_t *)data.data();
+
+    uint32_t msgIndex = msgData[0];
+    updatePeerStatus( info, msgIndex );
+
+    uint32_t msgType = msgData[1];
+    if ( msgType == 0 && data.length( ) >= 4 * sizeof( uint32_t ) )
+    {
+        uint32_t total = msgData[2];
+        uint32_t lost = msgData[3];
+        double dropped = (total > 0) ? lost / total : 100.0;
+
+        //if ( dropped > 0.0 )
+        {
+            cpp::Log::info( std::format( "from {} : {}/{}%{}\n",
+                peerDesc.name,
+                total,
+                dropped,
+                info.isRelayed ? " (relayed)" : "" ) );
+        }
+    }
+    else if ( msgType == 1 )
+    {
+
+    }
+}